@@ -0,0 +1,1703 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "ECS.hpp"
+#include "Snapshot.hpp"
+#include "SpatialHash.hpp"
+#include "RenderList.hpp"
+#include "Culling.hpp"
+#include "Hierarchy.hpp"
+#include "WorldMerge.hpp"
+#include "StreamingLoader.hpp"
+#include "Defragmenter.hpp"
+#include "PublishedSnapshot.hpp"
+#include "CoroutineSystem.hpp"
+#include "CommandBuffer.hpp"
+#include "StateHash.hpp"
+#include "WorldChecksum.hpp"
+#include "Replication.hpp"
+
+// Local stream sockets for the replication benchmark, Winsock has no socketpair so Windows uses loopback TCP.
+#if defined(_WIN32)
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	#pragma comment(lib, "Ws2_32.lib")
+	#define BENCHMARK_SOCKETS
+#elif defined(__unix__) || defined(__APPLE__)
+	#include <sys/socket.h>
+	#include <unistd.h>
+	#define BENCHMARK_SOCKETS
+#endif
+
+using namespace std;
+
+///////////////////////////////////////////////
+// Helpers ////////////////////////////////////
+///////////////////////////////////////////////
+
+class Stopwatch
+{
+public:
+	Stopwatch()
+		: m_Start(std::chrono::steady_clock::now())
+	{
+	}
+
+	double ElapsedMicroseconds() const
+	{
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_Start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point m_Start;
+};
+
+void Report(const char* name, double microseconds)
+{
+	cout << "-------------------------------------------------------------------------\n";
+	cout << "Benchmark {" << name << "}: " << microseconds << "us" << "\n";
+}
+
+///////////////////////////////////////////////
+// Helpers End ////////////////////////////////
+///////////////////////////////////////////////
+
+// Components
+struct Position
+{
+	float x, y, z;
+};
+
+struct Velocity
+{
+	float x, y, z;
+};
+
+/**
+ * Snapshot capture with 50k entities and 5% of them changing every frame.
+ */
+void BenchmarkSnapshotCapture()
+{
+	constexpr int numEntities = 50000;
+	constexpr int changedPerFrame = numEntities / 20;
+	constexpr int numFrames = 240;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+	ecs.RegisterComponent<Velocity>();
+
+	for (int i = 0; i < numEntities; i++)
+	{
+		Entity entity = ecs.CreateEntity();
+		ecs.AddComponent(entity, Position{ float(i), 0.0f, 0.0f });
+		ecs.AddComponent(entity, Velocity{ 1.0f, 0.0f, 0.0f });
+	}
+
+	SnapshotRing snapshots(ecs, 8);
+	std::mt19937 random(42);
+
+	double total = 0.0;
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		for (int i = 0; i < changedPerFrame; i++)
+		{
+			Entity entity = random() % numEntities;
+			auto& position = ecs.GetComponent<Position>(entity);
+			position.x += ecs.ReadComponent<Velocity>(entity).x;
+		}
+
+		Stopwatch stopwatch;
+		snapshots.Capture();
+		total += stopwatch.ElapsedMicroseconds();
+	}
+
+	Report("Snapshot capture, 50k entities, 5% churn, per frame", total / numFrames);
+
+	Stopwatch stopwatch;
+	snapshots.Rewind(snapshots.GetOldestFrame());
+	Report("Snapshot rewind over 8 frames", stopwatch.ElapsedMicroseconds());
+}
+
+/**
+ * Entity creation from 1 to 8 job threads at once.
+ */
+void BenchmarkConcurrentCreateEntity()
+{
+	constexpr int numEntities = 60000;
+
+	for (int numThreads = 1; numThreads <= 8; numThreads *= 2)
+	{
+		ECS ecs;
+		ecs.Init();
+
+		Stopwatch stopwatch;
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads.emplace_back([&ecs, numThreads]()
+			{
+				for (int i = 0; i < numEntities / numThreads; i++)
+					ecs.CreateEntity();
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		double elapsed = stopwatch.ElapsedMicroseconds();
+		string name = "CreateEntity, 60k entities from " + to_string(numThreads) + " threads";
+		Report(name.c_str(), elapsed);
+	}
+}
+
+Bounds BodyBounds(ECS&, Entity, const Position& position)
+{
+	return { position.x - 0.5f, position.y - 0.5f, position.x + 0.5f, position.y + 0.5f };
+}
+
+/**
+ * Spatial hash update and broadphase pairs with 100k bodies moving every frame.
+ */
+void BenchmarkSpatialHash()
+{
+	constexpr int numEntities = 100000;
+	constexpr int numFrames = 60;
+	constexpr float worldSize = 1000.0f;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+	ecs.RegisterComponent<Velocity>();
+
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> position(0.0f, worldSize);
+	std::uniform_real_distribution<float> velocity(-0.1f, 0.1f);
+
+	std::vector<Entity> entities;
+	for (int i = 0; i < numEntities; i++)
+	{
+		Entity entity = ecs.CreateEntity();
+		ecs.AddComponent(entity, Position{ position(random), position(random), 0.0f });
+		ecs.AddComponent(entity, Velocity{ velocity(random), velocity(random), 0.0f });
+		entities.push_back(entity);
+	}
+
+	SpatialHash<Position> index(4.0f, &BodyBounds);
+	index.Update(ecs);
+
+	std::vector<std::pair<Entity, Entity>> pairs;
+	double total = 0.0, worst = 0.0;
+
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		for (Entity entity : entities)
+		{
+			auto& p = ecs.GetComponent<Position>(entity);
+			const auto& v = ecs.ReadComponent<Velocity>(entity);
+			p.x += v.x;
+			p.y += v.y;
+		}
+
+		Stopwatch stopwatch;
+		index.Update(ecs);
+		index.Pairs(pairs);
+		double elapsed = stopwatch.ElapsedMicroseconds();
+
+		total += elapsed;
+		worst = std::max(worst, elapsed);
+	}
+
+	Report("Spatial hash update + pairs, 100k moving bodies, average", total / numFrames);
+	Report("Spatial hash update + pairs, 100k moving bodies, worst", worst);
+}
+
+/**
+ * Render list extraction and build of 100k quads over 4 materials, without a GPU.
+ */
+void BenchmarkRenderExtraction()
+{
+	constexpr int numEntities = 100000;
+	constexpr int numFrames = 60;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+
+	std::vector<Entity> entities;
+	for (int i = 0; i < numEntities; i++)
+	{
+		Entity entity = ecs.CreateEntity();
+		ecs.AddComponent(entity, Position{ float(i % 1000), float(i / 1000), 0.0f });
+		entities.push_back(entity);
+	}
+
+	RenderList renderList;
+	double total = 0.0;
+
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		Stopwatch stopwatch;
+
+		renderList.Clear();
+		renderList.Reserve(entities.size());
+		for (Entity entity : entities)
+		{
+			const auto& position = ecs.ReadComponent<Position>(entity);
+			renderList.AddQuad(entity % 4, position.x, position.y, 1.0f, 1.0f, PackColor(255, 255, 255));
+		}
+		renderList.Build();
+
+		total += stopwatch.ElapsedMicroseconds();
+	}
+
+	Report("Render list extract + build, 100k quads, 4 materials", total / numFrames);
+}
+
+/**
+ * Viewport culling with less than 5% of the world on screen.
+ * The dense kernel runs over 1M bounds, the ECS paths over a 100k entity world.
+ */
+void BenchmarkViewportCulling()
+{
+	constexpr int numFrames = 30;
+	constexpr float worldSize = 1000.0f;
+	const Bounds viewport{ 400.0f, 400.0f, 600.0f, 600.0f };
+
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> position(0.0f, worldSize);
+
+	{
+		constexpr size_t numBounds = 1000000;
+		std::vector<float> minX(numBounds), minY(numBounds), maxX(numBounds), maxY(numBounds);
+		for (size_t i = 0; i < numBounds; i++)
+		{
+			minX[i] = position(random);
+			minY[i] = position(random);
+			maxX[i] = minX[i] + 1.0f;
+			maxY[i] = minY[i] + 1.0f;
+		}
+
+		std::vector<std::uint32_t> indices(numBounds);
+		size_t visible = 0;
+		Stopwatch stopwatch;
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			visible = CullBounds(minX.data(), minY.data(), maxX.data(), maxY.data(), numBounds, viewport, indices.data());
+		}
+
+		string name = "CullBounds, 1M bounds, " + to_string(visible) + " visible";
+		Report(name.c_str(), stopwatch.ElapsedMicroseconds() / numFrames);
+	}
+
+	constexpr int numEntities = 100000;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+
+	for (int i = 0; i < numEntities; i++)
+	{
+		Entity entity = ecs.CreateEntity();
+		ecs.AddComponent(entity, Position{ position(random), position(random), 0.0f });
+	}
+
+	ViewportCuller<Position> culler(&BodyBounds);
+	SpatialHash<Position> index(4.0f, &BodyBounds);
+	culler.Update(ecs);
+	index.Update(ecs);
+
+	Stopwatch stopwatch;
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		culler.Update(ecs);
+		culler.Cull(viewport);
+	}
+	Report("ViewportCuller update + cull, 100k entities, static", stopwatch.ElapsedMicroseconds() / numFrames);
+
+	stopwatch = Stopwatch();
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		culler.CullIndexed(index, viewport);
+	}
+	Report("ViewportCuller spatial index cull, 100k entities", stopwatch.ElapsedMicroseconds() / numFrames);
+}
+
+/**
+ * Transform propagation over 10k trees of depth 3, 130k nodes, with 1% of the local transforms changing every frame.
+ */
+void BenchmarkTransformPropagation()
+{
+	constexpr int numRoots = 10000;
+	constexpr int numChildren = 3;
+	constexpr int numFrames = 30;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Transform>();
+	ecs.RegisterComponent<WorldTransform>();
+
+	auto createNode = [&ecs]()
+	{
+		Entity entity = ecs.CreateEntity();
+		ecs.AddComponent(entity, Transform{ 1.0f, 0.5f, 0.1f, 1.0f });
+		ecs.AddComponent(entity, WorldTransform{});
+		return entity;
+	};
+
+	Hierarchy hierarchy(ecs);
+	std::vector<Entity> nodes;
+	for (int root = 0; root < numRoots; root++)
+	{
+		Entity rootEntity = createNode();
+		nodes.push_back(rootEntity);
+
+		for (int i = 0; i < numChildren; i++)
+		{
+			Entity child = createNode();
+			hierarchy.SetParent(child, rootEntity);
+			nodes.push_back(child);
+
+			for (int j = 0; j < numChildren; j++)
+			{
+				Entity grandchild = createNode();
+				hierarchy.SetParent(grandchild, child);
+				nodes.push_back(grandchild);
+			}
+		}
+	}
+
+	JobSystem jobs;
+	hierarchy.PropagateTransforms(&jobs);
+
+	std::mt19937 random(42);
+	std::uniform_int_distribution<size_t> pick(0, nodes.size() - 1);
+
+	size_t recomputed = 0;
+	Stopwatch stopwatch;
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		for (size_t i = 0; i < nodes.size() / 100; i++)
+		{
+			ecs.GetComponent<Transform>(nodes[pick(random)]).rotation += 0.01f;
+		}
+
+		hierarchy.PropagateTransforms(&jobs);
+		recomputed += hierarchy.GetRecomputedCount();
+	}
+
+	string name = "Transform propagation, 130k nodes, 1% changed, " + to_string(recomputed / numFrames) + " recomputed";
+	Report(name.c_str(), stopwatch.ElapsedMicroseconds() / numFrames);
+
+	stopwatch = Stopwatch();
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		ecs.GetComponent<Transform>(nodes[0]).x += 1.0f;
+		hierarchy.PropagateTransforms(&jobs);
+	}
+	Report("Transform propagation, 130k nodes, one root moved", stopwatch.ElapsedMicroseconds() / numFrames);
+}
+
+class MovementSystem : public System
+{
+};
+
+class BoundsSystem : public System
+{
+};
+
+/**
+ * Spawning 50k copies of a two component entity, one AddComponent at a time and with Instantiate.
+ */
+void BenchmarkPrefabInstantiate()
+{
+	constexpr uint32_t numEntities = 50000;
+
+	for (int bulk = 0; bulk < 2; bulk++)
+	{
+		ECS ecs;
+		ecs.Init();
+		ecs.RegisterComponent<Position>();
+		ecs.RegisterComponent<Velocity>();
+
+		Signature movement;
+		movement.set(ecs.GetComponentType<Position>(), true);
+		movement.set(ecs.GetComponentType<Velocity>(), true);
+		ecs.RegisterSystem<MovementSystem>();
+		ecs.SetSystemSignature<MovementSystem>(movement);
+
+		Signature bounds;
+		bounds.set(ecs.GetComponentType<Position>(), true);
+		ecs.RegisterSystem<BoundsSystem>();
+		ecs.SetSystemSignature<BoundsSystem>(bounds);
+
+		Entity prefab = ecs.CreatePrefab();
+		ecs.AddComponent(prefab, Position{ 1.0f, 2.0f, 3.0f });
+		ecs.AddComponent(prefab, Velocity{ 0.0f, 0.0f, -1.0f });
+
+		Stopwatch stopwatch;
+		if (bulk)
+		{
+			ecs.Instantiate(prefab, numEntities);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < numEntities; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, Position{ 1.0f, 2.0f, 3.0f });
+				ecs.AddComponent(entity, Velocity{ 0.0f, 0.0f, -1.0f });
+			}
+		}
+
+		Report(bulk ? "Instantiate, 50k entities" : "CreateEntity + AddComponent, 50k entities", stopwatch.ElapsedMicroseconds());
+	}
+}
+
+/**
+ * 8 staging worlds with 8k entities each, filled in parallel and merged into the main world.
+ */
+void BenchmarkMergeWorld()
+{
+	constexpr int numWorlds = 8;
+	constexpr int numEntities = 8000;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+	ecs.RegisterComponent<Velocity>();
+
+	std::vector<ECS> staging(numWorlds);
+
+	Stopwatch stopwatch;
+	for (ECS& world : staging)
+	{
+		world.Init();
+		world.RegisterComponent<Position>();
+		world.RegisterComponent<Velocity>();
+	}
+	Report("Create 8 worlds", stopwatch.ElapsedMicroseconds());
+
+	JobSystem jobs;
+	jobs.Run(numWorlds, [&staging](uint32_t index)
+	{
+		ECS& world = staging[index];
+		for (int i = 0; i < numEntities; i++)
+		{
+			Entity entity = world.CreateEntity();
+			world.AddComponent(entity, Position{ float(i), float(index), 0.0f });
+			world.AddComponent(entity, Velocity{ 0.0f, 0.0f, 1.0f });
+		}
+	});
+
+	stopwatch = Stopwatch();
+	for (ECS& world : staging)
+	{
+		MergeWorld(world, ecs);
+	}
+	Report("MergeWorld, 8 worlds with 8k entities", stopwatch.ElapsedMicroseconds());
+}
+
+/**
+ * Streaming 16 chunk files of 4k entities into a live world with a 2ms commit budget per frame.
+ */
+void BenchmarkStreaming()
+{
+	constexpr int numChunks = 16;
+	constexpr int numEntities = 4000;
+
+	std::vector<std::string> paths;
+	for (int chunk = 0; chunk < numChunks; chunk++)
+	{
+		ECS ecs;
+		ecs.Init();
+		ecs.RegisterComponent<Position>();
+		ecs.RegisterComponent<Velocity>();
+
+		for (int i = 0; i < numEntities; i++)
+		{
+			Entity entity = ecs.CreateEntity();
+			ecs.AddComponent(entity, Position{ float(i), float(chunk), 0.0f });
+			ecs.AddComponent(entity, Velocity{ 0.0f, 0.0f, 1.0f });
+		}
+
+		paths.push_back("BenchmarkChunk" + to_string(chunk) + ".ecsw");
+		WorldFile().Save(ecs, paths.back().c_str());
+	}
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+	ecs.RegisterComponent<Velocity>();
+
+	StreamingLoader loader([](ECS& staging)
+	{
+		staging.RegisterComponent<Position>();
+		staging.RegisterComponent<Velocity>();
+	}, 2);
+
+	Stopwatch stopwatch;
+	for (const std::string& path : paths)
+	{
+		loader.Request(path);
+	}
+
+	int frames = 0;
+	double worstFrame = 0.0;
+	while (loader.GetStats().committed < numChunks)
+	{
+		loader.Commit(ecs, 2000.0);
+		worstFrame = std::max(worstFrame, loader.GetStats().lastCommitMicroseconds);
+		frames++;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	string name = "Streaming 16 chunks of 4k entities, " + to_string(frames) + " frames, max latency "
+		+ to_string(int(loader.GetStats().maxLatencyMicroseconds)) + "us, worst frame";
+	Report(name.c_str(), worstFrame);
+
+	for (const std::string& path : paths)
+	{
+		std::remove(path.c_str());
+	}
+}
+
+/**
+ * 10k entities created and destroyed every frame, with the default allocator and a pool on huge pages.
+ * Counts the allocations reaching the system allocator or the huge pages.
+ */
+void BenchmarkMemoryResources()
+{
+	constexpr int numEntities = 10000;
+	constexpr int numFrames = 30;
+
+	auto run = [](const char* allocator, std::pmr::memory_resource* resource, const MemoryTracker& system)
+	{
+		ECS ecs;
+		ecs.Init(resource);
+		ecs.RegisterComponent<Position>();
+		ecs.RegisterComponent<Velocity>();
+
+		Signature signature;
+		signature.set(ecs.GetComponentType<Position>(), true);
+		ecs.RegisterSystem<BoundsSystem>();
+		ecs.SetSystemSignature<BoundsSystem>(signature);
+
+		std::vector<Entity> entities(numEntities);
+		auto frame = [&]()
+		{
+			for (Entity& entity : entities)
+			{
+				entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, Position{ 0.0f, 0.0f, 0.0f });
+				ecs.AddComponent(entity, Velocity{ 0.0f, 0.0f, 0.0f });
+			}
+
+			for (Entity entity : entities)
+			{
+				ecs.DestroyEntity(entity);
+			}
+		};
+
+		frame();
+		std::uint64_t allocations = system.GetStats().allocations;
+
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			frame();
+		}
+
+		string name = string(allocator) + ", 10k entity churn, " + to_string((system.GetStats().allocations - allocations) / numFrames)
+			+ " system allocations per frame";
+		Report(name.c_str(), stopwatch.ElapsedMicroseconds() / numFrames);
+	};
+
+	{
+		MemoryTracker system(std::pmr::new_delete_resource());
+		run("Default allocator", &system, system);
+	}
+
+	{
+		HugePageResource hugePages;
+		MemoryTracker system(&hugePages);
+		std::pmr::unsynchronized_pool_resource pool(&system);
+		run("Pool on huge pages", &pool, system);
+	}
+}
+
+/**
+ * 100k entities using 16 distinct 64 byte materials, stored per entity and shared, and iterated by material.
+ */
+void BenchmarkSharedComponents()
+{
+	constexpr int numEntities = 100000;
+	constexpr int numMaterials = 16;
+	constexpr int numFrames = 10;
+
+	struct MaterialParams
+	{
+		std::uint32_t shader;
+		float params[15];
+
+		bool operator==(const MaterialParams& other) const
+		{
+			return shader == other.shader && std::equal(params, params + 15, other.params);
+		}
+	};
+
+	auto material = [](int i)
+	{
+		MaterialParams params{ static_cast<std::uint32_t>(i % numMaterials), {} };
+		params.params[0] = float(i % numMaterials);
+		return params;
+	};
+
+	{
+		ECS ecs;
+		ecs.Init();
+		ecs.RegisterComponent<Position>();
+		ecs.RegisterComponent<MaterialParams>();
+
+		for (int i = 0; i < numEntities; i++)
+		{
+			Entity entity = ecs.CreateEntity();
+			ecs.AddComponent(entity, Position{ float(i), 0.0f, 0.0f });
+			ecs.AddComponent(entity, material(i));
+		}
+
+		// Binding a material is simulated by summing its parameters, done whenever it differs from the bound one.
+		auto materials = ecs.GetComponentManager()->GetComponentArray<MaterialParams>();
+		int binds = 0;
+		float sum = 0.0f;
+		auto frame = [&]()
+		{
+			std::uint32_t bound = ~0u;
+			binds = 0;
+			for (size_t index = 0; index < materials->Size(); index++)
+			{
+				const MaterialParams& params = materials->Data()[index];
+				if (params.shader != bound)
+				{
+					bound = params.shader;
+					binds++;
+					sum += params.params[0];
+				}
+				sum += ecs.ReadComponent<Position>(materials->RawEntities()[index]).x;
+			}
+		};
+
+		frame();
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			frame();
+		}
+
+		string name = "Per entity materials, " + to_string(ecs.GetComponentMemory<MaterialParams>().bytes / 1024) + " KB, "
+			+ to_string(binds) + " binds per frame";
+		Report(name.c_str(), stopwatch.ElapsedMicroseconds() / numFrames);
+		if (sum < 0.0f)
+			cout << sum;
+	}
+
+	{
+		ECS ecs;
+		ecs.Init();
+		ecs.RegisterComponent<Position>();
+		ecs.RegisterSharedComponent<MaterialParams>();
+
+		for (int i = 0; i < numEntities; i++)
+		{
+			Entity entity = ecs.CreateEntity();
+			ecs.AddComponent(entity, Position{ float(i), 0.0f, 0.0f });
+			ecs.SetSharedComponent(entity, material(i));
+		}
+
+		Signature required;
+		required.set(ecs.GetComponentType<Position>(), true);
+
+		int binds = 0;
+		float sum = 0.0f;
+		auto frame = [&]()
+		{
+			binds = 0;
+			ecs.ForEachSharedGroup<MaterialParams>(required, [&](const MaterialParams& params, const Entity* entities, size_t count)
+			{
+				binds++;
+				sum += params.params[0];
+				for (size_t i = 0; i < count; i++)
+				{
+					sum += ecs.ReadComponent<Position>(entities[i]).x;
+				}
+			});
+		};
+
+		frame();
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			frame();
+		}
+
+		string name = "Shared materials, " + to_string(ecs.GetComponentMemory<MaterialParams>().bytes / 1024) + " KB, "
+			+ to_string(binds) + " binds per frame";
+		Report(name.c_str(), stopwatch.ElapsedMicroseconds() / numFrames);
+		if (sum < 0.0f)
+			cout << sum;
+	}
+}
+
+/**
+ * Reading global state 1M times, from a world resource and from a component on a dummy entity.
+ */
+void BenchmarkResources()
+{
+	constexpr int numReads = 1000000;
+
+	struct Gravity
+	{
+		float x, y, z;
+	};
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Gravity>();
+
+	Entity settings = ecs.CreateEntity();
+	ecs.AddComponent(settings, Gravity{ 0.0f, -9.8f, 0.0f });
+	ecs.SetResource<Gravity>(0.0f, -9.8f, 0.0f);
+
+	float sum = 0.0f;
+	{
+		Stopwatch stopwatch;
+		for (int i = 0; i < numReads; i++)
+		{
+			sum += ecs.ReadComponent<Gravity>(settings).y;
+		}
+		Report("Global state as a component on an entity, 1M reads", stopwatch.ElapsedMicroseconds());
+	}
+
+	{
+		Stopwatch stopwatch;
+		for (int i = 0; i < numReads; i++)
+		{
+			sum += ecs.GetResource<Gravity>().y;
+		}
+		Report("Global state as a world resource, 1M reads", stopwatch.ElapsedMicroseconds());
+	}
+
+	if (sum > 0.0f)
+		cout << sum;
+}
+
+/**
+ * 100k ships docked at 100 stations, finding the ships of every station from a component holding the target
+ * with a scan and from the reverse index of a relation.
+ */
+void BenchmarkRelations()
+{
+	constexpr int numShips = 100000;
+	constexpr int numStations = 100;
+
+	struct DockedAtComponent
+	{
+		Entity station;
+	};
+	struct DockedAt {};
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<DockedAtComponent>();
+	ecs.RegisterRelation<DockedAt>();
+
+	std::vector<Entity> stations(numStations);
+	for (Entity& station : stations)
+	{
+		station = ecs.CreateEntity();
+	}
+
+	for (int i = 0; i < numShips; i++)
+	{
+		Entity ship = ecs.CreateEntity();
+		ecs.AddComponent(ship, DockedAtComponent{ stations[i % numStations] });
+		ecs.AddPair<DockedAt>(ship, stations[i % numStations]);
+	}
+
+	size_t found = 0;
+	{
+		Stopwatch stopwatch;
+		auto docked = ecs.GetComponentManager()->GetComponentArray<DockedAtComponent>();
+		for (Entity station : stations)
+		{
+			for (size_t index = 0; index < docked->Size(); index++)
+			{
+				if (docked->Data()[index].station == station)
+					found++;
+			}
+		}
+		Report("Ships of all 100 stations, scanning 100k components", stopwatch.ElapsedMicroseconds());
+	}
+
+	{
+		Stopwatch stopwatch;
+		for (Entity station : stations)
+		{
+			ecs.ForEachSource<DockedAt>(station, [&](Entity) { found++; });
+		}
+		Report("Ships of all 100 stations, relation reverse index", stopwatch.ElapsedMicroseconds());
+	}
+
+	{
+		Stopwatch stopwatch;
+		for (Entity station : stations)
+		{
+			ecs.DestroyEntity(station);
+		}
+		Report("Destroying 100 stations, cleaning up 100k pairs", stopwatch.ElapsedMicroseconds());
+	}
+
+	if (found != 2 * numShips || ecs.GetRelation<DockedAt>().GetPairCount() != 0)
+		cout << "Relation benchmark mismatch\n";
+}
+
+/**
+ * 100k entities with Position and Velocity after heavy churn, reading both through the index,
+ * after SortAs lines the arrays up, and walking both dense arrays side by side.
+ */
+void BenchmarkSortComponents()
+{
+	constexpr int numEntities = 100000;
+	constexpr int numFrames = 20;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+	ecs.RegisterComponent<Velocity>();
+
+	// Velocities are added in a different order than positions, like after a lot of churn.
+	std::vector<Entity> entities(numEntities);
+	for (Entity& entity : entities)
+	{
+		entity = ecs.CreateEntity();
+		ecs.AddComponent(entity, Position{ 0.0f, 0.0f, 0.0f });
+	}
+
+	std::vector<Entity> shuffled = entities;
+	std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(42));
+	for (Entity entity : shuffled)
+	{
+		ecs.AddComponent(entity, Velocity{ 1.0f, 0.0f, 0.0f });
+	}
+
+	auto positions = ecs.GetComponentManager()->GetComponentArray<Position>();
+	auto velocities = ecs.GetComponentManager()->GetComponentArray<Velocity>();
+
+	// Next position summed up, the same reads as integrating.
+	float sum = 0.0f;
+	auto integrate = [&]()
+	{
+		const Position* position = positions->Data();
+		for (size_t index = 0; index < positions->Size(); index++)
+		{
+			sum += position[index].x + velocities->ReadData(positions->RawEntities()[index]).x;
+		}
+	};
+
+	auto run = [](const char* name, const auto& frame)
+	{
+		frame();
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			frame();
+		}
+		Report(name, stopwatch.ElapsedMicroseconds() / numFrames);
+	};
+
+	run("Position + Velocity through the index, scrambled order, per frame", integrate);
+
+	{
+		Stopwatch stopwatch;
+		ecs.SortAs<Position, Velocity>();
+		Report("SortAs<Position, Velocity>, 100k components", stopwatch.ElapsedMicroseconds());
+	}
+
+	run("Position + Velocity through the index, aligned order, per frame", integrate);
+
+	// Aligned arrays with the same entities need no lookup at all.
+	run("Position + Velocity walking both dense arrays, per frame", [&]()
+	{
+		const Position* position = positions->Data();
+		const Velocity* velocity = velocities->Data();
+		for (size_t index = 0; index < positions->Size(); index++)
+		{
+			sum += position[index].x + velocity[index].x;
+		}
+	});
+
+	if (sum < 0.0f)
+		cout << sum;
+}
+
+void BenchmarkEntityDefragment()
+{
+	constexpr int numLiving = 10000;
+	constexpr int numFrames = 50;
+	constexpr std::uint32_t movesPerStep = 256;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+
+	// Fill the ID space and keep a random tenth alive, like after a lot of churn.
+	std::vector<Entity> entities(MAX_ENTITIES);
+	for (Entity& entity : entities)
+	{
+		entity = ecs.CreateEntity();
+		ecs.AddComponent(entity, Position{ 1.0f, 0.0f, 0.0f });
+	}
+
+	std::shuffle(entities.begin(), entities.end(), std::mt19937(42));
+	for (size_t i = numLiving; i < entities.size(); i++)
+	{
+		ecs.DestroyEntity(entities[i]);
+	}
+
+	// Per entity ID state written from the dense array, like the interpolation capture.
+	auto positions = ecs.GetComponentManager()->GetComponentArray<Position>();
+	std::vector<Position> previous(MAX_ENTITIES);
+	auto capture = [&]()
+	{
+		const Entity* ids = positions->RawEntities();
+		const Position* position = positions->Data();
+		for (size_t index = 0; index < positions->Size(); index++)
+		{
+			previous[ids[index]] = position[index];
+		}
+	};
+
+	// Everything up to the highest living ID, like the signature scans.
+	const auto& entityManager = ecs.GetEntityManager();
+	size_t living = 0;
+	auto scan = [&]()
+	{
+		Entity end = entityManager->FindLivingEntityBelow(MAX_ENTITIES) + 1;
+		for (Entity entity = 0; entity < end; entity++)
+		{
+			living += entityManager->GetSignature(entity).any();
+		}
+	};
+
+	auto run = [](const char* name, const auto& frame)
+	{
+		frame();
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			frame();
+		}
+		Report(name, stopwatch.ElapsedMicroseconds() / numFrames);
+	};
+
+	run("Capture 10k per ID states, IDs spread over 131k, per frame", capture);
+	run("Scan signatures up to the highest ID, spread, per frame", scan);
+
+	EntityDefragmenter defragmenter(ecs);
+	{
+		Stopwatch stopwatch;
+		defragmenter.Step(movesPerStep);
+		Report("Defragment step, 256 moves", stopwatch.ElapsedMicroseconds());
+	}
+
+	int steps = 1;
+	Stopwatch stopwatch;
+	while (!defragmenter.IsCompact())
+	{
+		defragmenter.Step(movesPerStep);
+		steps++;
+	}
+	Report("Defragment the rest, 256 moves per step", stopwatch.ElapsedMicroseconds());
+	cout << "  " << steps << " steps, " << defragmenter.GetMovedCount() << " entities moved\n";
+
+	run("Capture 10k per ID states, IDs compacted, per frame", capture);
+	run("Scan signatures up to the highest ID, compacted, per frame", scan);
+
+	if (living == 0)
+		cout << living;
+}
+
+void BenchmarkPublishedSnapshot()
+{
+	constexpr int numEntities = 100000;
+	constexpr int numFrames = 100;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+	ecs.RegisterComponent<Velocity>();
+
+	for (int i = 0; i < numEntities; i++)
+	{
+		Entity entity = ecs.CreateEntity();
+		ecs.AddComponent(entity, Position{ 0.0f, 0.0f, 0.0f });
+		ecs.AddComponent(entity, Velocity{ 1.0f, 0.0f, 0.0f });
+	}
+
+	// Only positions are published, velocities cost nothing.
+	SnapshotPublisher publisher(ecs);
+	publisher.Track<Position>();
+	publisher.Publish();
+
+	{
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			publisher.Publish();
+		}
+		Report("Publish 100k positions, per frame", stopwatch.ElapsedMicroseconds() / numFrames);
+	}
+
+	{
+		constexpr int numAcquires = 1000000;
+		std::uint64_t sequences = 0;
+		Stopwatch stopwatch;
+		for (int i = 0; i < numAcquires; i++)
+		{
+			sequences += publisher.Acquire().GetSequence();
+		}
+		Report("Acquire and release a view, per call", stopwatch.ElapsedMicroseconds() / numAcquires);
+		if (sequences == 0)
+			cout << sequences;
+	}
+
+	// A reader summing the latest frame over and over while the simulation publishes.
+	std::atomic<bool> done{ false };
+	std::atomic<std::uint64_t> readFrames{ 0 };
+	std::thread reader([&]()
+	{
+		float sum = 0.0f;
+		while (!done.load())
+		{
+			PublishedView view = publisher.Acquire();
+			view.Get<Position>().ForEach([&](Entity, const Position& position) { sum += position.x; });
+			readFrames++;
+		}
+		if (sum < 0.0f)
+			cout << sum;
+	});
+
+	auto positions = ecs.GetComponentManager()->GetComponentArray<Position>();
+	auto velocities = ecs.GetComponentManager()->GetComponentArray<Velocity>();
+	Stopwatch stopwatch;
+	for (int i = 0; i < numFrames; i++)
+	{
+		for (size_t index = 0; index < positions->Size(); index++)
+		{
+			Entity entity = positions->EntityAtIndex(index);
+			ecs.GetComponent<Position>(entity).x += velocities->ReadData(entity).x;
+		}
+		publisher.Publish();
+	}
+	Report("Integrate and publish 100k, reader running, per frame", stopwatch.ElapsedMicroseconds() / numFrames);
+
+	done = true;
+	reader.join();
+	cout << "  " << readFrames.load() << " frames read, " << publisher.GetSkippedCount() << " publishes skipped\n";
+}
+
+void BenchmarkDeterministicMode()
+{
+	constexpr int numEntities = 100000;
+	constexpr int numFrames = 100;
+	constexpr uint32_t chunkSize = 256;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+	ecs.RegisterComponent<Velocity>();
+
+	std::vector<Entity> entities(numEntities);
+	for (Entity& entity : entities)
+	{
+		entity = ecs.CreateEntity();
+		ecs.AddComponent(entity, Position{ 0.0f, 0.0f, 0.0f });
+		ecs.AddComponent(entity, Velocity{ 1.0f, 0.0f, 0.0f });
+	}
+
+	WorldHasher hasher;
+	std::uint64_t hash = hasher.Hash(ecs);
+	{
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			hash ^= hasher.Hash(ecs);
+		}
+		Report("World state hash, 100k entities with Position + Velocity, per tick", stopwatch.ElapsedMicroseconds() / numFrames);
+	}
+
+	{
+		// 1 MiB stays in cache, like the columns of a world hashed right after the tick wrote them.
+		constexpr int numPasses = 16;
+		std::vector<unsigned char> bytes(1 << 20, 1);
+		Stopwatch stopwatch;
+		for (int i = 0; i < numPasses; i++)
+		{
+			StateHasher stream;
+			stream.Update(bytes.data(), bytes.size());
+			hash ^= stream.Finish();
+		}
+		double microseconds = stopwatch.ElapsedMicroseconds() / numPasses;
+		Report("State hash throughput, 1 MiB", microseconds);
+		cout << "  " << (bytes.size() / microseconds / 1000.0) << " GB/s\n";
+	}
+
+	// Every chunk of entities records a velocity change, then the buffer plays them back.
+	JobSystem jobs;
+	for (bool deterministic : { false, true })
+	{
+		CommandBuffer commands;
+		commands.SetDeterministic(deterministic);
+
+		auto frame = [&]()
+		{
+			jobs.ParallelForChunks(numEntities, chunkSize, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+			{
+				CommandRecorder recorder(0, chunk);
+				for (uint32_t i = begin; i < end; i++)
+				{
+					recorder.SetComponent(entities[i], Velocity{ 1.0f, float(chunk), 0.0f });
+				}
+				commands.Submit(std::move(recorder));
+			});
+			commands.Playback(ecs);
+		};
+
+		frame();
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames / 10; i++)
+		{
+			frame();
+		}
+		Report(deterministic ? "Record and play back 100k sets, ordered by (system, chunk), per frame" : "Record and play back 100k sets, submission order, per frame",
+			stopwatch.ElapsedMicroseconds() / (numFrames / 10));
+	}
+
+	if (hash == 0)
+		cout << hash;
+}
+
+void BenchmarkWorldChecksum()
+{
+	constexpr int numEntities = 100000;
+	constexpr int numFrames = 100;
+	constexpr int numChanged = numEntities / 100;
+
+	ECS ecs;
+	ecs.Init();
+	ecs.RegisterComponent<Position>();
+	ecs.RegisterComponent<Velocity>();
+
+	std::vector<Entity> entities(numEntities);
+	for (Entity& entity : entities)
+	{
+		entity = ecs.CreateEntity();
+		ecs.AddComponent(entity, Position{ 0.0f, 0.0f, 0.0f });
+		ecs.AddComponent(entity, Velocity{ 1.0f, 0.0f, 0.0f });
+	}
+
+	WorldChecksum checksum(ecs);
+	std::uint64_t hash = 0;
+	{
+		Stopwatch stopwatch;
+		hash ^= checksum.Update();
+		Report("World checksum, first update of 100k entities", stopwatch.ElapsedMicroseconds());
+	}
+
+	{
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			hash ^= checksum.Update();
+		}
+		Report("World checksum, nothing changed, per tick", stopwatch.ElapsedMicroseconds() / numFrames);
+	}
+
+	// 1% of the positions move every tick, either a contiguous run of slots or spread over the whole array.
+	std::mt19937 random(42);
+	std::vector<Entity> scattered(numChanged);
+	for (Entity& entity : scattered)
+	{
+		entity = entities[random() % numEntities];
+	}
+
+	for (bool contiguous : { true, false })
+	{
+		std::uint32_t rehashed = 0;
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			for (int j = 0; j < numChanged; j++)
+			{
+				Entity entity = contiguous ? entities[(i * numChanged + j) % numEntities] : scattered[j];
+				ecs.GetComponent<Position>(entity).x += 1.0f;
+			}
+			hash ^= checksum.Update();
+			rehashed += checksum.GetRehashedLeafCount();
+		}
+		Report(contiguous ? "World checksum, 1% changed in a run of slots, per tick" : "World checksum, 1% changed at random, per tick",
+			stopwatch.ElapsedMicroseconds() / numFrames);
+		cout << "  " << (rehashed / numFrames) << " leaves rehashed per tick\n";
+	}
+
+	{
+		WorldHasher hasher;
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			hash ^= hasher.Hash(ecs);
+		}
+		Report("Full world state hash for comparison, per tick", stopwatch.ElapsedMicroseconds() / numFrames);
+	}
+
+	// A peer whose world differs in one component.
+	ECS peer;
+	peer.Init();
+	peer.RegisterComponent<Position>();
+	peer.RegisterComponent<Velocity>();
+	for (Entity entity : entities)
+	{
+		Entity copy = peer.CreateEntity();
+		peer.AddComponent(copy, Position(ecs.ReadComponent<Position>(entity)));
+		peer.AddComponent(copy, Velocity(ecs.ReadComponent<Velocity>(entity)));
+	}
+	peer.GetComponent<Position>(entities[numEntities / 3]).y = 1.0f;
+
+	WorldChecksum peerChecksum(peer);
+	checksum.Update();
+	peerChecksum.Update();
+
+	{
+		DivergenceLocator locator(checksum);
+		Stopwatch stopwatch;
+		locator.Start(peerChecksum.GetSummary());
+		while (!locator.IsDone())
+		{
+			locator.Receive(peerChecksum.Answer(locator.GetQuery()));
+		}
+		Report("Locate a divergence, local exchanges only", stopwatch.ElapsedMicroseconds());
+
+		const ChecksumDivergence& result = locator.GetResult();
+		cout << "  " << result.exchanges << " exchanges, slots [" << result.first << ", " << (result.first + result.count) << ")\n";
+	}
+
+	if (hash == 0)
+		cout << hash;
+}
+
+#if defined(BENCHMARK_SOCKETS)
+// Every client gets a connected pair of local stream sockets, packets go through the kernel like over a real
+// connection. Each packet is prefixed with its size. On Windows the pair is a TCP connection over loopback.
+class LocalSocketTransport : public IReplicationTransport
+{
+public:
+	explicit LocalSocketTransport(size_t clientCount)
+		: m_Sockets(clientCount)
+	{
+#if defined(_WIN32)
+		WSADATA data;
+		WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+		for (auto& pair : m_Sockets)
+		{
+			CreatePair(pair);
+			int bufferSize = 4 << 20;
+			setsockopt(pair[0], SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+			setsockopt(pair[1], SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferSize), sizeof(bufferSize));
+		}
+	}
+
+	~LocalSocketTransport()
+	{
+		for (auto& pair : m_Sockets)
+		{
+			CloseSocket(pair[0]);
+			CloseSocket(pair[1]);
+		}
+#if defined(_WIN32)
+		WSACleanup();
+#endif
+	}
+
+	void Send(ClientId client, const std::uint8_t* data, size_t size) override
+	{
+		std::uint32_t header = static_cast<std::uint32_t>(size);
+		WriteAll(m_Sockets[client][0], reinterpret_cast<const std::uint8_t*>(&header), sizeof(header));
+		WriteAll(m_Sockets[client][0], data, size);
+	}
+
+	// Read one packet sent to the client.
+	const std::vector<std::uint8_t>& Receive(ClientId client)
+	{
+		std::uint32_t size = 0;
+		ReadAll(m_Sockets[client][1], reinterpret_cast<std::uint8_t*>(&size), sizeof(size));
+		m_Packet.resize(size);
+		ReadAll(m_Sockets[client][1], m_Packet.data(), size);
+		return m_Packet;
+	}
+
+private:
+#if defined(_WIN32)
+	using Socket = SOCKET;
+
+	// Sender first, connected to a listener on an ephemeral loopback port that only lives for the handshake.
+	static void CreatePair(std::array<Socket, 2>& pair)
+	{
+		Socket listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = 0;
+		int length = sizeof(address);
+		// Qualified, std::bind is visible here too.
+		::bind(listener, reinterpret_cast<const sockaddr*>(&address), length);
+		listen(listener, 1);
+		getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+
+		pair[0] = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		connect(pair[0], reinterpret_cast<const sockaddr*>(&address), length);
+		pair[1] = accept(listener, nullptr, nullptr);
+		closesocket(listener);
+
+		// Send every packet right away like the socket pair does, instead of waiting to coalesce them.
+		BOOL noDelay = TRUE;
+		setsockopt(pair[0], IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+	}
+
+	static void CloseSocket(Socket socket) { closesocket(socket); }
+
+	static void WriteAll(Socket socket, const std::uint8_t* data, size_t size)
+	{
+		while (size > 0)
+		{
+			int written = send(socket, reinterpret_cast<const char*>(data), static_cast<int>(std::min<size_t>(size, 1 << 30)), 0);
+			if (written <= 0)
+				return;
+			data += written;
+			size -= written;
+		}
+	}
+
+	static void ReadAll(Socket socket, std::uint8_t* data, size_t size)
+	{
+		while (size > 0)
+		{
+			int count = recv(socket, reinterpret_cast<char*>(data), static_cast<int>(std::min<size_t>(size, 1 << 30)), 0);
+			if (count <= 0)
+				return;
+			data += count;
+			size -= count;
+		}
+	}
+#else
+	using Socket = int;
+
+	static void CreatePair(std::array<Socket, 2>& pair)
+	{
+		socketpair(AF_UNIX, SOCK_STREAM, 0, pair.data());
+	}
+
+	static void CloseSocket(Socket socket) { close(socket); }
+
+	static void WriteAll(Socket socket, const std::uint8_t* data, size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t written = write(socket, data, size);
+			if (written <= 0)
+				return;
+			data += written;
+			size -= written;
+		}
+	}
+
+	static void ReadAll(Socket socket, std::uint8_t* data, size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t count = read(socket, data, size);
+			if (count <= 0)
+				return;
+			data += count;
+			size -= count;
+		}
+	}
+#endif
+
+	std::vector<std::array<Socket, 2>> m_Sockets;
+	std::vector<std::uint8_t> m_Packet;
+};
+#endif
+
+// An authoritative server replicating every entity to every client at 30 Hz, the worst case for interest sets.
+void BenchmarkReplication()
+{
+	constexpr int numEntities = 10000;
+	constexpr ClientId numClients = 64;
+	constexpr int numTicks = 30;
+	constexpr double tickRate = 30.0;
+
+	ECS server;
+	server.Init();
+	server.RegisterComponent<Position>();
+	server.RegisterComponent<Velocity>();
+
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> coordinate(-1000.0f, 1000.0f);
+	std::uniform_real_distribution<float> speed(-5.0f, 5.0f);
+
+	std::vector<Entity> entities(numEntities);
+	for (Entity& entity : entities)
+	{
+		entity = server.CreateEntity();
+		server.AddComponent(entity, Position{ coordinate(random), coordinate(random), 0.0f });
+		server.AddComponent(entity, Velocity{ speed(random), speed(random), 0.0f });
+	}
+
+	LoopbackTransport transport;
+	ReplicationServer replication(server, transport);
+	replication.Replicate<Position>();
+	replication.Replicate<Velocity>();
+
+	for (ClientId client = 0; client < numClients; client++)
+	{
+		replication.AddClient();
+		for (Entity entity : entities)
+		{
+			replication.SetInterest(client, entity, true);
+		}
+	}
+
+	// Client 0 applies its packets to a world of its own, the others are only counted.
+	ECS client;
+	client.Init();
+	client.RegisterComponent<Position>();
+	client.RegisterComponent<Velocity>();
+	ReplicationClient receiver(client);
+	receiver.Replicate<Position>();
+	receiver.Replicate<Velocity>();
+
+	auto deliver = [&]()
+	{
+		for (ClientId id = 1; id < numClients; id++)
+		{
+			transport.Discard(id);
+		}
+		Stopwatch stopwatch;
+		transport.Deliver(0, receiver);
+		return stopwatch.ElapsedMicroseconds();
+	};
+
+	{
+		Stopwatch stopwatch;
+		replication.Update();
+		Report("Replicate 10k entities to 64 clients, first update spawning everything", stopwatch.ElapsedMicroseconds());
+		cout << "  " << replication.GetClientStats(0).bytes << " bytes per client\n";
+		double microseconds = deliver();
+		Report("Client applies the first update", microseconds);
+	}
+
+	// Movers integrate their position every tick, the others stand still.
+	for (int moving : { numEntities / 10, numEntities })
+	{
+		double serverMicroseconds = 0.0;
+		double clientMicroseconds = 0.0;
+		std::uint64_t bytes = 0;
+		for (int tick = 0; tick < numTicks; tick++)
+		{
+			for (int i = 0; i < moving; i++)
+			{
+				Entity entity = entities[(i * 7919 + tick) % numEntities];
+				Position& position = server.GetComponent<Position>(entity);
+				const Velocity& velocity = server.ReadComponent<Velocity>(entity);
+				position.x += velocity.x / float(tickRate);
+				position.y += velocity.y / float(tickRate);
+			}
+
+			Stopwatch stopwatch;
+			replication.Update();
+			serverMicroseconds += stopwatch.ElapsedMicroseconds();
+
+			bytes += replication.GetClientStats(0).bytes;
+			clientMicroseconds += deliver();
+		}
+
+		Report(moving == numEntities ? "Replicate to 64 clients, all 10k entities moving, per tick" : "Replicate to 64 clients, 1k of 10k entities moving, per tick",
+			serverMicroseconds / numTicks);
+		cout << "  " << (bytes / numTicks) << " bytes per client per tick, " << (bytes / numTicks * tickRate * 8.0 / 1000.0) << " kbit/s per client at 30 Hz\n";
+		cout << "  " << (serverMicroseconds / numTicks / (1e6 / tickRate) * 100.0) << "% of a server core at 30 Hz\n";
+		Report("Client applies the tick", clientMicroseconds / numTicks);
+	}
+
+	// Every entity was replicated, compare the client's copy with the server.
+	Entity last = entities[numEntities - 1];
+	if (client.ReadComponent<Position>(receiver.GetLocalEntity(last)).x != server.ReadComponent<Position>(last).x)
+		cout << "Replicated position doesn't match the server\n";
+
+#if defined(BENCHMARK_SOCKETS)
+	// The same movers again, with every packet written to and read back from a local socket.
+	LocalSocketTransport sockets(numClients);
+	ReplicationServer socketReplication(server, sockets);
+	socketReplication.Replicate<Position>();
+	socketReplication.Replicate<Velocity>();
+	for (ClientId id = 0; id < numClients; id++)
+	{
+		socketReplication.AddClient();
+		for (Entity entity : entities)
+		{
+			socketReplication.SetInterest(id, entity, true);
+		}
+	}
+
+	auto drain = [&]()
+	{
+		size_t received = 0;
+		for (ClientId id = 0; id < numClients; id++)
+		{
+			received += sockets.Receive(id).size();
+		}
+		return received;
+	};
+
+	socketReplication.Update();
+	drain();
+
+	double microseconds = 0.0;
+	size_t received = 0;
+	for (int tick = 0; tick < numTicks; tick++)
+	{
+		for (int i = 0; i < numEntities / 10; i++)
+		{
+			server.GetComponent<Position>(entities[(i * 7919 + tick) % numEntities]).x += 0.1f;
+		}
+
+		Stopwatch stopwatch;
+		socketReplication.Update();
+		received += drain();
+		microseconds += stopwatch.ElapsedMicroseconds();
+	}
+	Report("Replicate over local sockets to 64 clients, 1k of 10k entities moving, send and receive per tick", microseconds / numTicks);
+	cout << "  " << (received / numTicks / numClients) << " bytes per client per tick\n";
+#endif
+}
+
+#if defined(__cpp_impl_coroutine)
+CoroutineSystem BenchmarkIdleSystem(CoroutineScheduler& scheduler)
+{
+	for (;;)
+	{
+		co_await scheduler.NextFrame();
+	}
+}
+
+// Every frame awaits a job summing its own buffer, like a planner waiting on a path search.
+CoroutineSystem BenchmarkPlannerSystem(CoroutineScheduler& scheduler, float& result)
+{
+	std::vector<float> costs(20000, 1.0f);
+	for (;;)
+	{
+		float sum = 0.0f;
+		co_await scheduler.RunJob([&]()
+		{
+			for (float cost : costs)
+			{
+				sum += cost * 0.5f;
+			}
+		});
+		result += sum;
+		co_await scheduler.NextFrame();
+	}
+}
+
+void BenchmarkCoroutineSystems()
+{
+	constexpr int numFrames = 100;
+
+	auto run = [](const char* name, CoroutineScheduler& scheduler)
+	{
+		scheduler.Update();
+		Stopwatch stopwatch;
+		for (int i = 0; i < numFrames; i++)
+		{
+			scheduler.Update();
+		}
+		Report(name, stopwatch.ElapsedMicroseconds() / numFrames);
+	};
+
+	{
+		CoroutineScheduler scheduler;
+		for (int i = 0; i < 1000; i++)
+		{
+			scheduler.Add("Idle", BenchmarkIdleSystem(scheduler));
+		}
+		run("Resume 1000 idle coroutine systems, per frame", scheduler);
+	}
+
+	std::vector<float> results(64, 0.0f);
+	JobSystem jobs;
+	for (JobSystem* pool : { static_cast<JobSystem*>(nullptr), &jobs })
+	{
+		CoroutineScheduler scheduler(pool);
+		for (float& result : results)
+		{
+			scheduler.Add("Planner", BenchmarkPlannerSystem(scheduler, result));
+		}
+		run(pool ? "64 planners awaiting jobs, on the job system, per frame" : "64 planners awaiting jobs, on one thread, per frame", scheduler);
+	}
+
+	if (results[0] < 0.0f)
+		cout << results[0];
+}
+#endif
+
+int main()
+{
+	cout << "ECS Benchmarks:\n";
+
+	BenchmarkSnapshotCapture();
+	BenchmarkConcurrentCreateEntity();
+	BenchmarkSpatialHash();
+	BenchmarkRenderExtraction();
+	BenchmarkViewportCulling();
+	BenchmarkTransformPropagation();
+	BenchmarkPrefabInstantiate();
+	BenchmarkMergeWorld();
+	BenchmarkStreaming();
+	BenchmarkMemoryResources();
+	BenchmarkSharedComponents();
+	BenchmarkResources();
+	BenchmarkRelations();
+	BenchmarkSortComponents();
+	BenchmarkEntityDefragment();
+	BenchmarkPublishedSnapshot();
+	BenchmarkDeterministicMode();
+	BenchmarkWorldChecksum();
+	BenchmarkReplication();
+#if defined(__cpp_impl_coroutine)
+	BenchmarkCoroutineSystems();
+#endif
+}
@@ -2,14 +2,44 @@
 
 #include <bitset>
 #include <cassert>
+#include <cstdint>
+
+// Can be overridden by the project, e.g. for benchmarks with bigger worlds.
+#ifndef ECS_MAX_ENTITIES
+#define ECS_MAX_ENTITIES 5000
+#endif
 
 // Aliases
 using Entity = std::uint32_t;
 using ComponentType = std::uint8_t;
+using ResourceType = std::uint8_t;
+using RelationType = std::uint8_t;
+
+// Change ticks, every structural change and mutable component access is stamped with the current tick.
+using Tick = std::uint32_t;
 
 // Constants
-constexpr Entity MAX_ENTITIES = 5000;
+constexpr Entity MAX_ENTITIES = ECS_MAX_ENTITIES;
 constexpr ComponentType MAX_COMPONENTS = 32;
+constexpr ResourceType MAX_RESOURCES = 32;
+constexpr RelationType MAX_RELATIONS = 32;
+
+// Marks "no entity", e.g. in remap tables.
+constexpr Entity INVALID_ENTITY = ~Entity(0);
+
+// An entity given a new ID, e.g. by defragmentation.
+struct EntityMove
+{
+	Entity from;
+	Entity to;
+};
 
 // More aliases
 using Signature = std::bitset<MAX_COMPONENTS>;
+using ResourceSignature = std::bitset<MAX_RESOURCES>;
+
+// True if tick happened after since, robust to the tick counter wrapping around.
+inline bool IsNewerTick(Tick tick, Tick since)
+{
+	return static_cast<std::int32_t>(tick - since) > 0;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "Base.hpp"
+
+/**
+ * Dirty list of the slots of a change tick array stamped since the reader last cleared it, so a reader like
+ * SnapshotRing finds the changes without scanning every tick. Only records while enabled.
+ * A slot is listed the first time it's stamped after the clear. Slots can be listed more than once and may have
+ * been moved since, so readers go through ForEachNewer, which checks the ticks and skips duplicates.
+ * Pushes are lock free, job threads stamping different slots in parallel can record at the same time.
+ * If more slots are pushed than the list holds, ForEachNewer falls back to scanning every tick.
+ */
+class ChangeList
+{
+public:
+	void Enable(Tick since)
+	{
+		m_Slots.resize(MAX_ENTITIES);
+		m_Seen.resize(MAX_ENTITIES, 0);
+		m_Enabled = true;
+		Clear(since);
+	}
+
+	void Disable()
+	{
+		m_Enabled = false;
+		m_Slots.clear();
+		m_Slots.shrink_to_fit();
+		m_Seen.clear();
+		m_Seen.shrink_to_fit();
+	}
+
+	bool IsEnabled() const { return m_Enabled; }
+
+	// Called before index is stamped, with the tick it had until now.
+	void Stamp(size_t index, Tick previous)
+	{
+		if (m_Enabled && !IsNewerTick(previous, m_Since))
+			Push(index);
+	}
+
+	// Record index whatever its tick was, for slots that just got a new occupant.
+	void Push(size_t index)
+	{
+		if (!m_Enabled)
+			return;
+
+		size_t position = m_Count.fetch_add(1, std::memory_order_relaxed);
+		if (position < m_Slots.size())
+			m_Slots[position] = static_cast<std::uint32_t>(index);
+	}
+
+	void PushRange(size_t first, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			Push(first + i);
+		}
+	}
+
+	// Slots moved wholesale, e.g. by sorting, only a scan finds them now.
+	void Overflow()
+	{
+		if (m_Enabled)
+			m_Count.store(m_Slots.size() + 1, std::memory_order_relaxed);
+	}
+
+	// Start a new list, stamps newer than since are the ones recorded from now on.
+	void Clear(Tick since)
+	{
+		m_Since = since;
+		m_Count.store(0, std::memory_order_relaxed);
+	}
+
+	Tick GetSince() const { return m_Since; }
+
+	// Call function(index) once for every slot below size whose tick is newer than the tick of the last Clear.
+	template<typename Function>
+	void ForEachNewer(const Tick* ticks, size_t size, Function&& function)
+	{
+		size_t count = m_Count.load(std::memory_order_relaxed);
+		if (!m_Enabled || count > m_Slots.size())
+		{
+			for (size_t index = 0; index < size; index++)
+			{
+				if (IsNewerTick(ticks[index], m_Since))
+					function(index);
+			}
+			return;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			std::uint32_t index = m_Slots[i];
+			if (index < size && !m_Seen[index] && IsNewerTick(ticks[index], m_Since))
+			{
+				m_Seen[index] = 1;
+				function(index);
+			}
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			m_Seen[m_Slots[i]] = 0;
+		}
+	}
+
+private:
+	bool m_Enabled{ false };
+	Tick m_Since{ 0 };
+
+	std::atomic<size_t> m_Count{ 0 };
+	std::vector<std::uint32_t> m_Slots;
+
+	// Marks of the slots already visited by ForEachNewer, cleared again before it returns.
+	std::vector<std::uint8_t> m_Seen;
+};
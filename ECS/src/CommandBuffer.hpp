@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ECS.hpp"
+
+/**
+ * Structural changes recorded by one chunk of one system's work, to be played back on the thread owning the world.
+ * Jobs can't create or destroy entities or add and remove components while other jobs iterate the world, so they
+ * record them here instead. Entities created by a recorder get a placeholder ID that the recorder's later commands
+ * can use, the real ID is only known at playback.
+ * A recorder is used by one thread at a time. Payloads are stored in blocks that never move, so components that
+ * aren't trivially copyable are fine.
+ */
+class CommandRecorder
+{
+public:
+	// Marks placeholder IDs handed out by CreateEntity.
+	static constexpr Entity PENDING_ENTITY = Entity(1) << 31;
+
+	// system and chunk order the playback in deterministic mode, sequence is the order of the commands.
+	CommandRecorder(std::uint32_t system, std::uint32_t chunk = 0)
+		: m_System(system), m_Chunk(chunk)
+	{
+		static_assert(MAX_ENTITIES < PENDING_ENTITY, "Entity IDs collide with placeholders.");
+	}
+
+	CommandRecorder(CommandRecorder&&) noexcept = default;
+	CommandRecorder& operator=(CommandRecorder&& other) noexcept
+	{
+		if (this != &other)
+		{
+			DestroyPayloads();
+			m_System = other.m_System;
+			m_Chunk = other.m_Chunk;
+			m_Commands = std::move(other.m_Commands);
+			m_Blocks = std::move(other.m_Blocks);
+			m_LargeBlocks = std::move(other.m_LargeBlocks);
+			m_BlockUsed = other.m_BlockUsed;
+			m_CreatedCount = other.m_CreatedCount;
+			m_Created = std::move(other.m_Created);
+			other.m_Commands.clear();
+		}
+		return *this;
+	}
+
+	CommandRecorder(const CommandRecorder&) = delete;
+	CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+	~CommandRecorder() { DestroyPayloads(); }
+
+	// Placeholder for an entity created at playback, only valid in commands of this recorder.
+	Entity CreateEntity()
+	{
+		Entity placeholder = PENDING_ENTITY | m_CreatedCount++;
+		m_Commands.push_back({ CommandType::Create, placeholder, nullptr, nullptr, nullptr });
+		return placeholder;
+	}
+
+	void DestroyEntity(Entity entity)
+	{
+		m_Commands.push_back({ CommandType::Destroy, entity, nullptr, nullptr, nullptr });
+	}
+
+	template<typename T>
+	void AddComponent(Entity entity, T component)
+	{
+		PushComponent(entity, std::move(component), [](ECS& ecs, Entity entity, void* payload)
+		{
+			ecs.AddComponent<T>(entity, std::move(*static_cast<T*>(payload)));
+		});
+	}
+
+	// Overwrite a component the entity already has, its OnSet observers are notified at playback.
+	template<typename T>
+	void SetComponent(Entity entity, T component)
+	{
+		PushComponent(entity, std::move(component), [](ECS& ecs, Entity entity, void* payload)
+		{
+			ecs.SetComponent<T>(entity, std::move(*static_cast<T*>(payload)));
+		});
+	}
+
+	template<typename T>
+	void RemoveComponent(Entity entity)
+	{
+		m_Commands.push_back({ CommandType::Apply, entity, nullptr, [](ECS& ecs, Entity entity, void*)
+		{
+			ecs.RemoveComponent<T>(entity);
+		}, nullptr });
+	}
+
+	std::uint32_t GetSystem() const { return m_System; }
+	std::uint32_t GetChunk() const { return m_Chunk; }
+	size_t GetCommandCount() const { return m_Commands.size(); }
+
+	// Run the commands in the order they were recorded and leave the recorder empty.
+	void Playback(ECS& ecs)
+	{
+		m_Created.resize(m_CreatedCount);
+
+		for (Command& command : m_Commands)
+		{
+			Entity entity = Resolve(command.entity);
+			switch (command.type)
+			{
+			case CommandType::Create:
+				m_Created[command.entity & ~PENDING_ENTITY] = ecs.CreateEntity();
+				break;
+			case CommandType::Destroy:
+				ecs.DestroyEntity(entity);
+				break;
+			case CommandType::Apply:
+				command.apply(ecs, entity, command.payload);
+				if (command.destroy)
+					command.destroy(command.payload);
+				command.destroy = nullptr;
+				break;
+			}
+		}
+
+		m_Commands.clear();
+		m_Blocks.clear();
+		m_LargeBlocks.clear();
+		m_BlockUsed = 0;
+		m_CreatedCount = 0;
+	}
+
+	// Real IDs of the entities created by the last playback, by placeholder.
+	Entity GetCreatedEntity(Entity placeholder) const { return m_Created[placeholder & ~PENDING_ENTITY]; }
+
+private:
+	static constexpr size_t BLOCK_SIZE = 4096;
+
+	enum class CommandType : std::uint8_t
+	{
+		Create,
+		Destroy,
+		Apply
+	};
+
+	struct Command
+	{
+		CommandType type;
+		Entity entity;
+		void* payload;
+		void (*apply)(ECS& ecs, Entity entity, void* payload);
+		void (*destroy)(void* payload);
+	};
+
+	template<typename T>
+	void PushComponent(Entity entity, T&& component, void (*apply)(ECS&, Entity, void*))
+	{
+		using Type = std::decay_t<T>;
+
+		void* payload = new (Allocate(sizeof(Type), alignof(Type))) Type(std::forward<T>(component));
+		void (*destroy)(void*) = nullptr;
+		if constexpr (!std::is_trivially_destructible_v<Type>)
+			destroy = [](void* payload) { static_cast<Type*>(payload)->~Type(); };
+
+		m_Commands.push_back({ CommandType::Apply, entity, payload, apply, destroy });
+	}
+
+	void* Allocate(size_t size, size_t alignment)
+	{
+		assert(alignment <= alignof(std::max_align_t) && "Over-aligned components can't be recorded.");
+
+		// Components bigger than a block get a block of their own, outside the ones being filled.
+		if (size > BLOCK_SIZE)
+		{
+			m_LargeBlocks.push_back(NewBlock(size));
+			return m_LargeBlocks.back().get();
+		}
+
+		size_t offset = (m_BlockUsed + alignment - 1) / alignment * alignment;
+		if (m_Blocks.empty() || offset + size > BLOCK_SIZE)
+		{
+			m_Blocks.push_back(NewBlock(BLOCK_SIZE));
+			offset = 0;
+		}
+
+		m_BlockUsed = offset + size;
+		return reinterpret_cast<unsigned char*>(m_Blocks.back().get()) + offset;
+	}
+
+	static std::unique_ptr<std::max_align_t[]> NewBlock(size_t size)
+	{
+		return std::unique_ptr<std::max_align_t[]>(new std::max_align_t[(size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)]);
+	}
+
+	Entity Resolve(Entity entity) const
+	{
+		return (entity & PENDING_ENTITY) && entity != INVALID_ENTITY ? m_Created[entity & ~PENDING_ENTITY] : entity;
+	}
+
+	void DestroyPayloads()
+	{
+		for (Command& command : m_Commands)
+		{
+			if (command.destroy)
+				command.destroy(command.payload);
+		}
+		m_Commands.clear();
+	}
+
+	std::uint32_t m_System;
+	std::uint32_t m_Chunk;
+
+	std::vector<Command> m_Commands;
+
+	// Payload blocks, the one being filled is the last.
+	std::vector<std::unique_ptr<std::max_align_t[]>> m_Blocks;
+	std::vector<std::unique_ptr<std::max_align_t[]>> m_LargeBlocks;
+	size_t m_BlockUsed{ 0 };
+
+	std::uint32_t m_CreatedCount{ 0 };
+	std::vector<Entity> m_Created;
+};
+
+/**
+ * Collects the recorders of a stage's jobs and plays them back on the thread owning the world.
+ * Jobs finish in whatever order the threads get to them, so in deterministic mode the recorders are played back
+ * ordered by (system, chunk) and every recorder in the order it recorded, which gives the same entity IDs and
+ * dense layouts on every machine. Each (system, chunk) pair may then only be submitted once per playback.
+ * Otherwise recorders are played back in the order they were submitted.
+ */
+class CommandBuffer
+{
+public:
+	void SetDeterministic(bool deterministic) { m_Deterministic = deterministic; }
+	bool IsDeterministic() const { return m_Deterministic; }
+
+	// Safe to call from any thread, empty recorders are dropped.
+	void Submit(CommandRecorder&& recorder)
+	{
+		if (recorder.GetCommandCount() == 0)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Submitted.push_back(std::move(recorder));
+	}
+
+	bool IsEmpty() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Submitted.empty();
+	}
+
+	// Only on the thread owning the world, with no job running.
+	void Playback(ECS& ecs)
+	{
+		if (m_Deterministic)
+		{
+			std::sort(m_Submitted.begin(), m_Submitted.end(), [](const CommandRecorder& a, const CommandRecorder& b)
+			{
+				return a.GetSystem() != b.GetSystem() ? a.GetSystem() < b.GetSystem() : a.GetChunk() < b.GetChunk();
+			});
+
+			for (size_t i = 1; i < m_Submitted.size(); i++)
+			{
+				assert((m_Submitted[i].GetSystem() != m_Submitted[i - 1].GetSystem() || m_Submitted[i].GetChunk() != m_Submitted[i - 1].GetChunk())
+					&& "A (system, chunk) pair was submitted twice, its playback order isn't deterministic.");
+			}
+		}
+
+		for (CommandRecorder& recorder : m_Submitted)
+		{
+			recorder.Playback(ecs);
+		}
+
+		m_PlayedCount += m_Submitted.size();
+		m_Submitted.clear();
+	}
+
+	// Recorders played back since the start.
+	std::uint64_t GetPlayedCount() const { return m_PlayedCount; }
+
+private:
+	mutable std::mutex m_Mutex;
+	std::vector<CommandRecorder> m_Submitted;
+
+	bool m_Deterministic{ false };
+	std::uint64_t m_PlayedCount{ 0 };
+};
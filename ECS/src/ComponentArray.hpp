@@ -1,9 +1,24 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <unordered_map>
+#include <memory>
+#include <memory_resource>
+#include <cstring>
+#include <type_traits>
+#include <vector>
 
 #include "Base.hpp"
+#include "ChangeList.hpp"
+
+// Layout version of a component type, stored in world files.
+// Specialize and bump it whenever the members of a component change so stale files are not used in place.
+template<typename T>
+struct ComponentVersion
+{
+	static constexpr std::uint32_t value = 0;
+};
 
 // Base Class.
 class IComponentArray
@@ -11,24 +26,103 @@ class IComponentArray
 public:
 	virtual ~IComponentArray() = default;
 	virtual void EntityDestroyed(Entity entity) = 0;
+
+	// Tick stamped on inserted and mutably accessed components, kept in sync by the ComponentManager.
+	void SetCurrentTick(Tick tick) { m_CurrentTick = tick; }
+
+	// Type erased access to the dense storage, used by world files.
+	virtual size_t Size() const = 0;
+	virtual size_t ComponentSize() const = 0;
+	virtual size_t ComponentAlignment() const = 0;
+	virtual std::uint32_t LayoutVersion() const = 0;
+	virtual bool IsTriviallyCopyable() const = 0;
+	virtual const void* RawData() const = 0;
+	virtual Entity EntityAtIndex(size_t index) const = 0;
+
+	// Entity and last change tick of every dense slot, parallel to RawData.
+	virtual const Entity* RawEntities() const = 0;
+	virtual const Tick* ChangeTicks() const = 0;
+
+	// Dirty list of ChangeTicks, for readers that would otherwise scan every tick.
+	ChangeList& GetChangeList() { return m_Changes; }
+
+	// Type erased access by entity, used to restore snapshots. RawComponent counts as a change.
+	virtual bool HasData(Entity entity) const = 0;
+	virtual void* RawComponent(Entity entity) = 0;
+	virtual void InsertRaw(Entity entity, const void* component) = 0;
+
+	// The value snapshots copy for a dense slot. Shared arrays return the value the slot points at instead of its
+	// value index, InsertRaw restores it by replacing the entity's value.
+	virtual bool IsValueTriviallyCopyable() const { return IsTriviallyCopyable(); }
+	virtual size_t ValueSize() const { return ComponentSize(); }
+	virtual const void* ValueAtIndex(size_t index) const { return static_cast<const std::uint8_t*>(RawData()) + index * ComponentSize(); }
+
+	// Append a copy of source's component for each of count entities, used to instantiate prefabs.
+	virtual void InsertCopies(Entity source, const Entity* entities, size_t count) = 0;
+
+	// Append every component of source, an array of the same type in another world, and leave source empty.
+	// remap maps the entity IDs of the source world to the ones in this world.
+	virtual void MoveFrom(IComponentArray& source, const Entity* remap) = 0;
+
+	// Use count components at data in place, data must stay valid as long as mapping is alive.
+	virtual void MapData(void* data, const Entity* entities, size_t count, std::shared_ptr<void> mapping) = 0;
+
+	// Copy count components from data into the owned storage.
+	virtual void CopyData(const void* data, const Entity* entities, size_t count) = 0;
+
+	// Key the components of every move's from entity by its to entity, which must have none.
+	// Counts as a change, so indices keyed by entity ID, like SpatialHash, pick up the new ID.
+	virtual void MoveEntities(const EntityMove* moves, size_t count) = 0;
+
+	// Layout of the storage, for introspection.
+	virtual size_t Capacity() const = 0;
+	virtual size_t IndexBucketCount() const = 0;
+	virtual double IndexLoadFactor() const = 0;
+	virtual bool IsMapped() const = 0;
+
+	// Components inserted and removed since the start.
+	std::uint64_t AddedCount() const { return m_AddedCount; }
+	std::uint64_t RemovedCount() const { return m_RemovedCount; }
+
+protected:
+	Tick m_CurrentTick{ 0 };
+	ChangeList m_Changes;
+
+	std::uint64_t m_AddedCount{ 0 };
+	std::uint64_t m_RemovedCount{ 0 };
 };
 
 template<typename T>
 class ComponentArray : public IComponentArray
 {
 public:
+	// The index map allocates from resource, the arrays live wherever the ComponentArray itself was allocated.
+	explicit ComponentArray(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		: m_EntityToIndexMap(resource), m_SortOrder(resource), m_SortScratch(resource)
+	{
+	}
+
 	void InsertData(Entity entity, const T& component)
 	{
 		assert(m_EntityToIndexMap.find(entity) == m_EntityToIndexMap.end() && "Component added to same entity more than once.");
 
+		// Mapped storage has no room to grow, so move it into the owned array first.
+		if (m_Mapping && m_Size == m_MappedCount)
+		{
+			Detach();
+		}
+
 		// Put the new entry at the end and update the maps.
 		size_t newIndex = m_Size;
-		m_ComponentArray[newIndex] = component;
+		m_Data[newIndex] = component;
+		m_ChangeTicks[newIndex] = m_CurrentTick;
+		m_Changes.Push(newIndex);
 
 		m_EntityToIndexMap[entity] = newIndex;
-		m_IndexToEntityMap[newIndex] = entity;
+		m_IndexToEntity[newIndex] = entity;
 
 		m_Size++;
+		m_AddedCount++;
 	}
 
 	#if 0
@@ -38,10 +132,10 @@ void InsertData(Entity entity, T&& component)
 
 		// Put the new entry at the end and update the maps.
 		size_t newIndex = m_Size;
-		m_ComponentArray[newIndex] = std::move(component);
+		m_Data[newIndex] = std::move(component);
 
 		m_EntityToIndexMap[entity] = newIndex;
-		m_IndexToEntityMap[newIndex] = entity;
+		m_IndexToEntity[newIndex] = entity;
 
 		m_Size++;
 	}
@@ -55,25 +149,41 @@ void InsertData(Entity entity, T&& component)
 		size_t indexOfRemovedEntity = m_EntityToIndexMap[entity];
 		size_t indexOfLastElement = m_Size - 1;
 
-		m_ComponentArray[indexOfRemovedEntity] = m_ComponentArray[indexOfLastElement];
+		m_Data[indexOfRemovedEntity] = m_Data[indexOfLastElement];
+		m_ChangeTicks[indexOfRemovedEntity] = m_ChangeTicks[indexOfLastElement];
+		m_Changes.Push(indexOfRemovedEntity);
 
 		// Update map to point to moved spot.
-		Entity entityOfLastElement = m_IndexToEntityMap[indexOfLastElement];
+		Entity entityOfLastElement = m_IndexToEntity[indexOfLastElement];
 		m_EntityToIndexMap[entityOfLastElement] = indexOfRemovedEntity;
-		m_IndexToEntityMap[indexOfRemovedEntity] = entityOfLastElement;
+		m_IndexToEntity[indexOfRemovedEntity] = entityOfLastElement;
 
 		// Remove the entity from map whose component has been removed.
 		m_EntityToIndexMap.erase(entity);
-		m_IndexToEntityMap.erase(indexOfLastElement);
 
 		m_Size--;
+		m_RemovedCount++;
 	}
 
+	// Mutable access, stamps the component as changed.
 	T& GetData(Entity entity)
 	{
-		assert(m_EntityToIndexMap.find(entity) != m_EntityToIndexMap.end() && "Retrieving non-existent component.");
+		auto it = m_EntityToIndexMap.find(entity);
+		assert(it != m_EntityToIndexMap.end() && "Retrieving non-existent component.");
+
+		size_t index = it->second;
+		m_Changes.Stamp(index, m_ChangeTicks[index]);
+		m_ChangeTicks[index] = m_CurrentTick;
 
-		return m_ComponentArray[m_EntityToIndexMap[entity]];
+		return m_Data[index];
+	}
+
+	const T& ReadData(Entity entity) const
+	{
+		auto it = m_EntityToIndexMap.find(entity);
+		assert(it != m_EntityToIndexMap.end() && "Retrieving non-existent component.");
+
+		return m_Data[it->second];
 	}
 
 	void EntityDestroyed(Entity entity) override
@@ -85,16 +195,356 @@ void InsertData(Entity entity, T&& component)
 		}
 	}
 
+	size_t Size() const override { return m_Size; }
+	size_t ComponentSize() const override { return sizeof(T); }
+	size_t ComponentAlignment() const override { return alignof(T); }
+	std::uint32_t LayoutVersion() const override { return ComponentVersion<T>::value; }
+	bool IsTriviallyCopyable() const override { return std::is_trivially_copyable_v<T>; }
+	const void* RawData() const override { return m_Data; }
+
+	// Typed view of the dense storage, m_Size components long.
+	const T* Data() const { return m_Data; }
+
+	Entity EntityAtIndex(size_t index) const override
+	{
+		assert(index < m_Size && "Index out of range.");
+
+		return m_IndexToEntity[index];
+	}
+
+	const Entity* RawEntities() const override { return m_IndexToEntity.data(); }
+	const Tick* ChangeTicks() const override { return m_ChangeTicks.data(); }
+
+	bool HasData(Entity entity) const override
+	{
+		return m_EntityToIndexMap.find(entity) != m_EntityToIndexMap.end();
+	}
+
+	void* RawComponent(Entity entity) override
+	{
+		return &GetData(entity);
+	}
+
+	void InsertRaw(Entity entity, const void* component) override
+	{
+		InsertData(entity, *static_cast<const T*>(component));
+	}
+
+	void InsertCopies(Entity source, const Entity* entities, size_t count) override
+	{
+		auto it = m_EntityToIndexMap.find(source);
+		assert(it != m_EntityToIndexMap.end() && "Copying non-existent component.");
+		assert(m_Size + count <= MAX_ENTITIES && "Too many components.");
+
+		if (count == 0)
+			return;
+
+		// Copy first, the source may live in a mapped column that is about to be dropped.
+		const T component = m_Data[it->second];
+
+		if (m_Mapping && m_Size + count > m_MappedCount)
+		{
+			Detach();
+		}
+
+		size_t first = m_Size;
+		T* rows = m_Data + first;
+
+		if constexpr (std::is_trivially_copyable_v<T>)
+		{
+			// Double the copied rows with every memcpy.
+			std::memcpy(rows, &component, sizeof(T));
+			for (size_t copied = 1; copied < count; copied *= 2)
+			{
+				std::memcpy(rows + copied, rows, std::min(copied, count - copied) * sizeof(T));
+			}
+		}
+		else
+		{
+			std::fill_n(rows, count, component);
+		}
+
+		std::fill_n(m_ChangeTicks.begin() + first, count, m_CurrentTick);
+		m_Changes.PushRange(first, count);
+		std::copy(entities, entities + count, m_IndexToEntity.begin() + first);
+
+		m_EntityToIndexMap.reserve(m_Size + count);
+		for (size_t i = 0; i < count; i++)
+		{
+			assert(m_EntityToIndexMap.find(entities[i]) == m_EntityToIndexMap.end() && "Component added to same entity more than once.");
+			m_EntityToIndexMap.emplace(entities[i], first + i);
+		}
+
+		m_Size += count;
+		m_AddedCount += count;
+	}
+
+	void MoveFrom(IComponentArray& source, const Entity* remap) override
+	{
+		auto& other = static_cast<ComponentArray<T>&>(source);
+		size_t count = other.m_Size;
+		assert(m_Size + count <= MAX_ENTITIES && "Too many components.");
+
+		if (m_Mapping && m_Size + count > m_MappedCount)
+		{
+			Detach();
+		}
+
+		size_t first = m_Size;
+
+		// The whole column at once.
+		if constexpr (std::is_trivially_copyable_v<T>)
+		{
+			std::memcpy(m_Data + first, other.m_Data, count * sizeof(T));
+		}
+		else
+		{
+			std::move(other.m_Data, other.m_Data + count, m_Data + first);
+		}
+
+		std::fill_n(m_ChangeTicks.begin() + first, count, m_CurrentTick);
+		m_Changes.PushRange(first, count);
+
+		m_EntityToIndexMap.reserve(m_Size + count);
+		for (size_t i = 0; i < count; i++)
+		{
+			Entity entity = remap[other.m_IndexToEntity[i]];
+
+			m_IndexToEntity[first + i] = entity;
+			m_EntityToIndexMap.emplace(entity, first + i);
+		}
+
+		m_Size += count;
+		m_AddedCount += count;
+
+		other.m_EntityToIndexMap.clear();
+		other.m_Size = 0;
+		other.m_RemovedCount += count;
+		if (other.m_Mapping)
+		{
+			other.m_Data = other.m_ComponentArray.data();
+			other.m_Mapping.reset();
+			other.m_MappedCount = 0;
+		}
+	}
+
+	void MoveEntities(const EntityMove* moves, size_t count) override
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			auto it = m_EntityToIndexMap.find(moves[i].from);
+			if (it == m_EntityToIndexMap.end())
+				continue;
+
+			size_t index = it->second;
+			m_EntityToIndexMap.erase(it);
+			m_EntityToIndexMap.emplace(moves[i].to, index);
+			m_IndexToEntity[index] = moves[i].to;
+			m_Changes.Stamp(index, m_ChangeTicks[index]);
+			m_ChangeTicks[index] = m_CurrentTick;
+		}
+	}
+
+	// Reorder the dense storage by compare(const T&, const T&), e.g. by spatial cell or material, so systems walking
+	// it touch memory in that order. Equal components end up in entity order, so the result doesn't depend on the
+	// order before. Components keep their change ticks, sorting isn't a change, but pointers into the storage go stale.
+	template<typename Compare>
+	void Sort(Compare compare)
+	{
+		PrepareSort();
+
+		std::sort(m_SortOrder.begin(), m_SortOrder.end(), [this, &compare](std::uint32_t a, std::uint32_t b)
+		{
+			if (compare(m_Data[a], m_Data[b]))
+				return true;
+			if (compare(m_Data[b], m_Data[a]))
+				return false;
+			return m_IndexToEntity[a] < m_IndexToEntity[b];
+		});
+
+		ApplySortOrder();
+	}
+
+	// Reorder the dense storage to follow leader's, the components of entities leader has come first in leader's order,
+	// the rest follow in their current order. If both hold the same entities, index i is the same entity in both.
+	void SortAs(const IComponentArray& leader)
+	{
+		PrepareSort();
+
+		// m_SortOrder is reused as the visited marks, the new order is built in place from the front.
+		size_t placed = 0;
+		const Entity* leaderEntities = leader.RawEntities();
+		for (size_t leaderIndex = 0; leaderIndex < leader.Size(); leaderIndex++)
+		{
+			auto it = m_EntityToIndexMap.find(leaderEntities[leaderIndex]);
+			if (it == m_EntityToIndexMap.end())
+				continue;
+
+			m_SortOrder[it->second] |= SORT_PLACED;
+			m_SortScratch[placed++] = static_cast<std::uint32_t>(it->second);
+		}
+
+		for (size_t index = 0; index < m_Size; index++)
+		{
+			if (!(m_SortOrder[index] & SORT_PLACED))
+				m_SortScratch[placed++] = static_cast<std::uint32_t>(index);
+		}
+
+		std::copy(m_SortScratch.begin(), m_SortScratch.begin() + m_Size, m_SortOrder.begin());
+
+		ApplySortOrder();
+	}
+
+	size_t Capacity() const override { return m_Mapping ? m_MappedCount : MAX_ENTITIES; }
+	size_t IndexBucketCount() const override { return m_EntityToIndexMap.bucket_count(); }
+	double IndexLoadFactor() const override { return m_EntityToIndexMap.load_factor(); }
+	bool IsMapped() const override { return static_cast<bool>(m_Mapping); }
+
+	void MapData(void* data, const Entity* entities, size_t count, std::shared_ptr<void> mapping) override
+	{
+		assert(m_Size == 0 && "Can only map data into an empty component array.");
+		assert(count <= MAX_ENTITIES && "Mapped column is larger than the entity cap.");
+		assert(std::is_trivially_copyable_v<T> && "Only trivially copyable components can be used in place.");
+		assert(reinterpret_cast<std::uintptr_t>(data) % alignof(T) == 0 && "Mapped column is misaligned.");
+
+		m_Data = static_cast<T*>(data);
+		m_Mapping = std::move(mapping);
+		m_MappedCount = count;
+
+		BuildIndex(entities, count);
+	}
+
+	void CopyData(const void* data, const Entity* entities, size_t count) override
+	{
+		assert(m_Size == 0 && "Can only copy data into an empty component array.");
+		assert(count <= MAX_ENTITIES && "Copied column is larger than the entity cap.");
+
+		// An empty array can still point into a file mapped by an earlier load.
+		if (m_Mapping)
+		{
+			Detach();
+		}
+
+		if constexpr (std::is_trivially_copyable_v<T>)
+		{
+			std::memcpy(m_ComponentArray.data(), data, count * sizeof(T));
+		}
+		else
+		{
+			assert(false && "Only trivially copyable components can be copied from raw data.");
+		}
+
+		BuildIndex(entities, count);
+	}
+
 private:
+	static constexpr std::uint32_t SORT_PLACED = std::uint32_t(1) << 31;
+
+	// Identity order in m_SortOrder, owned storage to write into.
+	void PrepareSort()
+	{
+		if (m_Mapping)
+		{
+			Detach();
+		}
+
+		m_SortOrder.resize(m_Size);
+		m_SortScratch.resize(m_Size);
+		for (size_t index = 0; index < m_Size; index++)
+		{
+			m_SortOrder[index] = static_cast<std::uint32_t>(index);
+		}
+	}
+
+	// Move the slot m_SortOrder[i] to i for every i, following the permutation's cycles so every component
+	// is moved once without a second buffer of components, then point the index at the new slots.
+	void ApplySortOrder()
+	{
+		for (std::uint32_t start = 0; start < m_Size; start++)
+		{
+			if (m_SortOrder[start] == start)
+				continue;
+
+			T component = std::move(m_Data[start]);
+			Entity entity = m_IndexToEntity[start];
+			Tick tick = m_ChangeTicks[start];
+
+			std::uint32_t hole = start;
+			while (m_SortOrder[hole] != start)
+			{
+				std::uint32_t next = m_SortOrder[hole];
+				m_Data[hole] = std::move(m_Data[next]);
+				m_IndexToEntity[hole] = m_IndexToEntity[next];
+				m_ChangeTicks[hole] = m_ChangeTicks[next];
+
+				m_SortOrder[hole] = hole;
+				hole = next;
+			}
+
+			m_Data[hole] = std::move(component);
+			m_IndexToEntity[hole] = entity;
+			m_ChangeTicks[hole] = tick;
+			m_SortOrder[hole] = hole;
+		}
+
+		for (size_t index = 0; index < m_Size; index++)
+		{
+			m_EntityToIndexMap[m_IndexToEntity[index]] = index;
+		}
+
+		// Changed components may have moved to slots the dirty list doesn't name.
+		m_Changes.Overflow();
+	}
+
+	void BuildIndex(const Entity* entities, size_t count)
+	{
+		for (size_t index = 0; index < count; index++)
+		{
+			m_EntityToIndexMap[entities[index]] = index;
+			m_IndexToEntity[index] = entities[index];
+			m_ChangeTicks[index] = m_CurrentTick;
+		}
+		m_Changes.PushRange(0, count);
+
+		m_Size = count;
+		m_AddedCount += count;
+	}
+
+	// Copy the mapped components into the owned array and drop the mapping.
+	void Detach()
+	{
+		std::copy(m_Data, m_Data + m_Size, m_ComponentArray.begin());
+
+		m_Data = m_ComponentArray.data();
+		m_Mapping.reset();
+		m_MappedCount = 0;
+	}
+
 	// Contiguous packed(packed in the sense that all the alive components will be together) array of components of Type T.
 	std::array<T, MAX_ENTITIES> m_ComponentArray;
 
+	// Components actually in use, either m_ComponentArray or a mapped world file column (copy-on-write).
+	T* m_Data{ m_ComponentArray.data() };
+
+	// Keeps a mapped world file alive while m_Data points into it.
+	std::shared_ptr<void> m_Mapping;
+
+	// Number of components available in the mapped column.
+	size_t m_MappedCount{ 0 };
+
 	// Map from entity IDs to array indices.
-	std::unordered_map<Entity, size_t> m_EntityToIndexMap;
+	std::pmr::unordered_map<Entity, size_t> m_EntityToIndexMap;
 
-	// Map from the array indices to entity IDs.
-	std::unordered_map<size_t, Entity> m_IndexToEntityMap;
+	// Array indices to entity IDs, dense like the components themselves.
+	std::array<Entity, MAX_ENTITIES> m_IndexToEntity;
+
+	// Tick of the last insert or mutable access of every component, moved along with it.
+	std::array<Tick, MAX_ENTITIES> m_ChangeTicks;
 
 	// Size of valid entries in the array.
-	size_t m_Size;
+	size_t m_Size{ 0 };
+
+	// Scratch of Sort and SortAs, kept so sorting every frame doesn't allocate.
+	std::pmr::vector<std::uint32_t> m_SortOrder;
+	std::pmr::vector<std::uint32_t> m_SortScratch;
 };
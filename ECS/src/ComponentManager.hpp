@@ -1,55 +1,118 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <unordered_map>
 #include <memory>
+#include <cstring>
 
 #include "Base.hpp"
 #include "ComponentArray.hpp"
+#include "ComponentRegistry.hpp"
+#include "Layout.hpp"
+#include "Memory.hpp"
+#include "SharedComponentArray.hpp"
 
 class ComponentManager
 {
 public:
+	explicit ComponentManager(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		: m_Resource(resource)
+	{
+	}
+
 	template<typename T>
 	void RegisterComponent()
 	{
-		const char* typeName = typeid(T).name();
-		assert(m_ComponentTypes.find(typeName) == m_ComponentTypes.end() && "Cannot register a type more than once.");
-
-		// Add this component type to the component type map.
-		m_ComponentTypes.insert({ typeName, m_NextComponentType });
+		RegisterArray<T, ComponentArray<T>>();
+	}
 
-		// Create a ComponentArray pointer and add it to the map
-		m_ComponentArrays.insert({ typeName, std::make_shared<ComponentArray<T>>() });
+	// Entities share deduplicated values of T instead of holding copies, see SharedComponentArray.
+	template<typename T>
+	void RegisterSharedComponent()
+	{
+		RegisterArray<T, SharedComponentArray<T>>();
+		m_SharedTypes.set(GetComponentType<T>(), true);
+	}
 
-		m_NextComponentType++;
+	template<typename T>
+	bool IsShared()
+	{
+		return m_SharedTypes.test(GetComponentType<T>());
 	}
 
 	// Get the component type after registering, so that signature can be created.
+	// Lookups never modify the maps, systems of a parallel stage can call this and the accessors below at once.
 	template<typename T>
-	ComponentType GetComponentType()
+	ComponentType GetComponentType() const
 	{
-		const char* typeName = typeid(T).name();
-		assert(m_ComponentTypes.find(typeName) != m_ComponentTypes.end() && "Component not registered before use.");
+		auto it = m_ComponentTypes.find(typeid(T).name());
+		assert(it != m_ComponentTypes.end() && "Component not registered before use.");
 
-		return m_ComponentTypes[typeName];
+		return it->second;
 	}
 
 	template<typename T>
 	void AddComponent(Entity entity, T&& component)
 	{
-		GetComponentArray<T>()->InsertData(entity, std::forward<T>(component));
+		ArrayOf<std::decay_t<T>>()->InsertData(entity, std::forward<T>(component));
 	}
 
 	template<typename T>
 	void RemoveComponent(Entity entity)
 	{
-		GetComponentArray<T>()->RemoveData(entity);
+		ArrayOf<T>()->RemoveData(entity);
 	}
 
 	template<typename T>
 	T& GetComponent(Entity entity)
 	{
-		return GetComponentArray<T>()->GetData(entity);
+		return ArrayOf<T>()->GetData(entity);
+	}
+
+	// Read only access, unlike GetComponent it doesn't mark the component as changed.
+	template<typename T>
+	const T& ReadComponent(Entity entity) const
+	{
+		return ArrayOf<T>()->ReadData(entity);
+	}
+
+	// Reorder U's dense storage to follow T's, T may be shared.
+	template<typename T, typename U>
+	void SortAs()
+	{
+		GetComponentArray<U>()->SortAs(*m_ComponentArraysByType[GetComponentType<T>()]);
+	}
+
+	// Memory of a component type, its fixed size storage included.
+	MemoryTracker& GetMemoryTracker(ComponentType type)
+	{
+		assert(m_Trackers[type] && "Component not registered before use.");
+
+		return *m_Trackers[type];
+	}
+
+	void SetCurrentTick(Tick tick)
+	{
+		m_CurrentTick = tick;
+
+		for (const auto& pair : m_ComponentArrays)
+		{
+			pair.second->SetCurrentTick(tick);
+		}
+	}
+
+	// Give every entity a copy of each of source's components in signature, one bulk append per component array.
+	void CloneComponents(Entity source, Signature signature, const Entity* entities, size_t count)
+	{
+		for (ComponentType type = 0; signature.any(); type++)
+		{
+			if (signature.test(type))
+			{
+				m_ComponentArraysByType[type]->InsertCopies(source, entities, count);
+				signature.reset(type);
+			}
+		}
 	}
 
 	void EntityDestroyed(Entity entity)
@@ -63,24 +126,144 @@ public:
 		}
 	}
 
-private:
-	// Map from type string pointer to a component type.
-	std::unordered_map<const char*, ComponentType> m_ComponentTypes{};
+	void MoveEntities(const EntityMove* moves, size_t count)
+	{
+		for (const auto& pair : m_ComponentArrays)
+		{
+			pair.second->MoveEntities(moves, count);
+		}
+	}
 
-	// Map from type string pointer to a component array pointer.
-	std::unordered_map<const char*, std::shared_ptr<IComponentArray>> m_ComponentArrays;
+	// Look up a registered component array by its type name string, returns nullptr if it isn't registered.
+	// Unlike the typed accessors this compares the contents of the name, so it works with names read back from a file.
+	std::shared_ptr<IComponentArray> FindComponentArray(const char* typeName, ComponentType& outType) const
+	{
+		for (const auto& pair : m_ComponentArrays)
+		{
+			if (std::strcmp(pair.first, typeName) == 0)
+			{
+				outType = m_ComponentTypes.at(pair.first);
+				return pair.second;
+			}
+		}
+
+		return nullptr;
+	}
+
+	const std::unordered_map<const char*, std::shared_ptr<IComponentArray>>& GetComponentArrays() const { return m_ComponentArrays; }
+
+	// Nullptr if no component has this type in this world.
+	IComponentArray* GetComponentArrayByType(ComponentType type) const { return m_ComponentArraysByType[type]; }
+
+	// One entry per registered component, ordered by component type.
+	std::vector<ComponentLayout> GetComponentLayouts() const
+	{
+		std::vector<ComponentLayout> layouts;
+		layouts.reserve(m_ComponentArrays.size());
+
+		for (const auto& pair : m_ComponentArrays)
+		{
+			const IComponentArray& array = *pair.second;
+
+			ComponentLayout layout;
+			layout.name = pair.first;
+			layout.type = m_ComponentTypes.at(pair.first);
+			layout.count = array.Size();
+			layout.capacity = array.Capacity();
+			layout.componentSize = array.ComponentSize();
+			layout.storageBytes = layout.capacity * layout.componentSize;
+			layout.memory = m_Trackers[layout.type]->GetStats();
+			layout.indexBuckets = array.IndexBucketCount();
+			layout.indexLoadFactor = array.IndexLoadFactor();
+			layout.mapped = array.IsMapped();
+			layout.added = array.AddedCount();
+			layout.removed = array.RemovedCount();
 
-	// The component type to be assigned to the next component.
-	ComponentType m_NextComponentType{ 0 };
+			if (layout.memory.bytes > 0)
+				layout.fragmentation = 1.0 - std::min(1.0, double(layout.count * layout.componentSize) / double(layout.memory.bytes));
+
+			layouts.push_back(std::move(layout));
+		}
+
+		std::sort(layouts.begin(), layouts.end(), [](const ComponentLayout& a, const ComponentLayout& b) { return a.type < b.type; });
+
+		return layouts;
+	}
 
 	// Convenience function to get the statically casted pointer to the ComponentArray of type T.
+	// Also used by code that walks the dense storage directly, like spatial indices.
+	template<typename T>
+	std::shared_ptr<ComponentArray<T>> GetComponentArray() const
+	{
+		auto it = m_ComponentArrays.find(typeid(T).name());
+
+		assert(it != m_ComponentArrays.end() && "Component not registered before use.");
+		assert(!m_SharedTypes.test(GetComponentType<T>()) && "Shared component used as a regular one.");
+
+		return std::static_pointer_cast<ComponentArray<T>>(it->second);
+	}
+
 	template<typename T>
-	std::shared_ptr<ComponentArray<T>> GetComponentArray()
+	std::shared_ptr<SharedComponentArray<T>> GetSharedComponentArray() const
+	{
+		auto it = m_ComponentArrays.find(typeid(T).name());
+
+		assert(it != m_ComponentArrays.end() && "Component not registered before use.");
+		assert(m_SharedTypes.test(GetComponentType<T>()) && "Regular component used as a shared one.");
+
+		return std::static_pointer_cast<SharedComponentArray<T>>(it->second);
+	}
+
+private:
+	// Typed array without copying the shared_ptr, so threads accessing the same type don't contend on its count.
+	template<typename T>
+	ComponentArray<T>* ArrayOf() const
+	{
+		ComponentType type = GetComponentType<T>();
+		assert(!m_SharedTypes.test(type) && "Shared component used as a regular one.");
+
+		return static_cast<ComponentArray<T>*>(m_ComponentArraysByType[type]);
+	}
+
+	template<typename T, typename Array>
+	void RegisterArray()
 	{
 		const char* typeName = typeid(T).name();
+		assert(m_ComponentTypes.find(typeName) == m_ComponentTypes.end() && "Cannot register a type more than once.");
 
-		assert(m_ComponentArrays.find(typeName) != m_ComponentArrays.end() && "Component not registered before use.");
+		// Same type in every world, taken from the process-wide registry.
+		ComponentType type = ComponentRegistry::Get().GetType<T>();
+		m_ComponentTypes.insert({ typeName, type });
 
-		return std::static_pointer_cast<ComponentArray<T>>(m_ComponentArrays[typeName]);
+		// Everything of this component type is allocated through its own tracker, so its memory can be measured.
+		m_Trackers[type] = std::make_unique<MemoryTracker>(m_Resource);
+		MemoryTracker* tracker = m_Trackers[type].get();
+
+		// Create a component array pointer and add it to the map.
+		// Not value initialized like make_shared would, zeroing the whole storage would make new worlds expensive.
+		auto componentArray = std::shared_ptr<Array>(NewFromResource<Array>(tracker, tracker));
+		componentArray->SetCurrentTick(m_CurrentTick);
+		m_ComponentArrays.insert({ typeName, componentArray });
+		m_ComponentArraysByType[type] = componentArray.get();
 	}
+
+	std::pmr::memory_resource* m_Resource;
+
+	// Per component type, declared before the arrays so they outlive them.
+	std::array<std::unique_ptr<MemoryTracker>, MAX_COMPONENTS> m_Trackers;
+
+	// Map from type string pointer to a component type, a local copy of the registry's entries for this world.
+	std::unordered_map<const char*, ComponentType> m_ComponentTypes{};
+
+	// Map from type string pointer to a component array pointer.
+	std::unordered_map<const char*, std::shared_ptr<IComponentArray>> m_ComponentArrays;
+
+	// Component arrays indexed by component type, owned by m_ComponentArrays.
+	std::array<IComponentArray*, MAX_COMPONENTS> m_ComponentArraysByType{};
+
+	// Component types registered as shared.
+	Signature m_SharedTypes;
+
+	// Tick stamped on changes, kept in sync by the ECS.
+	Tick m_CurrentTick{ 0 };
 };
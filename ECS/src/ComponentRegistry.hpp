@@ -0,0 +1,109 @@
+#pragma once
+
+#include <mutex>
+#include <typeinfo>
+#include <unordered_map>
+
+#include "Base.hpp"
+
+/**
+ * Process-wide component type IDs. A component gets its ComponentType the first time any world registers it
+ * and keeps it in every other world, so signatures mean the same thing in all worlds and can be copied between them.
+ * World resources and relations get their types the same way, each from a separate range.
+ * Thread safe, so staging worlds can register their components on worker threads.
+ */
+class ComponentRegistry
+{
+public:
+	static ComponentRegistry& Get()
+	{
+		static ComponentRegistry s_Registry;
+		return s_Registry;
+	}
+
+	template<typename T>
+	ComponentType GetType()
+	{
+		return GetType(typeid(T).name());
+	}
+
+	ComponentType GetType(const char* typeName)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		auto it = m_ComponentTypes.find(typeName);
+		if (it != m_ComponentTypes.end())
+			return it->second;
+
+		assert(m_NextComponentType < MAX_COMPONENTS && "Too many component types.");
+
+		m_ComponentTypes.insert({ typeName, m_NextComponentType });
+		return m_NextComponentType++;
+	}
+
+	size_t GetTypeCount()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_NextComponentType;
+	}
+
+	// Looked up once per type, later calls only read a static.
+	template<typename T>
+	static ResourceType GetResourceType()
+	{
+		static const ResourceType s_Type = Get().GetResourceType(typeid(T).name());
+		return s_Type;
+	}
+
+	ResourceType GetResourceType(const char* typeName)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		auto it = m_ResourceTypes.find(typeName);
+		if (it != m_ResourceTypes.end())
+			return it->second;
+
+		assert(m_NextResourceType < MAX_RESOURCES && "Too many resource types.");
+
+		m_ResourceTypes.insert({ typeName, m_NextResourceType });
+		return m_NextResourceType++;
+	}
+
+	template<typename T>
+	static RelationType GetRelationType()
+	{
+		static const RelationType s_Type = Get().GetRelationType(typeid(T).name());
+		return s_Type;
+	}
+
+	RelationType GetRelationType(const char* typeName)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		auto it = m_RelationTypes.find(typeName);
+		if (it != m_RelationTypes.end())
+			return it->second;
+
+		assert(m_NextRelationType < MAX_RELATIONS && "Too many relation types.");
+
+		m_RelationTypes.insert({ typeName, m_NextRelationType });
+		return m_NextRelationType++;
+	}
+
+private:
+	ComponentRegistry() = default;
+
+	std::mutex m_Mutex;
+
+	// Map from type string pointer to a component type.
+	std::unordered_map<const char*, ComponentType> m_ComponentTypes{};
+
+	// The component type to be assigned to the next new component.
+	ComponentType m_NextComponentType{ 0 };
+
+	std::unordered_map<const char*, ResourceType> m_ResourceTypes{};
+	ResourceType m_NextResourceType{ 0 };
+
+	std::unordered_map<const char*, RelationType> m_RelationTypes{};
+	RelationType m_NextRelationType{ 0 };
+};
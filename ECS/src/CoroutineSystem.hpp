@@ -0,0 +1,434 @@
+#pragma once
+
+// Coroutine systems need C++20, the header is empty for older standards.
+#if defined(__cpp_impl_coroutine)
+
+#include <algorithm>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ECS.hpp"
+#include "JobSystem.hpp"
+#include "World.hpp"
+
+// What a suspended coroutine system is waiting for.
+enum class CoroutineWait : std::uint8_t
+{
+	None,
+	NextFrame,
+	Job,
+	System,
+	Condition
+};
+
+/**
+ * Return type of a coroutine system, e.g. CoroutineSystem Patrol(CoroutineScheduler& scheduler, ECS& ecs).
+ * The body runs on the scheduler's workers and suspends with co_await on one of the scheduler's awaitables.
+ * A coroutine system starts suspended and only runs once it's added to a scheduler.
+ */
+class CoroutineSystem
+{
+public:
+	struct promise_type
+	{
+		CoroutineSystem get_return_object() { return CoroutineSystem(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+
+		// The ECS doesn't use exceptions.
+		void unhandled_exception() { std::terminate(); }
+
+		CoroutineWait wait{ CoroutineWait::None };
+		std::function<void()> job;
+		std::function<bool()> condition;
+		std::uint32_t system{ 0 };
+	};
+
+	using Handle = std::coroutine_handle<promise_type>;
+
+	CoroutineSystem(CoroutineSystem&& other) noexcept
+		: m_Handle(std::exchange(other.m_Handle, nullptr))
+	{
+	}
+
+	CoroutineSystem& operator=(CoroutineSystem&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (m_Handle)
+				m_Handle.destroy();
+			m_Handle = std::exchange(other.m_Handle, nullptr);
+		}
+		return *this;
+	}
+
+	CoroutineSystem(const CoroutineSystem&) = delete;
+	CoroutineSystem& operator=(const CoroutineSystem&) = delete;
+
+	~CoroutineSystem()
+	{
+		if (m_Handle)
+			m_Handle.destroy();
+	}
+
+private:
+	friend class CoroutineScheduler;
+
+	explicit CoroutineSystem(Handle handle)
+		: m_Handle(handle)
+	{
+	}
+
+	Handle m_Handle;
+};
+
+/**
+ * Runs coroutine systems, for logic that waits on work spanning frames, like pathfinding or streamed assets,
+ * without blocking a thread or writing a state machine by hand.
+ * Every Update resumes the systems that are ready in rounds: the ready systems are split into stages of systems
+ * whose SystemAccess doesn't conflict, like a World phase, and stages with more than one system are resumed on
+ * the job system. A system runs until its next co_await:
+ * - NextFrame() resumes it on the next Update.
+ * - RunJob(fn) submits fn to the job system in the background, Update doesn't wait for it. The system resumes on
+ *   the first Update after fn finished. Jobs must not touch the world, they compute on data they own. Without a
+ *   job system fn runs right away and the system resumes on the next Update.
+ * - WaitFor(id) resumes it in the round after the other system finished.
+ * - WaitUntil(predicate) checks the predicate at the start of every Update on the calling thread.
+ * Call Update from the thread driving the frame, e.g. as a World system with the default exclusive access,
+ * never from inside a job.
+ */
+class CoroutineScheduler
+{
+public:
+	using SystemId = std::uint32_t;
+
+	struct NextFrameAwaiter
+	{
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(CoroutineSystem::Handle handle) const noexcept { handle.promise().wait = CoroutineWait::NextFrame; }
+		void await_resume() const noexcept {}
+	};
+
+	struct JobAwaiter
+	{
+		std::function<void()> job;
+
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(CoroutineSystem::Handle handle)
+		{
+			handle.promise().wait = CoroutineWait::Job;
+			handle.promise().job = std::move(job);
+		}
+		void await_resume() const noexcept {}
+	};
+
+	struct SystemAwaiter
+	{
+		const CoroutineScheduler* scheduler;
+		SystemId system;
+
+		bool await_ready() const noexcept { return scheduler->IsDone(system); }
+		void await_suspend(CoroutineSystem::Handle handle) const noexcept
+		{
+			handle.promise().wait = CoroutineWait::System;
+			handle.promise().system = system;
+		}
+		void await_resume() const noexcept {}
+	};
+
+	struct ConditionAwaiter
+	{
+		std::function<bool()> condition;
+
+		bool await_ready() const { return condition(); }
+		void await_suspend(CoroutineSystem::Handle handle)
+		{
+			handle.promise().wait = CoroutineWait::Condition;
+			handle.promise().condition = std::move(condition);
+		}
+		void await_resume() const noexcept {}
+	};
+
+	// Without a job system everything runs on the thread calling Update.
+	explicit CoroutineScheduler(JobSystem* jobs = nullptr)
+		: m_Jobs(jobs)
+	{
+	}
+
+	// Jobs still running reference the systems' frames, they have to finish first.
+	~CoroutineScheduler()
+	{
+		std::unique_lock<std::mutex> lock(m_JobMutex);
+		m_JobDone.wait(lock, [this]() { return m_JobsInFlight == 0; });
+	}
+
+	CoroutineScheduler(const CoroutineScheduler&) = delete;
+	CoroutineScheduler& operator=(const CoroutineScheduler&) = delete;
+
+	// The system first runs on the next Update. IDs aren't reused. Not from systems resumed on the job system.
+	SystemId Add(const char* name, CoroutineSystem system, SystemAccess access = SystemAccess())
+	{
+		assert(system.m_Handle && "Adding an empty coroutine system.");
+
+		SystemId id = static_cast<SystemId>(m_Systems.size());
+		m_Systems.push_back({ name, std::move(system), access, false, {} });
+		m_NextFrame.push_back(id);
+
+		return id;
+	}
+
+	// Awaitables for the systems' co_await.
+	NextFrameAwaiter NextFrame() const { return {}; }
+	JobAwaiter RunJob(std::function<void()> job) const { return { std::move(job) }; }
+	SystemAwaiter WaitFor(SystemId system) const { return { this, system }; }
+	ConditionAwaiter WaitUntil(std::function<bool()> condition) const { return { std::move(condition) }; }
+
+	// Resume every system that is ready, until all of them wait for a later frame or finished.
+	void Update()
+	{
+		std::vector<SystemId>& ready = m_Ready;
+		ready.swap(m_NextFrame);
+
+		{
+			std::lock_guard<std::mutex> lock(m_JobMutex);
+			ready.insert(ready.end(), m_FinishedJobs.begin(), m_FinishedJobs.end());
+			m_FinishedJobs.clear();
+		}
+
+		for (size_t i = 0; i < m_Conditions.size();)
+		{
+			SystemId id = m_Conditions[i];
+			if (Promise(id).condition())
+			{
+				Promise(id).condition = nullptr;
+				ready.push_back(id);
+				m_Conditions[i] = m_Conditions.back();
+				m_Conditions.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		m_Stats = {};
+		while (!ready.empty())
+		{
+			ResumeRound(ready);
+			m_Stats.rounds++;
+			m_Stats.resumed += static_cast<std::uint32_t>(ready.size());
+
+			std::vector<SystemId>& next = m_Resumed;
+			next.clear();
+			for (SystemId id : ready)
+			{
+				Suspended(id, next);
+			}
+
+			ready.swap(next);
+		}
+		ready.clear();
+	}
+
+	bool IsDone(SystemId system) const { return m_Systems[system].done; }
+
+	// Jobs submitted by RunJob that haven't finished yet.
+	std::uint32_t GetJobsInFlight() const
+	{
+		std::lock_guard<std::mutex> lock(m_JobMutex);
+		return m_JobsInFlight;
+	}
+
+	// Systems that haven't finished.
+	size_t GetRunningCount() const
+	{
+		return static_cast<size_t>(std::count_if(m_Systems.begin(), m_Systems.end(), [](const Entry& entry) { return !entry.done; }));
+	}
+
+	struct Stats
+	{
+		// During the last Update, jobs counts the ones submitted.
+		std::uint32_t rounds{ 0 };
+		std::uint32_t resumed{ 0 };
+		std::uint32_t jobs{ 0 };
+	};
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	struct Entry
+	{
+		std::string name;
+		CoroutineSystem system;
+		SystemAccess access;
+		bool done;
+
+		// Systems waiting for this one to finish.
+		std::vector<SystemId> waiters;
+	};
+
+	CoroutineSystem::promise_type& Promise(SystemId id) { return m_Systems[id].system.m_Handle.promise(); }
+
+	// Resume the systems in stages of non-conflicting access, in the order they became ready.
+	// Every system goes into the stage after the last one it conflicts with, like in a World phase. Stages are
+	// tested against the union of their systems' access, latest first, so rounds of many systems stay linear.
+	void ResumeRound(const std::vector<SystemId>& ready)
+	{
+		for (auto& stage : m_Stages)
+		{
+			stage.clear();
+		}
+		m_StageAccess.clear();
+
+		for (SystemId id : ready)
+		{
+			const SystemAccess& access = m_Systems[id].access;
+
+			size_t stage = m_StageAccess.size();
+			while (stage > 0 && !access.ConflictsWith(m_StageAccess[stage - 1]))
+			{
+				stage--;
+			}
+
+			if (stage == m_StageAccess.size())
+			{
+				m_StageAccess.push_back(access);
+				if (stage >= m_Stages.size())
+					m_Stages.resize(stage + 1);
+			}
+			else
+			{
+				SystemAccess& merged = m_StageAccess[stage];
+				merged.reads |= access.reads;
+				merged.writes |= access.writes;
+				merged.resourceReads |= access.resourceReads;
+				merged.resourceWrites |= access.resourceWrites;
+			}
+			m_Stages[stage].push_back(id);
+		}
+
+		for (const auto& stage : m_Stages)
+		{
+			if (stage.empty())
+				break;
+
+			if (stage.size() == 1 || m_Jobs == nullptr)
+			{
+				for (SystemId id : stage)
+				{
+					Resume(id);
+				}
+			}
+			else
+			{
+				m_Jobs->Run(static_cast<std::uint32_t>(stage.size()), [&](std::uint32_t index)
+				{
+					Resume(stage[index]);
+				});
+			}
+		}
+	}
+
+	void Resume(SystemId id)
+	{
+		Promise(id).wait = CoroutineWait::None;
+		m_Systems[id].system.m_Handle.resume();
+	}
+
+	// File the system under what it waits for now, systems that can go on this Update are appended to next.
+	void Suspended(SystemId id, std::vector<SystemId>& next)
+	{
+		Entry& entry = m_Systems[id];
+		if (entry.system.m_Handle.done())
+		{
+			entry.done = true;
+			entry.system = CoroutineSystem(nullptr);
+			next.insert(next.end(), entry.waiters.begin(), entry.waiters.end());
+			entry.waiters.clear();
+			return;
+		}
+
+		CoroutineSystem::promise_type& promise = Promise(id);
+		switch (promise.wait)
+		{
+		case CoroutineWait::NextFrame:
+			m_NextFrame.push_back(id);
+			break;
+		case CoroutineWait::Job:
+			SubmitJob(id);
+			break;
+		case CoroutineWait::System:
+			if (m_Systems[promise.system].done)
+				next.push_back(id);
+			else
+				m_Systems[promise.system].waiters.push_back(id);
+			break;
+		case CoroutineWait::Condition:
+			m_Conditions.push_back(id);
+			break;
+		default:
+			assert(false && "Coroutine system suspended without a scheduler awaitable.");
+			break;
+		}
+	}
+
+	// The job owns its function, the promise isn't touched again until the system resumes.
+	void SubmitJob(SystemId id)
+	{
+		std::function<void()> job = std::move(Promise(id).job);
+		Promise(id).job = nullptr;
+		m_Stats.jobs++;
+
+		{
+			std::lock_guard<std::mutex> lock(m_JobMutex);
+			m_JobsInFlight++;
+		}
+
+		auto run = [this, id, job = std::move(job)]()
+		{
+			job();
+
+			std::lock_guard<std::mutex> lock(m_JobMutex);
+			m_FinishedJobs.push_back(id);
+			m_JobsInFlight--;
+			m_JobDone.notify_all();
+		};
+
+		if (m_Jobs)
+			m_Jobs->Submit(std::move(run));
+		else
+			run();
+	}
+
+	JobSystem* m_Jobs;
+
+	// Indexed by SystemId.
+	std::vector<Entry> m_Systems;
+
+	std::vector<SystemId> m_NextFrame;
+	std::vector<SystemId> m_Conditions;
+
+	// Systems whose job finished, filled by the job threads.
+	mutable std::mutex m_JobMutex;
+	std::condition_variable m_JobDone;
+	std::vector<SystemId> m_FinishedJobs;
+	std::uint32_t m_JobsInFlight{ 0 };
+
+	// Scratch kept so a steady Update doesn't allocate, stages past the last used one are empty.
+	std::vector<SystemId> m_Ready;
+	std::vector<SystemId> m_Resumed;
+	std::vector<std::vector<SystemId>> m_Stages;
+	std::vector<SystemAccess> m_StageAccess;
+
+	Stats m_Stats;
+};
+
+#endif
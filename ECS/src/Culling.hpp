@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "ECS.hpp"
+#include "SpatialHash.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ECS_CULL_SSE2
+#include <emmintrin.h>
+#endif
+
+// Write the indices of the boxes overlapping viewport to outIndices and return how many there are.
+// Boxes are passed as separate min/max arrays, outIndices needs room for count indices.
+inline size_t CullBounds(const float* minX, const float* minY, const float* maxX, const float* maxY, size_t count,
+	const Bounds& viewport, std::uint32_t* outIndices)
+{
+	size_t visible = 0;
+	size_t index = 0;
+
+#ifdef ECS_CULL_SSE2
+	const __m128 viewMinX = _mm_set1_ps(viewport.minX);
+	const __m128 viewMinY = _mm_set1_ps(viewport.minY);
+	const __m128 viewMaxX = _mm_set1_ps(viewport.maxX);
+	const __m128 viewMaxY = _mm_set1_ps(viewport.maxY);
+
+	for (; index + 4 <= count; index += 4)
+	{
+		__m128 inside = _mm_and_ps(
+			_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(minX + index), viewMaxX), _mm_cmpge_ps(_mm_loadu_ps(maxX + index), viewMinX)),
+			_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(minY + index), viewMaxY), _mm_cmpge_ps(_mm_loadu_ps(maxY + index), viewMinY)));
+
+		int mask = _mm_movemask_ps(inside);
+		if (mask == 0)
+			continue;
+
+		// Branchless compaction, every lane is written and only visible ones advance the output.
+		for (std::uint32_t lane = 0; lane < 4; lane++)
+		{
+			outIndices[visible] = static_cast<std::uint32_t>(index) + lane;
+			visible += (mask >> lane) & 1;
+		}
+	}
+#endif
+
+	for (; index < count; index++)
+	{
+		outIndices[visible] = static_cast<std::uint32_t>(index);
+		visible += (minX[index] <= viewport.maxX) & (maxX[index] >= viewport.minX) & (minY[index] <= viewport.maxY) & (maxY[index] >= viewport.minY);
+	}
+
+	return visible;
+}
+
+/**
+ * Produces the list of entities with a T component whose bounds overlap a viewport.
+ * Bounds are kept as dense min/max arrays in the component array's order, Update only recomputes the ones whose
+ * component or dependencies (see SpatialHash::BoundsFunction) changed since the last update, and Cull tests them
+ * 4 at a time with SSE2 where available.
+ * For big worlds where only a small part is on screen, CullIndexed asks a SpatialHash instead and only touches
+ * the cells around the viewport.
+ */
+template<typename T>
+class ViewportCuller
+{
+public:
+	using BoundsFunction = typename SpatialHash<T>::BoundsFunction;
+
+	ViewportCuller(BoundsFunction boundsFunction, Signature dependencies = Signature())
+		: m_BoundsFunction(boundsFunction), m_Dependencies(dependencies)
+	{
+	}
+
+	// Bring the dense bounds up to date with the components changed, added or removed since the last update.
+	void Update(ECS& ecs)
+	{
+		auto componentArray = ecs.GetComponentManager()->GetComponentArray<T>();
+
+		Tick tick = ecs.AdvanceTick();
+
+		const Tick* ticks = componentArray->ChangeTicks();
+		const Entity* entities = componentArray->RawEntities();
+		const T* components = componentArray->Data();
+		size_t size = componentArray->Size();
+
+		// Entities whose dependencies changed, marked first since the bounds are stored in T's order.
+		m_DependencyChanged.resize(MAX_ENTITIES, 0);
+		for (ComponentType dependency = 0; dependency < MAX_COMPONENTS; dependency++)
+		{
+			IComponentArray* array = m_Dependencies.test(dependency) ? ecs.GetComponentManager()->GetComponentArrayByType(dependency) : nullptr;
+			if (array == nullptr)
+				continue;
+
+			const Tick* dependencyTicks = array->ChangeTicks();
+			const Entity* dependents = array->RawEntities();
+			for (size_t index = 0; index < array->Size(); index++)
+			{
+				if (IsNewerTick(dependencyTicks[index], m_LastTick))
+					m_DependencyChanged[dependents[index]] = 1;
+			}
+		}
+
+		size_t oldSize = m_Entities.size();
+		m_Entities.resize(size);
+		m_MinX.resize(size);
+		m_MinY.resize(size);
+		m_MaxX.resize(size);
+		m_MaxY.resize(size);
+
+		for (size_t index = 0; index < size; index++)
+		{
+			// Removals swap the last component into the hole, so a different entity at an index counts as a change too.
+			if (index >= oldSize || m_Entities[index] != entities[index] || IsNewerTick(ticks[index], m_LastTick)
+				|| m_DependencyChanged[entities[index]])
+			{
+				Bounds bounds = m_BoundsFunction(ecs, entities[index], components[index]);
+
+				m_Entities[index] = entities[index];
+				m_MinX[index] = bounds.minX;
+				m_MinY[index] = bounds.minY;
+				m_MaxX[index] = bounds.maxX;
+				m_MaxY[index] = bounds.maxY;
+			}
+		}
+
+		if (m_Dependencies.any())
+			std::fill(m_DependencyChanged.begin(), m_DependencyChanged.end(), std::uint8_t(0));
+
+		m_LastTick = tick;
+	}
+
+	// Test every entity's bounds against the viewport.
+	const std::vector<Entity>& Cull(const Bounds& viewport)
+	{
+		m_Indices.resize(m_Entities.size());
+		size_t visible = CullBounds(m_MinX.data(), m_MinY.data(), m_MaxX.data(), m_MaxY.data(), m_Entities.size(), viewport, m_Indices.data());
+
+		m_Visible.resize(visible);
+		for (size_t i = 0; i < visible; i++)
+		{
+			m_Visible[i] = m_Entities[m_Indices[i]];
+		}
+
+		return m_Visible;
+	}
+
+	// Only visit the entities in the cells around the viewport, the index has to be updated by the caller.
+	const std::vector<Entity>& CullIndexed(const SpatialHash<T>& index, const Bounds& viewport)
+	{
+		m_Visible.clear();
+		index.Query(viewport, [this](Entity entity) { m_Visible.push_back(entity); });
+
+		return m_Visible;
+	}
+
+	// Result of the last cull.
+	const std::vector<Entity>& GetVisible() const { return m_Visible; }
+
+private:
+	BoundsFunction m_BoundsFunction;
+
+	// Component types the bounds function reads besides T.
+	Signature m_Dependencies;
+	std::vector<std::uint8_t> m_DependencyChanged;
+
+	// Bounds per component array index.
+	std::vector<Entity> m_Entities;
+	std::vector<float> m_MinX, m_MinY, m_MaxX, m_MaxY;
+
+	// Indices written by CullBounds.
+	std::vector<std::uint32_t> m_Indices;
+
+	std::vector<Entity> m_Visible;
+
+	// Tick closed by the last update.
+	Tick m_LastTick{ 0 };
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ECS.hpp"
+
+/**
+ * Compacts the entity ID space a few entities at a time. After heavy churn the living entities are spread over
+ * the whole ID range, so every pass that walks IDs or per ID arrays, like signatures, the spatial hash or the
+ * interpolation state, touches far more memory than there are entities. Each Step gives the highest living IDs
+ * the lowest free ones, until the living entities fill [0, count).
+ * Run a step between frames, after FlushObservers and with no job running, and bound it with maxMoves so the cost
+ * is spread over frames. Everything outside the ECS that keeps entity IDs, like a Hierarchy, the interpolation
+ * state of a World, game code handles or network IDs, has to be remapped with the moves of the step, through their
+ * MoveEntities or with Remap, before the next step.
+ */
+class EntityDefragmenter
+{
+public:
+	EntityDefragmenter(ECS& ecs)
+		: m_ECS(ecs), m_Remap(MAX_ENTITIES)
+	{
+		for (Entity entity = 0; entity < MAX_ENTITIES; entity++)
+		{
+			m_Remap[entity] = entity;
+		}
+	}
+
+	// Move at most maxMoves entities and return the moves made, which are valid until the next step.
+	const std::vector<EntityMove>& Step(std::uint32_t maxMoves)
+	{
+		// The previous step's entries go back to identity, so the table only ever holds one step.
+		for (const EntityMove& move : m_Moves)
+		{
+			m_Remap[move.from] = move.from;
+		}
+		m_Moves.clear();
+
+		const auto& entityManager = m_ECS.GetEntityManager();
+		Entity low = entityManager->FindFreeEntity(0);
+		Entity high = entityManager->FindLivingEntityBelow(MAX_ENTITIES);
+
+		while (m_Moves.size() < maxMoves && high != INVALID_ENTITY && low < high)
+		{
+			m_Moves.push_back({ high, low });
+			low = entityManager->FindFreeEntity(low + 1);
+			high = entityManager->FindLivingEntityBelow(high);
+		}
+
+		if (m_Moves.empty())
+			return m_Moves;
+
+		m_ECS.MoveEntities(m_Moves.data(), m_Moves.size());
+
+		for (const EntityMove& move : m_Moves)
+		{
+			m_Remap[move.from] = move.to;
+		}
+		m_MovedCount += m_Moves.size();
+
+		return m_Moves;
+	}
+
+	// ID of an entity held from before the last step.
+	Entity Remap(Entity entity) const { return m_Remap[entity]; }
+
+	// True once no living entity has an ID at or above the living count.
+	bool IsCompact() const
+	{
+		const auto& entityManager = m_ECS.GetEntityManager();
+		Entity high = entityManager->FindLivingEntityBelow(MAX_ENTITIES);
+
+		return high == INVALID_ENTITY || high < entityManager->GetLivingEntityCount();
+	}
+
+	// Entities moved since construction.
+	std::uint64_t GetMovedCount() const { return m_MovedCount; }
+
+private:
+	ECS& m_ECS;
+
+	// Old ID to new ID for the moves of the last step, identity everywhere else.
+	std::vector<Entity> m_Remap;
+
+	std::vector<EntityMove> m_Moves;
+	std::uint64_t m_MovedCount{ 0 };
+};
@@ -4,30 +4,122 @@
 #include "EntityManager.hpp"
 #include "ComponentManager.hpp"
 #include "SystemManager.hpp"
+#include "ObserverManager.hpp"
+#include "ResourceManager.hpp"
+#include "RelationManager.hpp"
+#include "Memory.hpp"
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 class ECS
 {
 public:
-	void Init() // Maybe: change to constructor.
+	// All memory of the world comes from resource, e.g. a HugePagePool or a pool on top of a PageArena.
+	// The resource has to outlive the ECS.
+	void Init(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) // Maybe: change to constructor.
 	{
-		m_EntityManager = std::make_unique<EntityManager>();
-		m_ComponentManager = std::make_unique<ComponentManager>();
-		m_SystemManager = std::make_unique<SystemManager>();
+		// Everything allocated through the old tracker has to be gone before it is replaced.
+		m_RelationManager.reset();
+		m_ResourceManager.reset();
+		m_ObserverManager.reset();
+		m_SystemManager.reset();
+		m_ComponentManager.reset();
+		m_EntityManager.reset();
+
+		m_Memory = std::make_unique<MemoryTracker>(resource);
+
+		m_EntityManager = NewFromResource<EntityManager>(m_Memory.get());
+		m_ComponentManager = std::make_unique<ComponentManager>(m_Memory.get());
+		m_SystemManager = std::make_unique<SystemManager>(m_Memory.get());
+		m_ObserverManager = std::make_unique<ObserverManager>();
+		m_ResourceManager = std::make_unique<ResourceManager>(m_Memory.get());
+		m_RelationManager = std::make_unique<RelationManager>(m_Memory.get());
+
+		m_CurrentTick = 1;
+		m_EntityManager->SetCurrentTick(m_CurrentTick);
+		m_ComponentManager->SetCurrentTick(m_CurrentTick);
 	}
 
 	// Entity methods.
+	// Returns INVALID_ENTITY once MAX_ENTITIES entities are alive.
 	Entity CreateEntity()
 	{
 		return m_EntityManager->CreateEntity();
 	}
 	
+	// Prefabs hold components like any entity, but systems and observers ignore them. Spawn copies with Instantiate.
+	Entity CreatePrefab()
+	{
+		Entity prefab = m_EntityManager->CreateEntity();
+		if (prefab == INVALID_ENTITY)
+			return prefab;
+
+		m_EntityManager->SetPrefab(prefab, true);
+
+		return prefab;
+	}
+
+	// Create count copies of prefab and write them to outEntities.
+	// Every component array gets one bulk append and system membership is updated once for the whole batch.
+	// If fewer than count IDs are left none are created and outEntities is filled with INVALID_ENTITY.
+	void Instantiate(Entity prefab, std::uint32_t count, Entity* outEntities)
+	{
+		assert(m_EntityManager->IsPrefab(prefab) && "Instantiating an entity that isn't a prefab.");
+
+		Signature signature = m_EntityManager->GetSignature(prefab);
+
+		if (!m_EntityManager->CreateEntities(count, signature, outEntities))
+		{
+			assert(false && "Can't create more entities, cap reached!");
+			std::fill_n(outEntities, count, INVALID_ENTITY);
+			return;
+		}
+
+		m_ComponentManager->CloneComponents(prefab, signature, outEntities, count);
+		m_SystemManager->EntitiesCreated(outEntities, count, signature);
+
+		m_ObserverManager->Record(ComponentEvent::Add, signature, outEntities, count);
+		m_ObserverManager->Record(ComponentEvent::Set, signature, outEntities, count);
+	}
+
+	std::vector<Entity> Instantiate(Entity prefab, std::uint32_t count)
+	{
+		std::vector<Entity> entities(count);
+		Instantiate(prefab, count, entities.data());
+
+		return entities;
+	}
+
 	void DestroyEntity(Entity entity)
 	{
-		m_EntityManager->DestroyEntity(entity);
-		m_ComponentManager->EntityDestroyed(entity);
-		m_SystemManager->EntityDestroyed(entity);
+		// Pairs of the entity go with it, relations with DestroySources take their sources along.
+		// The sources are drained from a work list, so a long chain of them doesn't grow the stack.
+		std::vector<Entity> cascade;
+		DestroySingle(entity, cascade);
+
+		while (!cascade.empty())
+		{
+			Entity source = cascade.back();
+			cascade.pop_back();
+
+			if (m_EntityManager->IsAlive(source))
+				DestroySingle(source, cascade);
+		}
+	}
+
+	// Give living entities new, free IDs, see EntityDefragmenter. Only between frames: no job may run and the
+	// observers must be flushed. Caches keyed by entity ID outside the world, like a Hierarchy, are remapped by
+	// their owner, snapshots taken before are invalid.
+	void MoveEntities(const EntityMove* moves, size_t count)
+	{
+		assert(!m_ObserverManager->HasPending() && "Flush the observers before moving entities.");
+
+		m_EntityManager->MoveEntities(moves, count);
+		m_ComponentManager->MoveEntities(moves, count);
+		m_SystemManager->MoveEntities(moves, count);
+		m_RelationManager->MoveEntities(moves, count);
 	}
 
 	// Component methods.
@@ -46,19 +138,30 @@ public:
 		signature.set(m_ComponentManager->GetComponentType<T>(), true);
 		m_EntityManager->SetSignature(entity, signature);
 
+		if (m_EntityManager->IsPrefab(entity))
+			return;
+
 		m_SystemManager->EntitySignatureChanged(entity, signature);
+
+		m_ObserverManager->Record(ComponentEvent::Add, m_ComponentManager->GetComponentType<T>(), entity);
+		m_ObserverManager->Record(ComponentEvent::Set, m_ComponentManager->GetComponentType<T>(), entity);
 	}
 
 	template<typename T>
 	void RemoveComponent(Entity entity)
 	{
+		bool prefab = m_EntityManager->IsPrefab(entity);
+		if (!prefab)
+			m_ObserverManager->Record(ComponentEvent::Remove, m_ComponentManager->GetComponentType<T>(), entity);
+
 		m_ComponentManager->RemoveComponent<T>(entity);
 
 		auto signature = m_EntityManager->GetSignature(entity);
 		signature.set(m_ComponentManager->GetComponentType<T>(), false);
 		m_EntityManager->SetSignature(entity, signature);
 
-		m_SystemManager->EntitySignatureChanged(entity, signature);
+		if (!prefab)
+			m_SystemManager->EntitySignatureChanged(entity, signature);
 	}
 
 	template<typename T>
@@ -67,12 +170,247 @@ public:
 		return m_ComponentManager->GetComponent<T>(entity);
 	}
 
+	// Assign a new value to an existing component and notify its OnSet observers.
+	template<typename T>
+	void SetComponent(Entity entity, T&& component)
+	{
+		using Component = std::decay_t<T>;
+
+		m_ComponentManager->GetComponent<Component>(entity) = std::forward<T>(component);
+		m_ObserverManager->Record(ComponentEvent::Set, m_ComponentManager->GetComponentType<Component>(), entity);
+	}
+
+	// Read only access, doesn't mark the component as changed.
+	template<typename T>
+	const T& ReadComponent(Entity entity)
+	{
+		return m_ComponentManager->ReadComponent<T>(entity);
+	}
+
+	// Reorder T's dense storage by compare(const T&, const T&), e.g. by spatial cell or material, so systems walking
+	// it go in that order. Pointers into the storage go stale, so don't sort while a system iterates it.
+	template<typename T, typename Compare>
+	void Sort(Compare compare)
+	{
+		m_ComponentManager->GetComponentArray<T>()->Sort(compare);
+	}
+
+	// Reorder U's dense storage to match T's, so walking both goes through memory in the same entity order.
+	template<typename T, typename U>
+	void SortAs()
+	{
+		m_ComponentManager->SortAs<T, U>();
+	}
+
+	// Shared component methods.
+	// Entities with equal values of a shared component point at one copy, T needs operator==.
+	template<typename T>
+	void RegisterSharedComponent()
+	{
+		m_ComponentManager->RegisterSharedComponent<T>();
+	}
+
+	// Adds the component if the entity doesn't have it yet, otherwise replaces its value.
+	template<typename T>
+	void SetSharedComponent(Entity entity, const T& value)
+	{
+		auto array = m_ComponentManager->GetSharedComponentArray<T>();
+		ComponentType type = m_ComponentManager->GetComponentType<T>();
+		bool added = !array->HasData(entity);
+
+		array->SetData(entity, value);
+
+		if (m_EntityManager->IsPrefab(entity))
+		{
+			if (added)
+				SetSignatureBit(entity, type, true);
+			return;
+		}
+
+		if (added)
+		{
+			m_SystemManager->EntitySignatureChanged(entity, SetSignatureBit(entity, type, true));
+			m_ObserverManager->Record(ComponentEvent::Add, type, entity);
+		}
+
+		m_ObserverManager->Record(ComponentEvent::Set, type, entity);
+	}
+
+	template<typename T>
+	void RemoveSharedComponent(Entity entity)
+	{
+		ComponentType type = m_ComponentManager->GetComponentType<T>();
+		bool prefab = m_EntityManager->IsPrefab(entity);
+		if (!prefab)
+			m_ObserverManager->Record(ComponentEvent::Remove, type, entity);
+
+		m_ComponentManager->GetSharedComponentArray<T>()->RemoveData(entity);
+
+		Signature signature = SetSignatureBit(entity, type, false);
+		if (!prefab)
+			m_SystemManager->EntitySignatureChanged(entity, signature);
+	}
+
+	template<typename T>
+	const T& GetSharedComponent(Entity entity)
+	{
+		return m_ComponentManager->GetSharedComponentArray<T>()->ReadData(entity);
+	}
+
+	// Call fn(value, entities, count) once per distinct value of T, with the entities having every component
+	// in required. Per value work, like binding a material, then happens once per group. Prefabs are left out.
+	// The filtered group lives in the call, so systems of a parallel stage can iterate at the same time.
+	template<typename T, typename F>
+	void ForEachSharedGroup(Signature required, F&& fn)
+	{
+		std::vector<Entity> matching;
+
+		m_ComponentManager->GetSharedComponentArray<T>()->ForEachGroup([&](const T& value, const Entity* entities, size_t count)
+		{
+			matching.clear();
+			for (size_t i = 0; i < count; i++)
+			{
+				Signature signature = m_EntityManager->GetSignature(entities[i]);
+				if ((signature & required) == required && !m_EntityManager->IsPrefab(entities[i]))
+					matching.push_back(entities[i]);
+			}
+
+			if (!matching.empty())
+				fn(value, matching.data(), matching.size());
+		});
+	}
+
 	template<typename T>
 	ComponentType GetComponentType()
 	{
 		return m_ComponentManager->GetComponentType<T>();
 	}
 
+	// Memory methods.
+	// Everything the world allocated through its resource.
+	MemoryStats GetMemoryStats() const
+	{
+		return m_Memory->GetStats();
+	}
+
+	// Bytes used by a component type, its storage and index included, and its budget.
+	template<typename T>
+	MemoryStats GetComponentMemory()
+	{
+		return m_ComponentManager->GetMemoryTracker(m_ComponentManager->GetComponentType<T>()).GetStats();
+	}
+
+	// Budgets are only reported through MemoryStats::OverBudget, allocations past them still succeed.
+	template<typename T>
+	void SetComponentBudget(size_t bytes)
+	{
+		m_ComponentManager->GetMemoryTracker(m_ComponentManager->GetComponentType<T>()).SetBudget(bytes);
+	}
+
+	// Resource methods.
+	// One value of T for the whole world, outside entity storage. Constructed from args, replacing the old value.
+	template<typename T, typename... Args>
+	T& SetResource(Args&&... args)
+	{
+		return m_ResourceManager->SetResource<T>(std::forward<Args>(args)...);
+	}
+
+	template<typename T>
+	T& GetResource()
+	{
+		return m_ResourceManager->GetResource<T>();
+	}
+
+	template<typename T>
+	bool HasResource()
+	{
+		return m_ResourceManager->FindResource<T>() != nullptr;
+	}
+
+	template<typename T>
+	void RemoveResource()
+	{
+		m_ResourceManager->RemoveResource<T>();
+	}
+
+	// For declaring resource access of systems, see SystemAccess.
+	template<typename T>
+	ResourceType GetResourceType()
+	{
+		return ComponentRegistry::GetResourceType<T>();
+	}
+
+	// Relation methods.
+	// Relations are tag types, a pair (R, target) on a source can be queried from both ends in O(result).
+	template<typename R>
+	void RegisterRelation(RelationCleanup cleanup = RelationCleanup::RemovePair)
+	{
+		m_RelationManager->RegisterRelation<R>(cleanup);
+	}
+
+	// Returns false if the pair already exists.
+	template<typename R>
+	bool AddPair(Entity source, Entity target)
+	{
+		assert(m_EntityManager->IsAlive(source) && m_EntityManager->IsAlive(target) && "Pair between entities that aren't alive.");
+
+		return m_RelationManager->GetRelation<R>().Add(source, target);
+	}
+
+	template<typename R>
+	bool RemovePair(Entity source, Entity target)
+	{
+		return m_RelationManager->GetRelation<R>().Remove(source, target);
+	}
+
+	template<typename R>
+	bool HasPair(Entity source, Entity target)
+	{
+		return m_RelationManager->GetRelation<R>().Has(source, target);
+	}
+
+	// The first target for relations with a single target per source, like ChildOf, or INVALID_ENTITY.
+	template<typename R>
+	Entity GetTarget(Entity source, size_t index = 0)
+	{
+		return m_RelationManager->GetRelation<R>().GetTarget(source, index);
+	}
+
+	// Call fn(target) for each pair (R, target) of source.
+	template<typename R, typename F>
+	void ForEachTarget(Entity source, F&& fn)
+	{
+		m_RelationManager->GetRelation<R>().ForEachTarget(source, std::forward<F>(fn));
+	}
+
+	// Call fn(source) for each source with the pair (R, target), e.g. all children of target.
+	template<typename R, typename F>
+	void ForEachSource(Entity target, F&& fn)
+	{
+		m_RelationManager->GetRelation<R>().ForEachSource(target, std::forward<F>(fn));
+	}
+
+	template<typename R>
+	RelationStorage& GetRelation()
+	{
+		return m_RelationManager->GetRelation<R>();
+	}
+
+	// Change tick methods.
+	// Closes the current tick and returns it, every change made afterwards is stamped with a newer tick.
+	// Consumers of changes remember the returned tick and next time look for changes newer than it.
+	Tick AdvanceTick()
+	{
+		Tick tick = m_CurrentTick++;
+
+		m_EntityManager->SetCurrentTick(m_CurrentTick);
+		m_ComponentManager->SetCurrentTick(m_CurrentTick);
+
+		return tick;
+	}
+
+	Tick GetCurrentTick() const { return m_CurrentTick; }
+
 	// System methods.
 	template<typename T, typename... Args>
 	std::shared_ptr<T> RegisterSystem(Args&&... params)
@@ -86,12 +424,86 @@ public:
 		m_SystemManager->SetSignature<T>(signature);
 	}
 
-	const std::unique_ptr<EntityManager>& GetEntityManager() const { return m_EntityManager; }
+	// Run the system every N ticks or spread its entities over several ticks, see SystemSchedule.
+	template<typename T>
+	void SetSystemSchedule(const SystemSchedule& schedule)
+	{
+		m_SystemManager->SetSchedule<T>(schedule);
+	}
+
+	template<typename T>
+	const SystemStats& GetSystemStats()
+	{
+		return m_SystemManager->GetStats<T>();
+	}
+
+	// Observer methods.
+	// Callbacks get the entities batched since the last FlushObservers, so call that once per frame.
+	template<typename T>
+	void OnAdd(ObserverCallback callback)
+	{
+		m_ObserverManager->AddObserver(ComponentEvent::Add, m_ComponentManager->GetComponentType<T>(), std::move(callback));
+	}
+
+	// The component is already gone when the callback runs, only the entity IDs are passed.
+	template<typename T>
+	void OnRemove(ObserverCallback callback)
+	{
+		m_ObserverManager->AddObserver(ComponentEvent::Remove, m_ComponentManager->GetComponentType<T>(), std::move(callback));
+	}
+
+	// Fired by AddComponent and SetComponent.
+	template<typename T>
+	void OnSet(ObserverCallback callback)
+	{
+		m_ObserverManager->AddObserver(ComponentEvent::Set, m_ComponentManager->GetComponentType<T>(), std::move(callback));
+	}
+
+	void FlushObservers()
+	{
+		m_ObserverManager->Flush(*this, *m_EntityManager);
+	}
+
+	const ResourcePtr<EntityManager>& GetEntityManager() const { return m_EntityManager; }
 	const std::unique_ptr<ComponentManager>& GetComponentManager() const { return m_ComponentManager; }
 	const std::unique_ptr<SystemManager>& GetSystemManager() const { return m_SystemManager; }
+	const std::unique_ptr<ObserverManager>& GetObserverManager() const { return m_ObserverManager; }
+	const std::unique_ptr<ResourceManager>& GetResourceManager() const { return m_ResourceManager; }
+	const std::unique_ptr<RelationManager>& GetRelationManager() const { return m_RelationManager; }
 
 private:
-	std::unique_ptr<EntityManager> m_EntityManager;
+	// Set or clear one component bit of the entity's signature and return the new signature.
+	Signature SetSignatureBit(Entity entity, ComponentType type, bool value)
+	{
+		Signature signature = m_EntityManager->GetSignature(entity);
+		signature.set(type, value);
+		m_EntityManager->SetSignature(entity, signature);
+
+		return signature;
+	}
+
+	// Destroy entity alone, the sources its relations take along are appended to cascade.
+	void DestroySingle(Entity entity, std::vector<Entity>& cascade)
+	{
+		if (!m_EntityManager->IsPrefab(entity))
+			m_ObserverManager->Record(ComponentEvent::Remove, m_EntityManager->GetSignature(entity), entity);
+
+		m_EntityManager->DestroyEntity(entity);
+		m_ComponentManager->EntityDestroyed(entity);
+		m_SystemManager->EntityDestroyed(entity);
+		m_RelationManager->EntityDestroyed(entity, cascade);
+	}
+
+	// Declared first so it outlives everything allocated through it.
+	std::unique_ptr<MemoryTracker> m_Memory;
+
+	ResourcePtr<EntityManager> m_EntityManager;
 	std::unique_ptr<ComponentManager> m_ComponentManager;
 	std::unique_ptr<SystemManager> m_SystemManager;
+	std::unique_ptr<ObserverManager> m_ObserverManager;
+	std::unique_ptr<ResourceManager> m_ResourceManager;
+	std::unique_ptr<RelationManager> m_RelationManager;
+
+	// Tick stamped on changes made right now.
+	Tick m_CurrentTick{ 0 };
 };
@@ -1,72 +1,480 @@
 #pragma once
 
-#include <queue>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include "Base.hpp"
+#include "ChangeList.hpp"
+#include "Layout.hpp"
 
+// Entity IDs a job thread takes from the shared queue at once.
+constexpr uint32_t ENTITY_BLOCK_SIZE = 64;
+
+// Number of per-thread ID caches, threads beyond that share a cache.
+constexpr size_t MAX_THREAD_CACHES = 64;
+
+/**
+ * CreateEntity is lock-free and can be called from any thread.
+ * The thread that created the manager takes IDs straight from the available queue, so IDs are handed out in order.
+ * Other threads take blocks of ENTITY_BLOCK_SIZE IDs with a single atomic operation and hand them out from a
+ * per-thread cache, so they don't contend with each other in the common case.
+ * Everything else (DestroyEntity, signatures, FlushThreadCaches) must only be called from one thread at a time.
+ */
 class EntityManager
 {
 public:
 	EntityManager()
+		: m_OwnerThread(std::this_thread::get_id())
 	{
 		// Initialize the queue with all possible entities.
 		for (Entity entity = 0; entity < MAX_ENTITIES; entity++)
 		{
-			m_AvailableEntities.push(entity);
+			m_AvailableEntities[entity] = entity;
 		}
+
+		m_AvailableTail.store(MAX_ENTITIES, std::memory_order_relaxed);
 	}
 
+	// Returns INVALID_ENTITY once the cap is reached.
 	Entity CreateEntity()
 	{
-		assert(m_LivingEntityCount < MAX_ENTITIES && "Can't create more entities, cap reached!");
+		Entity entity;
+
+		if (std::this_thread::get_id() == m_OwnerThread)
+		{
+			uint64_t head = 0;
+			if (!ClaimAvailable(1, head))
+			{
+				assert(false && "Can't create more entities, cap reached!");
+				return INVALID_ENTITY;
+			}
+
+			entity = m_AvailableEntities[head % MAX_ENTITIES];
+		}
+		else
+		{
+			ThreadCache& cache = m_ThreadCaches[ThreadCacheIndex()];
+
+			// Only contended if more than MAX_THREAD_CACHES threads create entities.
+			while (cache.busy.test_and_set(std::memory_order_acquire))
+			{
+				std::this_thread::yield();
+			}
 
-		// Create Entity.
-		Entity entity = m_AvailableEntities.front();
-		m_AvailableEntities.pop();
+			if (cache.count == 0)
+			{
+				// Other threads may claim in between, so retry with what is left until the queue is empty.
+				uint32_t count = 0;
+				uint64_t head = 0;
+				do
+				{
+					count = static_cast<uint32_t>(std::min<uint64_t>(ENTITY_BLOCK_SIZE, AvailableCount()));
+				} while (count > 0 && !ClaimAvailable(count, head));
 
-		m_LivingEntityCount++;
+				if (count == 0)
+				{
+					cache.busy.clear(std::memory_order_release);
+					assert(false && "Can't create more entities, cap reached!");
+					return INVALID_ENTITY;
+				}
+
+				for (uint32_t i = 0; i < count; i++)
+				{
+					// Hand out in queue order, so the cache is used from the back.
+					cache.entities[count - 1 - i] = m_AvailableEntities[(head + i) % MAX_ENTITIES];
+				}
+				cache.count = count;
+			}
+
+			entity = cache.entities[--cache.count];
+			cache.busy.clear(std::memory_order_release);
+		}
+
+		m_LivingEntities[entity / 64].fetch_or(uint64_t(1) << (entity % 64), std::memory_order_relaxed);
+		StampSignature(entity, m_CurrentTick.load(std::memory_order_relaxed));
+		m_LivingEntityCount.fetch_add(1, std::memory_order_relaxed);
+		m_CreatedCount.fetch_add(1, std::memory_order_relaxed);
 
 		return entity;
 	}
 
+	// Create count entities that all start with signature, IDs are claimed from the queue in one go.
+	// All or nothing, returns false and creates none if fewer than count IDs are left.
+	bool CreateEntities(uint32_t count, Signature signature, Entity* outEntities)
+	{
+		uint64_t head = 0;
+		if (!ClaimAvailable(count, head))
+			return false;
+
+		Tick tick = m_CurrentTick.load(std::memory_order_relaxed);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			Entity entity = m_AvailableEntities[(head + i) % MAX_ENTITIES];
+
+			m_LivingEntities[entity / 64].fetch_or(uint64_t(1) << (entity % 64), std::memory_order_relaxed);
+			StampSignature(entity, tick);
+			m_Signatures[entity] = signature;
+			outEntities[i] = entity;
+		}
+
+		m_LivingEntityCount.fetch_add(count, std::memory_order_relaxed);
+		m_CreatedCount.fetch_add(count, std::memory_order_relaxed);
+
+		return true;
+	}
+
 	void DestroyEntity(Entity entity)
 	{
-		assert(m_LivingEntityCount < MAX_ENTITIES && "Entity out of range");
-		assert(m_LivingEntityCount >= 0 && "Invalid entity");
+		assert(entity < MAX_ENTITIES && "Entity out of range");
+		assert(IsAlive(entity) && "Invalid entity");
 
 		// Invalidate the destroyed entity's signature
 		m_Signatures[entity].reset();
+		m_Prefabs.reset(entity);
 
 		// Put the destroyed entity back in the available queue
-		m_AvailableEntities.push(entity);
+		PushAvailable(entity);
+		m_LivingEntities[entity / 64].fetch_and(~(uint64_t(1) << (entity % 64)), std::memory_order_relaxed);
+		StampSignature(entity, m_CurrentTick.load(std::memory_order_relaxed));
 
-		m_LivingEntityCount--;
+		m_LivingEntityCount.fetch_sub(1, std::memory_order_relaxed);
+		m_DestroyedCount++;
 	}
 
 	void SetSignature(Entity entity, Signature signature)
 	{
-		assert(m_LivingEntityCount < MAX_ENTITIES && "Entity out of range");
-		assert(m_LivingEntityCount >= 0 && "Invalid entity");
+		assert(entity < MAX_ENTITIES && "Entity out of range");
 
 		m_Signatures[entity] = signature;
+		StampSignature(entity, m_CurrentTick.load(std::memory_order_relaxed));
 	}
 
 	Signature GetSignature(Entity entity) const
 	{
-		assert(m_LivingEntityCount < MAX_ENTITIES && "Entity out of range");
-		assert(m_LivingEntityCount >= 0 && "Invalid entity");
+		assert(entity < MAX_ENTITIES && "Entity out of range");
 
 		return m_Signatures[entity];
 	}
 
+	// Prefabs are templates for Instantiate, systems and observers don't see them.
+	void SetPrefab(Entity entity, bool prefab)
+	{
+		assert(entity < MAX_ENTITIES && "Entity out of range");
+
+		m_Prefabs.set(entity, prefab);
+	}
+
+	bool IsPrefab(Entity entity) const
+	{
+		assert(entity < MAX_ENTITIES && "Entity out of range");
+
+		return m_Prefabs.test(entity);
+	}
+
+	bool IsAlive(Entity entity) const
+	{
+		assert(entity < MAX_ENTITIES && "Entity out of range");
+
+		return (m_LivingEntities[entity / 64].load(std::memory_order_relaxed) >> (entity % 64)) & 1;
+	}
+
+	uint32_t GetLivingEntityCount() const { return m_LivingEntityCount.load(std::memory_order_relaxed); }
+
+	// IDs cached by job threads count as neither living nor available.
+	EntityLayout GetLayout() const
+	{
+		EntityLayout layout;
+		layout.living = GetLivingEntityCount();
+		layout.available = static_cast<std::uint32_t>(AvailableCount());
+		layout.prefabs = static_cast<std::uint32_t>(m_Prefabs.count());
+		layout.bytes = sizeof(EntityManager);
+		layout.created = m_CreatedCount.load(std::memory_order_relaxed);
+		layout.destroyed = m_DestroyedCount;
+
+		return layout;
+	}
+
+	// Put the IDs reserved by job threads but not handed out yet back into the available queue.
+	// Call at a sync point when no other thread is creating entities, e.g. before taking a snapshot.
+	void FlushThreadCaches()
+	{
+		for (ThreadCache& cache : m_ThreadCaches)
+		{
+			while (cache.count > 0)
+			{
+				PushAvailable(cache.entities[--cache.count]);
+			}
+		}
+	}
+
+	// Call fn(entity) for every living entity in ascending order. Whole words without living entities are skipped at once.
+	template<typename F>
+	void ForEachLivingEntity(F&& fn) const
+	{
+		for (Entity base = 0; base < MAX_ENTITIES; base += 64)
+		{
+			uint64_t word = m_LivingEntities[base / 64].load(std::memory_order_relaxed);
+			for (Entity bit = 0; word != 0; bit++, word >>= 1)
+			{
+				if (word & 1)
+					fn(base + bit);
+			}
+		}
+	}
+
+	// Lowest ID from start on that isn't alive, or MAX_ENTITIES. Whole words of living entities are skipped at once.
+	Entity FindFreeEntity(Entity start) const
+	{
+		for (Entity entity = start; entity < MAX_ENTITIES;)
+		{
+			uint64_t word = m_LivingEntities[entity / 64].load(std::memory_order_relaxed) >> (entity % 64);
+			if (word == (~uint64_t(0) >> (entity % 64)))
+			{
+				entity = (entity / 64 + 1) * 64;
+				continue;
+			}
+
+			if (!(word & 1))
+				return entity;
+			entity++;
+		}
+
+		return MAX_ENTITIES;
+	}
+
+	// Highest living ID below end, or INVALID_ENTITY. Whole words without living entities are skipped at once.
+	Entity FindLivingEntityBelow(Entity end) const
+	{
+		for (Entity entity = end; entity > 0;)
+		{
+			Entity candidate = entity - 1;
+			uint64_t word = m_LivingEntities[candidate / 64].load(std::memory_order_relaxed) << (63 - candidate % 64);
+			if (word == 0)
+			{
+				entity = candidate / 64 * 64;
+				continue;
+			}
+
+			if (word >> 63)
+				return candidate;
+			entity = candidate;
+		}
+
+		return INVALID_ENTITY;
+	}
+
+	// Give living entities new IDs, every to must be free. IDs cached by job threads are put back first, so no other
+	// thread may create entities meanwhile. The available queue is rebuilt in ascending order, so new entities
+	// take the lowest free IDs and the ID range stays dense.
+	void MoveEntities(const EntityMove* moves, size_t count)
+	{
+		FlushThreadCaches();
+
+		Tick tick = m_CurrentTick.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < count; i++)
+		{
+			Entity from = moves[i].from;
+			Entity to = moves[i].to;
+			assert(IsAlive(from) && !IsAlive(to) && "Entities can only be moved to free IDs.");
+
+			m_LivingEntities[to / 64].fetch_or(uint64_t(1) << (to % 64), std::memory_order_relaxed);
+			m_LivingEntities[from / 64].fetch_and(~(uint64_t(1) << (from % 64)), std::memory_order_relaxed);
+
+			m_Signatures[to] = m_Signatures[from];
+			m_Signatures[from].reset();
+			m_Prefabs.set(to, m_Prefabs.test(from));
+			m_Prefabs.reset(from);
+
+			StampSignature(to, tick);
+			StampSignature(from, tick);
+		}
+
+		uint64_t tail = 0;
+		for (Entity entity = 0; entity < MAX_ENTITIES; entity++)
+		{
+			if (!IsAlive(entity))
+				m_AvailableEntities[tail++] = entity;
+		}
+
+		m_AvailableHead.store(0, std::memory_order_relaxed);
+		m_AvailableTail.store(tail, std::memory_order_release);
+	}
+
+	// Unused entity IDs in the order they will be handed out.
+	std::vector<Entity> GetAvailableEntities() const
+	{
+		std::vector<Entity> available;
+		available.reserve(AvailableCount());
+
+		uint64_t tail = m_AvailableTail.load(std::memory_order_acquire);
+		for (uint64_t position = m_AvailableHead.load(std::memory_order_relaxed); position != tail; position++)
+		{
+			available.push_back(m_AvailableEntities[position % MAX_ENTITIES]);
+		}
+
+		return available;
+	}
+
+	// Replace the whole entity state, e.g. when loading a world. Signatures are cleared and have to be set again.
+	void Restore(const std::vector<Entity>& livingEntities, const std::vector<Entity>& availableEntities)
+	{
+		assert(livingEntities.size() + availableEntities.size() == MAX_ENTITIES && "Restored entity state doesn't cover all entities.");
+
+		DropThreadCaches();
+
+		std::copy(availableEntities.begin(), availableEntities.end(), m_AvailableEntities.begin());
+		m_AvailableHead.store(0, std::memory_order_relaxed);
+		m_AvailableTail.store(availableEntities.size(), std::memory_order_release);
+
+		for (auto& word : m_LivingEntities)
+		{
+			word.store(0, std::memory_order_relaxed);
+		}
+		for (Entity entity : livingEntities)
+		{
+			m_LivingEntities[entity / 64].fetch_or(uint64_t(1) << (entity % 64), std::memory_order_relaxed);
+		}
+
+		m_Signatures.fill(Signature{});
+		m_Prefabs.reset();
+		m_SignatureTicks.fill(m_CurrentTick.load(std::memory_order_relaxed));
+		m_SignatureChanges.Overflow();
+		m_LivingEntityCount.store(static_cast<uint32_t>(livingEntities.size()), std::memory_order_relaxed);
+	}
+
+	// The available queue is a ring buffer of MAX_ENTITIES IDs starting at the head,
+	// snapshots copy it directly instead of going through the queue operations.
+	const Entity* GetAvailableRing() const { return m_AvailableEntities.data(); }
+	uint32_t GetAvailableHead() const { return static_cast<uint32_t>(m_AvailableHead.load(std::memory_order_relaxed) % MAX_ENTITIES); }
+	uint32_t GetAvailableTail() const { return static_cast<uint32_t>(m_AvailableTail.load(std::memory_order_relaxed) % MAX_ENTITIES); }
+
+	// Restore the available queue from a snapshot, IDs cached by job threads are dropped.
+	void RestoreAvailable(const Entity* ring, uint32_t head, uint32_t livingEntityCount)
+	{
+		DropThreadCaches();
+
+		std::copy(ring, ring + MAX_ENTITIES, m_AvailableEntities.begin());
+		m_AvailableHead.store(head, std::memory_order_relaxed);
+		m_AvailableTail.store(uint64_t(head) + MAX_ENTITIES - livingEntityCount, std::memory_order_release);
+		m_LivingEntityCount.store(livingEntityCount, std::memory_order_relaxed);
+	}
+
+	// Set the state of a single entity without touching the available queue.
+	void RestoreEntity(Entity entity, bool alive, Signature signature)
+	{
+		if (alive)
+			m_LivingEntities[entity / 64].fetch_or(uint64_t(1) << (entity % 64), std::memory_order_relaxed);
+		else
+			m_LivingEntities[entity / 64].fetch_and(~(uint64_t(1) << (entity % 64)), std::memory_order_relaxed);
+
+		m_Signatures[entity] = signature;
+		StampSignature(entity, m_CurrentTick.load(std::memory_order_relaxed));
+	}
+
+	// Tick of the last create, destroy or signature change of every entity.
+	const Tick* GetSignatureTicks() const { return m_SignatureTicks.data(); }
+
+	// Dirty list of the signature ticks, indexed by entity ID.
+	ChangeList& GetSignatureChanges() { return m_SignatureChanges; }
+
+	void SetCurrentTick(Tick tick) { m_CurrentTick.store(tick, std::memory_order_relaxed); }
+
 private:
-	// Queue of unused entity IDs.
-	std::queue<Entity> m_AvailableEntities{};
+	struct alignas(64) ThreadCache
+	{
+		std::atomic_flag busy = ATOMIC_FLAG_INIT;
+		uint32_t count{ 0 };
+		std::array<Entity, ENTITY_BLOCK_SIZE> entities;
+	};
+
+	// Every thread gets a fixed cache slot the first time it creates an entity.
+	static size_t ThreadCacheIndex()
+	{
+		static std::atomic<size_t> s_NextIndex{ 0 };
+		thread_local size_t index = s_NextIndex.fetch_add(1, std::memory_order_relaxed) % MAX_THREAD_CACHES;
+
+		return index;
+	}
+
+	void StampSignature(Entity entity, Tick tick)
+	{
+		m_SignatureChanges.Stamp(entity, m_SignatureTicks[entity]);
+		m_SignatureTicks[entity] = tick;
+	}
+
+	uint64_t AvailableCount() const
+	{
+		return m_AvailableTail.load(std::memory_order_acquire) - m_AvailableHead.load(std::memory_order_relaxed);
+	}
+
+	// Take count IDs from the front of the available queue and set outHead to the position of the first one.
+	// Returns false and takes nothing if fewer than count IDs are left.
+	bool ClaimAvailable(uint32_t count, uint64_t& outHead)
+	{
+		uint64_t head = m_AvailableHead.load(std::memory_order_relaxed);
+
+		do
+		{
+			if (head + count > m_AvailableTail.load(std::memory_order_acquire))
+				return false;
+		} while (!m_AvailableHead.compare_exchange_weak(head, head + count, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+		outHead = head;
+		return true;
+	}
+
+	// Single producer, the release store publishes the ID to threads claiming it.
+	void PushAvailable(Entity entity)
+	{
+		uint64_t tail = m_AvailableTail.load(std::memory_order_relaxed);
+		m_AvailableEntities[tail % MAX_ENTITIES] = entity;
+		m_AvailableTail.store(tail + 1, std::memory_order_release);
+	}
+
+	void DropThreadCaches()
+	{
+		for (ThreadCache& cache : m_ThreadCaches)
+		{
+			cache.count = 0;
+		}
+	}
+
+	// Ring buffer queue of unused entity IDs.
+	std::array<Entity, MAX_ENTITIES> m_AvailableEntities{};
+
+	// Total number of IDs ever taken from and put into the available queue, positions are these modulo MAX_ENTITIES.
+	std::atomic<uint64_t> m_AvailableHead{ 0 };
+	std::atomic<uint64_t> m_AvailableTail{ 0 };
+
+	// ID blocks reserved by job threads.
+	std::array<ThreadCache, MAX_THREAD_CACHES> m_ThreadCaches{};
+
+	// Thread that takes IDs directly from the queue.
+	std::thread::id m_OwnerThread;
 
 	// Array of signatures where the index corresponds to the entity ID
 	std::array<Signature, MAX_ENTITIES> m_Signatures{};
 
+	// Bit per entity ID, set for prefabs.
+	std::bitset<MAX_ENTITIES> m_Prefabs{};
+
+	// Bit per entity ID, set while the entity is alive.
+	std::array<std::atomic<uint64_t>, (MAX_ENTITIES + 63) / 64> m_LivingEntities{};
+
+	// Change tick of every entity's signature and living state.
+	std::array<Tick, MAX_ENTITIES> m_SignatureTicks{};
+	ChangeList m_SignatureChanges;
+
+	// Tick stamped on changes, kept in sync by the ECS.
+	std::atomic<Tick> m_CurrentTick{ 0 };
+
 	// Total living entities.
-	uint32_t m_LivingEntityCount{ 0 };
+	std::atomic<uint32_t> m_LivingEntityCount{ 0 };
+
+	// Entities created and destroyed since the start, restoring a world doesn't count.
+	std::atomic<uint64_t> m_CreatedCount{ 0 };
+	uint64_t m_DestroyedCount{ 0 };
 };
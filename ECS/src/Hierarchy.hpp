@@ -0,0 +1,370 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "ECS.hpp"
+#include "JobSystem.hpp"
+
+// Local 2D transform relative to the parent, or to the world for roots.
+struct Transform
+{
+	float x{ 0.0f }, y{ 0.0f };
+	float rotation{ 0.0f };
+	float scale{ 1.0f };
+};
+
+// Transform relative to the world, written by Hierarchy::PropagateTransforms.
+struct WorldTransform
+{
+	float x{ 0.0f }, y{ 0.0f };
+	float rotation{ 0.0f };
+	float scale{ 1.0f };
+};
+
+// Apply local on top of parent.
+inline Transform CombineTransforms(const Transform& parent, const Transform& local)
+{
+	float c = std::cos(parent.rotation);
+	float s = std::sin(parent.rotation);
+
+	Transform result;
+	result.x = parent.x + parent.scale * (c * local.x - s * local.y);
+	result.y = parent.y + parent.scale * (s * local.x + c * local.y);
+	result.rotation = parent.rotation + local.rotation;
+	result.scale = parent.scale * local.scale;
+
+	return result;
+}
+
+/**
+ * Parent/child relationships between entities with Transform and WorldTransform components.
+ * Nodes are stored per depth in dense arrays together with a copy of their local and world transform and the slot
+ * of their parent in the level above, so propagation walks the levels top down in one linear pass and never looks
+ * up a parent. Reparenting moves the subtree to its new levels with swap removes, like the component arrays.
+ * Levels are processed in parallel on a job system, every level only reads the one above it.
+ * Entities that are destroyed have to be removed with Remove first.
+ */
+class Hierarchy
+{
+public:
+	static constexpr Entity NO_PARENT = std::numeric_limits<Entity>::max();
+
+	Hierarchy(ECS& ecs)
+		: m_ECS(ecs), m_Nodes(MAX_ENTITIES)
+	{
+	}
+
+	// Attach child under parent, moving it and its subtree if it already had a parent.
+	void SetParent(Entity child, Entity parent)
+	{
+		assert(child != parent && "An entity can't be its own parent.");
+
+		if (!m_Nodes[parent].inHierarchy)
+			AddNode(parent, 0, 0, m_ECS.ReadComponent<Transform>(parent));
+
+		for (Entity ancestor = parent; ancestor != NO_PARENT; ancestor = m_Nodes[ancestor].parent)
+		{
+			assert(ancestor != child && "Parenting an entity to its own descendant.");
+		}
+
+		Move(child, parent);
+	}
+
+	// Make the entity a root again, its subtree comes along.
+	void RemoveParent(Entity child)
+	{
+		if (m_Nodes[child].inHierarchy && m_Nodes[child].parent != NO_PARENT)
+			Move(child, NO_PARENT);
+	}
+
+	// Take the entity out of the hierarchy, its children become roots.
+	void Remove(Entity entity)
+	{
+		Node& node = m_Nodes[entity];
+		if (!node.inHierarchy)
+			return;
+
+		while (!node.children.empty())
+		{
+			Move(node.children.back(), NO_PARENT);
+		}
+
+		Detach(entity);
+		RemoveFromLevel(entity);
+		node.inHierarchy = false;
+	}
+
+	// Follow entities that got new IDs with ECS::MoveEntities.
+	void MoveEntities(const EntityMove* moves, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			Entity from = moves[i].from;
+			Entity to = moves[i].to;
+			if (!m_Nodes[from].inHierarchy)
+				continue;
+
+			m_Nodes[to] = std::move(m_Nodes[from]);
+			m_Nodes[from] = Node{};
+
+			Node& node = m_Nodes[to];
+			m_Levels[node.depth].entities[node.slot] = to;
+
+			if (node.parent != NO_PARENT)
+				*std::find(m_Nodes[node.parent].children.begin(), m_Nodes[node.parent].children.end(), from) = to;
+
+			for (Entity child : node.children)
+			{
+				m_Nodes[child].parent = to;
+			}
+		}
+	}
+
+	Entity GetParent(Entity entity) const { return m_Nodes[entity].parent; }
+	const std::vector<Entity>& GetChildren(Entity entity) const { return m_Nodes[entity].children; }
+	bool Contains(Entity entity) const { return m_Nodes[entity].inHierarchy; }
+	std::uint32_t GetDepth(Entity entity) const { return m_Nodes[entity].depth; }
+
+	size_t GetLevelCount() const { return m_Levels.size(); }
+	const std::vector<Entity>& GetLevel(size_t depth) const { return m_Levels[depth].entities; }
+
+	// World transforms recomputed by the last propagation.
+	size_t GetRecomputedCount() const { return m_RecomputedCount; }
+
+	// Recompute the world transform of every node whose Transform changed since the last call, and of their subtrees.
+	void PropagateTransforms(JobSystem* jobs = nullptr)
+	{
+		auto locals = m_ECS.GetComponentManager()->GetComponentArray<Transform>();
+
+		Tick tick = m_ECS.AdvanceTick();
+
+		// Pull the changed local transforms into the levels, one pass over the dense array.
+		const Tick* ticks = locals->ChangeTicks();
+		const Entity* entities = locals->RawEntities();
+		const Transform* transforms = locals->Data();
+
+		for (size_t index = 0; index < locals->Size(); index++)
+		{
+			const Node& node = m_Nodes[entities[index]];
+			if (node.inHierarchy && IsNewerTick(ticks[index], m_LastTick))
+			{
+				Level& level = m_Levels[node.depth];
+				level.local[node.slot] = transforms[index];
+				level.dirty[node.slot] = 1;
+			}
+		}
+
+		// Top down, a node is recomputed if it is dirty or its parent was recomputed.
+		for (size_t depth = 0; depth < m_Levels.size(); depth++)
+		{
+			Level& level = m_Levels[depth];
+			const Level* parentLevel = depth > 0 ? &m_Levels[depth - 1] : nullptr;
+
+			auto propagate = [&level, parentLevel](std::uint32_t begin, std::uint32_t end)
+			{
+				for (std::uint32_t slot = begin; slot < end; slot++)
+				{
+					std::uint32_t parentSlot = level.parentSlots[slot];
+					bool recompute = level.dirty[slot] || (parentLevel && parentLevel->changed[parentSlot]);
+
+					if (recompute)
+						level.world[slot] = parentLevel ? CombineTransforms(parentLevel->world[parentSlot], level.local[slot]) : level.local[slot];
+
+					level.changed[slot] = recompute;
+					level.dirty[slot] = 0;
+				}
+			};
+
+			std::uint32_t count = static_cast<std::uint32_t>(level.entities.size());
+			if (jobs && count >= PARALLEL_LEVEL_SIZE)
+				jobs->ParallelFor(count, propagate);
+			else
+				propagate(0, count);
+		}
+
+		// Write back only what changed, so consumers of WorldTransform changes see just those.
+		m_RecomputedCount = 0;
+		for (const Level& level : m_Levels)
+		{
+			for (size_t slot = 0; slot < level.entities.size(); slot++)
+			{
+				if (!level.changed[slot])
+					continue;
+
+				const Transform& world = level.world[slot];
+				m_ECS.GetComponent<WorldTransform>(level.entities[slot]) = { world.x, world.y, world.rotation, world.scale };
+				m_RecomputedCount++;
+			}
+		}
+
+		m_LastTick = tick;
+	}
+
+private:
+	// Levels smaller than this aren't worth handing to the job system.
+	static constexpr std::uint32_t PARALLEL_LEVEL_SIZE = 1024;
+
+	struct Node
+	{
+		Entity parent{ NO_PARENT };
+		std::vector<Entity> children;
+		std::uint32_t depth{ 0 };
+		std::uint32_t slot{ 0 };
+		bool inHierarchy{ false };
+	};
+
+	// All nodes of one depth, every vector is indexed by slot.
+	struct Level
+	{
+		std::vector<Entity> entities;
+		std::vector<std::uint32_t> parentSlots;
+		std::vector<Transform> local;
+		std::vector<Transform> world;
+
+		// Local transform or parent changed since the last propagation.
+		std::vector<std::uint8_t> dirty;
+
+		// World transform recomputed by the last propagation.
+		std::vector<std::uint8_t> changed;
+	};
+
+	void AddNode(Entity entity, std::uint32_t depth, std::uint32_t parentSlot, const Transform& local)
+	{
+		if (depth >= m_Levels.size())
+			m_Levels.resize(depth + 1);
+
+		Level& level = m_Levels[depth];
+		Node& node = m_Nodes[entity];
+		node.depth = depth;
+		node.slot = static_cast<std::uint32_t>(level.entities.size());
+		node.inHierarchy = true;
+
+		level.entities.push_back(entity);
+		level.parentSlots.push_back(parentSlot);
+		level.local.push_back(local);
+		level.world.push_back(local);
+		level.dirty.push_back(1);
+		level.changed.push_back(0);
+	}
+
+	// Swap remove the entity from its level, fixing the slots pointing at the entry moved into the hole.
+	Transform RemoveFromLevel(Entity entity)
+	{
+		Node& node = m_Nodes[entity];
+		Level& level = m_Levels[node.depth];
+		Transform local = level.local[node.slot];
+
+		size_t last = level.entities.size() - 1;
+		Entity moved = level.entities[last];
+
+		level.entities[node.slot] = moved;
+		level.parentSlots[node.slot] = level.parentSlots[last];
+		level.local[node.slot] = level.local[last];
+		level.world[node.slot] = level.world[last];
+		level.dirty[node.slot] = level.dirty[last];
+		level.changed[node.slot] = level.changed[last];
+
+		level.entities.pop_back();
+		level.parentSlots.pop_back();
+		level.local.pop_back();
+		level.world.pop_back();
+		level.dirty.pop_back();
+		level.changed.pop_back();
+
+		if (moved != entity)
+		{
+			m_Nodes[moved].slot = node.slot;
+			for (Entity child : m_Nodes[moved].children)
+			{
+				m_Levels[node.depth + 1].parentSlots[m_Nodes[child].slot] = node.slot;
+			}
+		}
+
+		while (!m_Levels.empty() && m_Levels.back().entities.empty())
+		{
+			m_Levels.pop_back();
+		}
+
+		return local;
+	}
+
+	// Take the entity out of its parent's children.
+	void Detach(Entity entity)
+	{
+		Node& node = m_Nodes[entity];
+		if (node.parent == NO_PARENT)
+			return;
+
+		auto& siblings = m_Nodes[node.parent].children;
+		siblings.erase(std::find(siblings.begin(), siblings.end(), entity));
+		node.parent = NO_PARENT;
+	}
+
+	// Move the entity and its subtree under parent, or to the roots.
+	void Move(Entity entity, Entity parent)
+	{
+		// Breadth first, so every node is added after its parent.
+		std::vector<Entity>& subtree = m_Subtree;
+		std::vector<Transform>& locals = m_SubtreeLocals;
+		subtree.clear();
+		locals.clear();
+
+		if (m_Nodes[entity].inHierarchy)
+		{
+			Detach(entity);
+
+			subtree.push_back(entity);
+			for (size_t i = 0; i < subtree.size(); i++)
+			{
+				for (Entity child : m_Nodes[subtree[i]].children)
+				{
+					subtree.push_back(child);
+				}
+			}
+
+			for (Entity node : subtree)
+			{
+				locals.push_back(RemoveFromLevel(node));
+			}
+		}
+		else
+		{
+			subtree.push_back(entity);
+			locals.push_back(m_ECS.ReadComponent<Transform>(entity));
+		}
+
+		m_Nodes[entity].parent = parent;
+		if (parent != NO_PARENT)
+			m_Nodes[parent].children.push_back(entity);
+
+		for (size_t i = 0; i < subtree.size(); i++)
+		{
+			Entity nodeParent = m_Nodes[subtree[i]].parent;
+			std::uint32_t depth = nodeParent == NO_PARENT ? 0 : m_Nodes[nodeParent].depth + 1;
+			std::uint32_t parentSlot = nodeParent == NO_PARENT ? 0 : m_Nodes[nodeParent].slot;
+
+			AddNode(subtree[i], depth, parentSlot, locals[i]);
+		}
+	}
+
+	ECS& m_ECS;
+
+	// Per entity ID.
+	std::vector<Node> m_Nodes;
+
+	// Nodes by depth, roots first.
+	std::vector<Level> m_Levels;
+
+	// Scratch for Move, kept so reparenting doesn't allocate in steady state.
+	std::vector<Entity> m_Subtree;
+	std::vector<Transform> m_SubtreeLocals;
+
+	size_t m_RecomputedCount{ 0 };
+
+	// Tick closed by the last propagation.
+	Tick m_LastTick{ 0 };
+};
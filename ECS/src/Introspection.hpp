@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "ECS.hpp"
+#include "Layout.hpp"
+
+// Structural changes between two captures.
+struct FrameCounters
+{
+	std::uint64_t entitiesCreated{ 0 };
+	std::uint64_t entitiesDestroyed{ 0 };
+	std::uint64_t componentsAdded{ 0 };
+	std::uint64_t componentsRemoved{ 0 };
+};
+
+struct WorldReport
+{
+	Tick tick{ 0 };
+
+	// Everything the world allocated through its resource.
+	MemoryStats memory;
+
+	EntityLayout entities;
+	std::vector<ComponentLayout> components;
+	std::vector<SystemLayout> systems;
+
+	// Since the previous Capture, or since the start for the first one.
+	FrameCounters frame;
+};
+
+/**
+ * Reports how a world uses its memory: live count, capacity, bytes and fragmentation per component type,
+ * entities per system and the structural changes of the last frame. Capture once per frame, e.g. after the systems
+ * ran, and hand the report to a profiler or a debug overlay, or write it out with ToJson.
+ * Reading the counters is cheap, building the report allocates, so it isn't meant to run every frame in shipping builds.
+ */
+class Introspection
+{
+public:
+	Introspection(ECS& ecs)
+		: m_ECS(ecs)
+	{
+	}
+
+	WorldReport Capture()
+	{
+		WorldReport report;
+		report.tick = m_ECS.GetCurrentTick();
+		report.memory = m_ECS.GetMemoryStats();
+		report.entities = m_ECS.GetEntityManager()->GetLayout();
+		report.components = m_ECS.GetComponentManager()->GetComponentLayouts();
+		report.systems = m_ECS.GetSystemManager()->GetSystemLayouts();
+
+		FrameCounters totals;
+		totals.entitiesCreated = report.entities.created;
+		totals.entitiesDestroyed = report.entities.destroyed;
+		for (const ComponentLayout& component : report.components)
+		{
+			totals.componentsAdded += component.added;
+			totals.componentsRemoved += component.removed;
+		}
+
+		report.frame.entitiesCreated = totals.entitiesCreated - m_Previous.entitiesCreated;
+		report.frame.entitiesDestroyed = totals.entitiesDestroyed - m_Previous.entitiesDestroyed;
+		report.frame.componentsAdded = totals.componentsAdded - m_Previous.componentsAdded;
+		report.frame.componentsRemoved = totals.componentsRemoved - m_Previous.componentsRemoved;
+		m_Previous = totals;
+
+		return report;
+	}
+
+	static std::string ToJson(const WorldReport& report)
+	{
+		std::string json;
+		json += "{";
+		json += "\"tick\":" + std::to_string(report.tick);
+		json += ",\"memory\":" + MemoryJson(report.memory);
+
+		const EntityLayout& entities = report.entities;
+		json += ",\"entities\":{";
+		json += "\"living\":" + std::to_string(entities.living);
+		json += ",\"capacity\":" + std::to_string(entities.capacity);
+		json += ",\"available\":" + std::to_string(entities.available);
+		json += ",\"prefabs\":" + std::to_string(entities.prefabs);
+		json += ",\"bytes\":" + std::to_string(entities.bytes);
+		json += ",\"created\":" + std::to_string(entities.created);
+		json += ",\"destroyed\":" + std::to_string(entities.destroyed);
+		json += "}";
+
+		json += ",\"components\":[";
+		for (size_t i = 0; i < report.components.size(); i++)
+		{
+			const ComponentLayout& component = report.components[i];
+
+			json += i > 0 ? ",{" : "{";
+			json += "\"name\":" + QuoteJson(component.name);
+			json += ",\"type\":" + std::to_string(component.type);
+			json += ",\"count\":" + std::to_string(component.count);
+			json += ",\"capacity\":" + std::to_string(component.capacity);
+			json += ",\"componentSize\":" + std::to_string(component.componentSize);
+			json += ",\"storageBytes\":" + std::to_string(component.storageBytes);
+			json += ",\"memory\":" + MemoryJson(component.memory);
+			json += ",\"fragmentation\":" + NumberJson(component.fragmentation);
+			json += ",\"indexBuckets\":" + std::to_string(component.indexBuckets);
+			json += ",\"indexLoadFactor\":" + NumberJson(component.indexLoadFactor);
+			json += ",\"mapped\":" + std::string(component.mapped ? "true" : "false");
+			json += ",\"added\":" + std::to_string(component.added);
+			json += ",\"removed\":" + std::to_string(component.removed);
+			json += "}";
+		}
+		json += "]";
+
+		json += ",\"systems\":[";
+		for (size_t i = 0; i < report.systems.size(); i++)
+		{
+			const SystemLayout& system = report.systems[i];
+
+			json += i > 0 ? ",{" : "{";
+			json += "\"name\":" + QuoteJson(system.name);
+			json += ",\"entities\":" + std::to_string(system.entityCount);
+			json += ",\"signature\":\"" + system.signature.to_string() + "\"";
+			json += ",\"schedule\":" + QuoteJson(ScheduleName(system.schedule));
+			json += ",\"visitedLastTick\":" + std::to_string(system.stats.visitedLastTick);
+			json += ",\"remaining\":" + std::to_string(system.stats.remaining);
+			json += "}";
+		}
+		json += "]";
+
+		json += ",\"frame\":{";
+		json += "\"entitiesCreated\":" + std::to_string(report.frame.entitiesCreated);
+		json += ",\"entitiesDestroyed\":" + std::to_string(report.frame.entitiesDestroyed);
+		json += ",\"componentsAdded\":" + std::to_string(report.frame.componentsAdded);
+		json += ",\"componentsRemoved\":" + std::to_string(report.frame.componentsRemoved);
+		json += "}";
+
+		json += "}";
+		return json;
+	}
+
+private:
+	static std::string MemoryJson(const MemoryStats& memory)
+	{
+		std::string json;
+		json += "{\"bytes\":" + std::to_string(memory.bytes);
+		json += ",\"peakBytes\":" + std::to_string(memory.peakBytes);
+		json += ",\"allocations\":" + std::to_string(memory.allocations);
+		json += ",\"budget\":" + std::to_string(memory.budget);
+		json += ",\"overBudget\":" + std::string(memory.OverBudget() ? "true" : "false");
+		json += "}";
+		return json;
+	}
+
+	// Fixed notation with a dot as the decimal point, whatever the locale.
+	static std::string NumberJson(double value)
+	{
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.4f", value);
+
+		for (char* c = buffer; *c; c++)
+		{
+			if (*c == ',')
+				*c = '.';
+		}
+
+		return buffer;
+	}
+
+	// Type names can hold anything, e.g. quotes in template arguments.
+	static std::string QuoteJson(const std::string& text)
+	{
+		std::string quoted = "\"";
+
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				quoted += '\\';
+				quoted += c;
+			}
+			else if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char escape[8];
+				std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned char>(c));
+				quoted += escape;
+			}
+			else
+			{
+				quoted += c;
+			}
+		}
+
+		quoted += "\"";
+		return quoted;
+	}
+
+	static const char* ScheduleName(ScheduleMode mode)
+	{
+		switch (mode)
+		{
+		case ScheduleMode::Interval: return "Interval";
+		case ScheduleMode::Sliced: return "Sliced";
+		case ScheduleMode::Budget: return "Budget";
+		default: return "EveryTick";
+		}
+	}
+
+	ECS& m_ECS;
+
+	// Totals at the previous Capture.
+	FrameCounters m_Previous;
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed pool of worker threads running one batch of tasks at a time.
+ * Run hands out task indices through an atomic counter, the calling thread helps out and returns once every
+ * task has finished, so callers never see a task still running. Only one thread may call Run at a time.
+ */
+class JobSystem
+{
+public:
+	// Worker count not counting the thread calling Run, 0 runs everything on the caller.
+	explicit JobSystem(uint32_t workerCount = DefaultWorkerCount())
+	{
+		for (uint32_t i = 0; i < workerCount; i++)
+		{
+			m_Workers.emplace_back([this]() { WorkerLoop(); });
+		}
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Quit = true;
+		}
+		m_WakeWorkers.notify_all();
+
+		for (auto& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Call task(index) for every index in [0, count) and wait for all of them.
+	void Run(uint32_t count, const std::function<void(uint32_t index)>& task)
+	{
+		if (count == 0)
+			return;
+
+		// Not worth waking anyone up for a single task.
+		if (count == 1 || m_Workers.empty())
+		{
+			for (uint32_t index = 0; index < count; index++)
+			{
+				task(index);
+			}
+			return;
+		}
+
+		{
+			// Workers that woke up late for the previous batch must be out before it is replaced.
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Done.wait(lock, [this]() { return m_ActiveWorkers == 0; });
+
+			m_Task = &task;
+			m_TaskCount = count;
+			m_NextIndex.store(0, std::memory_order_relaxed);
+			m_Remaining.store(count, std::memory_order_relaxed);
+			m_Generation++;
+		}
+		m_WakeWorkers.notify_all();
+
+		Work();
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Done.wait(lock, [this]() { return m_Remaining.load(std::memory_order_acquire) == 0 && m_ActiveWorkers == 0; });
+		m_Task = nullptr;
+	}
+
+	// Run task on a worker without waiting for it, e.g. work that spans frames. Workers only take background tasks
+	// between batches, a batch started meanwhile runs on the caller and the other workers. Without workers task
+	// runs right away on the caller. Tasks still queued when the job system is destroyed run before it returns.
+	void Submit(std::function<void()> task)
+	{
+		if (m_Workers.empty())
+		{
+			task();
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Background.push_back(std::move(task));
+		}
+		m_WakeWorkers.notify_one();
+	}
+
+	// Split [0, count) into about one range per thread and call task(begin, end) for each.
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t begin, uint32_t end)>& task)
+	{
+		uint32_t ranges = std::min<uint32_t>(count, GetThreadCount());
+		if (ranges == 0)
+			return;
+
+		Run(ranges, [&](uint32_t range)
+		{
+			task(uint32_t(uint64_t(count) * range / ranges), uint32_t(uint64_t(count) * (range + 1) / ranges));
+		});
+	}
+
+	// Split [0, count) into chunks of chunkSize and call task(chunk, begin, end) for each. Unlike ParallelFor the
+	// split doesn't depend on the thread count, so per chunk results, like partial sums or recorded commands,
+	// are the same on every machine.
+	void ParallelForChunks(uint32_t count, uint32_t chunkSize, const std::function<void(uint32_t chunk, uint32_t begin, uint32_t end)>& task)
+	{
+		assert(chunkSize > 0 && "Chunks can't be empty.");
+
+		Run((count + chunkSize - 1) / chunkSize, [&](uint32_t chunk)
+		{
+			uint32_t begin = chunk * chunkSize;
+			task(chunk, begin, std::min(begin + chunkSize, count));
+		});
+	}
+
+	// Workers plus the calling thread.
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
+
+	static uint32_t DefaultWorkerCount()
+	{
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+private:
+	void WorkerLoop()
+	{
+		uint64_t seenGeneration = 0;
+
+		while (true)
+		{
+			std::function<void()> background;
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_WakeWorkers.wait(lock, [&]() { return m_Quit || m_Generation != seenGeneration || !m_Background.empty(); });
+
+				// Batches go first, the caller of Run is waiting for them.
+				if (m_Generation != seenGeneration)
+				{
+					seenGeneration = m_Generation;
+					m_ActiveWorkers++;
+				}
+				else if (!m_Background.empty())
+				{
+					background = std::move(m_Background.front());
+					m_Background.pop_front();
+				}
+				else
+				{
+					return;
+				}
+			}
+
+			if (background)
+			{
+				background();
+				continue;
+			}
+
+			Work();
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_ActiveWorkers--;
+			}
+			m_Done.notify_all();
+		}
+	}
+
+	// Take task indices until there are none left.
+	void Work()
+	{
+		while (true)
+		{
+			uint32_t index = m_NextIndex.fetch_add(1, std::memory_order_relaxed);
+			if (index >= m_TaskCount)
+				return;
+
+			(*m_Task)(index);
+			m_Remaining.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	}
+
+	std::vector<std::thread> m_Workers;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeWorkers;
+	std::condition_variable m_Done;
+
+	// Current batch, only changed under the mutex while no worker is active.
+	const std::function<void(uint32_t)>* m_Task{ nullptr };
+	uint32_t m_TaskCount{ 0 };
+	uint64_t m_Generation{ 0 };
+	uint32_t m_ActiveWorkers{ 0 };
+	bool m_Quit{ false };
+
+	std::atomic<uint32_t> m_NextIndex{ 0 };
+	std::atomic<uint32_t> m_Remaining{ 0 };
+
+	// Tasks of Submit, taken under the mutex.
+	std::deque<std::function<void()>> m_Background;
+};
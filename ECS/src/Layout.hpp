@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Base.hpp"
+#include "Memory.hpp"
+#include "System.hpp"
+
+// What the managers report about themselves, see Introspection for the per frame view and JSON export.
+
+struct ComponentLayout
+{
+	// Type string of the component, readable with MSVC and mangled with GCC and Clang.
+	std::string name;
+	ComponentType type{ 0 };
+
+	size_t count{ 0 };
+	size_t capacity{ 0 };
+	size_t componentSize{ 0 };
+
+	// Bytes of the dense storage, used or not.
+	size_t storageBytes{ 0 };
+
+	// Storage, index map and everything else allocated for the type.
+	MemoryStats memory;
+
+	// Share of the type's memory not holding live components.
+	double fragmentation{ 0.0 };
+
+	size_t indexBuckets{ 0 };
+	double indexLoadFactor{ 0.0 };
+
+	// Still using a mapped world file column in place.
+	bool mapped{ false };
+
+	// Components inserted and removed since the start.
+	std::uint64_t added{ 0 };
+	std::uint64_t removed{ 0 };
+};
+
+struct EntityLayout
+{
+	std::uint32_t living{ 0 };
+	std::uint32_t capacity{ MAX_ENTITIES };
+	std::uint32_t available{ 0 };
+	std::uint32_t prefabs{ 0 };
+
+	// The entity manager itself, ID queue, signatures and ticks.
+	size_t bytes{ 0 };
+
+	// Entities created and destroyed since the start.
+	std::uint64_t created{ 0 };
+	std::uint64_t destroyed{ 0 };
+};
+
+struct SystemLayout
+{
+	std::string name;
+	size_t entityCount{ 0 };
+	Signature signature;
+	ScheduleMode schedule{ ScheduleMode::EveryTick };
+	SystemStats stats;
+};
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <Windows.h>
+#else
+	#include <sys/mman.h>
+#endif
+
+// Deletes objects made with NewFromResource.
+template<typename T>
+struct ResourceDeleter
+{
+	std::pmr::memory_resource* resource{ nullptr };
+
+	void operator()(T* object) const
+	{
+		object->~T();
+		resource->deallocate(object, sizeof(T), alignof(T));
+	}
+};
+
+template<typename T>
+using ResourcePtr = std::unique_ptr<T, ResourceDeleter<T>>;
+
+// Like new T, default initialized so fixed size arrays aren't zeroed and their pages are only touched once used.
+template<typename T, typename... Args>
+ResourcePtr<T> NewFromResource(std::pmr::memory_resource* resource, Args&&... args)
+{
+	void* memory = resource->allocate(sizeof(T), alignof(T));
+
+	T* object;
+	if constexpr (sizeof...(Args) == 0)
+		object = new (memory) T;
+	else
+		object = new (memory) T(std::forward<Args>(args)...);
+
+	return ResourcePtr<T>(object, ResourceDeleter<T>{ resource });
+}
+
+struct MemoryStats
+{
+	// Bytes currently allocated and the most there ever were.
+	size_t bytes{ 0 };
+	size_t peakBytes{ 0 };
+
+	// Allocations made so far, a steady state frame shouldn't add any.
+	std::uint64_t allocations{ 0 };
+
+	// 0 means no budget.
+	size_t budget{ 0 };
+
+	bool OverBudget() const { return budget != 0 && bytes > budget; }
+};
+
+/**
+ * Passes allocations on to an upstream resource and counts them, optionally against a budget.
+ * The ECS puts one in front of its resource and one in front of every component type.
+ */
+class MemoryTracker : public std::pmr::memory_resource
+{
+public:
+	explicit MemoryTracker(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+		: m_Upstream(upstream)
+	{
+	}
+
+	void SetBudget(size_t bytes) { m_Budget.store(bytes, std::memory_order_relaxed); }
+
+	MemoryStats GetStats() const
+	{
+		MemoryStats stats;
+		stats.bytes = m_Bytes.load(std::memory_order_relaxed);
+		stats.peakBytes = m_PeakBytes.load(std::memory_order_relaxed);
+		stats.allocations = m_Allocations.load(std::memory_order_relaxed);
+		stats.budget = m_Budget.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	std::pmr::memory_resource* GetUpstream() const { return m_Upstream; }
+
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		void* memory = m_Upstream->allocate(bytes, alignment);
+
+		size_t total = m_Bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		m_Allocations.fetch_add(1, std::memory_order_relaxed);
+
+		size_t peak = m_PeakBytes.load(std::memory_order_relaxed);
+		while (total > peak && !m_PeakBytes.compare_exchange_weak(peak, total, std::memory_order_relaxed))
+		{
+		}
+
+		return memory;
+	}
+
+	void do_deallocate(void* memory, size_t bytes, size_t alignment) override
+	{
+		m_Upstream->deallocate(memory, bytes, alignment);
+		m_Bytes.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+
+	std::pmr::memory_resource* m_Upstream;
+
+	std::atomic<size_t> m_Bytes{ 0 };
+	std::atomic<size_t> m_PeakBytes{ 0 };
+	std::atomic<std::uint64_t> m_Allocations{ 0 };
+	std::atomic<size_t> m_Budget{ 0 };
+};
+
+/**
+ * Memory straight from the OS in multiples of 2MB, using huge pages where the OS gives them out.
+ * Linux tries explicit huge pages first and falls back to transparent ones, Windows needs the lock pages privilege
+ * for large pages and otherwise falls back to normal pages. Meant as the upstream of pools and arenas,
+ * every allocation is at least one huge page.
+ */
+class HugePageResource : public std::pmr::memory_resource
+{
+public:
+	static constexpr size_t HugePageSize = size_t(2) << 20;
+
+	// Bytes that really ended up on explicit huge pages, the rest uses normal or transparent huge pages.
+	size_t GetHugePageBytes() const { return m_HugePageBytes.load(std::memory_order_relaxed); }
+
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		assert(alignment <= HugePageSize && "Alignment beyond a huge page.");
+
+		size_t size = RoundUp(bytes);
+
+#ifdef _WIN32
+		SIZE_T largePage = GetLargePageMinimum();
+		if (largePage != 0 && size % largePage == 0)
+		{
+			void* memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (memory)
+			{
+				m_HugePageBytes.fetch_add(size, std::memory_order_relaxed);
+				return memory;
+			}
+		}
+
+		void* memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (!memory)
+			throw std::bad_alloc();
+
+		return memory;
+#else
+	#ifdef MAP_HUGETLB
+		void* huge = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (huge != MAP_FAILED)
+		{
+			m_HugePageBytes.fetch_add(size, std::memory_order_relaxed);
+			return huge;
+		}
+	#endif
+
+		// Over-map so the block can be aligned to a huge page boundary, which transparent huge pages need.
+		size_t mappedSize = size + HugePageSize;
+		void* mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapped == MAP_FAILED)
+			throw std::bad_alloc();
+
+		std::uintptr_t start = reinterpret_cast<std::uintptr_t>(mapped);
+		std::uintptr_t aligned = (start + HugePageSize - 1) / HugePageSize * HugePageSize;
+
+		if (aligned > start)
+			munmap(mapped, aligned - start);
+		if (aligned + size < start + mappedSize)
+			munmap(reinterpret_cast<void*>(aligned + size), start + mappedSize - aligned - size);
+
+	#ifdef MADV_HUGEPAGE
+		madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+	#endif
+
+		return reinterpret_cast<void*>(aligned);
+#endif
+	}
+
+	void do_deallocate(void* memory, size_t bytes, size_t) override
+	{
+#ifdef _WIN32
+		(void)bytes;
+		VirtualFree(memory, 0, MEM_RELEASE);
+#else
+		munmap(memory, RoundUp(bytes));
+#endif
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+
+	static size_t RoundUp(size_t bytes)
+	{
+		return std::max<size_t>((bytes + HugePageSize - 1) / HugePageSize * HugePageSize, HugePageSize);
+	}
+
+	std::atomic<size_t> m_HugePageBytes{ 0 };
+};
+
+/**
+ * Bump allocator over big pages taken from an upstream resource. Deallocating does nothing, everything is given
+ * back at once by Release or the destructor, so on its own it suits data that lives as long as the world.
+ * Put a pool resource on top of it for containers that free and reuse memory.
+ */
+class PageArena : public std::pmr::memory_resource
+{
+public:
+	explicit PageArena(size_t pageSize = HugePageResource::HugePageSize, std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+		: m_PageSize(pageSize), m_Upstream(upstream)
+	{
+	}
+
+	~PageArena() { Release(); }
+
+	PageArena(const PageArena&) = delete;
+	PageArena& operator=(const PageArena&) = delete;
+
+	// Give every page back to the upstream, nothing allocated from the arena may be used afterwards.
+	void Release()
+	{
+		for (const Page& page : m_Pages)
+		{
+			m_Upstream->deallocate(page.memory, page.size, alignof(std::max_align_t));
+		}
+
+		m_Pages.clear();
+		m_Cursor = nullptr;
+		m_End = nullptr;
+		m_UsedBytes = 0;
+	}
+
+	size_t GetReservedBytes() const
+	{
+		size_t reserved = 0;
+		for (const Page& page : m_Pages)
+		{
+			reserved += page.size;
+		}
+
+		return reserved;
+	}
+
+	size_t GetUsedBytes() const { return m_UsedBytes; }
+	size_t GetPageCount() const { return m_Pages.size(); }
+
+private:
+	struct Page
+	{
+		void* memory;
+		size_t size;
+	};
+
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(m_Cursor) + alignment - 1) / alignment * alignment;
+
+		if (m_Cursor == nullptr || aligned + bytes > reinterpret_cast<std::uintptr_t>(m_End))
+		{
+			// Allocations bigger than a page get a page of their own.
+			size_t size = std::max(m_PageSize, bytes + alignment);
+			void* memory = m_Upstream->allocate(size, alignof(std::max_align_t));
+			m_Pages.push_back({ memory, size });
+
+			m_Cursor = static_cast<std::uint8_t*>(memory);
+			m_End = m_Cursor + size;
+			aligned = (reinterpret_cast<std::uintptr_t>(m_Cursor) + alignment - 1) / alignment * alignment;
+		}
+
+		m_Cursor = reinterpret_cast<std::uint8_t*>(aligned + bytes);
+		m_UsedBytes += bytes;
+
+		return reinterpret_cast<void*>(aligned);
+	}
+
+	void do_deallocate(void*, size_t, size_t) override
+	{
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+
+	size_t m_PageSize;
+	std::pmr::memory_resource* m_Upstream;
+
+	std::vector<Page> m_Pages;
+	std::uint8_t* m_Cursor{ nullptr };
+	std::uint8_t* m_End{ nullptr };
+	size_t m_UsedBytes{ 0 };
+};
+
+/**
+ * Pool resource whose chunks come from huge pages. Freed blocks are reused, so once the pools have grown to
+ * the working set, frames that create and destroy entities don't go to the OS anymore.
+ * Not thread safe, like std::pmr::unsynchronized_pool_resource.
+ */
+class HugePagePool : public std::pmr::memory_resource
+{
+public:
+	HugePagePool()
+		: m_Pool(&m_Pages)
+	{
+	}
+
+	const HugePageResource& GetPages() const { return m_Pages; }
+
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		return m_Pool.allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void* memory, size_t bytes, size_t alignment) override
+	{
+		m_Pool.deallocate(memory, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+
+	HugePageResource m_Pages;
+	std::pmr::unsynchronized_pool_resource m_Pool;
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include "Base.hpp"
+#include "EntityManager.hpp"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <vector>
+
+class ECS;
+
+enum class ComponentEvent : std::uint8_t
+{
+	Add,
+	Remove,
+	Set,
+	Count
+};
+
+// Called once per flush with every entity the event happened to since the last flush, in order.
+// Events are netted per flush: adding and removing a component in between reports neither, each entity is reported at
+// most once per add or remove, and adds and sets are only reported for entities that still have the component.
+// Removes are delivered before adds, so a component removed and added again shows up as a remove followed by an add.
+using ObserverCallback = std::function<void(ECS& ecs, const std::vector<Entity>& entities)>;
+
+class ObserverManager
+{
+public:
+	void AddObserver(ComponentEvent event, ComponentType type, ObserverCallback callback)
+	{
+		assert(type < MAX_COMPONENTS && "Component type out of range.");
+
+		auto& slot = m_Slots[static_cast<size_t>(event)][type];
+		slot.callbacks.push_back(std::move(callback));
+
+		m_Observed[static_cast<size_t>(event)].set(type, true);
+
+		// Adds and removes of the type are netted against each other from now on.
+		if (event != ComponentEvent::Set && !m_Tracked.test(type))
+		{
+			m_Tracked.set(type, true);
+			m_States[type].assign(MAX_ENTITIES, 0);
+		}
+	}
+
+	// Cheap check so unobserved component types don't record anything.
+	bool IsObserved(ComponentEvent event, ComponentType type) const
+	{
+		return m_Observed[static_cast<size_t>(event)].test(type);
+	}
+
+	void Record(ComponentEvent event, ComponentType type, Entity entity)
+	{
+		if (event != ComponentEvent::Set && m_Tracked.test(type))
+			Track(event, type, entity);
+
+		if (IsObserved(event, type))
+		{
+			m_Slots[static_cast<size_t>(event)][type].pending.push_back(entity);
+		}
+	}
+
+	// Record the event for every observed component type in the signature.
+	void Record(ComponentEvent event, Signature signature, Entity entity)
+	{
+		if (event != ComponentEvent::Set)
+		{
+			ForEachType(signature & m_Tracked, [&](ComponentType type)
+			{
+				Track(event, type, entity);
+			});
+		}
+
+		signature &= m_Observed[static_cast<size_t>(event)];
+
+		for (ComponentType type = 0; signature.any(); type++)
+		{
+			if (signature.test(type))
+			{
+				m_Slots[static_cast<size_t>(event)][type].pending.push_back(entity);
+				signature.reset(type);
+			}
+		}
+	}
+
+	// Record the event for every observed component type in the signature, for count entities at once.
+	void Record(ComponentEvent event, Signature signature, const Entity* entities, size_t count)
+	{
+		if (event != ComponentEvent::Set)
+		{
+			ForEachType(signature & m_Tracked, [&](ComponentType type)
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					Track(event, type, entities[i]);
+				}
+			});
+		}
+
+		signature &= m_Observed[static_cast<size_t>(event)];
+
+		for (ComponentType type = 0; signature.any(); type++)
+		{
+			if (signature.test(type))
+			{
+				auto& pending = m_Slots[static_cast<size_t>(event)][type].pending;
+				pending.insert(pending.end(), entities, entities + count);
+				signature.reset(type);
+			}
+		}
+	}
+
+	// True if events were recorded since the last flush.
+	bool HasPending() const
+	{
+		for (const auto& slots : m_Slots)
+		{
+			for (const auto& slot : slots)
+			{
+				if (!slot.pending.empty())
+					return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Net the batched event lists against the current entity state and hand them to their observers.
+	// Events recorded by the callbacks themselves are delivered on the next flush.
+	void Flush(ECS& ecs, const EntityManager& entityManager)
+	{
+		for (ComponentType type = 0; type < MAX_COMPONENTS; type++)
+		{
+			NetEvents(type, entityManager);
+		}
+
+		for (ComponentEvent event : { ComponentEvent::Remove, ComponentEvent::Add, ComponentEvent::Set })
+		{
+			for (ComponentType type = 0; type < MAX_COMPONENTS; type++)
+			{
+				auto& slot = m_Slots[static_cast<size_t>(event)][type];
+				if (slot.pending.empty())
+					continue;
+
+				// Swap so the lists keep their capacity and no allocation happens in steady state.
+				slot.delivering.swap(slot.pending);
+				for (const auto& callback : slot.callbacks)
+				{
+					callback(ecs, slot.delivering);
+				}
+				slot.delivering.clear();
+			}
+		}
+	}
+
+private:
+	// Per entity state of a tracked type between flushes.
+	static constexpr std::uint8_t TOUCHED = 1;
+	static constexpr std::uint8_t HAD_COMPONENT = 2;
+	static constexpr std::uint8_t REMOVE_REPORTED = 4;
+	static constexpr std::uint8_t ADD_REPORTED = 8;
+
+	template<typename F>
+	static void ForEachType(Signature signature, F&& function)
+	{
+		for (ComponentType type = 0; signature.any(); type++)
+		{
+			if (signature.test(type))
+			{
+				function(type);
+				signature.reset(type);
+			}
+		}
+	}
+
+	// The first add or remove since the last flush tells whether the entity had the component before.
+	void Track(ComponentEvent event, ComponentType type, Entity entity)
+	{
+		std::uint8_t& state = m_States[type][entity];
+		if (state & TOUCHED)
+			return;
+
+		state = TOUCHED | (event == ComponentEvent::Remove ? HAD_COMPONENT : 0);
+		m_Touched[type].push_back(entity);
+	}
+
+	void NetEvents(ComponentType type, const EntityManager& entityManager)
+	{
+		auto hasComponent = [&](Entity entity)
+		{
+			return entityManager.IsAlive(entity) && entityManager.GetSignature(entity).test(type);
+		};
+
+		auto& sets = m_Slots[static_cast<size_t>(ComponentEvent::Set)][type].pending;
+		sets.erase(std::remove_if(sets.begin(), sets.end(), [&](Entity entity) { return !hasComponent(entity); }), sets.end());
+
+		if (!m_Tracked.test(type))
+			return;
+
+		std::vector<std::uint8_t>& states = m_States[type];
+
+		// A remove only counts if the entity had the component before the batch.
+		auto& removes = m_Slots[static_cast<size_t>(ComponentEvent::Remove)][type].pending;
+		removes.erase(std::remove_if(removes.begin(), removes.end(), [&](Entity entity)
+		{
+			std::uint8_t& state = states[entity];
+			if (!(state & HAD_COMPONENT) || (state & REMOVE_REPORTED))
+				return true;
+
+			state |= REMOVE_REPORTED;
+			return false;
+		}), removes.end());
+
+		// An add only counts if the entity still has the component.
+		auto& adds = m_Slots[static_cast<size_t>(ComponentEvent::Add)][type].pending;
+		adds.erase(std::remove_if(adds.begin(), adds.end(), [&](Entity entity)
+		{
+			std::uint8_t& state = states[entity];
+			if ((state & ADD_REPORTED) || !hasComponent(entity))
+				return true;
+
+			state |= ADD_REPORTED;
+			return false;
+		}), adds.end());
+
+		for (Entity entity : m_Touched[type])
+		{
+			states[entity] = 0;
+		}
+		m_Touched[type].clear();
+	}
+
+	struct ObserverSlot
+	{
+		std::vector<ObserverCallback> callbacks;
+
+		// Entities recorded since the last flush.
+		std::vector<Entity> pending;
+
+		// List currently handed to the callbacks.
+		std::vector<Entity> delivering;
+	};
+
+	// Observers and event lists for every event and component type.
+	std::array<std::array<ObserverSlot, MAX_COMPONENTS>, static_cast<size_t>(ComponentEvent::Count)> m_Slots{};
+
+	// Component types with at least one observer, per event.
+	std::array<Signature, static_cast<size_t>(ComponentEvent::Count)> m_Observed{};
+
+	// Component types with add or remove observers, their adds and removes are netted in Flush.
+	Signature m_Tracked{};
+
+	// State of every entity and the entities added or removed since the last flush, per tracked type.
+	std::array<std::vector<std::uint8_t>, MAX_COMPONENTS> m_States{};
+	std::array<std::vector<Entity>, MAX_COMPONENTS> m_Touched{};
+};
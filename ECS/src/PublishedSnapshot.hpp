@@ -0,0 +1,291 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+#include "ECS.hpp"
+
+// Copy of one component column as it was at a publish.
+struct PublishedColumn
+{
+	const char* typeName{ nullptr };
+	size_t componentSize{ 0 };
+	size_t size{ 0 };
+
+	std::vector<Entity> entities;
+	std::vector<unsigned char> data;
+};
+
+// Typed read access to a published column.
+template<typename T>
+struct PublishedComponents
+{
+	const Entity* entities{ nullptr };
+	const T* data{ nullptr };
+	size_t size{ 0 };
+
+	// Call fn(entity, component) for every component of the column.
+	template<typename F>
+	void ForEach(F&& fn) const
+	{
+		for (size_t index = 0; index < size; index++)
+		{
+			fn(entities[index], data[index]);
+		}
+	}
+};
+
+class SnapshotPublisher;
+
+/**
+ * A reader's hold on one published frame, the frame isn't overwritten while the view is alive.
+ * Views are cheap to acquire but pin a buffer, so readers should let go once they're done with a frame.
+ */
+class PublishedView
+{
+public:
+	PublishedView() = default;
+
+	PublishedView(PublishedView&& other) noexcept
+		: m_Publisher(other.m_Publisher), m_Buffer(other.m_Buffer)
+	{
+		other.m_Publisher = nullptr;
+	}
+
+	PublishedView& operator=(PublishedView&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Release();
+			m_Publisher = other.m_Publisher;
+			m_Buffer = other.m_Buffer;
+			other.m_Publisher = nullptr;
+		}
+		return *this;
+	}
+
+	PublishedView(const PublishedView&) = delete;
+	PublishedView& operator=(const PublishedView&) = delete;
+
+	~PublishedView() { Release(); }
+
+	// False until the first publish.
+	bool IsValid() const { return m_Publisher != nullptr; }
+
+	// Number of the publish this view shows, counting from 1, and the world tick at that point.
+	inline std::uint64_t GetSequence() const;
+	inline Tick GetTick() const;
+
+	// Components of a tracked type as they were at the publish.
+	template<typename T>
+	PublishedComponents<T> Get() const;
+
+	inline void Release();
+
+private:
+	friend class SnapshotPublisher;
+
+	PublishedView(const SnapshotPublisher* publisher, size_t buffer)
+		: m_Publisher(publisher), m_Buffer(buffer)
+	{
+	}
+
+	const SnapshotPublisher* m_Publisher{ nullptr };
+	size_t m_Buffer{ 0 };
+};
+
+/**
+ * Publishes read-only copies of selected component columns for other threads, like a minimap, telemetry or
+ * AI planners, while the simulation keeps writing the world.
+ * The simulation thread calls Publish at the end of a frame, which copies the tracked columns into a buffer no
+ * reader holds and then makes it the current one with a single atomic store. Readers Acquire the current buffer
+ * by bumping its reader count, so neither side ever takes a lock and a reader sees one consistent frame for as long
+ * as it holds the view. With every spare buffer pinned by slow readers Publish skips the frame instead of waiting.
+ * Only tracked types cost memory, one copy per buffer. Types are tracked before readers start and must be
+ * trivially copyable, like the snapshot ring's columns.
+ */
+class SnapshotPublisher
+{
+public:
+	// Three buffers: the current one, one a reader may still hold and one to write.
+	SnapshotPublisher(ECS& ecs, size_t bufferCount = 3)
+		: m_ECS(ecs), m_Buffers(bufferCount)
+	{
+		assert(bufferCount >= 2 && "Publishing needs a buffer besides the current one.");
+	}
+
+	SnapshotPublisher(const SnapshotPublisher&) = delete;
+	SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+	~SnapshotPublisher()
+	{
+		for (const Buffer& buffer : m_Buffers)
+		{
+			assert(buffer.readers.load() == 0 && "Publisher destroyed while views are alive.");
+		}
+	}
+
+	template<typename T>
+	void Track()
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Published components must be trivially copyable.");
+		assert(m_Current.load() == NO_BUFFER && "Track every type before the first publish.");
+
+		ComponentType type = m_ECS.GetComponentType<T>();
+		assert(!m_Tracked.test(type) && "Component type tracked more than once.");
+		m_Tracked.set(type);
+
+		m_Columns.push_back(m_ECS.GetComponentManager()->GetComponentArray<T>().get());
+		for (Buffer& buffer : m_Buffers)
+		{
+			buffer.columns.emplace_back();
+			buffer.columns.back().typeName = typeid(T).name();
+			buffer.columns.back().componentSize = sizeof(T);
+		}
+	}
+
+	// Copy the tracked columns and make them the current frame. Only call from the thread writing the world,
+	// returns false if every spare buffer is held by a reader.
+	bool Publish()
+	{
+		size_t current = m_Current.load();
+
+		size_t target = NO_BUFFER;
+		for (size_t i = 0; i < m_Buffers.size(); i++)
+		{
+			if (i != current && m_Buffers[i].readers.load() == 0)
+			{
+				target = i;
+				break;
+			}
+		}
+
+		if (target == NO_BUFFER)
+		{
+			m_SkippedCount++;
+			return false;
+		}
+
+		Buffer& buffer = m_Buffers[target];
+		for (size_t i = 0; i < m_Columns.size(); i++)
+		{
+			const IComponentArray* array = m_Columns[i];
+			PublishedColumn& column = buffer.columns[i];
+
+			// Sizes only grow, so the buffers stop allocating once they've seen the largest frame.
+			column.size = array->Size();
+			if (column.entities.size() < column.size)
+			{
+				column.entities.resize(column.size);
+				column.data.resize(column.size * column.componentSize);
+			}
+
+			if (column.size > 0)
+			{
+				std::memcpy(column.entities.data(), array->RawEntities(), column.size * sizeof(Entity));
+				std::memcpy(column.data.data(), array->RawData(), column.size * column.componentSize);
+			}
+		}
+
+		buffer.sequence = ++m_Sequence;
+		buffer.tick = m_ECS.GetCurrentTick();
+
+		// Readers that pinned this buffer while it was written see it isn't current yet and retry.
+		m_Current.store(target);
+		return true;
+	}
+
+	// The latest published frame, invalid before the first publish. Safe to call from any thread.
+	PublishedView Acquire() const
+	{
+		for (;;)
+		{
+			size_t current = m_Current.load();
+			if (current == NO_BUFFER)
+				return PublishedView();
+
+			// The publisher never writes a buffer with readers, and only makes a buffer current once it's written,
+			// so a buffer that is still current after the pin is safe to read until it's released.
+			m_Buffers[current].readers.fetch_add(1);
+			if (m_Current.load() == current)
+				return PublishedView(this, current);
+
+			m_Buffers[current].readers.fetch_sub(1);
+		}
+	}
+
+	size_t GetBufferCount() const { return m_Buffers.size(); }
+
+	// Publishes skipped because readers held every spare buffer.
+	std::uint64_t GetSkippedCount() const { return m_SkippedCount; }
+
+private:
+	friend class PublishedView;
+
+	static constexpr size_t NO_BUFFER = ~size_t(0);
+
+	struct Buffer
+	{
+		mutable std::atomic<std::uint32_t> readers{ 0 };
+
+		std::uint64_t sequence{ 0 };
+		Tick tick{ 0 };
+
+		std::vector<PublishedColumn> columns;
+	};
+
+	ECS& m_ECS;
+
+	std::vector<Buffer> m_Buffers;
+	std::atomic<size_t> m_Current{ NO_BUFFER };
+
+	// Tracked arrays, parallel to every buffer's columns.
+	std::vector<const IComponentArray*> m_Columns;
+	Signature m_Tracked;
+
+	std::uint64_t m_Sequence{ 0 };
+	std::uint64_t m_SkippedCount{ 0 };
+};
+
+inline std::uint64_t PublishedView::GetSequence() const
+{
+	assert(IsValid() && "Reading an invalid view.");
+	return m_Publisher->m_Buffers[m_Buffer].sequence;
+}
+
+inline Tick PublishedView::GetTick() const
+{
+	assert(IsValid() && "Reading an invalid view.");
+	return m_Publisher->m_Buffers[m_Buffer].tick;
+}
+
+template<typename T>
+PublishedComponents<T> PublishedView::Get() const
+{
+	assert(IsValid() && "Reading an invalid view.");
+
+	// Found by type name, the world's type map isn't safe to read while the simulation runs.
+	const char* typeName = typeid(T).name();
+	for (const PublishedColumn& column : m_Publisher->m_Buffers[m_Buffer].columns)
+	{
+		if (column.typeName == typeName)
+			return { column.entities.data(), reinterpret_cast<const T*>(column.data.data()), column.size };
+	}
+
+	assert(false && "Component type not tracked.");
+	return {};
+}
+
+inline void PublishedView::Release()
+{
+	if (m_Publisher)
+	{
+		m_Publisher->m_Buffers[m_Buffer].readers.fetch_sub(1);
+		m_Publisher = nullptr;
+	}
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Base.hpp"
+#include "ComponentRegistry.hpp"
+
+// What happens to the pairs pointing at a target when it is destroyed.
+enum class RelationCleanup : std::uint8_t
+{
+	// The pairs are removed, their sources live on.
+	RemovePair,
+	// The sources are destroyed as well, e.g. for ownership.
+	DestroySources
+};
+
+/**
+ * Pairs (source, target) of one relation, e.g. every (ship, station) pair of DockedAt.
+ * Every source keeps the list of its targets and every target the list of its sources, and each entry knows its
+ * slot in the other list, so both directions are read in O(result) and a pair is removed in O(1) with swap removes.
+ * A source can have any number of targets, checking for an existing pair is linear in the source's targets.
+ */
+class RelationStorage
+{
+public:
+	RelationStorage(RelationCleanup cleanup, std::pmr::memory_resource* resource)
+		: m_Cleanup(cleanup), m_Targets(resource), m_Sources(resource)
+	{
+	}
+
+	// Returns false if the pair already exists.
+	bool Add(Entity source, Entity target)
+	{
+		auto& targets = m_Targets[source];
+		for (const Link& link : targets)
+		{
+			if (link.entity == target)
+				return false;
+		}
+
+		auto& sources = m_Sources[target];
+		targets.push_back({ target, static_cast<std::uint32_t>(sources.size()) });
+		sources.push_back({ source, static_cast<std::uint32_t>(targets.size() - 1) });
+		m_PairCount++;
+
+		return true;
+	}
+
+	// Returns false if there was no such pair.
+	bool Remove(Entity source, Entity target)
+	{
+		auto it = m_Targets.find(source);
+		if (it == m_Targets.end())
+			return false;
+
+		auto& targets = it->second;
+		for (std::uint32_t slot = 0; slot < targets.size(); slot++)
+		{
+			if (targets[slot].entity == target)
+			{
+				RemovePair(source, slot);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool Has(Entity source, Entity target) const
+	{
+		auto it = m_Targets.find(source);
+		if (it == m_Targets.end())
+			return false;
+
+		for (const Link& link : it->second)
+		{
+			if (link.entity == target)
+				return true;
+		}
+
+		return false;
+	}
+
+	// Target number index of source, or INVALID_ENTITY. Targets are in insertion order until one is removed.
+	Entity GetTarget(Entity source, size_t index = 0) const
+	{
+		auto it = m_Targets.find(source);
+		if (it == m_Targets.end() || index >= it->second.size())
+			return INVALID_ENTITY;
+
+		return it->second[index].entity;
+	}
+
+	size_t GetTargetCount(Entity source) const
+	{
+		auto it = m_Targets.find(source);
+		return it == m_Targets.end() ? 0 : it->second.size();
+	}
+
+	size_t GetSourceCount(Entity target) const
+	{
+		auto it = m_Sources.find(target);
+		return it == m_Sources.end() ? 0 : it->second.size();
+	}
+
+	// Call fn(target) for every pair of source. fn must not add or remove pairs of this relation.
+	template<typename F>
+	void ForEachTarget(Entity source, F&& fn) const
+	{
+		auto it = m_Targets.find(source);
+		if (it == m_Targets.end())
+			return;
+
+		for (const Link& link : it->second)
+		{
+			fn(link.entity);
+		}
+	}
+
+	// Call fn(source) for every pair pointing at target. fn must not add or remove pairs of this relation.
+	template<typename F>
+	void ForEachSource(Entity target, F&& fn) const
+	{
+		auto it = m_Sources.find(target);
+		if (it == m_Sources.end())
+			return;
+
+		for (const Link& link : it->second)
+		{
+			fn(link.entity);
+		}
+	}
+
+	// Remove every pair of source.
+	void RemoveTargets(Entity source)
+	{
+		auto it = m_Targets.find(source);
+		while (it != m_Targets.end())
+		{
+			// The last pair erases the list.
+			bool last = it->second.size() == 1;
+			RemovePair(source, static_cast<std::uint32_t>(it->second.size() - 1));
+			if (last)
+				break;
+		}
+	}
+
+	// Remove every pair of the entity in both directions, sources that have to be destroyed along are appended to cascade.
+	void EntityDestroyed(Entity entity, std::vector<Entity>& cascade)
+	{
+		RemoveTargets(entity);
+
+		auto it = m_Sources.find(entity);
+		while (it != m_Sources.end())
+		{
+			const Link& link = it->second.back();
+			if (m_Cleanup == RelationCleanup::DestroySources)
+				cascade.push_back(link.entity);
+
+			bool last = it->second.size() == 1;
+			RemovePair(link.entity, link.otherSlot);
+			if (last)
+				break;
+		}
+	}
+
+	// Re-key the pairs of every move's from entity to its to entity, which must have none.
+	void MoveEntities(const EntityMove* moves, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			MoveLinks(m_Targets, moves[i].from, moves[i].to, m_Sources);
+			MoveLinks(m_Sources, moves[i].from, moves[i].to, m_Targets);
+		}
+	}
+
+	RelationCleanup GetCleanup() const { return m_Cleanup; }
+	size_t GetPairCount() const { return m_PairCount; }
+
+	// Call fn(source, target) for every pair.
+	template<typename F>
+	void ForEachPair(F&& fn) const
+	{
+		for (const auto& pair : m_Targets)
+		{
+			for (const Link& link : pair.second)
+			{
+				fn(pair.first, link.entity);
+			}
+		}
+	}
+
+	void Clear()
+	{
+		m_Targets.clear();
+		m_Sources.clear();
+		m_PairCount = 0;
+	}
+
+private:
+	// Entry of a target or source list, otherSlot is the slot of the matching entry in the other entity's list.
+	struct Link
+	{
+		Entity entity;
+		std::uint32_t otherSlot;
+	};
+
+	using LinkMap = std::pmr::unordered_map<Entity, std::pmr::vector<Link>>;
+
+	// Remove the pair at slot of source's target list.
+	void RemovePair(Entity source, std::uint32_t slot)
+	{
+		auto targets = m_Targets.find(source);
+		Link link = targets->second[slot];
+
+		auto sources = m_Sources.find(link.entity);
+		RemoveLink(m_Sources, sources, link.otherSlot, m_Targets);
+		RemoveLink(m_Targets, targets, slot, m_Sources);
+
+		m_PairCount--;
+	}
+
+	// Swap remove the link at slot, point the moved link's counterpart at its new slot and drop emptied lists.
+	static void RemoveLink(LinkMap& map, LinkMap::iterator it, std::uint32_t slot, LinkMap& otherMap)
+	{
+		auto& links = it->second;
+		Link moved = links.back();
+		links[slot] = moved;
+		links.pop_back();
+
+		if (slot < links.size())
+			otherMap.find(moved.entity)->second[moved.otherSlot].otherSlot = slot;
+
+		if (links.empty())
+			map.erase(it);
+	}
+
+	// Point the counterparts of from's links at to and move the list to the key to, a pair of from with itself
+	// is fixed up by the second call.
+	static void MoveLinks(LinkMap& map, Entity from, Entity to, LinkMap& otherMap)
+	{
+		auto it = map.find(from);
+		if (it == map.end())
+			return;
+
+		for (const Link& link : it->second)
+		{
+			otherMap.find(link.entity)->second[link.otherSlot].entity = to;
+		}
+
+		auto node = map.extract(it);
+		node.key() = to;
+		map.insert(std::move(node));
+	}
+
+	RelationCleanup m_Cleanup;
+
+	// Source to its targets and target to its sources.
+	LinkMap m_Targets;
+	LinkMap m_Sources;
+
+	size_t m_PairCount{ 0 };
+};
+
+/**
+ * Relations between entities, one RelationStorage per relation type. Relation types are empty tag structs
+ * like ChildOf or DockedAt, they get their slot from the process-wide registry so lookups are an array index.
+ */
+class RelationManager
+{
+public:
+	explicit RelationManager(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		: m_Resource(resource)
+	{
+	}
+
+	template<typename R>
+	void RegisterRelation(RelationCleanup cleanup)
+	{
+		RelationType type = ComponentRegistry::GetRelationType<R>();
+		assert(!m_Relations[type] && "Cannot register a relation more than once.");
+
+		m_Relations[type] = std::make_unique<RelationStorage>(cleanup, m_Resource);
+	}
+
+	template<typename R>
+	RelationStorage& GetRelation()
+	{
+		RelationType type = ComponentRegistry::GetRelationType<R>();
+		assert(m_Relations[type] && "Relation not registered before use.");
+
+		return *m_Relations[type];
+	}
+
+	// Relations registered in this world, indexed by relation type.
+	const std::array<std::unique_ptr<RelationStorage>, MAX_RELATIONS>& GetRelations() const { return m_Relations; }
+
+	void EntityDestroyed(Entity entity, std::vector<Entity>& cascade)
+	{
+		for (const auto& relation : m_Relations)
+		{
+			if (relation)
+				relation->EntityDestroyed(entity, cascade);
+		}
+	}
+
+	void MoveEntities(const EntityMove* moves, size_t count)
+	{
+		for (const auto& relation : m_Relations)
+		{
+			if (relation)
+				relation->MoveEntities(moves, count);
+		}
+	}
+
+private:
+	std::pmr::memory_resource* m_Resource;
+
+	std::array<std::unique_ptr<RelationStorage>, MAX_RELATIONS> m_Relations;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Color with red in the lowest byte, the memory layout of GL_UNSIGNED_BYTE RGBA colors.
+constexpr std::uint32_t PackColor(std::uint8_t r, std::uint8_t g, std::uint8_t b, std::uint8_t a = 255)
+{
+	return std::uint32_t(r) | (std::uint32_t(g) << 8) | (std::uint32_t(b) << 16) | (std::uint32_t(a) << 24);
+}
+
+// Interleaved vertex, 2 floats of position followed by the packed color.
+struct QuadVertex
+{
+	float x, y;
+	std::uint32_t color;
+};
+
+// Range of the vertex buffer drawn with the same material.
+struct RenderBatch
+{
+	std::uint32_t material;
+	std::uint32_t firstVertex;
+	std::uint32_t vertexCount;
+};
+
+/**
+ * CPU side list of quads for one frame.
+ * Systems add quads in any order, Build sorts them by material and writes them into one contiguous vertex buffer,
+ * 4 vertices per quad in GL_QUADS order, so the whole frame is submitted with one draw per material instead of
+ * one per entity. Nothing here touches the GPU, so extraction can be tested and benchmarked headless.
+ */
+class RenderList
+{
+public:
+	void Clear()
+	{
+		m_Quads.clear();
+		m_Vertices.clear();
+		m_Batches.clear();
+	}
+
+	void Reserve(size_t quadCount)
+	{
+		m_Quads.reserve(quadCount);
+		m_Keys.reserve(quadCount);
+		m_Vertices.reserve(quadCount * 4);
+	}
+
+	void AddQuad(std::uint32_t material, float x, float y, float width, float height, std::uint32_t color)
+	{
+		m_Quads.push_back({ material, x, y, width, height, color });
+	}
+
+	// Sort the quads by material, keeping the order they were added in within a material, and fill the vertex buffer.
+	void Build()
+	{
+		m_Vertices.resize(m_Quads.size() * 4);
+		m_Batches.clear();
+
+		// Most frames only add quads in material order, e.g. a single material, so skip the sort then.
+		bool sorted = std::is_sorted(m_Quads.begin(), m_Quads.end(), [](const Quad& a, const Quad& b) { return a.material < b.material; });
+
+		if (!sorted)
+		{
+			// Material in the high bits and the add order in the low bits makes the sort stable.
+			m_Keys.resize(m_Quads.size());
+			for (size_t i = 0; i < m_Quads.size(); i++)
+			{
+				m_Keys[i] = (std::uint64_t(m_Quads[i].material) << 32) | i;
+			}
+			std::sort(m_Keys.begin(), m_Keys.end());
+		}
+
+		QuadVertex* vertex = m_Vertices.data();
+		for (size_t i = 0; i < m_Quads.size(); i++)
+		{
+			const Quad& quad = m_Quads[sorted ? i : static_cast<std::uint32_t>(m_Keys[i])];
+
+			vertex[0] = { quad.x, quad.y, quad.color };
+			vertex[1] = { quad.x + quad.width, quad.y, quad.color };
+			vertex[2] = { quad.x + quad.width, quad.y + quad.height, quad.color };
+			vertex[3] = { quad.x, quad.y + quad.height, quad.color };
+			vertex += 4;
+
+			if (m_Batches.empty() || m_Batches.back().material != quad.material)
+				m_Batches.push_back({ quad.material, static_cast<std::uint32_t>(i * 4), 0 });
+			m_Batches.back().vertexCount += 4;
+		}
+	}
+
+	size_t GetQuadCount() const { return m_Quads.size(); }
+
+	// Valid after Build.
+	const std::vector<QuadVertex>& GetVertices() const { return m_Vertices; }
+	const std::vector<RenderBatch>& GetBatches() const { return m_Batches; }
+
+private:
+	struct Quad
+	{
+		std::uint32_t material;
+		float x, y, width, height;
+		std::uint32_t color;
+	};
+
+	// Quads in the order they were added.
+	std::vector<Quad> m_Quads;
+
+	// Sort keys, kept around so building doesn't allocate in steady state.
+	std::vector<std::uint64_t> m_Keys;
+
+	std::vector<QuadVertex> m_Vertices;
+	std::vector<RenderBatch> m_Batches;
+};
@@ -0,0 +1,882 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "ECS.hpp"
+
+using ClientId = std::uint32_t;
+
+// Bits needed to store value, 0 for 0.
+constexpr std::uint32_t BitWidth(std::uint32_t value)
+{
+	std::uint32_t width = 0;
+	while (width < 32 && (value >> width) != 0)
+	{
+		width++;
+	}
+	return width;
+}
+
+/**
+ * Bit stream of 64-bit words, written LSB first. Sent as the little endian bytes of the words, like the state hash
+ * reads them, so both ends must be little endian.
+ */
+class BitWriter
+{
+public:
+	void Clear()
+	{
+		std::fill(m_Words.begin(), m_Words.begin() + std::min(m_Words.size(), m_Bits / 64 + 2), std::uint64_t(0));
+		m_Bits = 0;
+	}
+
+	// Write the low bits of value, up to 32.
+	void Write(std::uint32_t value, std::uint32_t bits)
+	{
+		assert(bits <= 32 && (bits == 32 || (value >> bits) == 0) && "Value doesn't fit the bits.");
+
+		size_t word = m_Bits / 64;
+		std::uint32_t offset = m_Bits % 64;
+		if (word + 2 > m_Words.size())
+			m_Words.resize(std::max<size_t>(64, m_Words.size() * 2), 0);
+
+		m_Words[word] |= std::uint64_t(value) << offset;
+		if (offset + bits > 64)
+			m_Words[word + 1] |= std::uint64_t(value) >> (64 - offset);
+
+		m_Bits += bits;
+	}
+
+	// Overwrite bits written as zeros before, e.g. a count only known at the end.
+	void Patch(size_t position, std::uint32_t value, std::uint32_t bits)
+	{
+		assert(position + bits <= m_Bits && "Patching bits that weren't written.");
+
+		size_t word = position / 64;
+		std::uint32_t offset = position % 64;
+		m_Words[word] |= std::uint64_t(value) << offset;
+		if (offset + bits > 64)
+			m_Words[word + 1] |= std::uint64_t(value) >> (64 - offset);
+	}
+
+	// Copy bits from another stream, 32 at a time.
+	void Append(const BitWriter& source, size_t position, size_t bits)
+	{
+		while (bits > 0)
+		{
+			std::uint32_t count = static_cast<std::uint32_t>(std::min<size_t>(bits, 32));
+			Write(source.Read(position, count), count);
+			position += count;
+			bits -= count;
+		}
+	}
+
+	std::uint32_t Read(size_t position, std::uint32_t bits) const
+	{
+		size_t word = position / 64;
+		std::uint32_t offset = position % 64;
+
+		std::uint64_t value = m_Words[word] >> offset;
+		if (offset + bits > 64)
+			value |= m_Words[word + 1] << (64 - offset);
+
+		return static_cast<std::uint32_t>(value & ((std::uint64_t(1) << bits) - 1));
+	}
+
+	// Small values cheap: 5 bits of width, then the value without its leading one.
+	void WriteVarBits(std::uint32_t value)
+	{
+		std::uint32_t width = BitWidth(value);
+		Write(width, 5);
+		if (width > 1)
+			Write(value & ~(std::uint32_t(1) << (width - 1)), width - 1);
+	}
+
+	size_t GetBitCount() const { return m_Bits; }
+	size_t GetByteCount() const { return (m_Bits + 7) / 8; }
+	const std::uint8_t* GetBytes() const { return reinterpret_cast<const std::uint8_t*>(m_Words.data()); }
+
+private:
+	std::vector<std::uint64_t> m_Words;
+	size_t m_Bits{ 0 };
+};
+
+// Reads a BitWriter's bytes, reading past the end gives zeros.
+class BitReader
+{
+public:
+	// Start reading a packet, the reader keeps its buffer so reading every packet doesn't allocate.
+	void Reset(const std::uint8_t* data, size_t size)
+	{
+		m_Words.assign((size + 7) / 8 + 1, 0);
+		if (size > 0)
+			std::memcpy(m_Words.data(), data, size);
+
+		m_Size = size * 8;
+		m_Bits = 0;
+	}
+
+	std::uint32_t Read(std::uint32_t bits)
+	{
+		if (bits == 0)
+			return 0;
+
+		size_t word = m_Bits / 64;
+		std::uint32_t offset = m_Bits % 64;
+		m_Bits += bits;
+		if (word + 1 >= m_Words.size())
+			return 0;
+
+		std::uint64_t value = m_Words[word] >> offset;
+		if (offset + bits > 64)
+			value |= m_Words[word + 1] << (64 - offset);
+
+		return static_cast<std::uint32_t>(value & ((std::uint64_t(1) << bits) - 1));
+	}
+
+	std::uint32_t ReadVarBits()
+	{
+		std::uint32_t width = Read(5);
+		if (width <= 1)
+			return width;
+
+		return Read(width - 1) | (std::uint32_t(1) << (width - 1));
+	}
+
+	// False once more bits were read than the packet has, i.e. the packet was cut off or corrupt.
+	bool IsValid() const { return m_Bits <= m_Size; }
+
+private:
+	std::vector<std::uint64_t> m_Words;
+	size_t m_Size{ 0 };
+	size_t m_Bits{ 0 };
+};
+
+// Replicated components go over the wire as up to 32 words of 32 bits.
+constexpr std::uint32_t MAX_REPLICATED_WORDS = 32;
+
+// Bits of the entity counts in a packet.
+constexpr std::uint32_t REPLICATION_COUNT_BITS = BitWidth(MAX_ENTITIES);
+
+// Components as words, a set bit per word that isn't zero, then every such word bit-packed with its width.
+// Deltas are the XOR with the last sent value, so a small change to a float only costs its low mantissa bits.
+inline void WriteReplicatedWords(BitWriter& writer, const std::uint32_t* words, std::uint32_t count)
+{
+	std::uint32_t mask = 0;
+	for (std::uint32_t i = 0; i < count; i++)
+	{
+		mask |= std::uint32_t(words[i] != 0) << i;
+	}
+	writer.Write(mask, count);
+
+	for (std::uint32_t i = 0; i < count; i++)
+	{
+		if (words[i] == 0)
+			continue;
+
+		std::uint32_t width = BitWidth(words[i]);
+		writer.Write(width - 1, 5);
+		if (width > 1)
+			writer.Write(words[i] & ~(std::uint32_t(1) << (width - 1)), width - 1);
+	}
+}
+
+inline void ReadReplicatedWords(BitReader& reader, std::uint32_t* words, std::uint32_t count)
+{
+	std::uint32_t mask = reader.Read(count);
+	for (std::uint32_t i = 0; i < count; i++)
+	{
+		words[i] = 0;
+		if ((mask >> i) & 1)
+		{
+			std::uint32_t width = reader.Read(5) + 1;
+			words[i] = reader.Read(width - 1) | (std::uint32_t(1) << (width - 1));
+		}
+	}
+}
+
+/**
+ * Delivers packets from a ReplicationServer to its clients. A client's packets must arrive complete and in the
+ * order they were sent, like over a stream socket or a reliable channel on top of UDP, because every packet
+ * is a delta on top of the ones before it.
+ */
+class IReplicationTransport
+{
+public:
+	virtual ~IReplicationTransport() = default;
+	virtual void Send(ClientId client, const std::uint8_t* data, size_t size) = 0;
+};
+
+/**
+ * Replicates components of an authoritative world to clients, one packet per client per Update.
+ * A client is sent the entities in its interest set that have a replicated component: entities entering the set
+ * are spawned with all their replicated components, entities leaving it or destroyed are despawned and the entities
+ * it already has get the components changed since the last Update, found by change tick, as XOR deltas against the
+ * value sent last time. Every client is sent every Update, so they all have the same last sent values and deltas
+ * are encoded once per changed entity and copied into every interested client's packet.
+ * Replicated components must be trivially copyable, at most 128 bytes and have zeroed padding. Prefabs aren't
+ * replicated. An entity destroyed and its ID reused between two updates looks like the same entity to clients.
+ */
+class ReplicationServer
+{
+public:
+	ReplicationServer(ECS& ecs, IReplicationTransport& transport)
+		: m_ECS(ecs), m_Transport(transport), m_Masks(MAX_ENTITIES, 0), m_ChangedTypes(MAX_ENTITIES, 0), m_Removed(MAX_ENTITIES, 0),
+		m_Present(WORDS, 0), m_Changed(WORDS, 0), m_RecordStart(MAX_ENTITIES, 0), m_RecordBits(MAX_ENTITIES, 0),
+		m_SpawnUpdate(MAX_ENTITIES, 0), m_SpawnStart(MAX_ENTITIES, 0), m_SpawnBits(MAX_ENTITIES, 0)
+	{
+	}
+
+	ReplicationServer(const ReplicationServer&) = delete;
+	ReplicationServer& operator=(const ReplicationServer&) = delete;
+
+	// Types are numbered in the order they are replicated, clients must replicate the same types in the same order.
+	template<typename T>
+	void Replicate()
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Replicated components must be trivially copyable.");
+		static_assert(sizeof(T) <= MAX_REPLICATED_WORDS * sizeof(std::uint32_t), "Replicated components are at most 128 bytes.");
+		assert(m_UpdateCount == 0 && "Replicate every type before the first update.");
+		assert(m_Types.size() < MAX_COMPONENTS && "Too many replicated types.");
+
+		ComponentType type = m_ECS.GetComponentType<T>();
+		assert(!m_ReplicatedTypes.test(type) && "Component type replicated more than once.");
+		m_ReplicatedTypes.set(type);
+
+		Type replicated;
+		replicated.type = type;
+		replicated.array = m_ECS.GetComponentManager()->GetComponentArray<T>().get();
+		replicated.size = sizeof(T);
+		replicated.words = static_cast<std::uint32_t>((sizeof(T) + sizeof(std::uint32_t) - 1) / sizeof(std::uint32_t));
+		replicated.sent.resize(size_t(MAX_ENTITIES) * replicated.words, 0);
+		replicated.deltas.resize(size_t(MAX_ENTITIES) * replicated.words, 0);
+		m_Types.push_back(std::move(replicated));
+	}
+
+	// Clients start with an empty interest set.
+	ClientId AddClient()
+	{
+		ClientId id = static_cast<ClientId>(m_Clients.size());
+		m_Clients.emplace_back();
+		m_Clients.back().interest.resize(WORDS, 0);
+		m_Clients.back().known.resize(WORDS, 0);
+		m_Clients.back().active = true;
+
+		return id;
+	}
+
+	// The client isn't sent anything anymore, IDs aren't reused.
+	void RemoveClient(ClientId client)
+	{
+		Client& removed = m_Clients[client];
+		removed.active = false;
+		std::fill(removed.interest.begin(), removed.interest.end(), std::uint64_t(0));
+		std::fill(removed.known.begin(), removed.known.end(), std::uint64_t(0));
+	}
+
+	void SetInterest(ClientId client, Entity entity, bool interested)
+	{
+		assert(entity < MAX_ENTITIES && "Entity out of range.");
+
+		std::uint64_t& word = m_Clients[client].interest[entity / 64];
+		std::uint64_t bit = std::uint64_t(1) << (entity % 64);
+		word = interested ? word | bit : word & ~bit;
+	}
+
+	bool IsInterested(ClientId client, Entity entity) const
+	{
+		return (m_Clients[client].interest[entity / 64] >> (entity % 64)) & 1;
+	}
+
+	void ClearInterest(ClientId client)
+	{
+		std::fill(m_Clients[client].interest.begin(), m_Clients[client].interest.end(), std::uint64_t(0));
+	}
+
+	struct ClientStats
+	{
+		// During the last update.
+		std::uint32_t bytes{ 0 };
+		std::uint32_t spawned{ 0 };
+		std::uint32_t despawned{ 0 };
+		std::uint32_t updated{ 0 };
+
+		// Since the client was added.
+		std::uint64_t totalBytes{ 0 };
+	};
+
+	const ClientStats& GetClientStats(ClientId client) const { return m_Clients[client].stats; }
+
+	// Send every active client the changes since the last update. Call once per network tick from the thread
+	// owning the world, with no job running, e.g. at the end of a World frame.
+	void Update()
+	{
+		Tick tick = m_ECS.AdvanceTick();
+		m_UpdateCount++;
+
+		ResetChanges();
+		UpdateSignatures();
+		for (std::uint32_t index = 0; index < m_Types.size(); index++)
+		{
+			UpdateComponents(index);
+		}
+		EncodeRecords();
+
+		m_LastTick = tick;
+
+		m_Spawns.Clear();
+		for (ClientId client = 0; client < m_Clients.size(); client++)
+		{
+			if (m_Clients[client].active)
+				SendClient(client);
+		}
+	}
+
+	// Number of the last update, sent in every packet.
+	std::uint32_t GetUpdateCount() const { return m_UpdateCount; }
+
+	// Entities with changed replicated components in the last update, over all clients.
+	size_t GetChangedCount() const { return m_ChangedEntities.size(); }
+
+private:
+	static constexpr std::uint32_t WORDS = (MAX_ENTITIES + 63) / 64;
+
+	struct Type
+	{
+		ComponentType type;
+		const IComponentArray* array;
+		size_t size;
+		std::uint32_t words;
+
+		// By entity: the value every client that has the entity was sent last, and this update's XOR with it.
+		std::vector<std::uint32_t> sent;
+		std::vector<std::uint32_t> deltas;
+	};
+
+	struct Client
+	{
+		// Entity bits, the entities the client wants and the ones it was spawned.
+		std::vector<std::uint64_t> interest;
+		std::vector<std::uint64_t> known;
+
+		bool active{ false };
+		ClientStats stats;
+	};
+
+	void ResetChanges()
+	{
+		for (Entity entity : m_ChangedEntities)
+		{
+			m_ChangedTypes[entity] = 0;
+			m_Removed[entity] = 0;
+			m_Changed[entity / 64] = 0;
+		}
+		m_ChangedEntities.clear();
+	}
+
+	void MarkChanged(Entity entity)
+	{
+		std::uint64_t bit = std::uint64_t(1) << (entity % 64);
+		if (m_Changed[entity / 64] & bit)
+			return;
+
+		m_Changed[entity / 64] |= bit;
+		m_ChangedEntities.push_back(entity);
+	}
+
+	// Replicated types of every entity whose signature changed, removed components are forgotten.
+	// Added components are sent even if their delta to zero is empty, the client has to add them.
+	void UpdateSignatures()
+	{
+		const auto& entityManager = m_ECS.GetEntityManager();
+		const Tick* signatureTicks = entityManager->GetSignatureTicks();
+
+		for (Entity entity = 0; entity < MAX_ENTITIES; entity++)
+		{
+			if (!IsNewerTick(signatureTicks[entity], m_LastTick))
+				continue;
+
+			std::uint32_t mask = 0;
+			if (entityManager->IsAlive(entity) && !entityManager->IsPrefab(entity))
+			{
+				Signature signature = entityManager->GetSignature(entity);
+				for (std::uint32_t index = 0; index < m_Types.size(); index++)
+				{
+					mask |= std::uint32_t(signature.test(m_Types[index].type)) << index;
+				}
+			}
+
+			std::uint32_t removed = m_Masks[entity] & ~mask;
+			for (std::uint32_t index = 0; index < m_Types.size(); index++)
+			{
+				if ((removed >> index) & 1)
+				{
+					Type& type = m_Types[index];
+					std::fill_n(type.sent.begin() + size_t(entity) * type.words, type.words, std::uint32_t(0));
+				}
+			}
+
+			if (removed != 0)
+			{
+				m_Removed[entity] = removed;
+				MarkChanged(entity);
+			}
+
+			std::uint32_t added = mask & ~m_Masks[entity];
+			if (added != 0)
+			{
+				m_ChangedTypes[entity] |= added;
+				MarkChanged(entity);
+			}
+
+			m_Masks[entity] = mask;
+			std::uint64_t bit = std::uint64_t(1) << (entity % 64);
+			m_Present[entity / 64] = mask != 0 ? m_Present[entity / 64] | bit : m_Present[entity / 64] & ~bit;
+		}
+	}
+
+	// Deltas of the components changed since the last update, components written with the same value are skipped.
+	void UpdateComponents(std::uint32_t index)
+	{
+		Type& type = m_Types[index];
+		const Tick* ticks = type.array->ChangeTicks();
+		const Entity* entities = type.array->RawEntities();
+		const unsigned char* data = static_cast<const unsigned char*>(type.array->RawData());
+		size_t size = type.array->Size();
+
+		for (size_t slot = 0; slot < size; slot++)
+		{
+			if (!IsNewerTick(ticks[slot], m_LastTick))
+				continue;
+
+			Entity entity = entities[slot];
+			if (!((m_Masks[entity] >> index) & 1))
+				continue;
+
+			std::uint32_t words[MAX_REPLICATED_WORDS] = {};
+			std::memcpy(words, data + slot * type.size, type.size);
+
+			std::uint32_t* sent = type.sent.data() + size_t(entity) * type.words;
+			std::uint32_t* delta = type.deltas.data() + size_t(entity) * type.words;
+			std::uint32_t changed = 0;
+			for (std::uint32_t word = 0; word < type.words; word++)
+			{
+				delta[word] = words[word] ^ sent[word];
+				changed |= delta[word];
+				sent[word] = words[word];
+			}
+
+			if (changed == 0)
+				continue;
+
+			m_ChangedTypes[entity] |= std::uint32_t(1) << index;
+			MarkChanged(entity);
+		}
+	}
+
+	// One update record per changed entity, shared by every client's packet:
+	// changed types, removed types, then the delta of every changed type.
+	void EncodeRecords()
+	{
+		std::sort(m_ChangedEntities.begin(), m_ChangedEntities.end());
+
+		std::uint32_t typeCount = static_cast<std::uint32_t>(m_Types.size());
+		m_Records.Clear();
+		for (Entity entity : m_ChangedEntities)
+		{
+			std::uint32_t changed = m_ChangedTypes[entity];
+			m_RecordStart[entity] = static_cast<std::uint32_t>(m_Records.GetBitCount());
+			m_Records.Write(changed, typeCount);
+			m_Records.Write(m_Removed[entity], typeCount);
+			for (std::uint32_t index = 0; index < typeCount; index++)
+			{
+				if ((changed >> index) & 1)
+				{
+					const Type& type = m_Types[index];
+					WriteReplicatedWords(m_Records, type.deltas.data() + size_t(entity) * type.words, type.words);
+				}
+			}
+			m_RecordBits[entity] = static_cast<std::uint32_t>(m_Records.GetBitCount() - m_RecordStart[entity]);
+		}
+	}
+
+	// Spawn record of an entity, its replicated types and their whole values, encoded once per update.
+	void EncodeSpawn(Entity entity)
+	{
+		if (m_SpawnUpdate[entity] == m_UpdateCount)
+			return;
+
+		m_SpawnUpdate[entity] = m_UpdateCount;
+		m_SpawnStart[entity] = static_cast<std::uint32_t>(m_Spawns.GetBitCount());
+
+		std::uint32_t mask = m_Masks[entity];
+		m_Spawns.Write(mask, static_cast<std::uint32_t>(m_Types.size()));
+		for (std::uint32_t index = 0; index < m_Types.size(); index++)
+		{
+			if ((mask >> index) & 1)
+			{
+				const Type& type = m_Types[index];
+				WriteReplicatedWords(m_Spawns, type.sent.data() + size_t(entity) * type.words, type.words);
+			}
+		}
+
+		m_SpawnBits[entity] = static_cast<std::uint32_t>(m_Spawns.GetBitCount() - m_SpawnStart[entity]);
+	}
+
+	// Packet: update number, type count, then despawned, updated and spawned entities, each section a count and
+	// ascending entities as gaps to the previous one followed by their record.
+	void SendClient(ClientId id)
+	{
+		Client& client = m_Clients[id];
+		client.stats.spawned = client.stats.despawned = client.stats.updated = 0;
+
+		BitWriter& packet = m_Packet;
+		packet.Clear();
+		packet.Write(m_UpdateCount, 32);
+		packet.Write(static_cast<std::uint32_t>(m_Types.size()), 6);
+
+		// Gone from the interest set or the world.
+		size_t countPosition = packet.GetBitCount();
+		packet.Write(0, REPLICATION_COUNT_BITS);
+		Entity previous = INVALID_ENTITY;
+		for (std::uint32_t word = 0; word < WORDS; word++)
+		{
+			std::uint64_t bits = client.known[word] & ~(client.interest[word] & m_Present[word]);
+			ForEachBit(bits, word, [&](Entity entity)
+			{
+				packet.WriteVarBits(entity - previous - 1);
+				previous = entity;
+				client.stats.despawned++;
+			});
+			client.known[word] &= ~bits;
+		}
+		packet.Patch(countPosition, client.stats.despawned, REPLICATION_COUNT_BITS);
+
+		// Changes to entities the client already has, before the new ones are added to known.
+		countPosition = packet.GetBitCount();
+		packet.Write(0, REPLICATION_COUNT_BITS);
+		previous = INVALID_ENTITY;
+		for (std::uint32_t word = 0; word < WORDS; word++)
+		{
+			std::uint64_t bits = client.known[word] & m_Changed[word];
+			ForEachBit(bits, word, [&](Entity entity)
+			{
+				packet.WriteVarBits(entity - previous - 1);
+				packet.Append(m_Records, m_RecordStart[entity], m_RecordBits[entity]);
+				previous = entity;
+				client.stats.updated++;
+			});
+		}
+		packet.Patch(countPosition, client.stats.updated, REPLICATION_COUNT_BITS);
+
+		countPosition = packet.GetBitCount();
+		packet.Write(0, REPLICATION_COUNT_BITS);
+		previous = INVALID_ENTITY;
+		for (std::uint32_t word = 0; word < WORDS; word++)
+		{
+			std::uint64_t bits = client.interest[word] & m_Present[word] & ~client.known[word];
+			ForEachBit(bits, word, [&](Entity entity)
+			{
+				EncodeSpawn(entity);
+				packet.WriteVarBits(entity - previous - 1);
+				packet.Append(m_Spawns, m_SpawnStart[entity], m_SpawnBits[entity]);
+				previous = entity;
+				client.stats.spawned++;
+			});
+			client.known[word] |= bits;
+		}
+		packet.Patch(countPosition, client.stats.spawned, REPLICATION_COUNT_BITS);
+
+		client.stats.bytes = static_cast<std::uint32_t>(packet.GetByteCount());
+		client.stats.totalBytes += client.stats.bytes;
+		m_Transport.Send(id, packet.GetBytes(), packet.GetByteCount());
+	}
+
+	template<typename F>
+	static void ForEachBit(std::uint64_t bits, std::uint32_t word, F&& fn)
+	{
+		for (Entity bit = 0; bits != 0; bit++, bits >>= 1)
+		{
+			if (bits & 1)
+				fn(word * 64 + bit);
+		}
+	}
+
+	ECS& m_ECS;
+	IReplicationTransport& m_Transport;
+
+	std::vector<Type> m_Types;
+	Signature m_ReplicatedTypes;
+	std::vector<Client> m_Clients;
+
+	// By entity: replicated types it has, and types changed and removed this update.
+	std::vector<std::uint32_t> m_Masks;
+	std::vector<std::uint32_t> m_ChangedTypes;
+	std::vector<std::uint32_t> m_Removed;
+
+	// Entity bits of the entities with a replicated component, and of the ones changed this update.
+	std::vector<std::uint64_t> m_Present;
+	std::vector<std::uint64_t> m_Changed;
+	std::vector<Entity> m_ChangedEntities;
+
+	// Update records of this update and where every changed entity's record is.
+	BitWriter m_Records;
+	std::vector<std::uint32_t> m_RecordStart;
+	std::vector<std::uint32_t> m_RecordBits;
+
+	// Spawn records, encoded the first time a client needs them in an update.
+	BitWriter m_Spawns;
+	std::vector<std::uint32_t> m_SpawnUpdate;
+	std::vector<std::uint32_t> m_SpawnStart;
+	std::vector<std::uint32_t> m_SpawnBits;
+
+	BitWriter m_Packet;
+
+	Tick m_LastTick{ 0 };
+	std::uint32_t m_UpdateCount{ 0 };
+};
+
+/**
+ * Applies a ReplicationServer's packets to a client world. Replicated entities are created in the client's world
+ * with its own IDs, GetLocalEntity maps the server's IDs to them. Components are added, written and removed through
+ * the ECS, so the client's systems and change ticks see replicated changes like local ones.
+ */
+class ReplicationClient
+{
+public:
+	ReplicationClient(ECS& ecs)
+		: m_ECS(ecs), m_LocalEntities(MAX_ENTITIES, INVALID_ENTITY), m_Masks(MAX_ENTITIES, 0)
+	{
+	}
+
+	ReplicationClient(const ReplicationClient&) = delete;
+	ReplicationClient& operator=(const ReplicationClient&) = delete;
+
+	// Same types in the same order as on the server.
+	template<typename T>
+	void Replicate()
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Replicated components must be trivially copyable.");
+		static_assert(sizeof(T) <= MAX_REPLICATED_WORDS * sizeof(std::uint32_t), "Replicated components are at most 128 bytes.");
+		assert(m_Types.size() < MAX_COMPONENTS && "Too many replicated types.");
+
+		Type replicated;
+		replicated.words = static_cast<std::uint32_t>((sizeof(T) + sizeof(std::uint32_t) - 1) / sizeof(std::uint32_t));
+		replicated.add = [](ECS& ecs, Entity entity, const std::uint32_t* words)
+		{
+			T component;
+			std::memcpy(&component, words, sizeof(T));
+			ecs.AddComponent(entity, std::move(component));
+		};
+		replicated.apply = [](ECS& ecs, Entity entity, const std::uint32_t* delta)
+		{
+			T& component = ecs.GetComponent<T>(entity);
+			std::uint32_t words[MAX_REPLICATED_WORDS] = {};
+			std::memcpy(words, &component, sizeof(T));
+			for (size_t word = 0; word < (sizeof(T) + sizeof(std::uint32_t) - 1) / sizeof(std::uint32_t); word++)
+			{
+				words[word] ^= delta[word];
+			}
+			std::memcpy(&component, words, sizeof(T));
+		};
+		replicated.remove = [](ECS& ecs, Entity entity)
+		{
+			ecs.RemoveComponent<T>(entity);
+		};
+		m_Types.push_back(replicated);
+	}
+
+	// Apply one packet, packets have to be received in the order they were sent.
+	// Returns false if the packet is cut off, corrupt or made for other replicated types.
+	bool Receive(const std::uint8_t* data, size_t size)
+	{
+		BitReader& reader = m_Reader;
+		reader.Reset(data, size);
+
+		std::uint32_t update = reader.Read(32);
+		std::uint32_t typeCount = reader.Read(6);
+		if (typeCount != m_Types.size())
+		{
+			assert(false && "Client and server replicate different types.");
+			return false;
+		}
+
+		Entity entity = INVALID_ENTITY;
+		std::uint32_t count = reader.Read(REPLICATION_COUNT_BITS);
+		for (std::uint32_t i = 0; i < count; i++)
+		{
+			if (!NextEntity(reader, entity))
+				return false;
+
+			if (m_LocalEntities[entity] != INVALID_ENTITY)
+			{
+				m_ECS.DestroyEntity(m_LocalEntities[entity]);
+				m_LocalEntities[entity] = INVALID_ENTITY;
+				m_Masks[entity] = 0;
+				m_EntityCount--;
+			}
+		}
+
+		entity = INVALID_ENTITY;
+		count = reader.Read(REPLICATION_COUNT_BITS);
+		for (std::uint32_t i = 0; i < count; i++)
+		{
+			if (!NextEntity(reader, entity) || m_LocalEntities[entity] == INVALID_ENTITY)
+				return false;
+
+			Entity local = m_LocalEntities[entity];
+			std::uint32_t changed = reader.Read(typeCount);
+			std::uint32_t removed = reader.Read(typeCount);
+
+			// Components the entity doesn't have yet were sent as a delta to zero, which is their value.
+			std::uint32_t words[MAX_REPLICATED_WORDS];
+			for (std::uint32_t index = 0; index < typeCount; index++)
+			{
+				if (!((changed >> index) & 1))
+					continue;
+
+				ReadReplicatedWords(reader, words, m_Types[index].words);
+				if ((m_Masks[entity] >> index) & 1)
+					m_Types[index].apply(m_ECS, local, words);
+				else
+					m_Types[index].add(m_ECS, local, words);
+			}
+
+			for (std::uint32_t index = 0; index < typeCount; index++)
+			{
+				if ((removed >> index) & (m_Masks[entity] >> index) & 1)
+					m_Types[index].remove(m_ECS, local);
+			}
+
+			m_Masks[entity] = (m_Masks[entity] | changed) & ~removed;
+			m_UpdatedCount++;
+		}
+
+		entity = INVALID_ENTITY;
+		count = reader.Read(REPLICATION_COUNT_BITS);
+		for (std::uint32_t i = 0; i < count; i++)
+		{
+			if (!NextEntity(reader, entity) || m_LocalEntities[entity] != INVALID_ENTITY)
+				return false;
+
+			Entity local = m_ECS.CreateEntity();
+			m_LocalEntities[entity] = local;
+			m_Masks[entity] = reader.Read(typeCount);
+			m_EntityCount++;
+
+			std::uint32_t words[MAX_REPLICATED_WORDS];
+			for (std::uint32_t index = 0; index < typeCount; index++)
+			{
+				if ((m_Masks[entity] >> index) & 1)
+				{
+					ReadReplicatedWords(reader, words, m_Types[index].words);
+					m_Types[index].add(m_ECS, local, words);
+				}
+			}
+		}
+
+		m_LastUpdate = update;
+		return reader.IsValid();
+	}
+
+	// The client's entity for a server entity, INVALID_ENTITY if it wasn't replicated to this client.
+	Entity GetLocalEntity(Entity serverEntity) const { return m_LocalEntities[serverEntity]; }
+
+	// Replicated entities the client has.
+	std::uint32_t GetEntityCount() const { return m_EntityCount; }
+
+	// Number of the last update received, counting from 1.
+	std::uint32_t GetLastUpdate() const { return m_LastUpdate; }
+
+	// Entity updates applied since the start.
+	std::uint64_t GetUpdatedCount() const { return m_UpdatedCount; }
+
+private:
+	struct Type
+	{
+		std::uint32_t words;
+		void (*add)(ECS& ecs, Entity entity, const std::uint32_t* words);
+		void (*apply)(ECS& ecs, Entity entity, const std::uint32_t* delta);
+		void (*remove)(ECS& ecs, Entity entity);
+	};
+
+	// Entities of a section are ascending, sent as the gap to the previous one.
+	static bool NextEntity(BitReader& reader, Entity& entity)
+	{
+		entity = entity + 1 + reader.ReadVarBits();
+		return entity < MAX_ENTITIES && reader.IsValid();
+	}
+
+	ECS& m_ECS;
+	std::vector<Type> m_Types;
+
+	// By server entity.
+	std::vector<Entity> m_LocalEntities;
+	std::vector<std::uint32_t> m_Masks;
+
+	BitReader m_Reader;
+	std::uint32_t m_EntityCount{ 0 };
+	std::uint32_t m_LastUpdate{ 0 };
+	std::uint64_t m_UpdatedCount{ 0 };
+};
+
+/**
+ * Keeps every client's packets in memory until they're delivered, to run a server and its clients in one process,
+ * e.g. in tests, benchmarks or a listen server's own client.
+ */
+class LoopbackTransport : public IReplicationTransport
+{
+public:
+	void Send(ClientId client, const std::uint8_t* data, size_t size) override
+	{
+		if (client >= m_Queues.size())
+			m_Queues.resize(client + 1);
+
+		Queue& queue = m_Queues[client];
+		queue.sizes.push_back(size);
+		queue.bytes.insert(queue.bytes.end(), data, data + size);
+	}
+
+	// Apply the client's packets in the order they were sent, returns false if the client rejected one.
+	bool Deliver(ClientId client, ReplicationClient& receiver)
+	{
+		if (client >= m_Queues.size())
+			return true;
+
+		Queue& queue = m_Queues[client];
+		bool accepted = true;
+		size_t offset = 0;
+		for (size_t size : queue.sizes)
+		{
+			accepted = receiver.Receive(queue.bytes.data() + offset, size) && accepted;
+			offset += size;
+		}
+
+		queue.sizes.clear();
+		queue.bytes.clear();
+		return accepted;
+	}
+
+	// Drop the client's packets, e.g. for a benchmark that only measures the server.
+	void Discard(ClientId client)
+	{
+		if (client < m_Queues.size())
+		{
+			m_Queues[client].sizes.clear();
+			m_Queues[client].bytes.clear();
+		}
+	}
+
+private:
+	struct Queue
+	{
+		std::vector<size_t> sizes;
+		std::vector<std::uint8_t> bytes;
+	};
+
+	std::vector<Queue> m_Queues;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "Base.hpp"
+#include "ComponentRegistry.hpp"
+
+/**
+ * World resources: one value per type that belongs to the world rather than to an entity, like the screen size
+ * or the frame's input. Every type gets a slot from the process-wide registry, so access is an array index,
+ * no hash lookup and no entity. Values are allocated from the world's memory resource.
+ */
+class ResourceManager
+{
+public:
+	explicit ResourceManager(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		: m_Resource(resource)
+	{
+	}
+
+	~ResourceManager()
+	{
+		for (ResourceType type = 0; type < MAX_RESOURCES; type++)
+		{
+			Destroy(type);
+		}
+	}
+
+	ResourceManager(const ResourceManager&) = delete;
+	ResourceManager& operator=(const ResourceManager&) = delete;
+
+	// Construct the resource from args, or aggregate initialize it, replacing the previous value if there is one.
+	template<typename T, typename... Args>
+	T& SetResource(Args&&... args)
+	{
+		ResourceType type = ComponentRegistry::GetResourceType<T>();
+
+		// Constructed before the old value goes, args may refer to it.
+		void* memory = m_Resource->allocate(sizeof(T), alignof(T));
+		T* data;
+		if constexpr (std::is_constructible_v<T, Args...>)
+			data = new (memory) T(std::forward<Args>(args)...);
+		else
+			data = new (memory) T{ std::forward<Args>(args)... };
+		Destroy(type);
+
+		Slot& slot = m_Slots[type];
+		slot.data = data;
+		slot.destroy = [](void* data, std::pmr::memory_resource* resource)
+		{
+			static_cast<T*>(data)->~T();
+			resource->deallocate(data, sizeof(T), alignof(T));
+		};
+
+		return *data;
+	}
+
+	template<typename T>
+	T& GetResource()
+	{
+		void* data = m_Slots[ComponentRegistry::GetResourceType<T>()].data;
+		assert(data && "Resource used before it was set.");
+
+		return *static_cast<T*>(data);
+	}
+
+	// Nullptr if the resource isn't set.
+	template<typename T>
+	T* FindResource()
+	{
+		return static_cast<T*>(m_Slots[ComponentRegistry::GetResourceType<T>()].data);
+	}
+
+	template<typename T>
+	void RemoveResource()
+	{
+		Destroy(ComponentRegistry::GetResourceType<T>());
+	}
+
+	// Resources currently set.
+	ResourceSignature GetSignature() const
+	{
+		ResourceSignature signature;
+		for (ResourceType type = 0; type < MAX_RESOURCES; type++)
+		{
+			signature.set(type, m_Slots[type].data != nullptr);
+		}
+
+		return signature;
+	}
+
+private:
+	struct Slot
+	{
+		void* data{ nullptr };
+		void (*destroy)(void* data, std::pmr::memory_resource* resource){ nullptr };
+	};
+
+	void Destroy(ResourceType type)
+	{
+		Slot& slot = m_Slots[type];
+		if (!slot.data)
+			return;
+
+		slot.destroy(slot.data, m_Resource);
+		slot = Slot{};
+	}
+
+	std::pmr::memory_resource* m_Resource;
+
+	// Indexed by resource type.
+	std::array<Slot, MAX_RESOURCES> m_Slots{};
+};
@@ -0,0 +1,392 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Base.hpp"
+#include "ComponentArray.hpp"
+
+template<typename T, typename = void>
+struct HasStdHash : std::false_type {};
+
+template<typename T>
+struct HasStdHash<T, std::void_t<decltype(std::hash<T>{}(std::declval<const T&>()))>> : std::true_type {};
+
+// Hash used to find equal shared values, specialize it for types without std::hash that have padding.
+// Types it can't hash all land in one bucket and are compared one by one.
+template<typename T>
+struct SharedComponentHash
+{
+	size_t operator()(const T& value) const
+	{
+		if constexpr (HasStdHash<T>::value)
+		{
+			return std::hash<T>{}(value);
+		}
+		else if constexpr (std::has_unique_object_representations_v<T>)
+		{
+			// FNV-1a over the bytes, only valid without padding.
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+			std::uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(T); i++)
+			{
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+			return static_cast<size_t>(hash);
+		}
+		else
+		{
+			return 0;
+		}
+	}
+};
+
+/**
+ * Storage for a shared component: entities point at a value stored once per world instead of holding a copy.
+ * Setting a value looks for an equal one (operator==) and reuses it, a value is dropped when its last entity lets go,
+ * so the number of entities in a value's group is its reference count.
+ * Besides the dense per entity column, which holds value indices, every value keeps the list of its entities,
+ * so work that depends only on the value, like binding a material, runs once per group.
+ * Values are immutable, changing the value of one entity moves it to another group.
+ * The dense column is no plain data of T, so world files skip shared components like other non trivially
+ * copyable ones. Snapshots copy the value of every entity instead and intern it again on rewind.
+ */
+template<typename T>
+class SharedComponentArray : public IComponentArray
+{
+public:
+	explicit SharedComponentArray(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		: m_Values(resource), m_Groups(resource), m_FreeValues(resource), m_Lookup(resource), m_EntityToIndexMap(resource)
+	{
+	}
+
+	// Give the entity value, replacing its previous one.
+	void SetData(Entity entity, const T& value)
+	{
+		std::uint32_t valueIndex = Intern(value);
+
+		auto it = m_EntityToIndexMap.find(entity);
+		if (it == m_EntityToIndexMap.end())
+		{
+			Append(entity, valueIndex);
+			m_AddedCount++;
+			return;
+		}
+
+		size_t index = it->second;
+		m_Changes.Stamp(index, m_ChangeTicks[index]);
+		m_ChangeTicks[index] = m_CurrentTick;
+
+		std::uint32_t oldValue = m_ValueIndices[index];
+		if (oldValue == valueIndex)
+			return;
+
+		LeaveGroup(index);
+		m_ValueIndices[index] = valueIndex;
+		m_GroupSlots[index] = static_cast<std::uint32_t>(m_Groups[valueIndex].size());
+		m_Groups[valueIndex].push_back(entity);
+	}
+
+	void RemoveData(Entity entity)
+	{
+		assert(m_EntityToIndexMap.find(entity) != m_EntityToIndexMap.end() && "Removing non-existent component.");
+
+		size_t indexOfRemovedEntity = m_EntityToIndexMap[entity];
+		size_t indexOfLastElement = m_Size - 1;
+
+		LeaveGroup(indexOfRemovedEntity);
+
+		// Copy element at end into deleted element's place to maintain density.
+		m_ValueIndices[indexOfRemovedEntity] = m_ValueIndices[indexOfLastElement];
+		m_GroupSlots[indexOfRemovedEntity] = m_GroupSlots[indexOfLastElement];
+		m_ChangeTicks[indexOfRemovedEntity] = m_ChangeTicks[indexOfLastElement];
+		m_Changes.Push(indexOfRemovedEntity);
+
+		Entity entityOfLastElement = m_IndexToEntity[indexOfLastElement];
+		m_EntityToIndexMap[entityOfLastElement] = indexOfRemovedEntity;
+		m_IndexToEntity[indexOfRemovedEntity] = entityOfLastElement;
+
+		m_EntityToIndexMap.erase(entity);
+
+		m_Size--;
+		m_RemovedCount++;
+	}
+
+	const T& ReadData(Entity entity) const
+	{
+		auto it = m_EntityToIndexMap.find(entity);
+		assert(it != m_EntityToIndexMap.end() && "Retrieving non-existent component.");
+
+		return *m_Values[m_ValueIndices[it->second]];
+	}
+
+	// Entities sharing the entity's value, itself included.
+	size_t RefCount(Entity entity) const
+	{
+		auto it = m_EntityToIndexMap.find(entity);
+		assert(it != m_EntityToIndexMap.end() && "Retrieving non-existent component.");
+
+		return m_Groups[m_ValueIndices[it->second]].size();
+	}
+
+	// Distinct values currently in use.
+	size_t ValueCount() const { return m_Values.size() - m_FreeValues.size(); }
+
+	// Call fn(value, entities, count) once per value in use.
+	template<typename F>
+	void ForEachGroup(F&& fn) const
+	{
+		for (size_t valueIndex = 0; valueIndex < m_Values.size(); valueIndex++)
+		{
+			const auto& group = m_Groups[valueIndex];
+			if (!group.empty())
+				fn(*m_Values[valueIndex], group.data(), group.size());
+		}
+	}
+
+	void EntityDestroyed(Entity entity) override
+	{
+		if (m_EntityToIndexMap.find(entity) != m_EntityToIndexMap.end())
+		{
+			RemoveData(entity);
+		}
+	}
+
+	size_t Size() const override { return m_Size; }
+	size_t ComponentSize() const override { return sizeof(std::uint32_t); }
+	size_t ComponentAlignment() const override { return alignof(std::uint32_t); }
+	std::uint32_t LayoutVersion() const override { return ComponentVersion<T>::value; }
+	bool IsTriviallyCopyable() const override { return false; }
+	const void* RawData() const override { return m_ValueIndices.data(); }
+
+	Entity EntityAtIndex(size_t index) const override
+	{
+		assert(index < m_Size && "Index out of range.");
+
+		return m_IndexToEntity[index];
+	}
+
+	const Entity* RawEntities() const override { return m_IndexToEntity.data(); }
+	const Tick* ChangeTicks() const override { return m_ChangeTicks.data(); }
+
+	bool HasData(Entity entity) const override
+	{
+		return m_EntityToIndexMap.find(entity) != m_EntityToIndexMap.end();
+	}
+
+	void* RawComponent(Entity) override
+	{
+		assert(false && "Shared components aren't stored per entity.");
+		return nullptr;
+	}
+
+	void InsertRaw(Entity entity, const void* component) override
+	{
+		SetData(entity, *static_cast<const T*>(component));
+	}
+
+	bool IsValueTriviallyCopyable() const override { return std::is_trivially_copyable_v<T>; }
+	size_t ValueSize() const override { return sizeof(T); }
+
+	const void* ValueAtIndex(size_t index) const override
+	{
+		assert(index < m_Size && "Index out of range.");
+
+		return &*m_Values[m_ValueIndices[index]];
+	}
+
+	// Copies of a prefab join its group, nothing is copied.
+	void InsertCopies(Entity source, const Entity* entities, size_t count) override
+	{
+		auto it = m_EntityToIndexMap.find(source);
+		assert(it != m_EntityToIndexMap.end() && "Copying non-existent component.");
+		assert(m_Size + count <= MAX_ENTITIES && "Too many components.");
+
+		std::uint32_t valueIndex = m_ValueIndices[it->second];
+
+		m_EntityToIndexMap.reserve(m_Size + count);
+		m_Groups[valueIndex].reserve(m_Groups[valueIndex].size() + count);
+		for (size_t i = 0; i < count; i++)
+		{
+			assert(m_EntityToIndexMap.find(entities[i]) == m_EntityToIndexMap.end() && "Component added to same entity more than once.");
+			Append(entities[i], valueIndex);
+		}
+
+		m_AddedCount += count;
+	}
+
+	// Every value of source is looked up once, so a world built from the same data merges into the existing groups.
+	void MoveFrom(IComponentArray& source, const Entity* remap) override
+	{
+		auto& other = static_cast<SharedComponentArray<T>&>(source);
+		size_t count = other.m_Size;
+		assert(m_Size + count <= MAX_ENTITIES && "Too many components.");
+
+		m_EntityToIndexMap.reserve(m_Size + count);
+		for (size_t otherValue = 0; otherValue < other.m_Values.size(); otherValue++)
+		{
+			const auto& group = other.m_Groups[otherValue];
+			if (group.empty())
+				continue;
+
+			std::uint32_t valueIndex = Intern(*other.m_Values[otherValue]);
+			m_Groups[valueIndex].reserve(m_Groups[valueIndex].size() + group.size());
+			for (Entity entity : group)
+			{
+				Append(remap[entity], valueIndex);
+			}
+		}
+
+		m_AddedCount += count;
+
+		other.m_Values.clear();
+		other.m_Groups.clear();
+		other.m_FreeValues.clear();
+		other.m_Lookup.clear();
+		other.m_EntityToIndexMap.clear();
+		other.m_Size = 0;
+		other.m_RemovedCount += count;
+	}
+
+	void MapData(void*, const Entity*, size_t, std::shared_ptr<void>) override
+	{
+		assert(false && "Shared components can't be mapped from a world file.");
+	}
+
+	void CopyData(const void*, const Entity*, size_t) override
+	{
+		assert(false && "Shared components can't be copied from raw data.");
+	}
+
+	void MoveEntities(const EntityMove* moves, size_t count) override
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			auto it = m_EntityToIndexMap.find(moves[i].from);
+			if (it == m_EntityToIndexMap.end())
+				continue;
+
+			size_t index = it->second;
+			m_EntityToIndexMap.erase(it);
+			m_EntityToIndexMap.emplace(moves[i].to, index);
+			m_IndexToEntity[index] = moves[i].to;
+			m_Changes.Stamp(index, m_ChangeTicks[index]);
+			m_ChangeTicks[index] = m_CurrentTick;
+			m_Groups[m_ValueIndices[index]][m_GroupSlots[index]] = moves[i].to;
+		}
+	}
+
+	size_t Capacity() const override { return MAX_ENTITIES; }
+	size_t IndexBucketCount() const override { return m_EntityToIndexMap.bucket_count(); }
+	double IndexLoadFactor() const override { return m_EntityToIndexMap.load_factor(); }
+	bool IsMapped() const override { return false; }
+
+private:
+	// Index of the value equal to value, stored first if there is none.
+	std::uint32_t Intern(const T& value)
+	{
+		size_t hash = SharedComponentHash<T>{}(value);
+
+		auto range = m_Lookup.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (*m_Values[it->second] == value)
+				return it->second;
+		}
+
+		std::uint32_t valueIndex;
+		if (!m_FreeValues.empty())
+		{
+			valueIndex = m_FreeValues.back();
+			m_FreeValues.pop_back();
+			m_Values[valueIndex].emplace(value);
+		}
+		else
+		{
+			valueIndex = static_cast<std::uint32_t>(m_Values.size());
+			m_Values.emplace_back(value);
+			m_Groups.emplace_back();
+		}
+
+		m_Lookup.emplace(hash, valueIndex);
+		return valueIndex;
+	}
+
+	// Add a dense entry for entity, which must not have one yet.
+	void Append(Entity entity, std::uint32_t valueIndex)
+	{
+		size_t index = m_Size;
+
+		m_ValueIndices[index] = valueIndex;
+		m_GroupSlots[index] = static_cast<std::uint32_t>(m_Groups[valueIndex].size());
+		m_ChangeTicks[index] = m_CurrentTick;
+		m_Changes.Push(index);
+		m_IndexToEntity[index] = entity;
+		m_EntityToIndexMap.emplace(entity, index);
+
+		m_Groups[valueIndex].push_back(entity);
+		m_Size++;
+	}
+
+	// Swap remove the entry at dense index from its group, dropping the value when the group runs empty.
+	void LeaveGroup(size_t index)
+	{
+		std::uint32_t valueIndex = m_ValueIndices[index];
+		auto& group = m_Groups[valueIndex];
+
+		std::uint32_t slot = m_GroupSlots[index];
+		Entity moved = group.back();
+		group[slot] = moved;
+		group.pop_back();
+
+		if (slot < group.size())
+			m_GroupSlots[m_EntityToIndexMap[moved]] = slot;
+
+		if (group.empty())
+		{
+			size_t hash = SharedComponentHash<T>{}(*m_Values[valueIndex]);
+
+			auto range = m_Lookup.equal_range(hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (it->second == valueIndex)
+				{
+					m_Lookup.erase(it);
+					break;
+				}
+			}
+
+			m_Values[valueIndex].reset();
+			m_FreeValues.push_back(valueIndex);
+		}
+	}
+
+	// Values by index, empty for indices on the free list.
+	std::pmr::vector<std::optional<T>> m_Values;
+
+	// Entities of every value, parallel to m_Values.
+	std::pmr::vector<std::pmr::vector<Entity>> m_Groups;
+
+	std::pmr::vector<std::uint32_t> m_FreeValues;
+
+	// Hash of a value to its index, several values can share a hash.
+	std::pmr::unordered_multimap<size_t, std::uint32_t> m_Lookup;
+
+	// Map from entity IDs to dense indices.
+	std::pmr::unordered_map<Entity, size_t> m_EntityToIndexMap;
+
+	// Dense per entity data: value index, slot in the value's group, entity and change tick.
+	std::array<std::uint32_t, MAX_ENTITIES> m_ValueIndices;
+	std::array<std::uint32_t, MAX_ENTITIES> m_GroupSlots;
+	std::array<Entity, MAX_ENTITIES> m_IndexToEntity;
+	std::array<Tick, MAX_ENTITIES> m_ChangeTicks;
+
+	size_t m_Size{ 0 };
+};
@@ -0,0 +1,436 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "ECS.hpp"
+
+/**
+ * Ring buffer of incremental world snapshots for rewind, replay and rollback.
+ * Every Capture only records the entities and component slots whose change tick is newer than the previous capture,
+ * found through the dirty lists of the tick arrays instead of a scan. Only one ring can track an ECS at a time.
+ * The oldest state in the window is kept as a full keyframe that the oldest frame is folded into when the window is full.
+ * Covers every trivially copyable component registered before the ring is created, shared ones included.
+ * Relations aren't recorded. Entities a rewind kills lose their pairs as with DestroyEntity,
+ * and sources of DestroySources relations are destroyed after the rewind.
+ */
+class SnapshotRing
+{
+public:
+	SnapshotRing(ECS& ecs, size_t capacity)
+		: m_ECS(ecs), m_Capacity(capacity), m_Frames(capacity)
+	{
+		assert(capacity > 0 && "Snapshot ring needs room for at least one frame.");
+
+		for (const auto& pair : ecs.GetComponentManager()->GetComponentArrays())
+		{
+			if (pair.second->IsValueTriviallyCopyable())
+			{
+				ComponentType type{ 0 };
+				ecs.GetComponentManager()->FindComponentArray(pair.first, type);
+				m_Columns.push_back({ pair.second.get(), type, pair.second->ValueSize(), !pair.second->IsTriviallyCopyable() });
+			}
+		}
+
+		for (Frame& frame : m_Frames)
+		{
+			frame.columns.resize(m_Columns.size());
+		}
+
+		m_Keyframe.Resize(m_Columns);
+		m_Scratch.Resize(m_Columns);
+		m_Dirty.resize(MAX_ENTITIES, 0);
+
+		CaptureKeyframe();
+
+		assert(!ecs.GetEntityManager()->GetSignatureChanges().IsEnabled() && "Only one snapshot ring can track an ECS.");
+		ecs.GetEntityManager()->GetSignatureChanges().Enable(m_LastTick);
+		for (const Column& column : m_Columns)
+		{
+			column.array->GetChangeList().Enable(m_LastTick);
+		}
+	}
+
+	~SnapshotRing()
+	{
+		m_ECS.GetEntityManager()->GetSignatureChanges().Disable();
+		for (const Column& column : m_Columns)
+		{
+			column.array->GetChangeList().Disable();
+		}
+	}
+
+	SnapshotRing(const SnapshotRing&) = delete;
+	SnapshotRing& operator=(const SnapshotRing&) = delete;
+
+	// Record the changes since the last capture as a new frame and return its frame number.
+	std::uint64_t Capture()
+	{
+		const auto& entityManager = m_ECS.GetEntityManager();
+		Tick tick = m_ECS.AdvanceTick();
+
+		if (m_FrameCount == m_Capacity)
+		{
+			m_Keyframe.Apply(m_Frames[m_FirstFrame], m_Columns);
+			m_FirstFrame = (m_FirstFrame + 1) % m_Capacity;
+			m_FrameCount--;
+			m_KeyframeNumber++;
+		}
+
+		Frame& frame = m_Frames[(m_FirstFrame + m_FrameCount) % m_Capacity];
+		frame.Clear();
+
+		// Entities created, destroyed or with a changed signature.
+		ChangeList& signatureChanges = entityManager->GetSignatureChanges();
+		signatureChanges.ForEachNewer(entityManager->GetSignatureTicks(), MAX_ENTITIES, [&](size_t index)
+		{
+			Entity entity = static_cast<Entity>(index);
+			frame.entities.push_back(entity);
+			frame.alive.push_back(entityManager->IsAlive(entity));
+			frame.signatures.push_back(entityManager->GetSignature(entity));
+		});
+		signatureChanges.Clear(tick);
+
+		// IDs pushed to the available queue since the last capture sit between the old and the new tail.
+		const Entity* ring = entityManager->GetAvailableRing();
+		frame.availableHead = entityManager->GetAvailableHead();
+		frame.livingEntityCount = entityManager->GetLivingEntityCount();
+		frame.pushedStart = m_LastAvailableTail;
+
+		uint32_t tail = entityManager->GetAvailableTail();
+		for (uint32_t position = m_LastAvailableTail; position != tail; position = (position + 1) % MAX_ENTITIES)
+		{
+			frame.pushedEntities.push_back(ring[position]);
+		}
+		m_LastAvailableTail = tail;
+
+		// Changed component slots.
+		for (size_t i = 0; i < m_Columns.size(); i++)
+		{
+			const Column& column = m_Columns[i];
+			ColumnFrame& columnFrame = frame.columns[i];
+
+			const Entity* entities = column.array->RawEntities();
+			const std::uint8_t* data = static_cast<const std::uint8_t*>(column.array->RawData());
+
+			// Find the changed slots first so the component bytes can be copied without growing the buffer every time.
+			m_ChangedIndices.clear();
+			ChangeList& changes = column.array->GetChangeList();
+			changes.ForEachNewer(column.array->ChangeTicks(), column.array->Size(), [&](size_t index)
+			{
+				m_ChangedIndices.push_back(static_cast<uint32_t>(index));
+			});
+			changes.Clear(tick);
+
+			columnFrame.entities.resize(m_ChangedIndices.size());
+			columnFrame.data.resize(m_ChangedIndices.size() * column.size);
+
+			std::uint8_t* destination = columnFrame.data.data();
+			for (size_t i = 0; i < m_ChangedIndices.size(); i++)
+			{
+				uint32_t index = m_ChangedIndices[i];
+				columnFrame.entities[i] = entities[index];
+				std::memcpy(destination + i * column.size, column.Value(data, index), column.size);
+			}
+		}
+
+		m_LastTick = tick;
+		m_FrameCount++;
+
+		return GetLatestFrame();
+	}
+
+	// Put the world back into the state it had when frame was captured, later frames are dropped.
+	bool Rewind(std::uint64_t frameNumber)
+	{
+		if (frameNumber < GetOldestFrame() || frameNumber > GetLatestFrame())
+			return false;
+
+		size_t framesToKeep = static_cast<size_t>(frameNumber - m_KeyframeNumber);
+
+		// Rebuild the full state of the target frame.
+		m_Scratch = m_Keyframe;
+		for (size_t i = 0; i < framesToKeep; i++)
+		{
+			m_Scratch.Apply(m_Frames[(m_FirstFrame + i) % m_Capacity], m_Columns);
+		}
+
+		// Only entities touched after the target frame can differ from it.
+		std::vector<Entity> dirtyEntities;
+		auto markDirty = [&](Entity entity)
+		{
+			if (!m_Dirty[entity])
+			{
+				m_Dirty[entity] = 1;
+				dirtyEntities.push_back(entity);
+			}
+		};
+
+		for (size_t i = framesToKeep; i < m_FrameCount; i++)
+		{
+			const Frame& frame = m_Frames[(m_FirstFrame + i) % m_Capacity];
+
+			for (Entity entity : frame.entities)
+				markDirty(entity);
+
+			for (const ColumnFrame& columnFrame : frame.columns)
+			{
+				for (Entity entity : columnFrame.entities)
+					markDirty(entity);
+			}
+		}
+
+		const auto& entityManager = m_ECS.GetEntityManager();
+		entityManager->GetSignatureChanges().ForEachNewer(entityManager->GetSignatureTicks(), MAX_ENTITIES, [&](size_t index)
+		{
+			markDirty(static_cast<Entity>(index));
+		});
+
+		for (const Column& column : m_Columns)
+		{
+			const Entity* entities = column.array->RawEntities();
+			column.array->GetChangeList().ForEachNewer(column.array->ChangeTicks(), column.array->Size(), [&](size_t index)
+			{
+				markDirty(entities[index]);
+			});
+		}
+
+		// Dirty lists aren't in any particular order, restore in ID order so the result doesn't depend on it.
+		std::sort(dirtyEntities.begin(), dirtyEntities.end());
+
+		// Write the target state of the dirty entities back into the world.
+		std::vector<Entity> cascade;
+		entityManager->RestoreAvailable(m_Scratch.availableEntities.data(), m_Scratch.availableHead, m_Scratch.livingEntityCount);
+
+		for (Entity entity : dirtyEntities)
+		{
+			m_Dirty[entity] = 0;
+
+			bool wasAlive = entityManager->IsAlive(entity);
+			bool alive = m_Scratch.alive[entity] != 0;
+			Signature signature = m_Scratch.signatures[entity];
+			entityManager->RestoreEntity(entity, alive, signature);
+
+			for (size_t i = 0; i < m_Columns.size(); i++)
+			{
+				IComponentArray& array = *m_Columns[i].array;
+				const std::uint8_t* component = m_Scratch.columns[i].data() + entity * m_Columns[i].size;
+
+				if (alive && signature.test(m_Columns[i].type))
+				{
+					if (!m_Columns[i].shared && array.HasData(entity))
+						std::memcpy(array.RawComponent(entity), component, m_Columns[i].size);
+					else
+						array.InsertRaw(entity, component);
+				}
+				else
+				{
+					array.EntityDestroyed(entity);
+				}
+			}
+
+			if (alive)
+			{
+				// Prefabs never join systems.
+				if (!entityManager->IsPrefab(entity))
+					m_ECS.GetSystemManager()->EntitySignatureChanged(entity, signature);
+			}
+			else
+			{
+				m_ECS.GetSystemManager()->EntityDestroyed(entity);
+
+				// Killed by the rewind, components of arrays the ring doesn't cover and pairs go with it.
+				if (wasAlive)
+				{
+					m_ECS.GetComponentManager()->EntityDestroyed(entity);
+					m_ECS.GetRelationManager()->EntityDestroyed(entity, cascade);
+				}
+			}
+		}
+
+		m_FrameCount = framesToKeep;
+		m_LastTick = m_ECS.AdvanceTick();
+		m_LastAvailableTail = entityManager->GetAvailableTail();
+
+		entityManager->GetSignatureChanges().Clear(m_LastTick);
+		for (const Column& column : m_Columns)
+		{
+			column.array->GetChangeList().Clear(m_LastTick);
+		}
+
+		// Sources outlive the rewind, so destroying them is a change for the next capture.
+		for (Entity source : cascade)
+		{
+			if (entityManager->IsAlive(source))
+				m_ECS.DestroyEntity(source);
+		}
+
+		return true;
+	}
+
+	std::uint64_t GetOldestFrame() const { return m_KeyframeNumber; }
+	std::uint64_t GetLatestFrame() const { return m_KeyframeNumber + m_FrameCount; }
+
+private:
+	struct Column
+	{
+		IComponentArray* array;
+		ComponentType type;
+		size_t size;
+
+		// Shared columns hold value indices, their values are copied instead.
+		bool shared;
+
+		const std::uint8_t* Value(const std::uint8_t* data, size_t index) const
+		{
+			return shared ? static_cast<const std::uint8_t*>(array->ValueAtIndex(index)) : data + index * size;
+		}
+	};
+
+	// Changed slots of one component type, data holds one component per entity.
+	struct ColumnFrame
+	{
+		std::vector<Entity> entities;
+		std::vector<std::uint8_t> data;
+	};
+
+	// Everything that changed between two captures.
+	struct Frame
+	{
+		std::vector<Entity> entities;
+		std::vector<std::uint8_t> alive;
+		std::vector<Signature> signatures;
+
+		uint32_t availableHead{ 0 };
+		uint32_t livingEntityCount{ 0 };
+		uint32_t pushedStart{ 0 };
+		std::vector<Entity> pushedEntities;
+
+		std::vector<ColumnFrame> columns;
+
+		// Vectors keep their capacity, so a warmed up ring doesn't allocate.
+		void Clear()
+		{
+			entities.clear();
+			alive.clear();
+			signatures.clear();
+			pushedEntities.clear();
+
+			for (ColumnFrame& column : columns)
+			{
+				column.entities.clear();
+				column.data.clear();
+			}
+		}
+	};
+
+	// Full world state indexed by entity ID.
+	struct State
+	{
+		std::vector<std::uint8_t> alive;
+		std::vector<Signature> signatures;
+
+		std::vector<Entity> availableEntities;
+		uint32_t availableHead{ 0 };
+		uint32_t livingEntityCount{ 0 };
+
+		std::vector<std::vector<std::uint8_t>> columns;
+
+		void Resize(const std::vector<Column>& columnInfos)
+		{
+			alive.assign(MAX_ENTITIES, 0);
+			signatures.assign(MAX_ENTITIES, Signature{});
+			availableEntities.assign(MAX_ENTITIES, 0);
+
+			columns.resize(columnInfos.size());
+			for (size_t i = 0; i < columnInfos.size(); i++)
+			{
+				columns[i].assign(MAX_ENTITIES * columnInfos[i].size, 0);
+			}
+		}
+
+		void Apply(const Frame& frame, const std::vector<Column>& columnInfos)
+		{
+			for (size_t i = 0; i < frame.entities.size(); i++)
+			{
+				alive[frame.entities[i]] = frame.alive[i];
+				signatures[frame.entities[i]] = frame.signatures[i];
+			}
+
+			for (size_t i = 0; i < frame.pushedEntities.size(); i++)
+			{
+				availableEntities[(frame.pushedStart + i) % MAX_ENTITIES] = frame.pushedEntities[i];
+			}
+			availableHead = frame.availableHead;
+			livingEntityCount = frame.livingEntityCount;
+
+			for (size_t i = 0; i < columnInfos.size(); i++)
+			{
+				const ColumnFrame& columnFrame = frame.columns[i];
+				size_t size = columnInfos[i].size;
+
+				for (size_t j = 0; j < columnFrame.entities.size(); j++)
+				{
+					std::memcpy(columns[i].data() + columnFrame.entities[j] * size, columnFrame.data.data() + j * size, size);
+				}
+			}
+		}
+	};
+
+	void CaptureKeyframe()
+	{
+		const auto& entityManager = m_ECS.GetEntityManager();
+
+		for (Entity entity = 0; entity < MAX_ENTITIES; entity++)
+		{
+			m_Keyframe.alive[entity] = entityManager->IsAlive(entity);
+			m_Keyframe.signatures[entity] = entityManager->GetSignature(entity);
+		}
+
+		const Entity* ring = entityManager->GetAvailableRing();
+		std::copy(ring, ring + MAX_ENTITIES, m_Keyframe.availableEntities.begin());
+		m_Keyframe.availableHead = entityManager->GetAvailableHead();
+		m_Keyframe.livingEntityCount = entityManager->GetLivingEntityCount();
+
+		for (size_t i = 0; i < m_Columns.size(); i++)
+		{
+			const Column& column = m_Columns[i];
+			const Entity* entities = column.array->RawEntities();
+			const std::uint8_t* data = static_cast<const std::uint8_t*>(column.array->RawData());
+
+			for (size_t index = 0; index < column.array->Size(); index++)
+			{
+				std::memcpy(m_Keyframe.columns[i].data() + entities[index] * column.size, column.Value(data, index), column.size);
+			}
+		}
+
+		m_LastTick = m_ECS.AdvanceTick();
+		m_LastAvailableTail = entityManager->GetAvailableTail();
+	}
+
+	ECS& m_ECS;
+
+	std::vector<Column> m_Columns;
+
+	// Ring of frames after the keyframe, oldest at m_FirstFrame.
+	size_t m_Capacity;
+	std::vector<Frame> m_Frames;
+	size_t m_FirstFrame{ 0 };
+	size_t m_FrameCount{ 0 };
+
+	// State of the oldest frame in the window and its frame number.
+	State m_Keyframe;
+	std::uint64_t m_KeyframeNumber{ 0 };
+
+	// Reused when rebuilding a frame for Rewind.
+	State m_Scratch;
+	std::vector<std::uint8_t> m_Dirty;
+	std::vector<uint32_t> m_ChangedIndices;
+
+	// Tick closed by the last capture and the available queue tail at that point.
+	Tick m_LastTick{ 0 };
+	uint32_t m_LastAvailableTail{ 0 };
+};
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ECS.hpp"
+
+// Axis aligned bounding box.
+struct Bounds
+{
+	float minX, minY, maxX, maxY;
+
+	bool Overlaps(const Bounds& other) const
+	{
+		return minX <= other.maxX && other.minX <= maxX && minY <= other.maxY && other.minY <= maxY;
+	}
+
+	// Squared distance from a point to the closest point of the box, 0 if the point is inside.
+	float DistanceSquared(float x, float y) const
+	{
+		float dx = std::max({ minX - x, 0.0f, x - maxX });
+		float dy = std::max({ minY - y, 0.0f, y - maxY });
+		return dx * dx + dy * dy;
+	}
+};
+
+/**
+ * Loose uniform grid over every entity that has a T component.
+ * Each entity lives in the single cell containing the center of its bounds, queries grow by the largest half extent seen.
+ * Update scans the signature ticks of every entity and the change ticks of T and of the dependencies, but only
+ * recomputes the bounds of entities whose ticks are newer than the previous update. An entity is only moved
+ * between cells when its center crosses a cell border, so entities that don't move cost no more than the scan.
+ */
+template<typename T>
+class SpatialHash
+{
+public:
+	// Computes the bounds of an entity from its T component. Other components it reads through ecs have to be
+	// passed as dependencies, so changing only them refreshes the bounds too.
+	using BoundsFunction = Bounds(*)(ECS& ecs, Entity entity, const T& component);
+
+	SpatialHash(float cellSize, BoundsFunction boundsFunction, Signature dependencies = Signature())
+		: m_CellSize(cellSize), m_InverseCellSize(1.0f / cellSize), m_BoundsFunction(boundsFunction), m_Dependencies(dependencies),
+		m_Records(MAX_ENTITIES)
+	{
+		assert(cellSize > 0.0f && "Cell size must be positive.");
+	}
+
+	// Bring the index up to date with the components changed, added or removed since the last update.
+	void Update(ECS& ecs)
+	{
+		const auto& entityManager = ecs.GetEntityManager();
+		auto componentArray = ecs.GetComponentManager()->GetComponentArray<T>();
+		ComponentType type = ecs.GetComponentType<T>();
+
+		Tick tick = ecs.AdvanceTick();
+
+		// Entities that lost the component or were destroyed.
+		const Tick* signatureTicks = entityManager->GetSignatureTicks();
+		for (Entity entity = 0; entity < MAX_ENTITIES; entity++)
+		{
+			if (m_Records[entity].cell != INVALID_CELL && IsNewerTick(signatureTicks[entity], m_LastTick)
+				&& (!entityManager->IsAlive(entity) || !entityManager->GetSignature(entity).test(type)))
+			{
+				Remove(entity);
+			}
+		}
+
+		// Added or mutably accessed components.
+		const Tick* ticks = componentArray->ChangeTicks();
+		const Entity* entities = componentArray->RawEntities();
+		const T* components = componentArray->Data();
+
+		for (size_t index = 0; index < componentArray->Size(); index++)
+		{
+			if (IsNewerTick(ticks[index], m_LastTick))
+			{
+				Entity entity = entities[index];
+				Move(entity, m_BoundsFunction(ecs, entity, components[index]));
+			}
+		}
+
+		// Changed dependencies of entities that kept their T.
+		for (ComponentType dependency = 0; dependency < MAX_COMPONENTS; dependency++)
+		{
+			IComponentArray* array = m_Dependencies.test(dependency) ? ecs.GetComponentManager()->GetComponentArrayByType(dependency) : nullptr;
+			if (array == nullptr)
+				continue;
+
+			const Tick* dependencyTicks = array->ChangeTicks();
+			const Entity* dependents = array->RawEntities();
+			for (size_t index = 0; index < array->Size(); index++)
+			{
+				Entity entity = dependents[index];
+				if (IsNewerTick(dependencyTicks[index], m_LastTick) && componentArray->HasData(entity))
+					Move(entity, m_BoundsFunction(ecs, entity, componentArray->ReadData(entity)));
+			}
+		}
+
+		SortNewCells();
+
+		m_LastTick = tick;
+	}
+
+	// Call fn(entity) for every entity whose bounds overlap area.
+	template<typename F>
+	void Query(const Bounds& area, F&& fn) const
+	{
+		int minCellX = CellCoordinate(area.minX - m_MaxHalfExtent);
+		int minCellY = CellCoordinate(area.minY - m_MaxHalfExtent);
+		int maxCellX = CellCoordinate(area.maxX + m_MaxHalfExtent);
+		int maxCellY = CellCoordinate(area.maxY + m_MaxHalfExtent);
+
+		for (int cellX = minCellX; cellX <= maxCellX; cellX++)
+		{
+			for (int cellY = minCellY; cellY <= maxCellY; cellY++)
+			{
+				auto it = m_CellLookup.find(CellKey(cellX, cellY));
+				if (it == m_CellLookup.end())
+					continue;
+
+				const Cell& cell = m_Cells[it->second];
+				for (uint32_t slot = 0; slot < cell.count; slot++)
+				{
+					const Entry& entry = cell.At(slot);
+					if (entry.bounds.Overlaps(area))
+						fn(entry.entity);
+				}
+			}
+		}
+	}
+
+	// Entity whose bounds are closest to the point, searching in growing squares up to maxDistance.
+	bool Nearest(float x, float y, float maxDistance, Entity& outEntity) const
+	{
+		float bestDistanceSquared = std::numeric_limits<float>::max();
+		bool found = false;
+
+		for (float radius = m_CellSize; ; radius *= 2.0f)
+		{
+			radius = std::min(radius, maxDistance);
+
+			Query({ x - radius, y - radius, x + radius, y + radius }, [&](Entity entity)
+			{
+				float distanceSquared = m_Records[entity].bounds.DistanceSquared(x, y);
+				if (distanceSquared < bestDistanceSquared)
+				{
+					bestDistanceSquared = distanceSquared;
+					outEntity = entity;
+					found = true;
+				}
+			});
+
+			// Anything outside the searched square is further away than radius.
+			if ((found && bestDistanceSquared <= radius * radius) || radius >= maxDistance)
+				break;
+		}
+
+		return found && bestDistanceSquared <= maxDistance * maxDistance;
+	}
+
+	// Every pair of entities with overlapping bounds, each pair reported once.
+	void Pairs(std::vector<std::pair<Entity, Entity>>& outPairs) const
+	{
+		outPairs.clear();
+
+		// How many cells apart two overlapping entities' centers can be.
+		int reach = static_cast<int>(std::ceil(2.0f * m_MaxHalfExtent * m_InverseCellSize));
+
+		// Cells are visited column by column, so the neighbours in every column to the right are found
+		// by walking one cursor per column forward instead of hashing every neighbouring cell.
+		std::vector<size_t> cursors(reach + 1, 0);
+
+		for (const SortedCell& sortedCell : m_SortedCells)
+		{
+			const Cell& cell = m_Cells[sortedCell.index];
+			if (cell.count == 0)
+				continue;
+
+			// Same cell, every pair once.
+			TestCells(cell, cell, true, outPairs);
+
+			// Forward half of the neighbouring cells, so every cell pair is visited once.
+			for (int dx = 0; dx <= reach; dx++)
+			{
+				SortedCell first{ sortedCell.cellX + dx, dx == 0 ? sortedCell.cellY + 1 : sortedCell.cellY - reach, 0 };
+				int maxCellY = sortedCell.cellY + reach;
+
+				size_t& cursor = cursors[dx];
+				while (cursor < m_SortedCells.size() && m_SortedCells[cursor] < first)
+					cursor++;
+
+				for (size_t other = cursor; other < m_SortedCells.size(); other++)
+				{
+					const SortedCell& otherCell = m_SortedCells[other];
+					if (otherCell.cellX != first.cellX || otherCell.cellY > maxCellY)
+						break;
+
+					TestCells(cell, m_Cells[otherCell.index], false, outPairs);
+				}
+			}
+		}
+	}
+
+	bool Contains(Entity entity) const { return m_Records[entity].cell != INVALID_CELL; }
+	const Bounds& GetBounds(Entity entity) const { return m_Records[entity].bounds; }
+
+	size_t GetCellCount() const { return m_Cells.size(); }
+
+private:
+	static constexpr uint32_t INVALID_CELL = std::numeric_limits<uint32_t>::max();
+
+	// Entries stored in the cell itself, most cells hold only a few entities.
+	static constexpr uint32_t INLINE_ENTRIES = 4;
+
+	struct Record
+	{
+		Bounds bounds{};
+		uint32_t cell{ INVALID_CELL };
+		uint32_t slot{ 0 };
+	};
+
+	struct Entry
+	{
+		Bounds bounds;
+		Entity entity;
+	};
+
+	// Entities of one cell with a copy of their bounds, so pairs and queries don't jump around in m_Records.
+	struct Cell
+	{
+		int cellX, cellY;
+		uint32_t count{ 0 };
+		std::array<Entry, INLINE_ENTRIES> entries{};
+		std::vector<Entry> overflow;
+
+		Entry& At(uint32_t slot) { return slot < INLINE_ENTRIES ? entries[slot] : overflow[slot - INLINE_ENTRIES]; }
+		const Entry& At(uint32_t slot) const { return slot < INLINE_ENTRIES ? entries[slot] : overflow[slot - INLINE_ENTRIES]; }
+	};
+
+	// Cell coordinates copied next to the index, so sorting and walking columns stays in one array.
+	struct SortedCell
+	{
+		int cellX, cellY;
+		uint32_t index;
+
+		bool operator<(const SortedCell& other) const
+		{
+			return cellX < other.cellX || (cellX == other.cellX && cellY < other.cellY);
+		}
+	};
+
+	static void TestCells(const Cell& a, const Cell& b, bool sameCell, std::vector<std::pair<Entity, Entity>>& outPairs)
+	{
+		for (uint32_t i = 0; i < a.count; i++)
+		{
+			const Entry& entry = a.At(i);
+			for (uint32_t j = sameCell ? i + 1 : 0; j < b.count; j++)
+			{
+				const Entry& other = b.At(j);
+				if (entry.bounds.Overlaps(other.bounds))
+					outPairs.push_back({ entry.entity, other.entity });
+			}
+		}
+	}
+
+	int CellCoordinate(float value) const
+	{
+		return static_cast<int>(std::floor(value * m_InverseCellSize));
+	}
+
+	static std::uint64_t CellKey(int cellX, int cellY)
+	{
+		return (static_cast<std::uint64_t>(static_cast<uint32_t>(cellX)) << 32) | static_cast<uint32_t>(cellY);
+	}
+
+	void Move(Entity entity, const Bounds& bounds)
+	{
+		Record& record = m_Records[entity];
+		record.bounds = bounds;
+
+		m_MaxHalfExtent = std::max({ m_MaxHalfExtent, (bounds.maxX - bounds.minX) * 0.5f, (bounds.maxY - bounds.minY) * 0.5f });
+
+		int cellX = CellCoordinate((bounds.minX + bounds.maxX) * 0.5f);
+		int cellY = CellCoordinate((bounds.minY + bounds.maxY) * 0.5f);
+
+		// Common case, still in the same cell.
+		if (record.cell != INVALID_CELL)
+		{
+			Cell& cell = m_Cells[record.cell];
+			if (cell.cellX == cellX && cell.cellY == cellY)
+			{
+				cell.At(record.slot).bounds = bounds;
+				return;
+			}
+
+			Remove(entity);
+		}
+
+		auto it = m_CellLookup.find(CellKey(cellX, cellY));
+		uint32_t cellIndex;
+		if (it != m_CellLookup.end())
+		{
+			cellIndex = it->second;
+		}
+		else
+		{
+			cellIndex = static_cast<uint32_t>(m_Cells.size());
+			m_Cells.emplace_back();
+			m_Cells.back().cellX = cellX;
+			m_Cells.back().cellY = cellY;
+			m_CellLookup.insert({ CellKey(cellX, cellY), cellIndex });
+		}
+
+		Cell& cell = m_Cells[cellIndex];
+		record.cell = cellIndex;
+		record.slot = cell.count++;
+
+		if (record.slot < INLINE_ENTRIES)
+			cell.entries[record.slot] = { bounds, entity };
+		else
+			cell.overflow.push_back({ bounds, entity });
+	}
+
+	void Remove(Entity entity)
+	{
+		Record& record = m_Records[entity];
+		Cell& cell = m_Cells[record.cell];
+
+		// Swap remove, same as the component arrays.
+		const Entry& last = cell.At(cell.count - 1);
+		m_Records[last.entity].slot = record.slot;
+		cell.At(record.slot) = last;
+
+		if (--cell.count >= INLINE_ENTRIES)
+			cell.overflow.pop_back();
+
+		// Empty cells are kept so an entity moving back in doesn't allocate.
+		record.cell = INVALID_CELL;
+	}
+
+	// Merge the cells created since the last update into the sorted order.
+	void SortNewCells()
+	{
+		size_t sortedCount = m_SortedCells.size();
+		if (sortedCount == m_Cells.size())
+			return;
+
+		for (uint32_t index = static_cast<uint32_t>(sortedCount); index < m_Cells.size(); index++)
+		{
+			m_SortedCells.push_back({ m_Cells[index].cellX, m_Cells[index].cellY, index });
+		}
+
+		std::sort(m_SortedCells.begin() + sortedCount, m_SortedCells.end());
+		std::inplace_merge(m_SortedCells.begin(), m_SortedCells.begin() + sortedCount, m_SortedCells.end());
+	}
+
+	float m_CellSize;
+	float m_InverseCellSize;
+	BoundsFunction m_BoundsFunction;
+
+	// Component types the bounds function reads besides T.
+	Signature m_Dependencies;
+
+	// Largest half width or height of any entity seen so far, the looseness of the grid.
+	float m_MaxHalfExtent{ 0.0f };
+
+	// Per entity ID, where it is stored and its last bounds.
+	std::vector<Record> m_Records;
+
+	// Cells that have ever been occupied, in creation order so their indices stay valid.
+	std::vector<Cell> m_Cells;
+	std::unordered_map<std::uint64_t, uint32_t> m_CellLookup;
+
+	// Every cell ordered by column then row.
+	std::vector<SortedCell> m_SortedCells;
+
+	// Tick closed by the last update.
+	Tick m_LastTick{ 0 };
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "ECS.hpp"
+
+/**
+ * Fast 64-bit hash of a byte stream for comparing world states, not for security.
+ * 32 independent 32-bit lanes each take one word of every 128-byte block, in the style of xxHash32, so the
+ * lanes map directly onto AVX2, SSE4.1 or NEON registers. Every path computes the same lanes, so a hash is the
+ * same on every machine as long as it reads the words little endian, which all supported targets do.
+ */
+class StateHasher
+{
+public:
+	StateHasher()
+	{
+		for (std::uint32_t lane = 0; lane < LANES; lane++)
+		{
+			m_Lanes[lane] = PRIME1 * (lane + 1) + PRIME2;
+		}
+	}
+
+	void Update(const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		m_Length += size;
+
+		// Top up a partial block first.
+		if (m_TailSize > 0)
+		{
+			size_t take = std::min(size, BLOCK_SIZE - m_TailSize);
+			std::memcpy(m_Tail + m_TailSize, bytes, take);
+			m_TailSize += take;
+			bytes += take;
+			size -= take;
+
+			if (m_TailSize < BLOCK_SIZE)
+				return;
+
+			Blocks(m_Tail, 1);
+			m_TailSize = 0;
+		}
+
+		size_t blocks = size / BLOCK_SIZE;
+		Blocks(bytes, blocks);
+
+		m_TailSize = size - blocks * BLOCK_SIZE;
+		std::memcpy(m_Tail, bytes + blocks * BLOCK_SIZE, m_TailSize);
+	}
+
+	template<typename T>
+	void UpdateValue(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be hashed as bytes.");
+		Update(&value, sizeof(T));
+	}
+
+	std::uint64_t Finish() const
+	{
+		std::uint64_t hash = m_Length * PRIME64;
+		for (std::uint32_t lane = 0; lane < LANES; lane++)
+		{
+			hash = Mix(hash ^ m_Lanes[lane]);
+		}
+
+		for (size_t i = 0; i < m_TailSize; i++)
+		{
+			hash = (hash ^ m_Tail[i]) * 1099511628211ull;
+		}
+
+		return Mix(hash);
+	}
+
+	// Finalizer of splitmix64, also used to combine hashes.
+	static std::uint64_t Mix(std::uint64_t value)
+	{
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+
+private:
+	// Four 8-lane vectors, so the multiplies of independent vectors overlap instead of waiting on each other.
+	static constexpr size_t VECTORS = 4;
+	static constexpr std::uint32_t LANES = VECTORS * 8;
+	static constexpr size_t BLOCK_SIZE = LANES * sizeof(std::uint32_t);
+
+	static constexpr std::uint32_t PRIME1 = 2654435761u;
+	static constexpr std::uint32_t PRIME2 = 2246822519u;
+	static constexpr std::uint64_t PRIME64 = 0x9E3779B97F4A7C15ull;
+
+	// lane = rotl(lane + word * PRIME2, 13) * PRIME1 for each word of each block.
+	void Blocks(const unsigned char* data, size_t blocks)
+	{
+#if defined(__AVX2__)
+		const __m256i prime1 = _mm256_set1_epi32(static_cast<int>(PRIME1));
+		const __m256i prime2 = _mm256_set1_epi32(static_cast<int>(PRIME2));
+		__m256i lanes[VECTORS];
+		for (size_t v = 0; v < VECTORS; v++)
+		{
+			lanes[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(m_Lanes + v * 8));
+		}
+
+		for (size_t block = 0; block < blocks; block++)
+		{
+			for (size_t v = 0; v < VECTORS; v++)
+			{
+				__m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + block * BLOCK_SIZE + v * 32));
+				__m256i value = _mm256_add_epi32(lanes[v], _mm256_mullo_epi32(words, prime2));
+				value = _mm256_or_si256(_mm256_slli_epi32(value, 13), _mm256_srli_epi32(value, 19));
+				lanes[v] = _mm256_mullo_epi32(value, prime1);
+			}
+		}
+
+		for (size_t v = 0; v < VECTORS; v++)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(m_Lanes + v * 8), lanes[v]);
+		}
+#elif defined(__SSE4_1__)
+		const __m128i prime1 = _mm_set1_epi32(static_cast<int>(PRIME1));
+		const __m128i prime2 = _mm_set1_epi32(static_cast<int>(PRIME2));
+		__m128i lanes[VECTORS * 2];
+		for (size_t v = 0; v < VECTORS * 2; v++)
+		{
+			lanes[v] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_Lanes + v * 4));
+		}
+
+		for (size_t block = 0; block < blocks; block++)
+		{
+			for (size_t v = 0; v < VECTORS * 2; v++)
+			{
+				__m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + block * BLOCK_SIZE + v * 16));
+				__m128i value = _mm_add_epi32(lanes[v], _mm_mullo_epi32(words, prime2));
+				value = _mm_or_si128(_mm_slli_epi32(value, 13), _mm_srli_epi32(value, 19));
+				lanes[v] = _mm_mullo_epi32(value, prime1);
+			}
+		}
+
+		for (size_t v = 0; v < VECTORS * 2; v++)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(m_Lanes + v * 4), lanes[v]);
+		}
+#elif defined(__ARM_NEON)
+		const uint32x4_t prime1 = vdupq_n_u32(PRIME1);
+		const uint32x4_t prime2 = vdupq_n_u32(PRIME2);
+		uint32x4_t lanes[VECTORS * 2];
+		for (size_t v = 0; v < VECTORS * 2; v++)
+		{
+			lanes[v] = vld1q_u32(m_Lanes + v * 4);
+		}
+
+		for (size_t block = 0; block < blocks; block++)
+		{
+			for (size_t v = 0; v < VECTORS * 2; v++)
+			{
+				uint32x4_t words = vreinterpretq_u32_u8(vld1q_u8(data + block * BLOCK_SIZE + v * 16));
+				uint32x4_t value = vmlaq_u32(lanes[v], words, prime2);
+				value = vorrq_u32(vshlq_n_u32(value, 13), vshrq_n_u32(value, 19));
+				lanes[v] = vmulq_u32(value, prime1);
+			}
+		}
+
+		for (size_t v = 0; v < VECTORS * 2; v++)
+		{
+			vst1q_u32(m_Lanes + v * 4, lanes[v]);
+		}
+#else
+		for (size_t block = 0; block < blocks; block++)
+		{
+			std::uint32_t words[LANES];
+			std::memcpy(words, data + block * BLOCK_SIZE, BLOCK_SIZE);
+
+			for (std::uint32_t lane = 0; lane < LANES; lane++)
+			{
+				std::uint32_t value = m_Lanes[lane] + words[lane] * PRIME2;
+				m_Lanes[lane] = ((value << 13) | (value >> 19)) * PRIME1;
+			}
+		}
+#endif
+	}
+
+	alignas(32) std::uint32_t m_Lanes[LANES];
+	unsigned char m_Tail[BLOCK_SIZE];
+	size_t m_TailSize{ 0 };
+	std::uint64_t m_Length{ 0 };
+};
+
+/**
+ * Hash of everything that decides how a world simulates: the living entities with their signatures and the
+ * dense arrays of every trivially copyable component, entities and bytes, in component type order.
+ * Dense order is part of the state, iteration follows it, so two worlds only hash equal if they would run the same.
+ * Components that aren't trivially copyable, shared components, resources and relations aren't covered.
+ * Component bytes are hashed as they are, so padding has to be zero, e.g. by value initializing components.
+ */
+class WorldHasher
+{
+public:
+	std::uint64_t Hash(const ECS& ecs)
+	{
+		StateHasher hasher;
+
+		// Signatures as 32-bit words, the layout of std::bitset differs between standard libraries.
+		const auto& entityManager = ecs.GetEntityManager();
+		m_Entities.clear();
+		entityManager->ForEachLivingEntity([&](Entity entity)
+		{
+			m_Entities.push_back(entity);
+			m_Entities.push_back(static_cast<std::uint32_t>(entityManager->GetSignature(entity).to_ulong()));
+		});
+		hasher.Update(m_Entities.data(), m_Entities.size() * sizeof(std::uint32_t));
+
+		const auto& componentManager = ecs.GetComponentManager();
+		for (ComponentType type = 0; type < MAX_COMPONENTS; type++)
+		{
+			const IComponentArray* array = componentManager->GetComponentArrayByType(type);
+			if (!array || !array->IsTriviallyCopyable())
+				continue;
+
+			std::uint64_t size = array->Size();
+			hasher.UpdateValue(static_cast<std::uint32_t>(type));
+			hasher.UpdateValue(size);
+			hasher.Update(array->RawEntities(), size * sizeof(Entity));
+			hasher.Update(array->RawData(), size * array->ComponentSize());
+		}
+
+		return hasher.Finish();
+	}
+
+private:
+	// Entity and signature pairs, kept so hashing every tick doesn't allocate.
+	std::vector<std::uint32_t> m_Entities;
+};
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ECS.hpp"
+#include "WorldFile.hpp"
+#include "WorldMerge.hpp"
+
+struct StreamingStats
+{
+	// Chunks waiting for a worker, being built and built but not committed yet.
+	std::uint32_t queued{ 0 };
+	std::uint32_t loading{ 0 };
+	std::uint32_t ready{ 0 };
+
+	std::uint64_t committed{ 0 };
+	std::uint64_t failed{ 0 };
+
+	// Main thread time spent in the last Commit.
+	double lastCommitMicroseconds{ 0.0 };
+
+	// Time from Request until the chunk was committed, of the last committed chunk and the worst one so far.
+	double lastLatencyMicroseconds{ 0.0 };
+	double maxLatencyMicroseconds{ 0.0 };
+};
+
+/**
+ * Streams chunk files, world files saved with WorldFile::Save, into a live world without hitches.
+ * Worker threads read each file, pass the bytes through the decoder, e.g. to decompress them, and load them into
+ * a staging world of their own, so the live world is never touched off the main thread.
+ * Commit runs at a frame boundary on the live world's thread and merges finished chunks with MergeWorld until the
+ * frame's budget is used up. Staging worlds are emptied by the merge and reused for later chunks.
+ */
+class StreamingLoader
+{
+public:
+	// Registers the components of a new staging world, the same ones the chunk files hold.
+	using SetupFunction = std::function<void(ECS& staging)>;
+
+	// Turns the file's bytes into a world file in place, returns false if they are corrupt.
+	using DecodeFunction = std::function<bool(std::vector<std::uint8_t>& bytes)>;
+
+	// Called for every committed chunk with the remap table from its staging world to the live world.
+	using CommitFunction = std::function<void(const std::string& path, const std::vector<Entity>& remap)>;
+
+	StreamingLoader(SetupFunction setup, std::uint32_t workerCount = 1)
+		: m_Setup(std::move(setup))
+	{
+		assert(workerCount > 0 && "Streaming needs at least one worker.");
+
+		for (std::uint32_t i = 0; i < workerCount; i++)
+		{
+			m_Workers.emplace_back([this]() { WorkerLoop(); });
+		}
+	}
+
+	// Chunks still queued are dropped, chunks being built are finished first.
+	~StreamingLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Quit = true;
+		}
+		m_WakeWorkers.notify_all();
+
+		for (auto& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	StreamingLoader(const StreamingLoader&) = delete;
+	StreamingLoader& operator=(const StreamingLoader&) = delete;
+
+	// Set before the first Request, workers use these without locking.
+	void SetDecoder(DecodeFunction decode) { m_Decode = std::move(decode); }
+	WorldFile& GetWorldFile() { return m_WorldFile; }
+
+	void Request(const std::string& path)
+	{
+		Chunk chunk;
+		chunk.path = path;
+		chunk.requestTime = std::chrono::steady_clock::now();
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Queued.push_back(std::move(chunk));
+		}
+		m_WakeWorkers.notify_one();
+	}
+
+	// Merge finished chunks into live until budgetMicroseconds are used up. The budget is checked between chunks
+	// and at least one chunk is committed if any is ready, so chunks bigger than the budget still get in.
+	std::uint32_t Commit(ECS& live, double budgetMicroseconds, const CommitFunction& onCommit = nullptr)
+	{
+		auto start = std::chrono::steady_clock::now();
+		auto budget = std::chrono::duration<double, std::micro>(budgetMicroseconds);
+		std::uint32_t committed = 0;
+
+		while (committed == 0 || std::chrono::steady_clock::now() - start < budget)
+		{
+			Chunk chunk;
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				if (m_Ready.empty())
+					break;
+
+				chunk = std::move(m_Ready.front());
+				m_Ready.pop_front();
+			}
+
+			std::vector<Entity> remap = MergeWorld(*chunk.world, live);
+			if (onCommit)
+				onCommit(chunk.path, remap);
+
+			double latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - chunk.requestTime).count();
+
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_FreeWorlds.push_back(std::move(chunk.world));
+			m_Stats.committed++;
+			m_Stats.lastLatencyMicroseconds = latency;
+			m_Stats.maxLatencyMicroseconds = std::max(m_Stats.maxLatencyMicroseconds, latency);
+			committed++;
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.lastCommitMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+		return committed;
+	}
+
+	// Block until every requested chunk is built or failed, e.g. behind a loading screen.
+	void WaitUntilBuilt()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Built.wait(lock, [this]() { return m_Queued.empty() && m_Loading == 0; });
+	}
+
+	StreamingStats GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		StreamingStats stats = m_Stats;
+		stats.queued = static_cast<std::uint32_t>(m_Queued.size());
+		stats.loading = m_Loading;
+		stats.ready = static_cast<std::uint32_t>(m_Ready.size());
+
+		return stats;
+	}
+
+private:
+	struct Chunk
+	{
+		std::string path;
+		std::chrono::steady_clock::time_point requestTime;
+		std::unique_ptr<ECS> world;
+	};
+
+	void WorkerLoop()
+	{
+		std::vector<std::uint8_t> bytes;
+
+		while (true)
+		{
+			Chunk chunk;
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_WakeWorkers.wait(lock, [this]() { return m_Quit || !m_Queued.empty(); });
+
+				if (m_Quit)
+					return;
+
+				chunk = std::move(m_Queued.front());
+				m_Queued.pop_front();
+				m_Loading++;
+
+				if (!m_FreeWorlds.empty())
+				{
+					chunk.world = std::move(m_FreeWorlds.back());
+					m_FreeWorlds.pop_back();
+				}
+			}
+
+			if (!chunk.world)
+			{
+				chunk.world = std::make_unique<ECS>();
+				chunk.world->Init();
+				m_Setup(*chunk.world);
+			}
+
+			bool built = Build(*chunk.world, chunk.path, bytes);
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Loading--;
+
+				// A failed load can leave the staging world half filled, so it isn't reused.
+				if (built)
+					m_Ready.push_back(std::move(chunk));
+				else
+					m_Stats.failed++;
+			}
+			m_Built.notify_all();
+		}
+	}
+
+	bool Build(ECS& staging, const std::string& path, std::vector<std::uint8_t>& bytes) const
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+
+		bytes.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+		if (!file)
+			return false;
+
+		if (m_Decode && !m_Decode(bytes))
+			return false;
+
+		return m_WorldFile.LoadFromMemory(staging, bytes.data(), bytes.size()).success;
+	}
+
+	SetupFunction m_Setup;
+	DecodeFunction m_Decode;
+	WorldFile m_WorldFile;
+
+	std::vector<std::thread> m_Workers;
+
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_WakeWorkers;
+	std::condition_variable m_Built;
+	bool m_Quit{ false };
+
+	// Requested chunks in order, then built chunks in the order they finished.
+	std::deque<Chunk> m_Queued;
+	std::deque<Chunk> m_Ready;
+	std::uint32_t m_Loading{ 0 };
+
+	// Empty staging worlds left over from committed chunks.
+	std::vector<std::unique_ptr<ECS>> m_FreeWorlds;
+
+	StreamingStats m_Stats{};
+};
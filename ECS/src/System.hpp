@@ -1,10 +1,215 @@
 #pragma once
 
 #include "Base.hpp"
+#include <chrono>
+#include <memory_resource>
 #include <set>
 
+enum class ScheduleMode : std::uint8_t
+{
+	// Every tick, every entity.
+	EveryTick,
+	// Every interval ticks, every entity.
+	Interval,
+	// Every tick, a rotating 1/slices of the entities.
+	Sliced,
+	// Every tick, as many entities as fit in the time budget.
+	Budget
+};
+
+struct SystemSchedule
+{
+	ScheduleMode mode{ ScheduleMode::EveryTick };
+
+	// Interval mode, run on ticks where (tick + offset) % interval == 0. Offsets spread systems with the same interval.
+	std::uint32_t interval{ 1 };
+	std::uint32_t offset{ 0 };
+
+	// Sliced mode, number of ticks one sweep over all entities is spread over.
+	std::uint32_t slices{ 1 };
+
+	// Budget mode, time after which the sweep stops and resumes next tick.
+	double budgetMicroseconds{ 0.0 };
+
+	static SystemSchedule Every(std::uint32_t interval, std::uint32_t offset = 0)
+	{
+		SystemSchedule schedule;
+		schedule.mode = ScheduleMode::Interval;
+		schedule.interval = interval;
+		schedule.offset = offset;
+		return schedule;
+	}
+
+	static SystemSchedule Sliced(std::uint32_t slices)
+	{
+		SystemSchedule schedule;
+		schedule.mode = ScheduleMode::Sliced;
+		schedule.slices = slices;
+		return schedule;
+	}
+
+	static SystemSchedule Budget(double microseconds)
+	{
+		SystemSchedule schedule;
+		schedule.mode = ScheduleMode::Budget;
+		schedule.budgetMicroseconds = microseconds;
+		return schedule;
+	}
+};
+
+// How far behind a sliced or budgeted system is.
+struct SystemStats
+{
+	// Entities visited by the last ForEachEntity.
+	std::uint32_t visitedLastTick{ 0 };
+
+	// Entities the current sweep still has to visit.
+	std::uint32_t remaining{ 0 };
+
+	// Ticks since the current sweep started, how stale the oldest entity can be.
+	std::uint32_t ticksBehind{ 0 };
+
+	// Ticks the last finished sweep took.
+	std::uint32_t lastSweepTicks{ 0 };
+
+	std::uint64_t completedSweeps{ 0 };
+};
+
+/**
+ * Systems iterate their entities with ForEachEntity, which follows the schedule set through the SystemManager.
+ * Sliced and budgeted systems remember the last entity visited and continue after it next tick, so entities
+ * added or removed in between don't break the sweep.
+ */
 class System
 {
 public:
-	std::set<Entity> m_Entities;
+	std::pmr::set<Entity> m_Entities{ ConstructionResource() };
+
+	// Resource the entity set of a system under construction allocates from, set by the SystemManager.
+	static std::pmr::memory_resource*& ConstructionResource()
+	{
+		thread_local std::pmr::memory_resource* s_Resource = std::pmr::get_default_resource();
+		return s_Resource;
+	}
+
+	// Call once per tick, returns false on ticks an interval system skips.
+	bool ShouldUpdate()
+	{
+		std::uint64_t tick = m_Tick++;
+
+		if (m_Schedule.mode != ScheduleMode::Interval)
+			return true;
+
+		return (tick + m_Schedule.offset) % m_Schedule.interval == 0;
+	}
+
+	// Call fn(entity) for the entities this tick's part of the sweep covers.
+	template<typename F>
+	void ForEachEntity(F&& fn)
+	{
+		if (m_Schedule.mode == ScheduleMode::EveryTick || m_Schedule.mode == ScheduleMode::Interval)
+		{
+			for (Entity entity : m_Entities)
+			{
+				fn(entity);
+			}
+
+			m_Stats.visitedLastTick = static_cast<std::uint32_t>(m_Entities.size());
+			m_Stats.remaining = 0;
+			m_Stats.ticksBehind = 0;
+			m_Stats.lastSweepTicks = 1;
+			m_Stats.completedSweeps++;
+			return;
+		}
+
+		if (!m_InSweep)
+		{
+			m_InSweep = true;
+			m_SweepStartTick = m_Tick;
+			m_SweepVisited = 0;
+		}
+
+		auto it = m_HasCursor ? m_Entities.upper_bound(m_Cursor) : m_Entities.begin();
+		std::uint32_t visited = 0;
+
+		if (m_Schedule.mode == ScheduleMode::Sliced)
+		{
+			std::uint32_t slices = m_Schedule.slices > 0 ? m_Schedule.slices : 1;
+			size_t quota = (m_Entities.size() + slices - 1) / slices;
+
+			for (; it != m_Entities.end() && visited < quota; ++it)
+			{
+				fn(*it);
+				m_Cursor = *it;
+				visited++;
+			}
+		}
+		else
+		{
+			auto start = std::chrono::steady_clock::now();
+			auto budget = std::chrono::duration<double, std::micro>(m_Schedule.budgetMicroseconds);
+
+			// The clock is only read every 16 entities, so at least that many are visited and the sweep always progresses.
+			for (; it != m_Entities.end(); ++it)
+			{
+				if (visited > 0 && visited % 16 == 0 && std::chrono::steady_clock::now() - start >= budget)
+					break;
+
+				fn(*it);
+				m_Cursor = *it;
+				visited++;
+			}
+		}
+
+		m_HasCursor = visited > 0 || m_HasCursor;
+		m_SweepVisited += visited;
+
+		m_Stats.visitedLastTick = visited;
+		m_Stats.ticksBehind = static_cast<std::uint32_t>(m_Tick - m_SweepStartTick);
+		m_Stats.remaining = m_Entities.size() > m_SweepVisited ? static_cast<std::uint32_t>(m_Entities.size() - m_SweepVisited) : 0;
+
+		// Sweep done, start over from the first entity next tick.
+		if (it == m_Entities.end())
+		{
+			m_InSweep = false;
+			m_HasCursor = false;
+			m_Stats.remaining = 0;
+			m_Stats.lastSweepTicks = m_Stats.ticksBehind + 1;
+			m_Stats.completedSweeps++;
+		}
+	}
+
+	void SetSchedule(const SystemSchedule& schedule)
+	{
+		assert((schedule.mode != ScheduleMode::Interval || schedule.interval > 0) && "Interval must be positive.");
+
+		m_Schedule = schedule;
+		m_InSweep = false;
+		m_HasCursor = false;
+	}
+
+	// The entities were given new IDs, which reorders the sweep, so the cursor can't resume where it was.
+	// The sweep starts over from the first entity but keeps its start tick, the staleness stats stay an upper bound.
+	void RestartSweep()
+	{
+		m_HasCursor = false;
+		m_SweepVisited = 0;
+	}
+
+	const SystemSchedule& GetSchedule() const { return m_Schedule; }
+	const SystemStats& GetStats() const { return m_Stats; }
+
+private:
+	SystemSchedule m_Schedule{};
+	SystemStats m_Stats{};
+
+	// Ticks counted by ShouldUpdate.
+	std::uint64_t m_Tick{ 0 };
+
+	// Sweep state of sliced and budgeted systems, the cursor is the last entity visited.
+	bool m_InSweep{ false };
+	bool m_HasCursor{ false };
+	Entity m_Cursor{ 0 };
+	std::uint64_t m_SweepStartTick{ 0 };
+	size_t m_SweepVisited{ 0 };
 };
@@ -2,14 +2,23 @@
 
 #include "Base.hpp"
 #include "System.hpp"
+#include "Layout.hpp"
 
+#include <algorithm>
 #include <unordered_map>
 #include <memory>
+#include <memory_resource>
+#include <vector>
 
 
 class SystemManager
 {
 public:
+	explicit SystemManager(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		: m_Resource(resource)
+	{
+	}
+
 	template<typename T, typename... Args>
 	std::shared_ptr<T> RegisterSystem(Args&&... params)
 	{
@@ -18,7 +27,12 @@ public:
 		assert(m_Systems.find(typeName) == m_Systems.end() && "Registering system more than once.");
 
 		// Create a pointer to the system and return it so it can be used externally.
+		// Its entity set allocates from the ECS's resource.
+		std::pmr::memory_resource* previous = System::ConstructionResource();
+		System::ConstructionResource() = m_Resource;
 		auto system = std::make_shared<T>(std::forward<Args>(params)...);
+		System::ConstructionResource() = previous;
+
 		m_Systems.insert({ typeName, system });
 
 		return system;
@@ -45,6 +59,52 @@ public:
 		return m_Signatures[typeName];
 	}
 
+	template<typename T>
+	void SetSchedule(const SystemSchedule& schedule)
+	{
+		const char* typeName = typeid(T).name();
+
+		assert(m_Systems.find(typeName) != m_Systems.end() && "System used before registered.");
+
+		m_Systems[typeName]->SetSchedule(schedule);
+	}
+
+	template<typename T>
+	const SystemStats& GetStats()
+	{
+		const char* typeName = typeid(T).name();
+
+		assert(m_Systems.find(typeName) != m_Systems.end() && "System used before registered.");
+
+		return m_Systems[typeName]->GetStats();
+	}
+
+	// One entry per registered system, ordered by name.
+	std::vector<SystemLayout> GetSystemLayouts() const
+	{
+		std::vector<SystemLayout> layouts;
+		layouts.reserve(m_Systems.size());
+
+		for (const auto& pair : m_Systems)
+		{
+			SystemLayout layout;
+			layout.name = pair.first;
+			layout.entityCount = pair.second->m_Entities.size();
+			layout.schedule = pair.second->GetSchedule().mode;
+			layout.stats = pair.second->GetStats();
+
+			auto signature = m_Signatures.find(pair.first);
+			if (signature != m_Signatures.end())
+				layout.signature = signature->second;
+
+			layouts.push_back(std::move(layout));
+		}
+
+		std::sort(layouts.begin(), layouts.end(), [](const SystemLayout& a, const SystemLayout& b) { return a.name < b.name; });
+
+		return layouts;
+	}
+
 	void EntityDestroyed(Entity entity)
 	{
 		// Erase a destroyed entity from all systems lists.
@@ -57,6 +117,42 @@ public:
 		}
 	}
 
+	// Systems keep the entities they had, under their new IDs.
+	void MoveEntities(const EntityMove* moves, size_t count)
+	{
+		for (const auto& pair : m_Systems)
+		{
+			auto& entities = pair.second->m_Entities;
+			bool moved = false;
+			for (size_t i = 0; i < count; i++)
+			{
+				if (entities.erase(moves[i].from))
+				{
+					entities.insert(moves[i].to);
+					moved = true;
+				}
+			}
+
+			// Sliced and budgeted sweeps keep their cursor as an entity ID.
+			if (moved)
+				pair.second->RestartSweep();
+		}
+	}
+
+	// New entities that all have the same signature, every system's signature is only tested once.
+	void EntitiesCreated(const Entity* entities, size_t count, Signature entitySignature)
+	{
+		for (const auto& pair : m_Systems)
+		{
+			const auto& systemSignature = m_Signatures[pair.first];
+
+			if ((entitySignature & systemSignature) == systemSignature)
+			{
+				pair.second->m_Entities.insert(entities, entities + count);
+			}
+		}
+	}
+
 	void EntitySignatureChanged(Entity entity, Signature entitySignature)
 	{
 		// Notify each system that an entity's signature changed.
@@ -79,6 +175,8 @@ public:
 		}
 	}
 private:
+	std::pmr::memory_resource* m_Resource;
+
 	// Map from system type string pointer to a signature.
 	std::unordered_map<const char*, Signature> m_Signatures{};
 
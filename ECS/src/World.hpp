@@ -0,0 +1,415 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "CommandBuffer.hpp"
+#include "ECS.hpp"
+#include "JobSystem.hpp"
+#include "WorldChecksum.hpp"
+
+enum class Phase : std::uint8_t
+{
+	PreUpdate,
+	FixedUpdate,
+	Update,
+	PostUpdate,
+	Render,
+	Count
+};
+
+struct FrameTime
+{
+	// Seconds since the previous frame, after clamping to the max frame time.
+	double deltaTime;
+
+	// Constant step of the FixedUpdate phase.
+	double fixedDeltaTime;
+
+	// How far the frame is between the last two fixed steps, for interpolation.
+	float alpha;
+
+	// Fixed steps run since the start.
+	std::uint64_t fixedStep;
+};
+
+struct FrameStats
+{
+	// Fixed steps run during the last frame.
+	std::uint32_t fixedSteps{ 0 };
+
+	// Fixed steps skipped over the whole run because the catch-up limit was reached.
+	std::uint64_t droppedSteps{ 0 };
+
+	std::array<double, static_cast<size_t>(Phase::Count)> phaseMicroseconds{};
+
+	// World checksum after the last fixed step, only computed in deterministic mode.
+	std::uint64_t stateHash{ 0 };
+};
+
+// Components and world resources a system reads and writes. Systems of a phase whose accesses don't conflict run in parallel.
+struct SystemAccess
+{
+	Signature reads;
+	Signature writes;
+	ResourceSignature resourceReads;
+	ResourceSignature resourceWrites;
+	bool exclusive;
+
+	// Unknown access, the system runs alone.
+	SystemAccess()
+		: exclusive(true)
+	{
+	}
+
+	SystemAccess(Signature reads, Signature writes, ResourceSignature resourceReads = {}, ResourceSignature resourceWrites = {})
+		: reads(reads), writes(writes), resourceReads(resourceReads), resourceWrites(resourceWrites), exclusive(false)
+	{
+	}
+
+	bool ConflictsWith(const SystemAccess& other) const
+	{
+		return exclusive || other.exclusive
+			|| (writes & (other.reads | other.writes)).any() || (other.writes & reads).any()
+			|| (resourceWrites & (other.resourceReads | other.resourceWrites)).any() || (other.resourceWrites & resourceReads).any();
+	}
+};
+
+/**
+ * Runs the systems of an ECS once per frame in phases: PreUpdate, FixedUpdate, Update, PostUpdate and Render.
+ * FixedUpdate runs at a fixed rate from an accumulator of whole nanoseconds, so the simulation steps are identical
+ * no matter the frame rate, and at most a set number of steps run per frame, the rest are dropped.
+ * Systems of a phase are split into stages where no two systems conflict, stages with more than one system
+ * run on the job system. A stage with a single system runs on the calling thread, so exclusive systems like
+ * rendering stay on the main thread. Structural changes systems record into GetCommands are played back after
+ * their stage.
+ * Components registered with Interpolate keep their value from before the last fixed step, so rendering can
+ * blend between the last two steps with Interpolated.
+ */
+class World
+{
+public:
+	using SystemFunction = std::function<void(ECS& ecs, const FrameTime& time)>;
+
+	World(ECS& ecs, JobSystem* jobs = nullptr)
+		: m_ECS(ecs), m_Jobs(jobs), m_Checksum(ecs)
+	{
+		SetFixedRate(60.0);
+	}
+
+	// Steps per second of FixedUpdate and how many steps one frame may run to catch up.
+	void SetFixedRate(double stepsPerSecond, std::uint32_t maxStepsPerFrame = 5)
+	{
+		assert(stepsPerSecond > 0.0 && maxStepsPerFrame > 0 && "Invalid fixed rate.");
+
+		m_FixedStepNanoseconds = static_cast<std::int64_t>(1e9 / stepsPerSecond + 0.5);
+		m_MaxStepsPerFrame = maxStepsPerFrame;
+		m_Accumulator = 0;
+	}
+
+	// Longer frames, e.g. after a breakpoint, are treated as this long.
+	void SetMaxFrameTime(double seconds) { m_MaxFrameTime = seconds; }
+
+	// For lockstep and replay verification: commands are played back ordered by (system, chunk) and the world
+	// checksum is updated after every fixed step, so two machines can compare their frames and locate a divergence
+	// with GetChecksum. Systems that split their work use ParallelForChunks with a fixed chunk size, ParallelFor
+	// splits by thread count.
+	void SetDeterministic(bool deterministic)
+	{
+		m_Deterministic = deterministic;
+		m_Commands.SetDeterministic(deterministic);
+	}
+
+	bool IsDeterministic() const { return m_Deterministic; }
+
+	// Structural changes recorded by systems, played back after every stage.
+	CommandBuffer& GetCommands() { return m_Commands; }
+
+	// Checksum trees of the last fixed step, only updated in deterministic mode.
+	const WorldChecksum& GetChecksum() const { return m_Checksum; }
+
+	void AddSystem(Phase phase, const char* name, SystemFunction function, SystemAccess access = SystemAccess())
+	{
+		auto& phaseSystems = m_Phases[static_cast<size_t>(phase)];
+		phaseSystems.systems.push_back({ name, std::move(function), access });
+		phaseSystems.dirty = true;
+	}
+
+	// Systems with the usual Update(ECS&) method, skipped on ticks their schedule doesn't run them.
+	template<typename T>
+	void AddSystem(Phase phase, const char* name, std::shared_ptr<T> system, SystemAccess access = SystemAccess())
+	{
+		AddSystem(phase, name, [system](ECS& ecs, const FrameTime&)
+		{
+			if (system->ShouldUpdate())
+				system->Update(ecs);
+		}, access);
+	}
+
+	template<typename... T>
+	Signature ComponentSignature() const
+	{
+		Signature signature;
+		(signature.set(m_ECS.GetComponentType<T>(), true), ...);
+		return signature;
+	}
+
+	template<typename... T>
+	ResourceSignature Resources()
+	{
+		ResourceSignature signature;
+		(signature.set(m_ECS.GetResourceType<T>(), true), ...);
+		return signature;
+	}
+
+	// Keep the value of every T from before the last fixed step, lerp blends two values by alpha.
+	template<typename T>
+	void Interpolate(T(*lerp)(const T& previous, const T& current, float alpha))
+	{
+		const char* typeName = typeid(T).name();
+		assert(m_Interpolations.find(typeName) == m_Interpolations.end() && "Interpolating a component more than once.");
+
+		m_Interpolations.insert({ typeName, std::make_unique<Interpolation<T>>(lerp) });
+	}
+
+	// Entity's T blended between the last two fixed steps, or the current value if it didn't exist before the last step.
+	template<typename T>
+	T Interpolated(Entity entity) const
+	{
+		auto it = m_Interpolations.find(typeid(T).name());
+		assert(it != m_Interpolations.end() && "Component isn't interpolated.");
+
+		const auto& interpolation = static_cast<const Interpolation<T>&>(*it->second);
+		const T& current = m_ECS.ReadComponent<T>(entity);
+
+		if (m_Time.fixedStep == 0 || interpolation.capturedStep[entity] != m_Time.fixedStep - 1)
+			return current;
+
+		return interpolation.lerp(interpolation.previous[entity], current, m_Time.alpha);
+	}
+
+	// Follow entities that got new IDs with ECS::MoveEntities, so they keep blending from their own values.
+	void MoveEntities(const EntityMove* moves, size_t count)
+	{
+		for (const auto& pair : m_Interpolations)
+		{
+			pair.second->MoveEntities(moves, count);
+		}
+	}
+
+	// Run one frame, deltaSeconds is the real time since the previous call.
+	void Tick(double deltaSeconds)
+	{
+		deltaSeconds = std::min(std::max(deltaSeconds, 0.0), m_MaxFrameTime);
+
+		m_Time.deltaTime = deltaSeconds;
+		m_Time.fixedDeltaTime = m_FixedStepNanoseconds * 1e-9;
+		m_Accumulator += static_cast<std::int64_t>(deltaSeconds * 1e9 + 0.5);
+
+		RunPhase(Phase::PreUpdate);
+
+		m_Stats.fixedSteps = 0;
+		m_Stats.phaseMicroseconds[static_cast<size_t>(Phase::FixedUpdate)] = 0.0;
+
+		while (m_Accumulator >= m_FixedStepNanoseconds && m_Stats.fixedSteps < m_MaxStepsPerFrame)
+		{
+			for (const auto& pair : m_Interpolations)
+			{
+				pair.second->Capture(m_ECS, m_Time.fixedStep);
+			}
+
+			RunPhase(Phase::FixedUpdate, true);
+
+			if (m_Deterministic)
+				m_Stats.stateHash = m_Checksum.Update();
+
+			m_Accumulator -= m_FixedStepNanoseconds;
+			m_Time.fixedStep++;
+			m_Stats.fixedSteps++;
+		}
+
+		// Catch-up limit reached, drop the backlog instead of spiraling.
+		if (m_Accumulator >= m_FixedStepNanoseconds)
+		{
+			m_Stats.droppedSteps += m_Accumulator / m_FixedStepNanoseconds;
+			m_Accumulator %= m_FixedStepNanoseconds;
+		}
+
+		m_Time.alpha = static_cast<float>(double(m_Accumulator) / double(m_FixedStepNanoseconds));
+
+		RunPhase(Phase::Update);
+		RunPhase(Phase::PostUpdate);
+		RunPhase(Phase::Render);
+	}
+
+	const FrameTime& GetTime() const { return m_Time; }
+	const FrameStats& GetStats() const { return m_Stats; }
+
+	// Number of parallel stages the phase's systems are split into.
+	size_t GetStageCount(Phase phase)
+	{
+		auto& phaseSystems = m_Phases[static_cast<size_t>(phase)];
+		BuildStages(phaseSystems);
+
+		return phaseSystems.stages.size();
+	}
+
+	ECS& GetECS() { return m_ECS; }
+
+private:
+	struct SystemEntry
+	{
+		std::string name;
+		SystemFunction function;
+		SystemAccess access;
+	};
+
+	struct PhaseSystems
+	{
+		// In the order they were added, conflicting systems always run in this order.
+		std::vector<SystemEntry> systems;
+
+		// Indices into systems, every stage only holds systems that don't conflict with each other.
+		std::vector<std::vector<std::uint32_t>> stages;
+
+		bool dirty{ false };
+	};
+
+	class IInterpolation
+	{
+	public:
+		virtual ~IInterpolation() = default;
+		virtual void Capture(ECS& ecs, std::uint64_t step) = 0;
+		virtual void MoveEntities(const EntityMove* moves, size_t count) = 0;
+	};
+
+	template<typename T>
+	class Interpolation : public IInterpolation
+	{
+	public:
+		using LerpFunction = T(*)(const T&, const T&, float);
+
+		Interpolation(LerpFunction lerp)
+			: lerp(lerp), previous(MAX_ENTITIES), capturedStep(MAX_ENTITIES, ~std::uint64_t(0))
+		{
+		}
+
+		void Capture(ECS& ecs, std::uint64_t step) override
+		{
+			auto componentArray = ecs.GetComponentManager()->GetComponentArray<T>();
+			const Entity* entities = componentArray->RawEntities();
+			const T* components = componentArray->Data();
+
+			for (size_t index = 0; index < componentArray->Size(); index++)
+			{
+				previous[entities[index]] = components[index];
+				capturedStep[entities[index]] = step;
+			}
+		}
+
+		// The old ID is free afterwards, an entity created there later has nothing to blend from.
+		void MoveEntities(const EntityMove* moves, size_t count) override
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				previous[moves[i].to] = previous[moves[i].from];
+				capturedStep[moves[i].to] = capturedStep[moves[i].from];
+				capturedStep[moves[i].from] = ~std::uint64_t(0);
+			}
+		}
+
+		LerpFunction lerp;
+
+		// Per entity ID, the value before the step it was captured at.
+		std::vector<T> previous;
+		std::vector<std::uint64_t> capturedStep;
+	};
+
+	// Every system goes into the stage after the last earlier system it conflicts with.
+	void BuildStages(PhaseSystems& phaseSystems)
+	{
+		if (!phaseSystems.dirty)
+			return;
+
+		const auto& systems = phaseSystems.systems;
+		std::vector<std::uint32_t> systemStage(systems.size(), 0);
+
+		phaseSystems.stages.clear();
+		for (std::uint32_t i = 0; i < systems.size(); i++)
+		{
+			for (std::uint32_t j = 0; j < i; j++)
+			{
+				if (systems[i].access.ConflictsWith(systems[j].access))
+					systemStage[i] = std::max(systemStage[i], systemStage[j] + 1);
+			}
+
+			if (systemStage[i] >= phaseSystems.stages.size())
+				phaseSystems.stages.resize(systemStage[i] + 1);
+			phaseSystems.stages[systemStage[i]].push_back(i);
+		}
+
+		phaseSystems.dirty = false;
+	}
+
+	void RunPhase(Phase phase, bool accumulateTime = false)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		auto& phaseSystems = m_Phases[static_cast<size_t>(phase)];
+		BuildStages(phaseSystems);
+
+		for (const auto& stage : phaseSystems.stages)
+		{
+			if (stage.size() == 1 || m_Jobs == nullptr)
+			{
+				for (std::uint32_t system : stage)
+				{
+					phaseSystems.systems[system].function(m_ECS, m_Time);
+				}
+			}
+			else
+			{
+				m_Jobs->Run(static_cast<std::uint32_t>(stage.size()), [&](std::uint32_t index)
+				{
+					phaseSystems.systems[stage[index]].function(m_ECS, m_Time);
+				});
+			}
+
+			// The next stage sees the structural changes of this one.
+			if (!m_Commands.IsEmpty())
+				m_Commands.Playback(m_ECS);
+		}
+
+		double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		double& phaseTime = m_Stats.phaseMicroseconds[static_cast<size_t>(phase)];
+		phaseTime = accumulateTime ? phaseTime + elapsed : elapsed;
+	}
+
+	ECS& m_ECS;
+	JobSystem* m_Jobs;
+
+	std::array<PhaseSystems, static_cast<size_t>(Phase::Count)> m_Phases;
+
+	// Map from component type string pointer to its interpolation.
+	std::unordered_map<const char*, std::unique_ptr<IInterpolation>> m_Interpolations;
+
+	// Fixed step length and unsimulated time, in nanoseconds so stepping doesn't drift.
+	std::int64_t m_FixedStepNanoseconds{ 0 };
+	std::int64_t m_Accumulator{ 0 };
+	std::uint32_t m_MaxStepsPerFrame{ 5 };
+	double m_MaxFrameTime{ 0.25 };
+
+	FrameTime m_Time{};
+	FrameStats m_Stats{};
+
+	bool m_Deterministic{ false };
+	CommandBuffer m_Commands;
+	WorldChecksum m_Checksum;
+};
@@ -0,0 +1,461 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "ECS.hpp"
+#include "StateHash.hpp"
+
+// Tree of the entity layer in checksum summaries and queries, component trees use their component type.
+constexpr ComponentType CHECKSUM_ENTITIES = MAX_COMPONENTS;
+
+// Root of one tree, a peer sends the summary of every non-empty tree to start locating a divergence.
+struct ChecksumSummary
+{
+	ComponentType tree;
+	std::uint32_t size;
+	std::uint64_t root;
+};
+
+// Asks a peer for the two children of a node, node 1 is the root.
+struct ChecksumQuery
+{
+	ComponentType tree;
+	std::uint32_t node;
+};
+
+struct ChecksumReply
+{
+	std::uint64_t left;
+	std::uint64_t right;
+};
+
+// Where two worlds differ: dense slots [first, first + count) of a component type, or entity IDs for the entity layer.
+struct ChecksumDivergence
+{
+	ComponentType tree{ CHECKSUM_ENTITIES };
+	std::uint32_t first{ 0 };
+	std::uint32_t count{ 0 };
+
+	// Local entities in the range, the living ones for the entity layer.
+	std::vector<Entity> entities;
+
+	// Summary plus queries answered by the peer.
+	std::uint32_t exchanges{ 0 };
+};
+
+/**
+ * Incremental 64-bit checksum of a world for catching desyncs between lockstep peers every frame.
+ * Every trivially copyable component type gets a Merkle tree over its dense slots, 64 slots per leaf, and the entity
+ * layer gets one over entity IDs with the living bits and signatures. Update only rehashes the leaves with a slot
+ * changed since the last update, by change tick or by a different entity in the slot after a removal or sort, and
+ * the nodes above them. Trees have a fixed shape for MAX_ENTITIES, so a DivergenceLocator can walk two peers' trees
+ * down to the first differing leaf in log2 of the leaf count queries.
+ * Like the WorldHasher, dense order is part of the state and components that aren't trivially copyable, shared
+ * components, resources and relations aren't covered.
+ */
+class WorldChecksum
+{
+public:
+	static constexpr std::uint32_t LEAF_SLOTS = 64;
+
+	// Leaves of every tree, a power of two so every node has two children.
+	static constexpr std::uint32_t LEAF_COUNT = []()
+	{
+		std::uint32_t count = 1;
+		while (count * LEAF_SLOTS < MAX_ENTITIES)
+		{
+			count *= 2;
+		}
+		return count;
+	}();
+
+	WorldChecksum(ECS& ecs)
+		: m_ECS(ecs)
+	{
+	}
+
+	// Bring the trees up to date with the world and return the world checksum.
+	// Advances the world tick, like every other incremental consumer of change ticks.
+	std::uint64_t Update()
+	{
+		Tick tick = m_ECS.AdvanceTick();
+		m_RehashedLeafCount = 0;
+
+		UpdateEntities();
+
+		const auto& componentManager = m_ECS.GetComponentManager();
+		for (ComponentType type = 0; type < MAX_COMPONENTS; type++)
+		{
+			const IComponentArray* array = componentManager->GetComponentArrayByType(type);
+			if (array && array->IsTriviallyCopyable())
+				UpdateComponents(type, *array);
+		}
+
+		m_LastTick = tick;
+
+		// The world checksum covers the roots of the non-empty trees, so registering a type no entity has
+		// doesn't change it.
+		m_Summary.clear();
+		StateHasher hasher;
+		for (ComponentType tree = 0; tree <= CHECKSUM_ENTITIES; tree++)
+		{
+			const Tree& current = m_Trees[tree];
+			if (current.nodes.empty() || current.nodes[1] == 0)
+				continue;
+
+			m_Summary.push_back({ tree, current.size, current.nodes[1] });
+			hasher.UpdateValue(static_cast<std::uint32_t>(tree));
+			hasher.UpdateValue(current.size);
+			hasher.UpdateValue(current.nodes[1]);
+		}
+		m_Root = hasher.Finish();
+
+		return m_Root;
+	}
+
+	std::uint64_t GetRoot() const { return m_Root; }
+
+	// Roots of the non-empty trees in tree order, as of the last update.
+	const std::vector<ChecksumSummary>& GetSummary() const { return m_Summary; }
+
+	// Root of a tree, 0 if it's empty.
+	std::uint64_t GetTreeRoot(ComponentType tree) const { return GetNode(tree, 1); }
+
+	// Answer a peer's DivergenceLocator from the state of the last update.
+	ChecksumReply Answer(const ChecksumQuery& query) const
+	{
+		assert(query.node >= 1 && query.node < LEAF_COUNT && "Query for a node without children.");
+
+		return { GetNode(query.tree, query.node * 2), GetNode(query.tree, query.node * 2 + 1) };
+	}
+
+	// Entities in slots [first, first + count) of a component tree as of the last update, or the living entities
+	// in the ID range for the entity layer.
+	void GetEntities(ComponentType tree, std::uint32_t first, std::uint32_t count, std::vector<Entity>& entities) const
+	{
+		entities.clear();
+
+		const Tree& current = m_Trees[tree];
+		if (tree == CHECKSUM_ENTITIES)
+		{
+			const auto& entityManager = m_ECS.GetEntityManager();
+			for (Entity entity = first; entity < std::min<Entity>(first + count, MAX_ENTITIES); entity++)
+			{
+				if (entityManager->IsAlive(entity))
+					entities.push_back(entity);
+			}
+		}
+		else if (first < current.size)
+		{
+			std::uint32_t end = std::min(first + count, current.size);
+			entities.assign(current.entities.begin() + first, current.entities.begin() + end);
+		}
+	}
+
+	// Leaves rehashed by the last update, over every tree.
+	std::uint32_t GetRehashedLeafCount() const { return m_RehashedLeafCount; }
+
+	// Parent of two nodes, empty subtrees stay 0.
+	static std::uint64_t Combine(std::uint64_t left, std::uint64_t right)
+	{
+		if ((left | right) == 0)
+			return 0;
+
+		return StateHasher::Mix(StateHasher::Mix(left) ^ right);
+	}
+
+private:
+	struct Tree
+	{
+		// Heap order, node 1 is the root and the leaves start at LEAF_COUNT. Empty until the first update.
+		std::vector<std::uint64_t> nodes;
+
+		// Slots at the last update and the entity in every slot, to catch slots that got another component
+		// without a new change tick.
+		std::uint32_t size{ 0 };
+		std::vector<Entity> entities;
+	};
+
+	std::uint64_t GetNode(ComponentType tree, std::uint32_t node) const
+	{
+		assert(tree <= CHECKSUM_ENTITIES && "Tree out of range.");
+
+		const Tree& current = m_Trees[tree];
+		return current.nodes.empty() ? 0 : current.nodes[node];
+	}
+
+	// Leaf i covers entity IDs [i * 64, i * 64 + 64), one word of living bits.
+	void UpdateEntities()
+	{
+		Tree& tree = m_Trees[CHECKSUM_ENTITIES];
+		bool rebuild = tree.nodes.empty();
+		if (rebuild)
+			tree.nodes.resize(LEAF_COUNT * 2, 0);
+
+		const auto& entityManager = m_ECS.GetEntityManager();
+		const Tick* signatureTicks = entityManager->GetSignatureTicks();
+
+		m_DirtyLeaves.clear();
+		for (std::uint32_t leaf = 0; leaf * LEAF_SLOTS < MAX_ENTITIES; leaf++)
+		{
+			Entity first = leaf * LEAF_SLOTS;
+			Entity end = std::min<Entity>(first + LEAF_SLOTS, MAX_ENTITIES);
+
+			if (!rebuild && !AnyNewer(signatureTicks + first, end - first))
+				continue;
+
+			// Living bits, then the signature of every living entity as a 32-bit word.
+			std::uint64_t living = 0;
+			std::uint32_t signatures[LEAF_SLOTS] = {};
+			for (Entity entity = first; entity < end; entity++)
+			{
+				if (entityManager->IsAlive(entity))
+				{
+					living |= std::uint64_t(1) << (entity - first);
+					signatures[entity - first] = static_cast<std::uint32_t>(entityManager->GetSignature(entity).to_ulong());
+				}
+			}
+
+			std::uint64_t hash = 0;
+			if (living != 0)
+			{
+				StateHasher hasher;
+				hasher.UpdateValue(living);
+				hasher.UpdateValue(signatures);
+				hash = hasher.Finish();
+			}
+
+			SetLeaf(tree, leaf, hash);
+		}
+
+		tree.size = entityManager->GetLivingEntityCount();
+		Propagate(tree);
+	}
+
+	// Leaf i covers dense slots [i * 64, i * 64 + 64), their entities and component bytes.
+	void UpdateComponents(ComponentType type, const IComponentArray& array)
+	{
+		Tree& tree = m_Trees[type];
+		bool rebuild = tree.nodes.empty();
+		if (rebuild)
+			tree.nodes.resize(LEAF_COUNT * 2, 0);
+
+		std::uint32_t size = static_cast<std::uint32_t>(array.Size());
+		std::uint32_t oldSize = tree.size;
+		if (tree.entities.size() < size)
+			tree.entities.resize(size);
+
+		const Tick* ticks = array.ChangeTicks();
+		const Entity* entities = array.RawEntities();
+		const unsigned char* data = static_cast<const unsigned char*>(array.RawData());
+		size_t componentSize = array.ComponentSize();
+
+		m_DirtyLeaves.clear();
+		std::uint32_t leafCount = (std::max(size, oldSize) + LEAF_SLOTS - 1) / LEAF_SLOTS;
+		for (std::uint32_t leaf = 0; leaf < leafCount; leaf++)
+		{
+			std::uint32_t first = leaf * LEAF_SLOTS;
+			std::uint32_t end = std::min(first + LEAF_SLOTS, size);
+			std::uint32_t oldEnd = std::min(first + LEAF_SLOTS, oldSize);
+			std::uint32_t count = end > first ? end - first : 0;
+
+			// Removals and sorts move components between slots without stamping them, the slot's entity changes though.
+			bool changed = rebuild || end != oldEnd;
+			if (!changed && count > 0)
+			{
+				changed = AnyNewer(ticks + first, count)
+					|| std::memcmp(entities + first, tree.entities.data() + first, count * sizeof(Entity)) != 0;
+			}
+			if (!changed)
+				continue;
+
+			std::uint64_t hash = 0;
+			if (count > 0)
+			{
+				StateHasher hasher;
+				hasher.Update(entities + first, count * sizeof(Entity));
+				hasher.Update(data + first * componentSize, count * componentSize);
+				hash = hasher.Finish();
+
+				std::memcpy(tree.entities.data() + first, entities + first, count * sizeof(Entity));
+			}
+
+			SetLeaf(tree, leaf, hash);
+		}
+
+		tree.size = size;
+		Propagate(tree);
+	}
+
+	// IsNewerTick for a run of ticks: a newer tick makes m_LastTick - tick negative, so ORing the differences
+	// checks them all without a branch per slot and vectorizes.
+	bool AnyNewer(const Tick* ticks, std::uint32_t count) const
+	{
+		Tick differences = 0;
+		for (std::uint32_t i = 0; i < count; i++)
+		{
+			differences |= m_LastTick - ticks[i];
+		}
+		return static_cast<std::int32_t>(differences) < 0;
+	}
+
+	void SetLeaf(Tree& tree, std::uint32_t leaf, std::uint64_t hash)
+	{
+		m_RehashedLeafCount++;
+
+		std::uint64_t& node = tree.nodes[LEAF_COUNT + leaf];
+		if (node == hash)
+			return;
+
+		node = hash;
+		m_DirtyLeaves.push_back(LEAF_COUNT + leaf);
+	}
+
+	// Recompute the parents of the changed leaves level by level, every node once. The dirty nodes of a level are
+	// ascending, so the parents of neighbours are deduplicated by comparing with the last one.
+	void Propagate(Tree& tree)
+	{
+		std::vector<std::uint32_t>& nodes = m_DirtyLeaves;
+		while (!nodes.empty() && nodes[0] > 1)
+		{
+			size_t parents = 0;
+			for (std::uint32_t node : nodes)
+			{
+				std::uint32_t parent = node / 2;
+				if (parents == 0 || nodes[parents - 1] != parent)
+					nodes[parents++] = parent;
+			}
+			nodes.resize(parents);
+
+			for (std::uint32_t parent : nodes)
+			{
+				tree.nodes[parent] = Combine(tree.nodes[parent * 2], tree.nodes[parent * 2 + 1]);
+			}
+		}
+	}
+
+	ECS& m_ECS;
+
+	// By component type, the entity layer last.
+	std::array<Tree, MAX_COMPONENTS + 1> m_Trees;
+	std::vector<ChecksumSummary> m_Summary;
+	std::uint64_t m_Root{ 0 };
+
+	// Tick closed by the last update.
+	Tick m_LastTick{ 0 };
+
+	// Scratch of the current tree, kept so updating every frame doesn't allocate.
+	std::vector<std::uint32_t> m_DirtyLeaves;
+	std::uint32_t m_RehashedLeafCount{ 0 };
+};
+
+/**
+ * Finds where the world of a peer differs from ours by walking both checksum trees from the root down, one
+ * ChecksumQuery per level that the peer answers with WorldChecksum::Answer. Start with the peer's summary, then
+ * send GetQuery and pass the reply to Receive until IsDone. Both checksums must stay at the update being compared
+ * until the locator is done, e.g. by keeping the checksum of a step around until the peers agree on it.
+ */
+class DivergenceLocator
+{
+public:
+	DivergenceLocator(const WorldChecksum& checksum)
+		: m_Checksum(checksum)
+	{
+	}
+
+	// Pick the first tree whose root differs, returns false if every tree matches.
+	bool Start(const std::vector<ChecksumSummary>& remote)
+	{
+		std::array<std::uint64_t, CHECKSUM_ENTITIES + 1> remoteRoots{};
+		for (const ChecksumSummary& summary : remote)
+		{
+			assert(summary.tree <= CHECKSUM_ENTITIES && "Tree out of range.");
+			remoteRoots[summary.tree] = summary.root;
+		}
+
+		m_Result = ChecksumDivergence();
+		m_Result.exchanges = 1;
+		m_Done = true;
+
+		for (ComponentType tree = 0; tree <= CHECKSUM_ENTITIES; tree++)
+		{
+			if (m_Checksum.GetTreeRoot(tree) == remoteRoots[tree])
+				continue;
+
+			m_Query = { tree, 1 };
+			m_Done = false;
+			m_Result.tree = tree;
+			return true;
+		}
+
+		return false;
+	}
+
+	bool IsDone() const { return m_Done; }
+
+	// Next query for the peer, only while not done.
+	const ChecksumQuery& GetQuery() const
+	{
+		assert(!m_Done && "Locator is done, there is nothing left to ask.");
+		return m_Query;
+	}
+
+	// Descend into the first child that differs, until a leaf is reached.
+	void Receive(const ChecksumReply& reply)
+	{
+		assert(!m_Done && "Reply without a query.");
+		m_Result.exchanges++;
+
+		std::uint32_t left = m_Query.node * 2;
+		ChecksumReply local = m_Checksum.Answer(m_Query);
+
+		// A differing node always has a differing child, unless the peer's tree is built differently.
+		if (local.left != reply.left)
+			m_Query.node = left;
+		else if (local.right != reply.right)
+			m_Query.node = left + 1;
+		else
+		{
+			Finish();
+			return;
+		}
+
+		if (m_Query.node >= WorldChecksum::LEAF_COUNT)
+			Finish();
+	}
+
+	const ChecksumDivergence& GetResult() const
+	{
+		assert(m_Done && "Locator isn't done yet.");
+		return m_Result;
+	}
+
+private:
+	// The slots under the current node, its level is the index of its highest bit.
+	void Finish()
+	{
+		std::uint32_t level = 0;
+		while ((m_Query.node >> (level + 1)) != 0)
+		{
+			level++;
+		}
+
+		std::uint32_t leaves = WorldChecksum::LEAF_COUNT >> level;
+		std::uint32_t firstLeaf = (m_Query.node - (std::uint32_t(1) << level)) * leaves;
+
+		m_Result.first = firstLeaf * WorldChecksum::LEAF_SLOTS;
+		m_Result.count = leaves * WorldChecksum::LEAF_SLOTS;
+		m_Checksum.GetEntities(m_Result.tree, m_Result.first, m_Result.count, m_Result.entities);
+		m_Done = true;
+	}
+
+	const WorldChecksum& m_Checksum;
+
+	ChecksumQuery m_Query{ CHECKSUM_ENTITIES, 1 };
+	ChecksumDivergence m_Result;
+	bool m_Done{ true };
+};
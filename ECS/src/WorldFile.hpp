@@ -0,0 +1,518 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <Windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "ECS.hpp"
+
+// A whole file mapped copy-on-write, pages are only read from disk once touched
+// and writing to them never changes the file.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+#ifdef _WIN32
+		if (m_Data)
+			UnmapViewOfFile(m_Data);
+		if (m_Mapping)
+			CloseHandle(m_Mapping);
+		if (m_File != INVALID_HANDLE_VALUE)
+			CloseHandle(m_File);
+#else
+		if (m_Data)
+			munmap(m_Data, m_Size);
+#endif
+	}
+
+	// Returns nullptr if the file can't be opened or mapped.
+	static std::shared_ptr<MappedFile> Open(const char* path)
+	{
+		auto file = std::make_shared<MappedFile>();
+
+#ifdef _WIN32
+		file->m_File = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file->m_File == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file->m_File, &size) || size.QuadPart == 0)
+			return nullptr;
+
+		file->m_Mapping = CreateFileMappingA(file->m_File, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (!file->m_Mapping)
+			return nullptr;
+
+		file->m_Data = MapViewOfFile(file->m_Mapping, FILE_MAP_COPY, 0, 0, 0);
+		if (!file->m_Data)
+			return nullptr;
+
+		file->m_Size = static_cast<size_t>(size.QuadPart);
+#else
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			return nullptr;
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			close(fd);
+			return nullptr;
+		}
+
+		void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd);
+
+		if (data == MAP_FAILED)
+			return nullptr;
+
+		file->m_Data = data;
+		file->m_Size = static_cast<size_t>(info.st_size);
+#endif
+
+		return file;
+	}
+
+	std::uint8_t* Data() const { return static_cast<std::uint8_t*>(m_Data); }
+	size_t Size() const { return m_Size; }
+
+private:
+	void* m_Data{ nullptr };
+	size_t m_Size{ 0 };
+
+#ifdef _WIN32
+	HANDLE m_File{ INVALID_HANDLE_VALUE };
+	HANDLE m_Mapping{ nullptr };
+#endif
+};
+
+enum class WorldLoadMode
+{
+	// Map the file and use trivially copyable columns in place.
+	Map,
+	// Read the file and copy every column into the component arrays.
+	Copy
+};
+
+struct WorldLoadResult
+{
+	bool success{ false };
+
+	size_t mappedColumns{ 0 };
+	size_t copiedColumns{ 0 };
+	size_t migratedColumns{ 0 };
+
+	// Type names of columns that were dropped, either not registered or changed without a migration.
+	std::vector<std::string> skippedColumns;
+};
+
+/**
+ * Binary world file.
+ * Layout: FileHeader, ColumnHeaders, type names, living entities, available entities,
+ * then for every component column its entity IDs and its dense component data.
+ * Column data is aligned to ColumnAlignment from the start of the file, so a mapped file can be used directly.
+ * Only trivially copyable components are stored.
+ */
+class WorldFile
+{
+public:
+	static constexpr std::uint32_t Magic = 0x57534345; // "ECSW"
+	static constexpr std::uint32_t Version = 2;
+	static constexpr std::uint64_t ColumnAlignment = 64;
+
+	// Converts a column saved with a different size or ComponentVersion into the current T.
+	template<typename T>
+	void RegisterMigration(std::function<T(const void* oldComponent, size_t oldSize, std::uint32_t oldVersion)> migration)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable components are stored in world files.");
+
+		m_Migrations[typeid(T).name()] = [migration](const std::uint8_t* data, size_t oldSize, std::uint32_t oldVersion,
+			const Entity* entities, size_t count, IComponentArray& array)
+		{
+			std::vector<T> components;
+			components.reserve(count);
+
+			for (size_t i = 0; i < count; i++)
+			{
+				components.push_back(migration(data + i * oldSize, oldSize, oldVersion));
+			}
+
+			array.CopyData(components.data(), entities, count);
+		};
+	}
+
+	bool Save(ECS& ecs, const char* path) const
+	{
+		const auto& entityManager = ecs.GetEntityManager();
+		const auto& componentManager = ecs.GetComponentManager();
+
+		// IDs cached by job threads are neither living nor available, the file has to account for every ID.
+		entityManager->FlushThreadCaches();
+
+		std::vector<Entity> livingEntities;
+		std::vector<Entity> prefabs;
+		livingEntities.reserve(entityManager->GetLivingEntityCount());
+		for (Entity entity = 0; entity < MAX_ENTITIES; entity++)
+		{
+			if (entityManager->IsAlive(entity))
+			{
+				livingEntities.push_back(entity);
+				if (entityManager->IsPrefab(entity))
+					prefabs.push_back(entity);
+			}
+		}
+
+		std::vector<Entity> availableEntities = entityManager->GetAvailableEntities();
+
+		std::vector<std::pair<const char*, IComponentArray*>> columns;
+		for (const auto& pair : componentManager->GetComponentArrays())
+		{
+			if (pair.second->IsTriviallyCopyable())
+				columns.push_back({ pair.first, pair.second.get() });
+		}
+
+		// Lay out every section before writing anything.
+		FileHeader header{};
+		header.magic = Magic;
+		header.version = Version;
+		header.columnCount = static_cast<std::uint32_t>(columns.size());
+		header.livingCount = static_cast<std::uint32_t>(livingEntities.size());
+		header.availableCount = static_cast<std::uint32_t>(availableEntities.size());
+		header.prefabCount = static_cast<std::uint32_t>(prefabs.size());
+
+		std::uint64_t offset = sizeof(FileHeader) + columns.size() * sizeof(ColumnHeader);
+
+		std::vector<ColumnHeader> columnHeaders(columns.size());
+		for (size_t i = 0; i < columns.size(); i++)
+		{
+			columnHeaders[i].nameOffset = offset;
+			columnHeaders[i].nameLength = static_cast<std::uint32_t>(std::strlen(columns[i].first));
+			offset += columnHeaders[i].nameLength;
+		}
+
+		header.livingOffset = Align(offset, alignof(Entity));
+		header.availableOffset = header.livingOffset + livingEntities.size() * sizeof(Entity);
+		header.prefabOffset = header.availableOffset + availableEntities.size() * sizeof(Entity);
+		offset = header.prefabOffset + prefabs.size() * sizeof(Entity);
+
+		for (size_t i = 0; i < columns.size(); i++)
+		{
+			const IComponentArray& array = *columns[i].second;
+			ColumnHeader& column = columnHeaders[i];
+
+			column.componentSize = static_cast<std::uint32_t>(array.ComponentSize());
+			column.componentAlignment = static_cast<std::uint32_t>(array.ComponentAlignment());
+			column.layoutVersion = array.LayoutVersion();
+			column.count = static_cast<std::uint32_t>(array.Size());
+
+			column.entitiesOffset = Align(offset, alignof(Entity));
+			offset = column.entitiesOffset + column.count * sizeof(Entity);
+
+			column.dataOffset = Align(offset, std::max<std::uint64_t>(ColumnAlignment, column.componentAlignment));
+			offset = column.dataOffset + static_cast<std::uint64_t>(column.count) * column.componentSize;
+		}
+
+		header.fileSize = offset;
+
+		// Build the file in memory and write it out in one go.
+		std::vector<std::uint8_t> bytes(static_cast<size_t>(header.fileSize), 0);
+		std::memcpy(bytes.data(), &header, sizeof(FileHeader));
+		std::memcpy(bytes.data() + sizeof(FileHeader), columnHeaders.data(), columnHeaders.size() * sizeof(ColumnHeader));
+
+		for (size_t i = 0; i < columns.size(); i++)
+		{
+			const IComponentArray& array = *columns[i].second;
+			const ColumnHeader& column = columnHeaders[i];
+
+			std::memcpy(bytes.data() + column.nameOffset, columns[i].first, column.nameLength);
+
+			Entity* entities = reinterpret_cast<Entity*>(bytes.data() + column.entitiesOffset);
+			for (size_t index = 0; index < column.count; index++)
+			{
+				entities[index] = array.EntityAtIndex(index);
+			}
+
+			std::memcpy(bytes.data() + column.dataOffset, array.RawData(), static_cast<size_t>(column.count) * column.componentSize);
+		}
+
+		std::memcpy(bytes.data() + header.livingOffset, livingEntities.data(), livingEntities.size() * sizeof(Entity));
+		std::memcpy(bytes.data() + header.availableOffset, availableEntities.data(), availableEntities.size() * sizeof(Entity));
+		std::memcpy(bytes.data() + header.prefabOffset, prefabs.data(), prefabs.size() * sizeof(Entity));
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+		return static_cast<bool>(file);
+	}
+
+	// Load a world file into an ECS that has its components registered but no living entities yet.
+	WorldLoadResult Load(ECS& ecs, const char* path, WorldLoadMode mode = WorldLoadMode::Map) const
+	{
+		WorldLoadResult result;
+
+		// In map mode the mapping owns the bytes, in copy mode a plain buffer does.
+		std::shared_ptr<MappedFile> mapping;
+		std::vector<std::uint8_t> buffer;
+		const std::uint8_t* bytes = nullptr;
+		size_t size = 0;
+
+		if (mode == WorldLoadMode::Map)
+		{
+			mapping = MappedFile::Open(path);
+			if (!mapping)
+				return result;
+
+			bytes = mapping->Data();
+			size = mapping->Size();
+		}
+		else
+		{
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			if (!file)
+				return result;
+
+			buffer.resize(static_cast<size_t>(file.tellg()));
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+			if (!file)
+				return result;
+
+			bytes = buffer.data();
+			size = buffer.size();
+		}
+
+		return LoadBytes(ecs, bytes, size, mapping);
+	}
+
+	// Load a world file that is already in memory, e.g. after decompressing it. Every column is copied.
+	WorldLoadResult LoadFromMemory(ECS& ecs, const std::uint8_t* bytes, size_t size) const
+	{
+		return LoadBytes(ecs, bytes, size, nullptr);
+	}
+
+private:
+	// Columns are only used in place if mapping owns the bytes.
+	WorldLoadResult LoadBytes(ECS& ecs, const std::uint8_t* bytes, size_t size, const std::shared_ptr<MappedFile>& mapping) const
+	{
+		WorldLoadResult result;
+
+		const auto& entityManager = ecs.GetEntityManager();
+		const auto& componentManager = ecs.GetComponentManager();
+
+		assert(entityManager->GetLivingEntityCount() == 0 && "World files can only be loaded into an empty ECS.");
+
+		if (size < sizeof(FileHeader))
+			return result;
+
+		FileHeader header;
+		std::memcpy(&header, bytes, sizeof(FileHeader));
+
+		if (header.magic != Magic || header.version != Version || header.fileSize != size)
+			return result;
+
+		if (header.livingCount + static_cast<std::uint64_t>(header.availableCount) != MAX_ENTITIES
+			|| !InBounds(header.livingOffset, header.livingCount * sizeof(Entity), size)
+			|| !InBounds(header.availableOffset, header.availableCount * sizeof(Entity), size)
+			|| !InBounds(header.prefabOffset, header.prefabCount * sizeof(Entity), size)
+			|| !InBounds(sizeof(FileHeader), header.columnCount * sizeof(ColumnHeader), size))
+		{
+			return result;
+		}
+
+		std::vector<Entity> livingEntities(header.livingCount);
+		std::vector<Entity> availableEntities(header.availableCount);
+		std::memcpy(livingEntities.data(), bytes + header.livingOffset, livingEntities.size() * sizeof(Entity));
+		std::memcpy(availableEntities.data(), bytes + header.availableOffset, availableEntities.size() * sizeof(Entity));
+
+		// Every ID has to be either living or available, exactly once.
+		std::vector<std::uint8_t> state(MAX_ENTITIES, 0);
+		for (Entity entity : livingEntities)
+		{
+			if (entity >= MAX_ENTITIES || state[entity] != 0)
+				return result;
+			state[entity] = 1;
+		}
+
+		for (Entity entity : availableEntities)
+		{
+			if (entity >= MAX_ENTITIES || state[entity] != 0)
+				return result;
+			state[entity] = 2;
+		}
+
+		// Prefabs are living entities, each listed once.
+		std::vector<Entity> prefabs(header.prefabCount);
+		std::memcpy(prefabs.data(), bytes + header.prefabOffset, prefabs.size() * sizeof(Entity));
+		for (Entity entity : prefabs)
+		{
+			if (entity >= MAX_ENTITIES || state[entity] != 1)
+				return result;
+			state[entity] = 3;
+		}
+
+		// Check every column before touching the ECS, so a broken file never leaves a half loaded world.
+		std::vector<ColumnHeader> columns(header.columnCount);
+		std::vector<std::uint32_t> seen(MAX_ENTITIES, 0);
+		for (std::uint32_t i = 0; i < header.columnCount; i++)
+		{
+			ColumnHeader& column = columns[i];
+			std::memcpy(&column, bytes + sizeof(FileHeader) + i * sizeof(ColumnHeader), sizeof(ColumnHeader));
+
+			if (!InBounds(column.nameOffset, column.nameLength, size)
+				|| !InBounds(column.entitiesOffset, column.count * sizeof(Entity), size)
+				|| !InBounds(column.dataOffset, static_cast<std::uint64_t>(column.count) * column.componentSize, size)
+				|| column.count > MAX_ENTITIES)
+			{
+				return result;
+			}
+
+			const Entity* entities = reinterpret_cast<const Entity*>(bytes + column.entitiesOffset);
+			for (size_t index = 0; index < column.count; index++)
+			{
+				Entity entity = entities[index];
+				if (entity >= MAX_ENTITIES || (state[entity] != 1 && state[entity] != 3) || seen[entity] == i + 1)
+					return result;
+				seen[entity] = i + 1;
+			}
+		}
+
+		entityManager->Restore(livingEntities, availableEntities);
+		for (Entity entity : prefabs)
+		{
+			entityManager->SetPrefab(entity, true);
+		}
+
+		for (const ColumnHeader& column : columns)
+		{
+			std::string typeName(reinterpret_cast<const char*>(bytes + column.nameOffset), column.nameLength);
+			const Entity* entities = reinterpret_cast<const Entity*>(bytes + column.entitiesOffset);
+			const std::uint8_t* data = bytes + column.dataOffset;
+
+			ComponentType type{ 0 };
+			auto array = componentManager->FindComponentArray(typeName.c_str(), type);
+			if (!array)
+			{
+				result.skippedColumns.push_back(typeName);
+				continue;
+			}
+
+			bool layoutMatches = column.componentSize == array->ComponentSize()
+				&& column.componentAlignment == array->ComponentAlignment()
+				&& column.layoutVersion == array->LayoutVersion()
+				&& array->IsTriviallyCopyable();
+
+			if (!layoutMatches)
+			{
+				auto migration = m_Migrations.find(typeName);
+				if (migration == m_Migrations.end())
+				{
+					result.skippedColumns.push_back(typeName);
+					continue;
+				}
+
+				migration->second(data, column.componentSize, column.layoutVersion, entities, column.count, *array);
+				result.migratedColumns++;
+			}
+			else if (mapping && reinterpret_cast<std::uintptr_t>(data) % array->ComponentAlignment() == 0)
+			{
+				array->MapData(const_cast<std::uint8_t*>(data), entities, column.count, mapping);
+				result.mappedColumns++;
+			}
+			else
+			{
+				array->CopyData(data, entities, column.count);
+				result.copiedColumns++;
+			}
+
+			for (size_t index = 0; index < column.count; index++)
+			{
+				auto signature = entityManager->GetSignature(entities[index]);
+				signature.set(type, true);
+				entityManager->SetSignature(entities[index], signature);
+			}
+		}
+
+		// Systems only learn about entities once all their components are in place, prefabs stay out of them.
+		for (Entity entity : livingEntities)
+		{
+			if (!entityManager->IsPrefab(entity))
+				ecs.GetSystemManager()->EntitySignatureChanged(entity, entityManager->GetSignature(entity));
+		}
+
+		result.success = true;
+		return result;
+	}
+
+	struct FileHeader
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t columnCount;
+		std::uint32_t livingCount;
+		std::uint32_t availableCount;
+		std::uint32_t prefabCount;
+		std::uint64_t livingOffset;
+		std::uint64_t availableOffset;
+		std::uint64_t fileSize;
+		std::uint64_t prefabOffset;
+	};
+
+	struct ColumnHeader
+	{
+		std::uint64_t nameOffset;
+		std::uint64_t entitiesOffset;
+		std::uint64_t dataOffset;
+		std::uint32_t nameLength;
+		std::uint32_t componentSize;
+		std::uint32_t componentAlignment;
+		std::uint32_t layoutVersion;
+		std::uint32_t count;
+		std::uint32_t padding;
+	};
+
+	static_assert(sizeof(FileHeader) == 56, "FileHeader layout is part of the file format.");
+	static_assert(sizeof(ColumnHeader) == 48, "ColumnHeader layout is part of the file format.");
+
+	static std::uint64_t Align(std::uint64_t offset, std::uint64_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	static bool InBounds(std::uint64_t offset, std::uint64_t length, size_t size)
+	{
+		return offset <= size && length <= size - offset;
+	}
+
+	using Migration = std::function<void(const std::uint8_t* data, size_t oldSize, std::uint32_t oldVersion,
+		const Entity* entities, size_t count, IComponentArray& array)>;
+
+	// Map from component type name to the migration for stale columns of that type.
+	std::unordered_map<std::string, Migration> m_Migrations;
+};
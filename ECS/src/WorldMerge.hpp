@@ -0,0 +1,102 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "ECS.hpp"
+
+/**
+ * Move every entity of source into destination and return the remap table, MAX_ENTITIES long and indexed by
+ * the source entity ID, holding the new ID or INVALID_ENTITY for IDs that weren't alive.
+ * Component types are shared by all worlds, so signatures are copied as they are and every component column is
+ * appended to the destination in one go. System membership is updated once per distinct signature.
+ * Meant for worlds built in the background, e.g. a level chunk loaded on a worker thread: the source world can be
+ * filled without touching the live one, only the merge itself has to happen on the destination's thread.
+ * Relation pairs are moved and remapped. Components holding entity IDs have to be fixed up with the returned table
+ * by the caller.
+ * If destination has fewer free IDs than source has entities nothing is moved and every entry is INVALID_ENTITY.
+ */
+inline std::vector<Entity> MergeWorld(ECS& source, ECS& destination)
+{
+	auto& sourceEntities = source.GetEntityManager();
+	auto& destinationEntities = destination.GetEntityManager();
+
+	std::vector<Entity> living;
+	living.reserve(sourceEntities->GetLivingEntityCount());
+	for (Entity entity = 0; entity < MAX_ENTITIES; entity++)
+	{
+		if (sourceEntities->IsAlive(entity))
+			living.push_back(entity);
+	}
+
+	std::vector<Entity> remap(MAX_ENTITIES, INVALID_ENTITY);
+
+	std::vector<Entity> created(living.size());
+	if (!destinationEntities->CreateEntities(static_cast<std::uint32_t>(living.size()), Signature(), created.data()))
+	{
+		assert(false && "Destination world can't hold the merged entities.");
+		return remap;
+	}
+
+	// Group the new entities by signature, prefabs stay out of systems and observers.
+	std::unordered_map<unsigned long long, std::vector<Entity>> groups;
+	for (size_t i = 0; i < living.size(); i++)
+	{
+		Signature signature = sourceEntities->GetSignature(living[i]);
+		bool prefab = sourceEntities->IsPrefab(living[i]);
+
+		remap[living[i]] = created[i];
+		destinationEntities->SetSignature(created[i], signature);
+		destinationEntities->SetPrefab(created[i], prefab);
+
+		if (!prefab)
+			groups[signature.to_ullong()].push_back(created[i]);
+	}
+
+	for (const auto& pair : source.GetComponentManager()->GetComponentArrays())
+	{
+		if (pair.second->Size() == 0)
+			continue;
+
+		const auto& destinationArrays = destination.GetComponentManager()->GetComponentArrays();
+		auto it = destinationArrays.find(pair.first);
+		assert(it != destinationArrays.end() && "Component not registered in the destination world.");
+
+		it->second->MoveFrom(*pair.second, remap.data());
+	}
+
+	for (const auto& pair : groups)
+	{
+		Signature signature(pair.first);
+		const auto& entities = pair.second;
+
+		destination.GetSystemManager()->EntitiesCreated(entities.data(), entities.size(), signature);
+		destination.GetObserverManager()->Record(ComponentEvent::Add, signature, entities.data(), entities.size());
+		destination.GetObserverManager()->Record(ComponentEvent::Set, signature, entities.data(), entities.size());
+	}
+
+	const auto& sourceRelations = source.GetRelationManager()->GetRelations();
+	const auto& destinationRelations = destination.GetRelationManager()->GetRelations();
+	for (RelationType type = 0; type < MAX_RELATIONS; type++)
+	{
+		if (!sourceRelations[type] || sourceRelations[type]->GetPairCount() == 0)
+			continue;
+
+		assert(destinationRelations[type] && "Relation not registered in the destination world.");
+
+		sourceRelations[type]->ForEachPair([&](Entity pairSource, Entity pairTarget)
+		{
+			destinationRelations[type]->Add(remap[pairSource], remap[pairTarget]);
+		});
+		sourceRelations[type]->Clear();
+	}
+
+	// The components and pairs are gone already, so only the IDs are released in the source.
+	for (Entity entity : living)
+	{
+		sourceEntities->DestroyEntity(entity);
+		source.GetSystemManager()->EntityDestroyed(entity);
+	}
+
+	return remap;
+}
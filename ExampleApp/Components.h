@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 struct RigidBody
 {
 	int x, y;
@@ -13,6 +15,12 @@ struct RigidBody
 	}
 };
 
+// World resource, the window size in pixels.
+struct Screen
+{
+	int width, height;
+};
+
 struct Size
 {
 	int width, height;
@@ -36,4 +44,20 @@ struct Gravity
 		: magnitude(magnitude)
 	{
 	}
+
+	// Shared component, entities with equal gravity point at one value.
+	bool operator==(const Gravity& other) const { return magnitude == other.magnitude; }
+};
+
+struct Material
+{
+	std::uint32_t id;
+	std::uint32_t color;
+
+	Material() = default;
+
+	Material(std::uint32_t id, std::uint32_t color)
+		: id(id), color(color)
+	{
+	}
 };
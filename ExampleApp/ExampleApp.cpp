@@ -7,31 +7,36 @@
 #include "Components.h"
 #include "Systems.h"
 
-int width = 1280;
-int height = 720;
+constexpr int width = 1280;
+constexpr int height = 720;
 
 // Helper methods.
-void FillQuad(float x, float y, float width, float height)
+// Submit a whole render list buffer with a single draw call.
+void DrawQuads(const QuadVertex* vertices, size_t count)
 {
-    glBegin(GL_QUADS);
-        glVertex2f(x, y);
-        glVertex2f(x + width, y);
-        glVertex2f(x + width, y + height);
-        glVertex2f(x, y + height);
-    glEnd();
-}
+    if (count == 0)
+        return;
 
-void SetColor(float r, float g, float b)
-{
-    glColor3f(r, g, b);
-}
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
 
-// Sorry!
-ECS ecs;
-int entityToAddGravityTo = 0;
+    glVertexPointer(2, GL_FLOAT, sizeof(QuadVertex), &vertices->x);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(QuadVertex), &vertices->color);
+    glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(count));
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
 
 constexpr int numEntities = 20;
-std::array<Entity, numEntities> entities;
+
+// State the window callbacks need, reached through the window's user pointer.
+struct App
+{
+    ECS ecs;
+    int entityToAddGravityTo = 0;
+    std::array<Entity, numEntities> entities;
+};
 
 int main()
 {
@@ -60,18 +65,30 @@ int main()
 
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+    App app;
+    glfwSetWindowUserPointer(window, &app);
+
     // Initialize ECS.
+    ECS& ecs = app.ecs;
     ecs.Init();
+    ecs.SetResource<Screen>(width, height);
 
     // Register components.
     ecs.RegisterComponent<RigidBody>();
     ecs.RegisterComponent<Size>();
-    ecs.RegisterComponent<Gravity>();
+    ecs.RegisterSharedComponent<Gravity>();
+    ecs.RegisterComponent<Material>();
+
+    // Simulation runs at a fixed 60 steps per second, rendering interpolates between steps.
+    JobSystem jobs;
+    World world(ecs, &jobs);
+    world.SetFixedRate(60.0);
+    world.Interpolate<RigidBody>(&LerpRigidBody);
 
     // Register systems.
     auto rigidBodySystem = ecs.RegisterSystem<RigidBodySystem>();
     auto gravitySystem = ecs.RegisterSystem<GravitySystem>();
-    auto renderSystem = ecs.RegisterSystem<RenderSystem>();
+    auto renderSystem = ecs.RegisterSystem<RenderSystem>(world);
 
     // Set signature for the systems.
     Signature signature;
@@ -79,18 +96,30 @@ int main()
     signature.set(ecs.GetComponentType<Size>(), true);
 
     ecs.SetSystemSignature<RigidBodySystem>(signature);
+
+    signature.set(ecs.GetComponentType<Material>(), true);
     ecs.SetSystemSignature<RenderSystem>(signature);
+    signature.set(ecs.GetComponentType<Material>(), false);
 
     signature.set(ecs.GetComponentType<Size>(), false);
     signature.set(ecs.GetComponentType<Gravity>(), true);
 
     ecs.SetSystemSignature<GravitySystem>(signature);
 
+    // Gravity only accelerates, the rigid body step then integrates, in that order since both write RigidBody.
+    world.AddSystem(Phase::FixedUpdate, "Gravity", gravitySystem,
+        SystemAccess(world.ComponentSignature<Gravity>(), world.ComponentSignature<RigidBody>()));
+    world.AddSystem(Phase::FixedUpdate, "RigidBody", rigidBodySystem,
+        SystemAccess(world.ComponentSignature<Size>(), world.ComponentSignature<RigidBody>(), world.Resources<Screen>(), {}));
+    world.AddSystem(Phase::Render, "Render", renderSystem);
+
     for (int i = 0; i < numEntities; i++)
     {
-        entities[i] = ecs.CreateEntity();
-        ecs.AddComponent(entities[i], RigidBody(i * 60 + 20, 50, 0, 0));
-        ecs.AddComponent(entities[i], Size(50, 50));
+        Entity entity = ecs.CreateEntity();
+        ecs.AddComponent(entity, RigidBody(i * 60 + 20, 50, 0, 0));
+        ecs.AddComponent(entity, Size(50, 50));
+        ecs.AddComponent(entity, Material(i % 2, i % 2 ? PackColor(255, 200, 61) : PackColor(55, 222, 61)));
+        app.entities[i] = entity;
     }
 
     glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -101,9 +130,10 @@ int main()
                 {
                 case GLFW_PRESS:
                 {
-                    if (entityToAddGravityTo == numEntities)
+                    App& app = *static_cast<App*>(glfwGetWindowUserPointer(window));
+                    if (app.entityToAddGravityTo == numEntities)
                         return;
-                    ecs.AddComponent(entities[entityToAddGravityTo++], Gravity(1));
+                    app.ecs.SetSharedComponent(app.entities[app.entityToAddGravityTo++], Gravity(1));
                     break;
                 }
                 default:
@@ -112,6 +142,8 @@ int main()
             }
         });
 
+    double lastTime = glfwGetTime();
+
     while (!glfwWindowShouldClose(window))
     {
         glClearColor(92.0f / 255, 154.0f / 255, 255.0f / 255, 1);
@@ -119,9 +151,9 @@ int main()
             
         // Main Rendering and logic here. /////////////////////////////////////////
 
-        rigidBodySystem->Update(ecs);
-        gravitySystem->Update(ecs);
-        renderSystem->Update(ecs);
+        double time = glfwGetTime();
+        world.Tick(time - lastTime);
+        lastTime = time;
 
         ///////////////////////////////////////////////////////////////////////////
 
@@ -1,15 +1,17 @@
 #pragma once
 
+#include <cmath>
+
 // From ECS
 #include "ECS.hpp"
+#include "RenderList.hpp"
+#include "Culling.hpp"
+#include "World.hpp"
 
 // From this app
 #include "Components.h"
 
-extern int width;
-extern int height;
-extern void SetColor(float, float, float);
-extern void FillQuad(float, float, float, float);
+extern void DrawQuads(const QuadVertex*, size_t);
 
 class RigidBodySystem : public System
 {
@@ -18,10 +20,12 @@ public:
 
 	void Update(ECS& ecs)
 	{
-		for (const auto& entity : m_Entities)
+		const Screen& screen = ecs.GetResource<Screen>();
+
+		ForEachEntity([&](Entity entity)
 		{
 			auto& rigidBody = ecs.GetComponent<RigidBody>(entity);
-			auto& size = ecs.GetComponent<Size>(entity);
+			const auto& size = ecs.ReadComponent<Size>(entity);
 
 			rigidBody.vx += rigidBody.ax;
 			rigidBody.vy += rigidBody.ay;
@@ -38,28 +42,84 @@ public:
 			if (rigidBody.y < 0)
 				rigidBody.y = 0;
 
-			if (rigidBody.x + size.width > width)
-				rigidBody.x = width - size.width;
-			if (rigidBody.y + size.height > height)
-				rigidBody.y = height - size.height;
-		}
+			if (rigidBody.x + size.width > screen.width)
+				rigidBody.x = screen.width - size.width;
+			if (rigidBody.y + size.height > screen.height)
+				rigidBody.y = screen.height - size.height;
+		});
 	}
 };
 
+// Screen rectangle of a body, every RigidBody in this app also has a Size.
+inline Bounds RigidBodyBounds(ECS& ecs, Entity entity, const RigidBody& rigidBody)
+{
+	const auto& size = ecs.ReadComponent<Size>(entity);
+
+	return { float(rigidBody.x), float(rigidBody.y), float(rigidBody.x + size.width), float(rigidBody.y + size.height) };
+}
+
+// Blend between two fixed steps for rendering.
+inline RigidBody LerpRigidBody(const RigidBody& previous, const RigidBody& current, float alpha)
+{
+	RigidBody result = current;
+	result.x = previous.x + static_cast<int>(std::lround((current.x - previous.x) * alpha));
+	result.y = previous.y + static_cast<int>(std::lround((current.y - previous.y) * alpha));
+
+	return result;
+}
+
 class RenderSystem : public System
 {
 public:
+	// Positions are drawn interpolated between the world's fixed steps.
+	// Bounds also depend on Size, see RigidBodyBounds.
+	RenderSystem(const World& world)
+		: m_World(world), m_Culler(&RigidBodyBounds, world.ComponentSignature<Size>())
+	{
+	}
+
 	void Update(ECS& ecs)
 	{
-		for (const auto& entity : m_Entities)
+		Extract(ecs);
+
+		// Every material here is just a vertex color, so the whole list is one draw.
+		const auto& vertices = m_RenderList.GetVertices();
+		DrawQuads(vertices.data(), vertices.size());
+	}
+
+	// Collect the visible quads into the render list, doesn't touch the GPU.
+	void Extract(ECS& ecs)
+	{
+		m_Culler.Update(ecs);
+
+		const Screen& screen = ecs.GetResource<Screen>();
+		const auto& visible = m_Culler.Cull({ 0.0f, 0.0f, float(screen.width), float(screen.height) });
+
+		m_RenderList.Clear();
+		m_RenderList.Reserve(visible.size());
+
+		for (const auto& entity : visible)
 		{
-			auto& rigidBody = ecs.GetComponent<RigidBody>(entity);
-			auto& size = ecs.GetComponent<Size>(entity);
-			
-			SetColor(55.0f / 255, 222.0f / 255, 61.0f / 255);
-			FillQuad(rigidBody.x, rigidBody.y, size.width, size.height);
+			// The culler sees every RigidBody, only draw the ones matching this system's signature.
+			if (m_Entities.find(entity) == m_Entities.end())
+				continue;
+
+			RigidBody rigidBody = m_World.Interpolated<RigidBody>(entity);
+			const auto& size = ecs.ReadComponent<Size>(entity);
+			const auto& material = ecs.ReadComponent<Material>(entity);
+
+			m_RenderList.AddQuad(material.id, rigidBody.x, rigidBody.y, size.width, size.height, material.color);
 		}
+
+		m_RenderList.Build();
 	}
+
+	const RenderList& GetRenderList() const { return m_RenderList; }
+
+private:
+	const World& m_World;
+	ViewportCuller<RigidBody> m_Culler;
+	RenderList m_RenderList;
 };
 
 class GravitySystem : public System
@@ -67,14 +127,13 @@ class GravitySystem : public System
 public:
 	GravitySystem() = default;
 
+	// Gravity is shared, every entity reads the one value of its group.
 	void Update(ECS &ecs)
 	{
-		for (const auto& entity : m_Entities)
+		ForEachEntity([&](Entity entity)
 		{
-			auto& rigidBody = ecs.GetComponent<RigidBody>(entity);
-			auto& gravity = ecs.GetComponent<Gravity>(entity);
-
-			rigidBody.ay += gravity.magnitude;
-		}
+			const Gravity& gravity = ecs.GetSharedComponent<Gravity>(entity);
+			ecs.GetComponent<RigidBody>(entity).ay += gravity.magnitude;
+		});
 	}
 };
@@ -2,8 +2,32 @@
 #include "CppUnitTest.h"
 
 #include "../ECS/src/ECS.hpp"
+#include "../ECS/src/WorldFile.hpp"
+#include "../ECS/src/Snapshot.hpp"
+#include "../ECS/src/SpatialHash.hpp"
+#include "../ECS/src/RenderList.hpp"
+#include "../ECS/src/Culling.hpp"
+#include "../ECS/src/World.hpp"
+#include "../ECS/src/Hierarchy.hpp"
+#include "../ECS/src/WorldMerge.hpp"
+#include "../ECS/src/StreamingLoader.hpp"
+#include "../ECS/src/Introspection.hpp"
+#include "../ECS/src/Defragmenter.hpp"
+#include "../ECS/src/PublishedSnapshot.hpp"
+#include "../ECS/src/CoroutineSystem.hpp"
+#include "../ECS/src/CommandBuffer.hpp"
+#include "../ECS/src/StateHash.hpp"
+#include "../ECS/src/WorldChecksum.hpp"
+#include "../ECS/src/Replication.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -31,6 +55,62 @@ namespace UnitTests
 			}
 		};
 
+		struct TestPosition
+		{
+			float x, y;
+		};
+
+		// Not trivially copyable.
+		struct TestName
+		{
+			std::string name;
+		};
+
+		// Bigger than a command recorder block.
+		struct TestLarge
+		{
+			int values[1100];
+		};
+
+		// World resources.
+		struct TestScreen
+		{
+			int width, height;
+		};
+
+		struct TestInput
+		{
+			std::vector<int> keys;
+		};
+
+		// Relations.
+		struct TestDockedAt {};
+		struct TestOwnedBy {};
+
+		// Shared between entities.
+		struct TestMaterial
+		{
+			std::uint32_t shader;
+			float tint[4];
+
+			bool operator==(const TestMaterial& other) const
+			{
+				return shader == other.shader && std::equal(tint, tint + 4, other.tint);
+			}
+		};
+
+		static Bounds TestBounds(ECS&, Entity, const TestPosition& position)
+		{
+			return { position.x - 1.0f, position.y - 1.0f, position.x + 1.0f, position.y + 1.0f };
+		}
+
+		// Half extent read from the entity's TestComponent.
+		static Bounds TestSizedBounds(ECS& ecs, Entity entity, const TestPosition& position)
+		{
+			float half = float(ecs.ReadComponent<TestComponent>(entity).val);
+			return { position.x - half, position.y - half, position.x + half, position.y + half };
+		}
+
 		// Systems
 		class TestSystem : public System
 		{
@@ -52,6 +132,18 @@ namespace UnitTests
 			}
 		};
 
+		// Counts how often every entity was visited.
+		class CountingSystem : public System
+		{
+		public:
+			std::vector<int> visits = std::vector<int>(MAX_ENTITIES, 0);
+
+			void Update(ECS&)
+			{
+				ForEachEntity([&](Entity entity) { visits[entity]++; });
+			}
+		};
+
 
 		TEST_METHOD(TestInitialization)
 		{
@@ -142,5 +234,2381 @@ namespace UnitTests
 			Assert::IsTrue(ecs.GetComponent<TestComponent>(entity).val == 9);
 		}
 
+		TEST_METHOD(TestWorldFileMapped)
+		{
+			const char* path = "TestWorldFileMapped.ecsw";
+
+			{
+				ECS ecs;
+				ecs.Init();
+				ecs.RegisterComponent<TestComponent>();
+
+				for (int i = 0; i < 100; i++)
+				{
+					Entity entity = ecs.CreateEntity();
+					if (i % 2 == 0)
+						ecs.AddComponent(entity, TestComponent(i));
+				}
+				ecs.DestroyEntity(10);
+
+				Assert::IsTrue(WorldFile().Save(ecs, path));
+			}
+
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			auto system = ecs.RegisterSystem<TestSystem>(10);
+
+			Signature signature;
+			signature.set(ecs.GetComponentType<TestComponent>(), true);
+			ecs.SetSystemSignature<TestSystem>(signature);
+
+			WorldLoadResult result = WorldFile().Load(ecs, path);
+			Assert::IsTrue(result.success);
+			Assert::IsTrue(result.mappedColumns == 1);
+			Assert::IsTrue(system->m_Entities.size() == 49);
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(42).val == 42);
+
+			// Writes go to private pages and adding past the mapped column moves it into owned storage.
+			system->Update(ecs);
+			Entity entity = ecs.CreateEntity();
+			Assert::IsTrue(entity == 100);
+			ecs.AddComponent(entity, TestComponent(7));
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(42).val == 41);
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(entity).val == 7);
+
+			std::remove(path);
+		}
+
+		TEST_METHOD(TestWorldFileCopyAndSkip)
+		{
+			const char* path = "TestWorldFileCopyAndSkip.ecsw";
+
+			{
+				ECS ecs;
+				ecs.Init();
+				ecs.RegisterComponent<TestComponent>();
+				ecs.RegisterComponent<int>();
+
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestComponent(5));
+				ecs.AddComponent(entity, 3);
+
+				Assert::IsTrue(WorldFile().Save(ecs, path));
+			}
+
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+
+			WorldLoadResult result = WorldFile().Load(ecs, path, WorldLoadMode::Copy);
+			Assert::IsTrue(result.success);
+			Assert::IsTrue(result.copiedColumns == 1);
+			Assert::IsTrue(result.skippedColumns.size() == 1);
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(0).val == 5);
+
+			// Copying into an array that was emptied after mapping another file doesn't read the old mapping.
+			const char* mappedPath = "TestWorldFileCopyAndSkipMapped.ecsw";
+			{
+				ECS mappedSource;
+				mappedSource.Init();
+				mappedSource.RegisterComponent<TestComponent>();
+				mappedSource.AddComponent(mappedSource.CreateEntity(), TestComponent(1));
+				Assert::IsTrue(WorldFile().Save(mappedSource, mappedPath));
+			}
+
+			ECS reloaded;
+			reloaded.Init();
+			reloaded.RegisterComponent<TestComponent>();
+			Assert::IsTrue(WorldFile().Load(reloaded, mappedPath, WorldLoadMode::Map).mappedColumns == 1);
+			reloaded.DestroyEntity(0);
+			Assert::IsTrue(WorldFile().Load(reloaded, path, WorldLoadMode::Copy).success);
+			Assert::IsTrue(reloaded.GetComponent<TestComponent>(0).val == 5);
+
+			std::remove(mappedPath);
+			std::remove(path);
+		}
+
+		TEST_METHOD(TestWorldFileAfterThreadCreation)
+		{
+			const char* path = "TestWorldFileAfterThreadCreation.ecsw";
+
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.AddComponent(ecs.CreateEntity(), TestComponent(1));
+
+			// The worker caches a batch of IDs and only hands out one.
+			Entity created = INVALID_ENTITY;
+			std::thread worker([&]() { created = ecs.CreateEntity(); });
+			worker.join();
+			ecs.AddComponent(created, TestComponent(2));
+
+			Assert::IsTrue(WorldFile().Save(ecs, path));
+
+			ECS loaded;
+			loaded.Init();
+			loaded.RegisterComponent<TestComponent>();
+			Assert::IsTrue(WorldFile().Load(loaded, path).success);
+			Assert::AreEqual(2u, loaded.GetEntityManager()->GetLivingEntityCount());
+			Assert::AreEqual(2, loaded.GetComponent<TestComponent>(created).val);
+
+			std::remove(path);
+		}
+
+		TEST_METHOD(TestWorldFilePrefabs)
+		{
+			const char* path = "TestWorldFilePrefabs.ecsw";
+
+			Entity prefab;
+			{
+				ECS ecs;
+				ecs.Init();
+				ecs.RegisterComponent<TestComponent>();
+
+				prefab = ecs.CreatePrefab();
+				ecs.AddComponent(prefab, TestComponent(3));
+				ecs.Instantiate(prefab, 2);
+
+				Assert::IsTrue(WorldFile().Save(ecs, path));
+			}
+
+			ECS loaded;
+			loaded.Init();
+			loaded.RegisterComponent<TestComponent>();
+			auto system = loaded.RegisterSystem<CountingSystem>();
+			Signature signature;
+			signature.set(loaded.GetComponentType<TestComponent>(), true);
+			loaded.SetSystemSignature<CountingSystem>(signature);
+
+			// The prefab comes back as a prefab and stays out of systems.
+			Assert::IsTrue(WorldFile().Load(loaded, path).success);
+			Assert::IsTrue(loaded.GetEntityManager()->IsPrefab(prefab));
+			Assert::IsTrue(system->m_Entities.size() == 2);
+			Assert::IsTrue(loaded.Instantiate(prefab, 1).size() == 1);
+			Assert::IsTrue(system->m_Entities.size() == 3);
+
+			std::remove(path);
+		}
+
+		TEST_METHOD(TestWorldFileRejectsCorruptFiles)
+		{
+			const char* path = "TestWorldFileRejectsCorruptFiles.ecsw";
+
+			{
+				ECS ecs;
+				ecs.Init();
+				ecs.RegisterComponent<TestComponent>();
+
+				for (int i = 0; i < 2; i++)
+				{
+					Entity entity = ecs.CreateEntity();
+					ecs.AddComponent(entity, TestComponent(i));
+				}
+
+				Assert::IsTrue(WorldFile().Save(ecs, path));
+			}
+
+			std::ifstream file(path, std::ios::binary);
+			std::vector<std::uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			file.close();
+			std::remove(path);
+
+			auto load = [&](const std::vector<std::uint8_t>& corrupt)
+			{
+				ECS ecs;
+				ecs.Init();
+				ecs.RegisterComponent<TestComponent>();
+				bool success = WorldFile().LoadFromMemory(ecs, corrupt.data(), corrupt.size()).success;
+
+				// Nothing is restored unless the whole file is valid.
+				Assert::IsTrue(success || ecs.GetEntityManager()->GetLivingEntityCount() == 0);
+				return success;
+			};
+
+			auto read64 = [&](size_t offset)
+			{
+				std::uint64_t value;
+				std::memcpy(&value, bytes.data() + offset, sizeof(value));
+				return static_cast<size_t>(value);
+			};
+
+			Assert::IsTrue(load(bytes));
+
+			// The column references an entity that isn't alive.
+			std::vector<std::uint8_t> corrupt = bytes;
+			Entity dead = 100;
+			std::memcpy(corrupt.data() + read64(56 + 8), &dead, sizeof(Entity));
+			Assert::IsFalse(load(corrupt));
+
+			// An available ID is listed twice.
+			corrupt = bytes;
+			size_t available = read64(32);
+			std::memcpy(corrupt.data() + available + sizeof(Entity), corrupt.data() + available, sizeof(Entity));
+			Assert::IsFalse(load(corrupt));
+
+			// An available ID out of range.
+			corrupt = bytes;
+			Entity outOfRange = MAX_ENTITIES;
+			std::memcpy(corrupt.data() + available, &outOfRange, sizeof(Entity));
+			Assert::IsFalse(load(corrupt));
+		}
+
+
+		TEST_METHOD(TestSnapshotRewind)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterComponent<TestName>();
+			auto system = ecs.RegisterSystem<TestSystem>(10);
+
+			Signature signature;
+			signature.set(ecs.GetComponentType<TestComponent>(), true);
+			ecs.SetSystemSignature<TestSystem>(signature);
+
+			for (int i = 0; i < 10; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestComponent(100));
+			}
+
+			SnapshotRing snapshots(ecs, 4);
+
+			// Frame 1: one entity changes.
+			system->Update(ecs);
+			std::uint64_t frame = snapshots.Capture();
+
+			// Frame 2: structural changes.
+			ecs.DestroyEntity(3);
+			Entity spawned = ecs.CreateEntity();
+			ecs.AddComponent(spawned, TestComponent(5));
+			ecs.AddComponent(spawned, TestName{ "spawned" });
+			ecs.RemoveComponent<TestComponent>(7);
+			snapshots.Capture();
+
+			// Uncaptured changes are rolled back as well.
+			system->Update(ecs);
+
+			Assert::IsTrue(snapshots.Rewind(frame));
+			Assert::IsTrue(system->m_Entities.size() == 10);
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(3).val == 99);
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(7).val == 99);
+			Assert::IsTrue(ecs.GetEntityManager()->IsAlive(3));
+			Assert::IsFalse(ecs.GetEntityManager()->IsAlive(spawned));
+
+			// Components the ring doesn't cover leave with the entities the rewind kills.
+			Assert::IsFalse(ecs.GetComponentManager()->GetComponentArray<TestName>()->HasData(spawned));
+
+			// The available queue is restored too, so the same ID is handed out again.
+			Assert::IsTrue(ecs.CreateEntity() == spawned);
+			ecs.AddComponent(spawned, TestName{ "reused" });
+			Assert::AreEqual(std::string("reused"), ecs.ReadComponent<TestName>(spawned).name);
+		}
+
+		TEST_METHOD(TestSnapshotPrefabs)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			auto system = ecs.RegisterSystem<CountingSystem>();
+
+			Signature signature;
+			signature.set(ecs.GetComponentType<TestComponent>(), true);
+			ecs.SetSystemSignature<CountingSystem>(signature);
+
+			Entity prefab = ecs.CreatePrefab();
+			ecs.AddComponent(prefab, TestComponent(1));
+			ecs.Instantiate(prefab, 1);
+
+			SnapshotRing snapshots(ecs, 4);
+			std::uint64_t frame = snapshots.Capture();
+
+			ecs.GetComponent<TestComponent>(prefab).val = 2;
+			snapshots.Capture();
+
+			// Rewinding the prefab's component doesn't push it into the system.
+			Assert::IsTrue(snapshots.Rewind(frame));
+			Assert::IsTrue(ecs.ReadComponent<TestComponent>(prefab).val == 1);
+			Assert::IsTrue(system->m_Entities.size() == 1);
+		}
+
+		TEST_METHOD(TestSnapshotRelations)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterRelation<TestDockedAt>();
+			ecs.RegisterRelation<TestOwnedBy>(RelationCleanup::DestroySources);
+
+			Entity keep = ecs.CreateEntity();
+			Entity item = ecs.CreateEntity();
+
+			SnapshotRing snapshots(ecs, 4);
+			std::uint64_t frame = snapshots.Capture();
+
+			Entity spawned = ecs.CreateEntity();
+			ecs.AddComponent(spawned, TestComponent(1));
+			Assert::IsTrue(ecs.AddPair<TestDockedAt>(keep, spawned));
+			Assert::IsTrue(ecs.AddPair<TestOwnedBy>(item, spawned));
+			snapshots.Capture();
+
+			// The pairs leave with the spawned entity, and the item it owned is destroyed like with DestroyEntity.
+			Assert::IsTrue(snapshots.Rewind(frame));
+			Assert::IsFalse(ecs.GetEntityManager()->IsAlive(spawned));
+			Assert::IsFalse(ecs.HasPair<TestDockedAt>(keep, spawned));
+			Assert::IsFalse(ecs.GetEntityManager()->IsAlive(item));
+			Assert::IsTrue(ecs.GetEntityManager()->IsAlive(keep));
+			Assert::IsTrue(ecs.GetRelation<TestDockedAt>().GetPairCount() == 0);
+		}
+
+		TEST_METHOD(TestSnapshotWindow)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+
+			Entity entity = ecs.CreateEntity();
+			ecs.AddComponent(entity, TestComponent(0));
+
+			SnapshotRing snapshots(ecs, 3);
+			for (int i = 1; i <= 10; i++)
+			{
+				ecs.GetComponent<TestComponent>(entity).val = i;
+				snapshots.Capture();
+			}
+
+			// Only the last 3 frames and the keyframe before them are kept.
+			Assert::IsTrue(snapshots.GetOldestFrame() == 7);
+			Assert::IsFalse(snapshots.Rewind(6));
+			Assert::IsTrue(snapshots.Rewind(7));
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(entity).val == 7);
+			Assert::IsTrue(snapshots.GetLatestFrame() == 7);
+		}
+
+		TEST_METHOD(TestSnapshotDirtyLists)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+
+			for (int i = 0; i < 10; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestComponent(i));
+			}
+
+			SnapshotRing snapshots(ecs, 4);
+
+			// Removing entity 0's component moves entity 9 into its slot, the change to 9 is found in the new slot.
+			ecs.RemoveComponent<TestComponent>(0);
+			ecs.GetComponent<TestComponent>(9).val = 90;
+			ecs.GetComponent<TestComponent>(2).val = 20;
+			std::uint64_t frame = snapshots.Capture();
+
+			// Sorting moves changed components to slots the dirty list doesn't name.
+			ecs.GetComponent<TestComponent>(5).val = 50;
+			ecs.Sort<TestComponent>([](const TestComponent& a, const TestComponent& b) { return a.val > b.val; });
+			snapshots.Capture();
+
+			ecs.GetComponent<TestComponent>(3).val = 30;
+			Assert::IsTrue(snapshots.Rewind(frame));
+
+			Assert::IsFalse(ecs.GetEntityManager()->GetSignature(0).test(ecs.GetComponentType<TestComponent>()));
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(9).val == 90);
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(2).val == 20);
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(5).val == 5);
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(3).val == 3);
+
+			// Rewinding the keyframe only needs the frame's own changes.
+			Assert::IsTrue(snapshots.Rewind(snapshots.GetOldestFrame()));
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(0).val == 0);
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(9).val == 9);
+		}
+
+
+		TEST_METHOD(TestSnapshotSharedComponents)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterSharedComponent<TestMaterial>();
+
+			const TestMaterial red{ 1, { 1.0f, 0.0f, 0.0f, 1.0f } };
+			const TestMaterial blue{ 1, { 0.0f, 0.0f, 1.0f, 1.0f } };
+
+			Entity a = ecs.CreateEntity();
+			ecs.SetSharedComponent(a, red);
+			Entity b = ecs.CreateEntity();
+			ecs.AddComponent(b, TestComponent(1));
+
+			SnapshotRing snapshots(ecs, 4);
+			std::uint64_t frame = snapshots.Capture();
+
+			ecs.SetSharedComponent(b, red);
+			ecs.SetSharedComponent(a, blue);
+			snapshots.Capture();
+
+			// The shared entries follow the restored signatures.
+			Assert::IsTrue(snapshots.Rewind(frame));
+
+			auto materials = ecs.GetComponentManager()->GetSharedComponentArray<TestMaterial>();
+			ComponentType type = ecs.GetComponentType<TestMaterial>();
+			Assert::IsFalse(ecs.GetEntityManager()->GetSignature(b).test(type));
+			Assert::IsFalse(materials->HasData(b));
+			Assert::IsTrue(ecs.GetSharedComponent<TestMaterial>(a) == red);
+			Assert::AreEqual(size_t(1), materials->ValueCount());
+			Assert::AreEqual(size_t(1), materials->RefCount(a));
+
+			// A value dropped with its last entity comes back.
+			ecs.DestroyEntity(a);
+			snapshots.Capture();
+			Assert::IsTrue(snapshots.Rewind(frame));
+
+			Assert::IsTrue(ecs.GetEntityManager()->GetSignature(a).test(type));
+			Assert::IsTrue(ecs.GetSharedComponent<TestMaterial>(a) == red);
+			Assert::AreEqual(size_t(1), materials->ValueCount());
+		}
+
+		TEST_METHOD(TestObservers)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+
+			std::vector<Entity> added, removed, set;
+			int addCalls = 0;
+
+			ecs.OnAdd<TestComponent>([&](ECS&, const std::vector<Entity>& entities)
+			{
+				added.insert(added.end(), entities.begin(), entities.end());
+				addCalls++;
+			});
+			ecs.OnRemove<TestComponent>([&](ECS&, const std::vector<Entity>& entities)
+			{
+				removed.insert(removed.end(), entities.begin(), entities.end());
+			});
+			ecs.OnSet<TestComponent>([&](ECS&, const std::vector<Entity>& entities)
+			{
+				set.insert(set.end(), entities.begin(), entities.end());
+			});
+
+			for (int i = 0; i < 3; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestComponent(i));
+			}
+
+			// Nothing is delivered before the flush.
+			Assert::IsTrue(added.empty());
+
+			ecs.SetComponent(1, TestComponent(10));
+			ecs.RemoveComponent<TestComponent>(0);
+			ecs.DestroyEntity(2);
+			ecs.FlushObservers();
+
+			// One batched call, components added and removed again before the flush are reported neither way.
+			Assert::IsTrue(addCalls == 1);
+			Assert::IsTrue(added == std::vector<Entity>({ 1 }));
+			Assert::IsTrue(removed.empty());
+			Assert::IsTrue(set == std::vector<Entity>({ 1, 1 }));
+			Assert::IsTrue(ecs.GetComponent<TestComponent>(1).val == 10);
+
+			ecs.FlushObservers();
+			Assert::IsTrue(addCalls == 1);
+
+			// A component that existed before is reported removed once, a replaced one as removed and added.
+			Entity other = ecs.CreateEntity();
+			ecs.AddComponent(other, TestComponent(3));
+			ecs.FlushObservers();
+			added.clear();
+
+			ecs.RemoveComponent<TestComponent>(1);
+			ecs.AddComponent(1, TestComponent(11));
+			ecs.RemoveComponent<TestComponent>(1);
+			ecs.RemoveComponent<TestComponent>(other);
+			ecs.AddComponent(other, TestComponent(4));
+			ecs.FlushObservers();
+
+			Assert::IsTrue(removed == std::vector<Entity>({ 1, other }));
+			Assert::IsTrue(added == std::vector<Entity>({ other }));
+		}
+
+		TEST_METHOD(TestConcurrentCreateEntity)
+		{
+			ECS ecs;
+			ecs.Init();
+
+			constexpr int numThreads = 8;
+			constexpr int perThread = 500;
+
+			// The main thread keeps creating while the workers do.
+			std::vector<std::vector<Entity>> created(numThreads + 1);
+			std::vector<std::thread> threads;
+			for (int t = 0; t < numThreads; t++)
+			{
+				threads.emplace_back([&ecs, &created, t]()
+				{
+					for (int i = 0; i < perThread; i++)
+						created[t].push_back(ecs.CreateEntity());
+				});
+			}
+			for (int i = 0; i < perThread; i++)
+				created[numThreads].push_back(ecs.CreateEntity());
+			for (auto& thread : threads)
+				thread.join();
+
+			std::vector<bool> seen(MAX_ENTITIES, false);
+			for (const auto& entities : created)
+			{
+				for (Entity entity : entities)
+				{
+					Assert::IsFalse(seen[entity]);
+					Assert::IsTrue(ecs.GetEntityManager()->IsAlive(entity));
+					seen[entity] = true;
+				}
+			}
+			Assert::IsTrue(ecs.GetEntityManager()->GetLivingEntityCount() == (numThreads + 1) * perThread);
+
+			// Unused IDs reserved by the workers go back to the queue.
+			ecs.GetEntityManager()->FlushThreadCaches();
+			Assert::IsTrue(ecs.GetEntityManager()->GetAvailableEntities().size() == MAX_ENTITIES - (numThreads + 1) * perThread);
+		}
+
+		TEST_METHOD(TestCreateEntitiesAtCap)
+		{
+			EntityManager entityManager;
+			std::vector<Entity> entities(MAX_ENTITIES);
+
+			Assert::IsTrue(entityManager.CreateEntities(MAX_ENTITIES - 10, Signature(), entities.data()));
+
+			// A batch that doesn't fit creates nothing.
+			Assert::IsFalse(entityManager.CreateEntities(20, Signature(), entities.data()));
+			Assert::IsTrue(entityManager.GetLivingEntityCount() == MAX_ENTITIES - 10);
+
+			// Job threads see the cap too, the last IDs all go out exactly once.
+			std::thread worker([&]()
+			{
+				Assert::IsTrue(entityManager.CreateEntities(10, Signature(), entities.data()));
+			});
+			worker.join();
+
+			Assert::IsTrue(entityManager.GetLivingEntityCount() == MAX_ENTITIES);
+			Assert::IsFalse(entityManager.CreateEntities(1, Signature(), entities.data()));
+			for (Entity entity = 0; entity < MAX_ENTITIES; entity++)
+			{
+				Assert::IsTrue(entityManager.IsAlive(entity));
+			}
+		}
+
+		TEST_METHOD(TestSpatialHashQueries)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+
+			// A row of entities 3 units apart, plus one overlapping the first.
+			for (int i = 0; i < 10; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestPosition{ i * 3.0f, 0.0f });
+			}
+			Entity overlapping = ecs.CreateEntity();
+			ecs.AddComponent(overlapping, TestPosition{ 0.5f, 0.5f });
+
+			SpatialHash<TestPosition> index(4.0f, &TestBounds);
+			index.Update(ecs);
+
+			std::vector<Entity> found;
+			index.Query({ 5.0f, -1.0f, 7.0f, 1.0f }, [&](Entity entity) { found.push_back(entity); });
+			std::sort(found.begin(), found.end());
+			Assert::IsTrue(found == std::vector<Entity>({ 2 }));
+
+			Entity nearest;
+			Assert::IsTrue(index.Nearest(13.0f, 5.0f, 100.0f, nearest));
+			Assert::IsTrue(nearest == 4);
+			Assert::IsFalse(index.Nearest(100.0f, 100.0f, 10.0f, nearest));
+
+			std::vector<std::pair<Entity, Entity>> pairs;
+			index.Pairs(pairs);
+			Assert::IsTrue(pairs.size() == 1);
+			Assert::IsTrue(std::min(pairs[0].first, pairs[0].second) == 0 && std::max(pairs[0].first, pairs[0].second) == overlapping);
+		}
+
+		TEST_METHOD(TestSpatialHashIncremental)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+
+			Entity a = ecs.CreateEntity();
+			ecs.AddComponent(a, TestPosition{ 0.0f, 0.0f });
+			Entity b = ecs.CreateEntity();
+			ecs.AddComponent(b, TestPosition{ 50.0f, 0.0f });
+
+			SpatialHash<TestPosition> index(4.0f, &TestBounds);
+			index.Update(ecs);
+
+			// Only the moved entity changes cell, the destroyed one disappears.
+			ecs.GetComponent<TestPosition>(a).x = 100.0f;
+			ecs.DestroyEntity(b);
+			index.Update(ecs);
+
+			Assert::IsFalse(index.Contains(b));
+			Assert::IsTrue(index.GetBounds(a).minX == 99.0f);
+
+			int count = 0;
+			index.Query({ -10.0f, -10.0f, 10.0f, 10.0f }, [&](Entity) { count++; });
+			Assert::IsTrue(count == 0);
+			index.Query({ 95.0f, -10.0f, 105.0f, 10.0f }, [&](Entity) { count++; });
+			Assert::IsTrue(count == 1);
+		}
+
+		TEST_METHOD(TestRenderListBatches)
+		{
+			RenderList renderList;
+			renderList.AddQuad(2, 0.0f, 0.0f, 10.0f, 20.0f, PackColor(255, 0, 0));
+			renderList.AddQuad(1, 5.0f, 5.0f, 1.0f, 1.0f, PackColor(0, 255, 0));
+			renderList.AddQuad(2, 100.0f, 0.0f, 10.0f, 10.0f, PackColor(0, 0, 255));
+			renderList.Build();
+
+			// Sorted by material, add order kept within a material.
+			const auto& batches = renderList.GetBatches();
+			Assert::IsTrue(batches.size() == 2);
+			Assert::IsTrue(batches[0].material == 1 && batches[0].firstVertex == 0 && batches[0].vertexCount == 4);
+			Assert::IsTrue(batches[1].material == 2 && batches[1].firstVertex == 4 && batches[1].vertexCount == 8);
+
+			const auto& vertices = renderList.GetVertices();
+			Assert::IsTrue(vertices.size() == 12);
+			Assert::IsTrue(vertices[0].x == 5.0f && vertices[0].color == PackColor(0, 255, 0));
+			Assert::IsTrue(vertices[6].x == 10.0f && vertices[6].y == 20.0f && vertices[6].color == PackColor(255, 0, 0));
+			Assert::IsTrue(vertices[8].x == 100.0f && vertices[8].color == PackColor(0, 0, 255));
+
+			// Clearing keeps nothing from the previous frame.
+			renderList.Clear();
+			renderList.Build();
+			Assert::IsTrue(renderList.GetVertices().empty() && renderList.GetBatches().empty());
+		}
+
+		TEST_METHOD(TestViewportCulling)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+
+			// Enough entities for the SIMD loop and the scalar tail.
+			std::vector<Entity> entities;
+			for (int i = 0; i < 11; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestPosition{ i * 10.0f, 0.0f });
+				entities.push_back(entity);
+			}
+
+			ViewportCuller<TestPosition> culler(&TestBounds);
+			culler.Update(ecs);
+
+			// Bounds are 1 unit around the position, so 0, 10, 20 and 30 overlap.
+			Bounds viewport{ -5.0f, -5.0f, 29.5f, 5.0f };
+			std::vector<Entity> visible = culler.Cull(viewport);
+			std::sort(visible.begin(), visible.end());
+			Assert::IsTrue(visible == std::vector<Entity>{ entities[0], entities[1], entities[2], entities[3] });
+
+			// Only the changed and swapped entities are recomputed, the result follows them.
+			ecs.GetComponent<TestPosition>(entities[9]).x = 15.0f;
+			ecs.DestroyEntity(entities[0]);
+			culler.Update(ecs);
+
+			visible = culler.Cull(viewport);
+			std::sort(visible.begin(), visible.end());
+			Assert::IsTrue(visible == std::vector<Entity>{ entities[1], entities[2], entities[3], entities[9] });
+
+			// The spatial index path finds the same entities.
+			SpatialHash<TestPosition> index(4.0f, &TestBounds);
+			index.Update(ecs);
+
+			std::vector<Entity> indexed = culler.CullIndexed(index, viewport);
+			std::sort(indexed.begin(), indexed.end());
+			Assert::IsTrue(indexed == visible);
+		}
+
+		TEST_METHOD(TestBoundsDependencies)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+			ecs.RegisterComponent<TestComponent>();
+
+			Entity entity = ecs.CreateEntity();
+			ecs.AddComponent(entity, TestPosition{ 0.0f, 0.0f });
+			ecs.AddComponent(entity, TestComponent(1));
+
+			Signature dependencies;
+			dependencies.set(ecs.GetComponentType<TestComponent>(), true);
+			ViewportCuller<TestPosition> culler(&TestSizedBounds, dependencies);
+			SpatialHash<TestPosition> index(4.0f, &TestSizedBounds, dependencies);
+			culler.Update(ecs);
+			index.Update(ecs);
+
+			Bounds viewport{ 5.0f, 5.0f, 6.0f, 6.0f };
+			Assert::IsTrue(culler.Cull(viewport).empty());
+			Assert::IsTrue(culler.CullIndexed(index, viewport).empty());
+
+			// Only the dependency changes, both refresh the bounds.
+			ecs.GetComponent<TestComponent>(entity).val = 10;
+			culler.Update(ecs);
+			index.Update(ecs);
+
+			Assert::IsTrue(culler.Cull(viewport) == std::vector<Entity>{ entity });
+			Assert::IsTrue(culler.CullIndexed(index, viewport) == std::vector<Entity>{ entity });
+		}
+
+		static TestComponent LerpTestComponent(const TestComponent& previous, const TestComponent& current, float alpha)
+		{
+			return TestComponent(previous.val + static_cast<int>((current.val - previous.val) * alpha));
+		}
+
+		TEST_METHOD(TestWorldFixedStep)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+
+			Entity entity = ecs.CreateEntity();
+			ecs.AddComponent(entity, TestComponent(0));
+
+			World world(ecs);
+			world.SetFixedRate(10.0, 4);
+			world.Interpolate<TestComponent>(&LerpTestComponent);
+
+			std::vector<Phase> order;
+			world.AddSystem(Phase::Render, "Render", [&](ECS&, const FrameTime&) { order.push_back(Phase::Render); });
+			world.AddSystem(Phase::PreUpdate, "PreUpdate", [&](ECS&, const FrameTime&) { order.push_back(Phase::PreUpdate); });
+			world.AddSystem(Phase::FixedUpdate, "Step", [&](ECS& ecs, const FrameTime& time)
+			{
+				Assert::IsTrue(time.fixedDeltaTime == 0.1);
+				ecs.GetComponent<TestComponent>(entity).val += 10;
+				order.push_back(Phase::FixedUpdate);
+			});
+
+			// 0.25s is 2 steps with half a step left over.
+			world.Tick(0.25);
+			Assert::IsTrue(world.GetStats().fixedSteps == 2);
+			Assert::IsTrue(std::abs(world.GetTime().alpha - 0.5f) < 1e-4f);
+			Assert::IsTrue(order == std::vector<Phase>{ Phase::PreUpdate, Phase::FixedUpdate, Phase::FixedUpdate, Phase::Render });
+
+			// Halfway between 10 and 20.
+			Assert::IsTrue(world.Interpolated<TestComponent>(entity).val == 15);
+
+			// A long frame is clamped and the catch-up limit drops what's left.
+			world.SetMaxFrameTime(1.0);
+			world.Tick(5.0);
+			Assert::IsTrue(world.GetStats().fixedSteps == 4);
+			Assert::IsTrue(world.GetStats().droppedSteps == 6);
+			Assert::IsTrue(ecs.ReadComponent<TestComponent>(entity).val == 60);
+		}
+
+		TEST_METHOD(TestWorldInterpolationAfterDefragment)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+
+			for (int i = 0; i < 5; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestComponent(i * 100));
+			}
+			ecs.DestroyEntity(1);
+
+			World world(ecs);
+			world.SetFixedRate(10.0, 4);
+			world.Interpolate<TestComponent>(&LerpTestComponent);
+			world.AddSystem(Phase::FixedUpdate, "Step", [&](ECS& ecs, const FrameTime&)
+			{
+				// 0 is captured before the step and destroyed in it.
+				ecs.DestroyEntity(0);
+				for (Entity entity = 2; entity < 5; entity++)
+					ecs.GetComponent<TestComponent>(entity).val += 10;
+			});
+
+			world.Tick(0.15);
+			ecs.FlushObservers();
+
+			// 4 takes the ID captured for the destroyed 0, 3 takes 1 which wasn't captured at all.
+			EntityDefragmenter defragmenter(ecs);
+			const auto& moves = defragmenter.Step(2);
+			Assert::AreEqual(size_t(2), moves.size());
+			world.MoveEntities(moves.data(), moves.size());
+
+			Assert::AreEqual(0u, defragmenter.Remap(4));
+			Assert::AreEqual(1u, defragmenter.Remap(3));
+			Assert::AreEqual(405, world.Interpolated<TestComponent>(0).val);
+			Assert::AreEqual(305, world.Interpolated<TestComponent>(1).val);
+			Assert::AreEqual(205, world.Interpolated<TestComponent>(2).val);
+		}
+
+		TEST_METHOD(TestWorldParallelStages)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterComponent<TestPosition>();
+
+			JobSystem jobs(2);
+			World world(ecs, &jobs);
+
+			std::vector<Entity> entities;
+			for (int i = 0; i < 100; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestComponent(i));
+				ecs.AddComponent(entity, TestPosition{ float(i), 0.0f });
+				entities.push_back(entity);
+			}
+
+			// Every system touches the components it declares, through ReadComponent for reads.
+			std::atomic<int> runs{ 0 };
+			std::atomic<int> sumA{ 0 };
+			std::atomic<int> sumB{ 0 };
+			auto readA = [&](ECS& ecs, const FrameTime&)
+			{
+				for (Entity entity : entities)
+					sumA += ecs.ReadComponent<TestComponent>(entity).val;
+				runs++;
+			};
+			auto readB = [&](ECS& ecs, const FrameTime&)
+			{
+				for (Entity entity : entities)
+					sumB += ecs.ReadComponent<TestComponent>(entity).val + int(ecs.ReadComponent<TestPosition>(entity).x);
+				runs++;
+			};
+			auto write = [&](ECS& ecs, const FrameTime&)
+			{
+				for (Entity entity : entities)
+					ecs.GetComponent<TestComponent>(entity).val += 1000;
+				runs++;
+			};
+			auto writeOther = [&](ECS& ecs, const FrameTime&)
+			{
+				for (Entity entity : entities)
+					ecs.GetComponent<TestPosition>(entity).y += 1.0f;
+				runs++;
+			};
+			bool written = false;
+			auto exclusive = [&](ECS& ecs, const FrameTime&)
+			{
+				written = std::all_of(entities.begin(), entities.end(), [&](Entity entity)
+				{
+					return ecs.ReadComponent<TestComponent>(entity).val >= 1000 && ecs.ReadComponent<TestPosition>(entity).y == 1.0f;
+				});
+				runs++;
+			};
+
+			// Two readers share a stage, the writers wait for them, the exclusive system runs alone.
+			world.AddSystem(Phase::Update, "ReadA", readA, SystemAccess(world.ComponentSignature<TestComponent>(), Signature()));
+			world.AddSystem(Phase::Update, "ReadB", readB, SystemAccess(world.ComponentSignature<TestComponent, TestPosition>(), Signature()));
+			world.AddSystem(Phase::Update, "Write", write, SystemAccess(Signature(), world.ComponentSignature<TestComponent>()));
+			world.AddSystem(Phase::Update, "WriteOther", writeOther, SystemAccess(Signature(), world.ComponentSignature<TestPosition>()));
+			world.AddSystem(Phase::Update, "Exclusive", exclusive);
+
+			Assert::IsTrue(world.GetStageCount(Phase::Update) == 3);
+
+			world.Tick(0.0);
+			Assert::IsTrue(runs == 5);
+
+			// The readers saw the values from before the writers' stage.
+			Assert::IsTrue(sumA == 4950);
+			Assert::IsTrue(sumB == 2 * 4950);
+			Assert::IsTrue(written);
+			for (int i = 0; i < 100; i++)
+			{
+				Assert::IsTrue(ecs.ReadComponent<TestComponent>(entities[i]).val == i + 1000);
+			}
+
+			// Every index of a job batch runs exactly once.
+			std::vector<std::atomic<int>> hits(1000);
+			jobs.ParallelFor(1000, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; i++)
+					hits[i]++;
+			});
+			Assert::IsTrue(std::all_of(hits.begin(), hits.end(), [](const std::atomic<int>& hit) { return hit == 1; }));
+		}
+
+		TEST_METHOD(TestSystemSchedules)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+
+			auto system = ecs.RegisterSystem<CountingSystem>();
+			Signature signature;
+			signature.set(ecs.GetComponentType<TestComponent>(), true);
+			ecs.SetSystemSignature<CountingSystem>(signature);
+
+			for (int i = 0; i < 10; i++)
+			{
+				ecs.AddComponent(ecs.CreateEntity(), TestComponent(i));
+			}
+
+			// Every 3rd tick, offset by 1.
+			ecs.SetSystemSchedule<CountingSystem>(SystemSchedule::Every(3, 1));
+			int runs = 0;
+			for (int tick = 0; tick < 9; tick++)
+			{
+				if (system->ShouldUpdate())
+				{
+					Assert::IsTrue(tick % 3 == 2);
+					runs++;
+				}
+			}
+			Assert::IsTrue(runs == 3);
+
+			// 10 entities over 3 slices, 4 + 4 + 2 then the next sweep.
+			ecs.SetSystemSchedule<CountingSystem>(SystemSchedule::Sliced(3));
+			std::vector<std::uint32_t> visited;
+			for (int tick = 0; tick < 4; tick++)
+			{
+				system->ShouldUpdate();
+				system->Update(ecs);
+				visited.push_back(ecs.GetSystemStats<CountingSystem>().visitedLastTick);
+
+				if (tick == 1)
+				{
+					Assert::IsTrue(ecs.GetSystemStats<CountingSystem>().remaining == 2);
+					Assert::IsTrue(ecs.GetSystemStats<CountingSystem>().ticksBehind == 1);
+				}
+			}
+			Assert::IsTrue(visited == std::vector<std::uint32_t>{ 4, 4, 2, 4 });
+			Assert::IsTrue(ecs.GetSystemStats<CountingSystem>().completedSweeps == 1);
+			Assert::IsTrue(ecs.GetSystemStats<CountingSystem>().lastSweepTicks == 3);
+			Assert::IsTrue(system->visits[0] == 2 && system->visits[4] == 1 && system->visits[9] == 1);
+
+			// A zero budget still makes progress and resumes after the cursor, destroying entities in between is fine.
+			for (int i = 0; i < 40; i++)
+			{
+				ecs.AddComponent(ecs.CreateEntity(), TestComponent(0));
+			}
+			ecs.SetSystemSchedule<CountingSystem>(SystemSchedule::Budget(0.0));
+			std::fill(system->visits.begin(), system->visits.end(), 0);
+
+			system->ShouldUpdate();
+			system->Update(ecs);
+			Assert::IsTrue(ecs.GetSystemStats<CountingSystem>().visitedLastTick == 16);
+
+			ecs.DestroyEntity(5);
+			while (ecs.GetSystemStats<CountingSystem>().remaining > 0)
+			{
+				system->ShouldUpdate();
+				system->Update(ecs);
+			}
+			Assert::IsTrue(std::all_of(system->visits.begin(), system->visits.begin() + 50, [](int visits) { return visits == 1; }));
+
+			// Moving an entity behind the cursor of a sweep doesn't make the sweep skip it.
+			ecs.SetSystemSchedule<CountingSystem>(SystemSchedule::Sliced(2));
+			std::fill(system->visits.begin(), system->visits.end(), 0);
+			system->ShouldUpdate();
+			system->Update(ecs);
+
+			EntityMove move{ 49, 5 };
+			ecs.MoveEntities(&move, 1);
+			std::uint64_t sweeps = ecs.GetSystemStats<CountingSystem>().completedSweeps;
+			while (ecs.GetSystemStats<CountingSystem>().completedSweeps == sweeps)
+			{
+				system->ShouldUpdate();
+				system->Update(ecs);
+			}
+			Assert::IsTrue(std::all_of(system->visits.begin(), system->visits.begin() + 49, [](int visits) { return visits >= 1; }));
+		}
+
+
+		TEST_METHOD(TestHierarchyPropagation)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<Transform>();
+			ecs.RegisterComponent<WorldTransform>();
+
+			std::vector<Entity> entities;
+			for (int i = 0; i < 5; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, Transform{ 1.0f, 0.0f, 0.0f, 1.0f });
+				ecs.AddComponent(entity, WorldTransform{});
+				entities.push_back(entity);
+			}
+
+			// 0 -> 1 -> 2 and 0 -> 3, 4 stays out.
+			Hierarchy hierarchy(ecs);
+			hierarchy.SetParent(entities[1], entities[0]);
+			hierarchy.SetParent(entities[2], entities[1]);
+			hierarchy.SetParent(entities[3], entities[0]);
+
+			Assert::IsTrue(hierarchy.GetLevelCount() == 3);
+			Assert::IsTrue(hierarchy.GetDepth(entities[2]) == 2);
+			Assert::IsTrue(hierarchy.GetChildren(entities[0]).size() == 2);
+			Assert::IsFalse(hierarchy.Contains(entities[4]));
+
+			JobSystem jobs(2);
+			hierarchy.PropagateTransforms(&jobs);
+			Assert::IsTrue(hierarchy.GetRecomputedCount() == 4);
+			Assert::IsTrue(ecs.ReadComponent<WorldTransform>(entities[2]).x == 3.0f);
+
+			// Nothing changed, nothing recomputed.
+			hierarchy.PropagateTransforms(&jobs);
+			Assert::IsTrue(hierarchy.GetRecomputedCount() == 0);
+
+			// Only the dirty subtree is recomputed, the root's rotation and scale carry down.
+			ecs.GetComponent<Transform>(entities[1]) = Transform{ 1.0f, 0.0f, 3.14159265f / 2.0f, 2.0f };
+			hierarchy.PropagateTransforms(&jobs);
+			Assert::IsTrue(hierarchy.GetRecomputedCount() == 2);
+
+			const WorldTransform& world = ecs.ReadComponent<WorldTransform>(entities[2]);
+			Assert::IsTrue(std::fabs(world.x - 2.0f) < 1e-5f && std::fabs(world.y - 2.0f) < 1e-5f && world.scale == 2.0f);
+
+			// Reparenting moves the subtree up a level and recomputes it.
+			hierarchy.SetParent(entities[1], entities[3]);
+			Assert::IsTrue(hierarchy.GetDepth(entities[1]) == 2 && hierarchy.GetDepth(entities[2]) == 3);
+			Assert::IsTrue(hierarchy.GetChildren(entities[0]).size() == 1);
+
+			hierarchy.PropagateTransforms(&jobs);
+			Assert::IsTrue(hierarchy.GetRecomputedCount() == 2);
+			Assert::IsTrue(std::fabs(ecs.ReadComponent<WorldTransform>(entities[2]).x - 3.0f) < 1e-5f);
+
+			// Removing a node turns its children into roots.
+			hierarchy.Remove(entities[3]);
+			Assert::IsTrue(hierarchy.GetParent(entities[1]) == Hierarchy::NO_PARENT);
+			Assert::IsTrue(hierarchy.GetDepth(entities[2]) == 1 && hierarchy.GetLevelCount() == 2);
+
+			hierarchy.PropagateTransforms();
+			Assert::IsTrue(hierarchy.GetRecomputedCount() == 2);
+			Assert::IsTrue(std::fabs(ecs.ReadComponent<WorldTransform>(entities[2]).y - 2.0f) < 1e-5f);
+		}
+
+		TEST_METHOD(TestPrefabInstantiate)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterComponent<TestPosition>();
+			ecs.RegisterComponent<TestName>();
+
+			auto system = ecs.RegisterSystem<CountingSystem>();
+			Signature signature;
+			signature.set(ecs.GetComponentType<TestPosition>(), true);
+			ecs.SetSystemSignature<CountingSystem>(signature);
+
+			std::vector<Entity> added;
+			ecs.OnAdd<TestPosition>([&](ECS&, const std::vector<Entity>& entities) { added.insert(added.end(), entities.begin(), entities.end()); });
+
+			// Systems and observers don't see the prefab itself.
+			Entity prefab = ecs.CreatePrefab();
+			ecs.AddComponent(prefab, TestPosition{ 1.0f, 2.0f });
+			ecs.AddComponent(prefab, TestName{ "bullet" });
+			Assert::IsTrue(system->m_Entities.empty());
+
+			ecs.AddComponent(ecs.CreateEntity(), TestComponent(7));
+
+			std::vector<Entity> instances = ecs.Instantiate(prefab, 37);
+			Assert::IsTrue(instances.size() == 37);
+			Assert::IsTrue(ecs.GetEntityManager()->GetLivingEntityCount() == 39);
+			Assert::IsTrue(system->m_Entities.size() == 37);
+
+			for (Entity instance : instances)
+			{
+				Assert::IsTrue(ecs.GetEntityManager()->GetSignature(instance) == ecs.GetEntityManager()->GetSignature(prefab));
+				Assert::IsTrue(ecs.ReadComponent<TestPosition>(instance).y == 2.0f);
+				Assert::IsTrue(ecs.ReadComponent<TestName>(instance).name == "bullet");
+				Assert::IsFalse(ecs.GetEntityManager()->IsPrefab(instance));
+			}
+
+			// Instances are independent copies and behave like any other entity.
+			ecs.GetComponent<TestName>(instances[3]).name = "rocket";
+			ecs.RemoveComponent<TestPosition>(instances[5]);
+			ecs.DestroyEntity(instances[6]);
+			Assert::IsTrue(ecs.ReadComponent<TestName>(prefab).name == "bullet");
+			Assert::IsTrue(ecs.ReadComponent<TestName>(instances[4]).name == "bullet");
+			Assert::IsTrue(ecs.ReadComponent<TestPosition>(instances[36]).x == 1.0f);
+			Assert::IsTrue(system->m_Entities.size() == 35);
+
+			// The instances that lost their position before the flush aren't reported as added.
+			ecs.FlushObservers();
+			std::vector<Entity> expected = instances;
+			expected.erase(expected.begin() + 5, expected.begin() + 7);
+			Assert::IsTrue(added == expected);
+		}
+
+		TEST_METHOD(TestMergeWorld)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterComponent<TestName>();
+			ecs.RegisterComponent<TestPosition>();
+
+			auto system = ecs.RegisterSystem<CountingSystem>();
+			Signature signature;
+			signature.set(ecs.GetComponentType<TestPosition>(), true);
+			ecs.SetSystemSignature<CountingSystem>(signature);
+
+			Entity existing = ecs.CreateEntity();
+			ecs.AddComponent(existing, TestPosition{ -1.0f, -1.0f });
+
+			// Built on another thread without touching the live world, components registered in a different order.
+			ECS staging;
+			std::thread loader([&staging]()
+			{
+				staging.Init();
+				staging.RegisterComponent<TestPosition>();
+				staging.RegisterComponent<TestName>();
+
+				for (int i = 0; i < 10; i++)
+				{
+					Entity entity = staging.CreateEntity();
+					staging.AddComponent(entity, TestPosition{ float(i), 0.0f });
+					if (i % 2 == 0)
+						staging.AddComponent(entity, TestName{ "chunk" });
+				}
+			});
+			loader.join();
+
+			Assert::IsTrue(staging.GetComponentType<TestPosition>() == ecs.GetComponentType<TestPosition>());
+			Assert::IsTrue(staging.GetComponentType<TestName>() == ecs.GetComponentType<TestName>());
+
+			std::vector<Entity> remap = MergeWorld(staging, ecs);
+
+			Assert::IsTrue(ecs.GetEntityManager()->GetLivingEntityCount() == 11);
+			Assert::IsTrue(staging.GetEntityManager()->GetLivingEntityCount() == 0);
+			Assert::IsTrue(staging.GetComponentManager()->GetComponentArray<TestPosition>()->Size() == 0);
+			Assert::IsTrue(remap[10] == INVALID_ENTITY);
+
+			for (Entity entity = 0; entity < 10; entity++)
+			{
+				Entity merged = remap[entity];
+				Assert::IsTrue(merged != existing && ecs.GetEntityManager()->IsAlive(merged));
+				Assert::IsTrue(ecs.ReadComponent<TestPosition>(merged).x == float(entity));
+				Assert::IsTrue(ecs.GetComponentManager()->GetComponentArray<TestName>()->HasData(merged) == (entity % 2 == 0));
+			}
+			Assert::IsTrue(ecs.ReadComponent<TestName>(remap[4]).name == "chunk");
+			Assert::IsTrue(ecs.ReadComponent<TestPosition>(existing).x == -1.0f);
+			Assert::IsTrue(system->m_Entities.size() == 11);
+
+			// The staging world can be filled again.
+			Entity entity = staging.CreateEntity();
+			staging.AddComponent(entity, TestPosition{ 5.0f, 5.0f });
+			remap = MergeWorld(staging, ecs);
+			Assert::IsTrue(ecs.ReadComponent<TestPosition>(remap[entity]).y == 5.0f);
+		}
+
+		TEST_METHOD(TestStreamingLoader)
+		{
+			// Three chunks of 10 entities, "compressed" by flipping every byte.
+			std::vector<std::string> paths;
+			for (int chunk = 0; chunk < 3; chunk++)
+			{
+				std::string path = "TestStreamingChunk" + std::to_string(chunk) + ".ecsw";
+				paths.push_back(path);
+
+				ECS ecs;
+				ecs.Init();
+				ecs.RegisterComponent<TestPosition>();
+				for (int i = 0; i < 10; i++)
+				{
+					ecs.AddComponent(ecs.CreateEntity(), TestPosition{ float(chunk * 100 + i), 0.0f });
+				}
+				Assert::IsTrue(WorldFile().Save(ecs, path.c_str()));
+
+				std::ifstream in(path, std::ios::binary);
+				std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+				in.close();
+				for (char& byte : bytes)
+					byte = ~byte;
+				std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+			}
+
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterComponent<TestPosition>();
+			ecs.AddComponent(ecs.CreateEntity(), TestPosition{ -1.0f, 0.0f });
+
+			StreamingLoader loader([](ECS& staging) { staging.RegisterComponent<TestPosition>(); }, 2);
+			loader.SetDecoder([](std::vector<std::uint8_t>& bytes)
+			{
+				for (std::uint8_t& byte : bytes)
+					byte = ~byte;
+				return true;
+			});
+
+			for (const std::string& path : paths)
+				loader.Request(path);
+			loader.Request("TestStreamingMissing.ecsw");
+
+			loader.WaitUntilBuilt();
+			Assert::IsTrue(loader.GetStats().ready == 3 && loader.GetStats().failed == 1 && loader.GetStats().queued == 0);
+
+			// Nothing touched the live world yet, a zero budget still commits one chunk per frame.
+			Assert::IsTrue(ecs.GetEntityManager()->GetLivingEntityCount() == 1);
+
+			std::vector<float> committedX;
+			auto onCommit = [&](const std::string&, const std::vector<Entity>& remap)
+			{
+				committedX.push_back(ecs.ReadComponent<TestPosition>(remap[9]).x);
+			};
+
+			Assert::IsTrue(loader.Commit(ecs, 0.0, onCommit) == 1);
+			Assert::IsTrue(ecs.GetEntityManager()->GetLivingEntityCount() == 11);
+			Assert::IsTrue(loader.Commit(ecs, 1e9, onCommit) == 2);
+			Assert::IsTrue(ecs.GetEntityManager()->GetLivingEntityCount() == 31);
+
+			std::sort(committedX.begin(), committedX.end());
+			Assert::IsTrue(committedX == std::vector<float>{ 9.0f, 109.0f, 209.0f });
+
+			StreamingStats stats = loader.GetStats();
+			Assert::IsTrue(stats.committed == 3 && stats.ready == 0);
+			Assert::IsTrue(stats.maxLatencyMicroseconds > 0.0 && stats.lastCommitMicroseconds > 0.0);
+
+			// Staging worlds are reused for the next chunks.
+			loader.Request(paths[0]);
+			loader.WaitUntilBuilt();
+			Assert::IsTrue(loader.Commit(ecs, 0.0) == 1);
+			Assert::IsTrue(ecs.GetEntityManager()->GetLivingEntityCount() == 41);
+
+			for (const std::string& path : paths)
+				std::remove(path.c_str());
+		}
+
+		TEST_METHOD(TestMemoryResources)
+		{
+			// Counts what reaches the OS, the pool below the ECS reuses freed blocks.
+			MemoryTracker system(std::pmr::new_delete_resource());
+			PageArena arena(64 * 1024, &system);
+			std::pmr::unsynchronized_pool_resource pool(&arena);
+
+			{
+				ECS ecs;
+				ecs.Init(&pool);
+				ecs.RegisterComponent<TestComponent>();
+				ecs.RegisterComponent<TestPosition>();
+
+				auto countingSystem = ecs.RegisterSystem<CountingSystem>();
+				Signature signature;
+				signature.set(ecs.GetComponentType<TestPosition>(), true);
+				ecs.SetSystemSignature<CountingSystem>(signature);
+
+				// The storage of a component type counts against it.
+				MemoryStats positions = ecs.GetComponentMemory<TestPosition>();
+				Assert::IsTrue(positions.bytes >= MAX_ENTITIES * sizeof(TestPosition));
+				Assert::IsTrue(ecs.GetMemoryStats().bytes >= positions.bytes + ecs.GetComponentMemory<TestComponent>().bytes);
+
+				ecs.SetComponentBudget<TestPosition>(positions.bytes);
+				Assert::IsFalse(ecs.GetComponentMemory<TestPosition>().OverBudget());
+
+				std::vector<Entity> entities;
+				auto frame = [&]()
+				{
+					for (int i = 0; i < 200; i++)
+					{
+						Entity entity = ecs.CreateEntity();
+						ecs.AddComponent(entity, TestPosition{ 1.0f, 2.0f });
+						ecs.AddComponent(entity, TestComponent(i));
+						entities.push_back(entity);
+					}
+
+					countingSystem->Update(ecs);
+
+					for (Entity entity : entities)
+						ecs.DestroyEntity(entity);
+					entities.clear();
+				};
+
+				// Once the pools and hash tables have grown, frames don't allocate anymore.
+				for (int i = 0; i < 5; i++)
+					frame();
+
+				std::uint64_t allocations = system.GetStats().allocations;
+				for (int i = 0; i < 50; i++)
+					frame();
+				Assert::IsTrue(system.GetStats().allocations == allocations);
+
+				// The index map of the positions is past the storage alone.
+				Assert::IsTrue(ecs.GetComponentMemory<TestPosition>().peakBytes > positions.bytes);
+				Assert::IsTrue(ecs.GetComponentMemory<TestPosition>().allocations > positions.allocations);
+			}
+
+			// Arena pages are only given back all at once, after everything using them.
+			Assert::IsTrue(arena.GetPageCount() > 0 && arena.GetUsedBytes() <= arena.GetReservedBytes());
+			pool.release();
+			arena.Release();
+			Assert::IsTrue(system.GetStats().bytes == 0);
+
+			// Huge page memory works with or without real huge pages.
+			HugePagePool hugePages;
+			{
+				ECS ecs;
+				ecs.Init(&hugePages);
+				ecs.RegisterComponent<TestPosition>();
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestPosition{ 3.0f, 4.0f });
+				Assert::IsTrue(ecs.ReadComponent<TestPosition>(entity).y == 4.0f);
+			}
+		}
+
+		TEST_METHOD(TestIntrospection)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterComponent<TestPosition>();
+
+			auto countingSystem = ecs.RegisterSystem<CountingSystem>();
+			Signature signature;
+			signature.set(ecs.GetComponentType<TestPosition>(), true);
+			ecs.SetSystemSignature<CountingSystem>(signature);
+
+			Introspection introspection(ecs);
+
+			std::vector<Entity> entities;
+			for (int i = 0; i < 100; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestPosition{ 1.0f, 2.0f });
+				if (i % 2 == 0)
+					ecs.AddComponent(entity, TestComponent(i));
+				entities.push_back(entity);
+			}
+
+			WorldReport report = introspection.Capture();
+			Assert::AreEqual(100u, report.entities.living);
+			Assert::AreEqual(MAX_ENTITIES - 100u, report.entities.available);
+			Assert::IsTrue(report.frame.entitiesCreated == 100 && report.frame.componentsAdded == 150);
+
+			Assert::AreEqual(size_t(2), report.components.size());
+			for (const ComponentLayout& component : report.components)
+			{
+				bool position = component.type == ecs.GetComponentType<TestPosition>();
+				Assert::AreEqual(position ? size_t(100) : size_t(50), component.count);
+				Assert::IsTrue(component.memory.bytes >= component.storageBytes);
+				Assert::IsTrue(component.fragmentation > 0.9 && component.fragmentation < 1.0);
+			}
+
+			Assert::AreEqual(size_t(1), report.systems.size());
+			Assert::AreEqual(size_t(100), report.systems[0].entityCount);
+
+			// The next capture only sees what happened since.
+			for (int i = 0; i < 10; i++)
+				ecs.DestroyEntity(entities[i]);
+			ecs.RemoveComponent<TestPosition>(entities[10]);
+
+			report = introspection.Capture();
+			Assert::IsTrue(report.frame.entitiesCreated == 0 && report.frame.entitiesDestroyed == 10);
+			Assert::IsTrue(report.frame.componentsAdded == 0 && report.frame.componentsRemoved == 16);
+			Assert::AreEqual(size_t(89), report.systems[0].entityCount);
+
+			std::string json = Introspection::ToJson(report);
+			Assert::IsTrue(json.front() == '{' && json.back() == '}');
+			Assert::IsTrue(json.find("\"living\":90") != std::string::npos);
+			Assert::IsTrue(json.find("\"fragmentation\":0.") != std::string::npos);
+			Assert::IsTrue(json.find("\"entitiesDestroyed\":10") != std::string::npos);
+			Assert::IsTrue(json.find("\"componentsRemoved\":16") != std::string::npos);
+		}
+
+		TEST_METHOD(TestSharedComponents)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+			ecs.RegisterSharedComponent<TestMaterial>();
+
+			auto countingSystem = ecs.RegisterSystem<CountingSystem>();
+			Signature signature;
+			signature.set(ecs.GetComponentType<TestMaterial>(), true);
+			ecs.SetSystemSignature<CountingSystem>(signature);
+
+			const TestMaterial red{ 1, { 1.0f, 0.0f, 0.0f, 1.0f } };
+			const TestMaterial blue{ 1, { 0.0f, 0.0f, 1.0f, 1.0f } };
+
+			std::vector<Entity> entities;
+			for (int i = 0; i < 100; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.SetSharedComponent(entity, i % 4 == 0 ? blue : red);
+				if (i < 50)
+					ecs.AddComponent(entity, TestPosition{ float(i), 0.0f });
+				entities.push_back(entity);
+			}
+
+			// Stored once per distinct value.
+			auto materials = ecs.GetComponentManager()->GetSharedComponentArray<TestMaterial>();
+			Assert::AreEqual(size_t(2), materials->ValueCount());
+			Assert::AreEqual(size_t(75), materials->RefCount(entities[1]));
+			Assert::AreEqual(size_t(25), materials->RefCount(entities[0]));
+			Assert::IsTrue(ecs.GetSharedComponent<TestMaterial>(entities[0]) == blue);
+			Assert::AreEqual(size_t(100), countingSystem->m_Entities.size());
+
+			// Changing one entity's value moves it to another group.
+			ecs.SetSharedComponent(entities[1], blue);
+			Assert::AreEqual(size_t(74), materials->RefCount(entities[2]));
+			Assert::AreEqual(size_t(26), materials->RefCount(entities[1]));
+
+			// A value nobody uses anymore is dropped.
+			const TestMaterial green{ 2, { 0.0f, 1.0f, 0.0f, 1.0f } };
+			ecs.SetSharedComponent(entities[2], green);
+			Assert::AreEqual(size_t(3), materials->ValueCount());
+			ecs.RemoveSharedComponent<TestMaterial>(entities[2]);
+			ecs.DestroyEntity(entities[3]);
+			Assert::AreEqual(size_t(2), materials->ValueCount());
+			Assert::AreEqual(size_t(98), countingSystem->m_Entities.size());
+
+			// One call per value, filtered by the required components.
+			Signature withPosition;
+			withPosition.set(ecs.GetComponentType<TestPosition>(), true);
+
+			size_t groups = 0, grouped = 0;
+			ecs.ForEachSharedGroup<TestMaterial>(withPosition, [&](const TestMaterial& material, const Entity* group, size_t count)
+			{
+				groups++;
+				grouped += count;
+				for (size_t i = 0; i < count; i++)
+					Assert::IsTrue(ecs.GetSharedComponent<TestMaterial>(group[i]) == material);
+			});
+			Assert::AreEqual(size_t(2), groups);
+			Assert::AreEqual(size_t(48), grouped);
+
+			// Prefab copies join the prefab's group.
+			Entity prefab = ecs.CreatePrefab();
+			ecs.SetSharedComponent(prefab, green);
+			auto copies = ecs.Instantiate(prefab, 10);
+			Assert::AreEqual(size_t(11), materials->RefCount(copies[0]));
+			Assert::AreEqual(size_t(108), countingSystem->m_Entities.size());
+
+			// Merging finds the values already in the destination.
+			ECS staging;
+			staging.Init();
+			staging.RegisterComponent<TestPosition>();
+			staging.RegisterSharedComponent<TestMaterial>();
+			for (int i = 0; i < 5; i++)
+				staging.SetSharedComponent(staging.CreateEntity(), red);
+
+			std::vector<Entity> remap = MergeWorld(staging, ecs);
+			Assert::AreEqual(size_t(3), materials->ValueCount());
+			Assert::AreEqual(size_t(77), materials->RefCount(remap[0]));
+			Assert::AreEqual(size_t(0), staging.GetComponentManager()->GetSharedComponentArray<TestMaterial>()->ValueCount());
+		}
+
+		TEST_METHOD(TestResources)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+
+			Assert::IsFalse(ecs.HasResource<TestScreen>());
+
+			// Aggregates are initialized from the arguments, no entity is involved.
+			size_t bytes = ecs.GetMemoryStats().bytes;
+			TestScreen& screen = ecs.SetResource<TestScreen>(1280, 720);
+			Assert::IsTrue(ecs.HasResource<TestScreen>());
+			Assert::IsTrue(&ecs.GetResource<TestScreen>() == &screen);
+			Assert::AreEqual(720, ecs.GetResource<TestScreen>().height);
+			Assert::AreEqual(0u, ecs.GetEntityManager()->GetLivingEntityCount());
+			Assert::IsTrue(ecs.GetMemoryStats().bytes > bytes);
+
+			ecs.GetResource<TestScreen>().width = 1920;
+			Assert::AreEqual(1920, screen.width);
+
+			// Replacing may copy from the old value.
+			ecs.SetResource<TestInput>(TestInput{ { 1, 2, 3 } });
+			ecs.SetResource<TestInput>(ecs.GetResource<TestInput>());
+			Assert::AreEqual(size_t(3), ecs.GetResource<TestInput>().keys.size());
+
+			// Resources belong to their world.
+			ECS other;
+			other.Init();
+			Assert::IsFalse(other.HasResource<TestScreen>());
+			other.SetResource<TestScreen>(640, 480);
+			Assert::AreEqual(1920, ecs.GetResource<TestScreen>().width);
+
+			ecs.RemoveResource<TestInput>();
+			Assert::IsFalse(ecs.HasResource<TestInput>());
+			Assert::IsTrue(ecs.GetResourceManager()->GetSignature().test(ecs.GetResourceType<TestScreen>()));
+
+			// Resource access splits stages like component access does.
+			World world(ecs);
+			auto none = [](ECS&, const FrameTime&) {};
+			world.AddSystem(Phase::Update, "ReadScreenA", none, SystemAccess(Signature(), Signature(), world.Resources<TestScreen>(), {}));
+			world.AddSystem(Phase::Update, "ReadScreenB", none, SystemAccess(Signature(), Signature(), world.Resources<TestScreen>(), {}));
+			world.AddSystem(Phase::Update, "WriteInput", none, SystemAccess(Signature(), Signature(), {}, world.Resources<TestInput>()));
+			Assert::IsTrue(world.GetStageCount(Phase::Update) == 1);
+
+			world.AddSystem(Phase::Update, "WriteScreen", none, SystemAccess(Signature(), Signature(), {}, world.Resources<TestScreen>()));
+			Assert::IsTrue(world.GetStageCount(Phase::Update) == 2);
+		}
+
+		TEST_METHOD(TestRelations)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterRelation<TestDockedAt>();
+			ecs.RegisterRelation<TestOwnedBy>(RelationCleanup::DestroySources);
+
+			Entity station = ecs.CreateEntity();
+			Entity otherStation = ecs.CreateEntity();
+
+			std::vector<Entity> ships;
+			for (int i = 0; i < 10; i++)
+			{
+				Entity ship = ecs.CreateEntity();
+				Assert::IsTrue(ecs.AddPair<TestDockedAt>(ship, station));
+				ships.push_back(ship);
+			}
+			Assert::IsFalse(ecs.AddPair<TestDockedAt>(ships[0], station));
+			Assert::IsTrue(ecs.AddPair<TestDockedAt>(ships[0], otherStation));
+
+			// Both directions.
+			Assert::AreEqual(size_t(10), ecs.GetRelation<TestDockedAt>().GetSourceCount(station));
+			Assert::AreEqual(size_t(2), ecs.GetRelation<TestDockedAt>().GetTargetCount(ships[0]));
+			Assert::AreEqual(station, ecs.GetTarget<TestDockedAt>(ships[3]));
+			Assert::AreEqual(INVALID_ENTITY, ecs.GetTarget<TestDockedAt>(station));
+
+			// Removing from the middle keeps both lists consistent.
+			Assert::IsTrue(ecs.RemovePair<TestDockedAt>(ships[4], station));
+			Assert::IsFalse(ecs.RemovePair<TestDockedAt>(ships[4], station));
+			ecs.DestroyEntity(ships[7]);
+
+			std::vector<Entity> docked;
+			ecs.ForEachSource<TestDockedAt>(station, [&](Entity ship) { docked.push_back(ship); });
+			std::sort(docked.begin(), docked.end());
+			Assert::IsTrue(docked == std::vector<Entity>{ ships[0], ships[1], ships[2], ships[3], ships[5], ships[6], ships[8], ships[9] });
+			for (Entity ship : docked)
+				Assert::IsTrue(ecs.HasPair<TestDockedAt>(ship, station));
+
+			// Destroying the target only removes the pairs.
+			ecs.DestroyEntity(station);
+			Assert::IsTrue(ecs.GetEntityManager()->IsAlive(ships[1]));
+			Assert::IsFalse(ecs.HasPair<TestDockedAt>(ships[1], station));
+			Assert::AreEqual(otherStation, ecs.GetTarget<TestDockedAt>(ships[0]));
+			Assert::AreEqual(size_t(1), ecs.GetRelation<TestDockedAt>().GetPairCount());
+
+			// Ownership takes the owned entities along, down the chain.
+			Entity fleet = ecs.CreateEntity();
+			ecs.AddPair<TestOwnedBy>(ships[1], fleet);
+			ecs.AddPair<TestOwnedBy>(ships[2], fleet);
+			ecs.AddPair<TestOwnedBy>(ships[3], ships[2]);
+			ecs.AddPair<TestDockedAt>(ships[3], otherStation);
+
+			ecs.DestroyEntity(fleet);
+			Assert::IsFalse(ecs.GetEntityManager()->IsAlive(ships[1]));
+			Assert::IsFalse(ecs.GetEntityManager()->IsAlive(ships[2]));
+			Assert::IsFalse(ecs.GetEntityManager()->IsAlive(ships[3]));
+			Assert::IsTrue(ecs.GetEntityManager()->IsAlive(ships[5]));
+			Assert::AreEqual(size_t(0), ecs.GetRelation<TestOwnedBy>().GetPairCount());
+			Assert::AreEqual(size_t(1), ecs.GetRelation<TestDockedAt>().GetSourceCount(otherStation));
+
+			// A chain as long as the world is destroyed without recursing once per link.
+			uint32_t living = ecs.GetEntityManager()->GetLivingEntityCount();
+			Entity owner = ecs.CreateEntity();
+			Entity root = owner;
+			while (ecs.GetEntityManager()->GetLivingEntityCount() < MAX_ENTITIES)
+			{
+				Entity owned = ecs.CreateEntity();
+				ecs.AddPair<TestOwnedBy>(owned, owner);
+				owner = owned;
+			}
+			ecs.DestroyEntity(root);
+			Assert::AreEqual(living, ecs.GetEntityManager()->GetLivingEntityCount());
+			Assert::AreEqual(size_t(0), ecs.GetRelation<TestOwnedBy>().GetPairCount());
+
+			// Merged pairs are remapped.
+			ECS staging;
+			staging.Init();
+			staging.RegisterRelation<TestDockedAt>();
+			Entity stagedStation = staging.CreateEntity();
+			Entity stagedShip = staging.CreateEntity();
+			staging.AddPair<TestDockedAt>(stagedShip, stagedStation);
+
+			std::vector<Entity> remap = MergeWorld(staging, ecs);
+			Assert::IsTrue(ecs.HasPair<TestDockedAt>(remap[stagedShip], remap[stagedStation]));
+			Assert::AreEqual(size_t(0), staging.GetRelation<TestDockedAt>().GetPairCount());
+		}
+
+		TEST_METHOD(TestSortComponents)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterComponent<TestName>();
+
+			std::vector<Entity> entities;
+			for (int i = 0; i < 200; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestPosition{ float((i * 37) % 50), float(i) });
+				if (i % 3 != 0)
+					ecs.AddComponent(entity, TestComponent(i));
+				ecs.AddComponent(entity, TestName{ std::to_string(i % 7) });
+				entities.push_back(entity);
+			}
+
+			// Churn scrambles the dense order.
+			for (int i = 0; i < 200; i += 9)
+				ecs.DestroyEntity(entities[i]);
+
+			Tick before = ecs.AdvanceTick();
+			ecs.Sort<TestPosition>([](const TestPosition& a, const TestPosition& b) { return a.x < b.x; });
+
+			auto positions = ecs.GetComponentManager()->GetComponentArray<TestPosition>();
+			for (size_t index = 1; index < positions->Size(); index++)
+			{
+				const TestPosition& previous = positions->Data()[index - 1];
+				const TestPosition& current = positions->Data()[index];
+				Assert::IsTrue(previous.x < current.x || (previous.x == current.x && positions->RawEntities()[index - 1] < positions->RawEntities()[index]));
+
+				// Sorting isn't a change.
+				Assert::IsFalse(IsNewerTick(positions->ChangeTicks()[index], before));
+			}
+
+			// The index follows the components.
+			for (int i = 1; i < 200; i++)
+			{
+				if (i % 9 != 0)
+					Assert::IsTrue(ecs.ReadComponent<TestPosition>(entities[i]).y == float(i));
+			}
+
+			// Entities both arrays hold line up at the front, in the leader's order.
+			ecs.SortAs<TestPosition, TestComponent>();
+			auto components = ecs.GetComponentManager()->GetComponentArray<TestComponent>();
+			size_t matched = 0;
+			for (size_t index = 0; index < positions->Size() && matched < components->Size(); index++)
+			{
+				Entity entity = positions->RawEntities()[index];
+				if (components->HasData(entity))
+					Assert::AreEqual(entity, components->RawEntities()[matched++]);
+			}
+			Assert::AreEqual(components->Size(), matched);
+			for (int i = 1; i < 200; i++)
+			{
+				if (i % 9 != 0 && i % 3 != 0)
+					Assert::AreEqual(i, ecs.ReadComponent<TestComponent>(entities[i]).val);
+			}
+
+			// Components that aren't trivially copyable are moved.
+			ecs.Sort<TestName>([](const TestName& a, const TestName& b) { return a.name < b.name; });
+			ecs.SortAs<TestName, TestPosition>();
+			Assert::IsTrue(ecs.ReadComponent<TestName>(entities[13]).name == "6");
+			Assert::IsTrue(ecs.ReadComponent<TestName>(positions->RawEntities()[0]).name == "0");
+			for (size_t index = 1; index < positions->Size(); index++)
+				Assert::IsTrue(ecs.ReadComponent<TestName>(positions->RawEntities()[index - 1]).name <= ecs.ReadComponent<TestName>(positions->RawEntities()[index]).name);
+		}
+		TEST_METHOD(TestEntityDefragment)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterComponent<TestName>();
+			ecs.RegisterComponent<Transform>();
+			ecs.RegisterComponent<WorldTransform>();
+			ecs.RegisterSharedComponent<TestMaterial>();
+			ecs.RegisterRelation<TestDockedAt>();
+
+			auto system = ecs.RegisterSystem<TestSystem>(0);
+			Signature signature;
+			signature.set(ecs.GetComponentType<TestComponent>(), true);
+			ecs.SetSystemSignature<TestSystem>(signature);
+
+			// Every fourth of 100 entities survives, spread over the whole range.
+			std::vector<Entity> handles;
+			for (int i = 0; i < 100; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestComponent(i));
+				ecs.AddComponent(entity, TestName{ std::to_string(i) });
+				if (i % 8 == 0)
+					ecs.SetSharedComponent(entity, TestMaterial{ 1, { 1.0f, 1.0f, 1.0f, 1.0f } });
+				handles.push_back(entity);
+			}
+			for (int i = 0; i < 100; i++)
+			{
+				if (i % 4 != 0)
+					ecs.DestroyEntity(handles[i]);
+			}
+
+			ecs.AddPair<TestDockedAt>(handles[96], handles[4]);
+			ecs.AddPair<TestDockedAt>(handles[92], handles[92]);
+
+			Hierarchy hierarchy(ecs);
+			ecs.AddComponent(handles[88], Transform{});
+			ecs.AddComponent(handles[88], WorldTransform{});
+			ecs.AddComponent(handles[96], Transform{});
+			ecs.AddComponent(handles[96], WorldTransform{});
+			hierarchy.SetParent(handles[96], handles[88]);
+			ecs.FlushObservers();
+
+			// A few moves per step, handles follow through the remap table.
+			EntityDefragmenter defragmenter(ecs);
+			int steps = 0;
+			while (!defragmenter.IsCompact())
+			{
+				const auto& moves = defragmenter.Step(5);
+				Assert::IsTrue(moves.size() <= 5);
+				hierarchy.MoveEntities(moves.data(), moves.size());
+				for (int i = 0; i < 100; i += 4)
+					handles[i] = defragmenter.Remap(handles[i]);
+				steps++;
+			}
+			Assert::IsTrue(steps > 1);
+			Assert::IsTrue(defragmenter.Step(5).empty());
+
+			const auto& entityManager = ecs.GetEntityManager();
+			for (Entity entity = 0; entity < 25; entity++)
+				Assert::IsTrue(entityManager->IsAlive(entity));
+			Assert::AreEqual(25u, entityManager->GetLivingEntityCount());
+
+			for (int i = 0; i < 100; i += 4)
+			{
+				Assert::IsTrue(handles[i] < 25);
+				Assert::AreEqual(i, ecs.GetComponent<TestComponent>(handles[i]).val);
+				Assert::AreEqual(std::to_string(i), ecs.ReadComponent<TestName>(handles[i]).name);
+				Assert::AreEqual(i % 8 == 0, ecs.GetEntityManager()->GetSignature(handles[i]).test(ecs.GetComponentType<TestMaterial>()));
+			}
+			Assert::AreEqual(size_t(25), system->m_Entities.size());
+			Assert::IsTrue(*system->m_Entities.rbegin() < 25);
+			Assert::AreEqual(size_t(13), ecs.GetComponentManager()->GetSharedComponentArray<TestMaterial>()->RefCount(handles[0]));
+
+			std::vector<Entity> grouped;
+			ecs.ForEachSharedGroup<TestMaterial>(Signature(), [&](const TestMaterial&, const Entity* entities, size_t count)
+			{
+				grouped.insert(grouped.end(), entities, entities + count);
+			});
+			Assert::AreEqual(size_t(13), grouped.size());
+			for (Entity entity : grouped)
+				Assert::IsTrue(entity < 25);
+
+			Assert::IsTrue(ecs.HasPair<TestDockedAt>(handles[96], handles[4]));
+			Assert::IsTrue(ecs.HasPair<TestDockedAt>(handles[92], handles[92]));
+			Assert::AreEqual(size_t(2), ecs.GetRelation<TestDockedAt>().GetPairCount());
+			Assert::AreEqual(handles[88], hierarchy.GetParent(handles[96]));
+			Assert::IsTrue(hierarchy.GetChildren(handles[88]) == std::vector<Entity>{ handles[96] });
+
+			// New entities take the lowest free IDs.
+			Assert::AreEqual(Entity(25), ecs.CreateEntity());
+		}
+		TEST_METHOD(TestPublishedSnapshot)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+			ecs.RegisterComponent<TestComponent>();
+
+			SnapshotPublisher publisher(ecs);
+			publisher.Track<TestPosition>();
+			Assert::IsFalse(publisher.Acquire().IsValid());
+
+			std::vector<Entity> entities;
+			for (int i = 0; i < 100; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestPosition{ 0.0f, float(i) });
+				ecs.AddComponent(entity, TestComponent(i));
+				entities.push_back(entity);
+			}
+			Assert::IsTrue(publisher.Publish());
+
+			// A held view keeps its frame while the world and later publishes move on.
+			PublishedView first = publisher.Acquire();
+			Assert::AreEqual(std::uint64_t(1), first.GetSequence());
+
+			for (Entity entity : entities)
+				ecs.GetComponent<TestPosition>(entity).x = 1.0f;
+			ecs.DestroyEntity(entities[0]);
+			Assert::IsTrue(publisher.Publish());
+			Assert::IsTrue(publisher.Publish());
+
+			auto positions = first.Get<TestPosition>();
+			Assert::AreEqual(size_t(100), positions.size);
+			positions.ForEach([](Entity, const TestPosition& position) { Assert::AreEqual(0.0f, position.x); });
+
+			{
+				PublishedView latest = publisher.Acquire();
+				Assert::AreEqual(std::uint64_t(3), latest.GetSequence());
+				Assert::AreEqual(size_t(99), latest.Get<TestPosition>().size);
+				latest.Get<TestPosition>().ForEach([](Entity, const TestPosition& position) { Assert::AreEqual(1.0f, position.x); });
+
+				// Every buffer held, so the frame is skipped instead of overwriting one.
+				Assert::IsTrue(publisher.Publish());
+				PublishedView newest = publisher.Acquire();
+				Assert::IsFalse(publisher.Publish());
+				Assert::AreEqual(std::uint64_t(1), publisher.GetSkippedCount());
+			}
+			first.Release();
+			Assert::IsTrue(publisher.Publish());
+		}
+
+		TEST_METHOD(TestPublishedSnapshotConcurrentReaders)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+
+			SnapshotPublisher publisher(ecs);
+			publisher.Track<TestPosition>();
+
+			for (int i = 0; i < 1000; i++)
+				ecs.AddComponent(ecs.CreateEntity(), TestPosition{ 0.0f, 0.0f });
+			publisher.Publish();
+
+			// Every frame writes one value into all components, so a torn read shows up as mixed values.
+			std::atomic<bool> done{ false };
+			std::atomic<int> torn{ 0 };
+			std::atomic<int> reads{ 0 };
+			std::vector<std::thread> readers;
+			for (int i = 0; i < 3; i++)
+			{
+				readers.emplace_back([&]()
+				{
+					std::uint64_t lastSequence = 0;
+					while (!done.load())
+					{
+						PublishedView view = publisher.Acquire();
+						auto positions = view.Get<TestPosition>();
+						float first = positions.data[0].x;
+						positions.ForEach([&](Entity, const TestPosition& position)
+						{
+							if (position.x != first || position.y != first)
+								torn++;
+						});
+
+						if (view.GetSequence() < lastSequence)
+							torn++;
+						lastSequence = view.GetSequence();
+						reads++;
+					}
+				});
+			}
+
+			auto array = ecs.GetComponentManager()->GetComponentArray<TestPosition>();
+			for (int frame = 1; frame <= 2000 || reads.load() < 100; frame++)
+			{
+				for (size_t index = 0; index < array->Size(); index++)
+					ecs.GetComponent<TestPosition>(array->EntityAtIndex(index)) = { float(frame), float(frame) };
+				publisher.Publish();
+			}
+
+			done = true;
+			for (auto& reader : readers)
+				reader.join();
+
+			Assert::AreEqual(0, torn.load());
+		}
+#if defined(__cpp_impl_coroutine)
+		static CoroutineSystem TestCountFrames(CoroutineScheduler& scheduler, int& frames)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				frames++;
+				co_await scheduler.NextFrame();
+			}
+		}
+
+		static CoroutineSystem TestPlanPath(CoroutineScheduler& scheduler, ECS& ecs, Entity entity, CoroutineScheduler::SystemId counter, std::vector<int>& log)
+		{
+			// The job computes off the world, the result is written back once the system resumes.
+			std::vector<int> costs(1000);
+			int total = 0;
+			co_await scheduler.RunJob([&]()
+			{
+				for (size_t i = 0; i < costs.size(); i++)
+					costs[i] = int(i % 7);
+				for (int cost : costs)
+					total += cost;
+			});
+			ecs.GetComponent<TestComponent>(entity).val = total;
+			log.push_back(1);
+
+			co_await scheduler.WaitFor(counter);
+			log.push_back(2);
+
+			co_await scheduler.WaitUntil([&]() { return ecs.GetComponent<TestComponent>(entity).val == 0; });
+			log.push_back(3);
+		}
+
+		static CoroutineSystem TestAwaitRelease(CoroutineScheduler& scheduler, std::atomic<bool>& release, bool& resumed)
+		{
+			co_await scheduler.RunJob([&]()
+			{
+				while (!release)
+					std::this_thread::yield();
+			});
+			resumed = true;
+		}
+
+		TEST_METHOD(TestCoroutineSystems)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			Entity entity = ecs.CreateEntity();
+			ecs.AddComponent(entity, TestComponent(0));
+
+			JobSystem jobs(2);
+			CoroutineScheduler scheduler(&jobs);
+
+			int frames = 0;
+			std::vector<int> log;
+			std::atomic<bool> release{ false };
+			bool resumed = false;
+			auto counter = scheduler.Add("Counter", TestCountFrames(scheduler, frames));
+			auto planner = scheduler.Add("Planner", TestPlanPath(scheduler, ecs, entity, counter, log));
+			auto waiter = scheduler.Add("Waiter", TestAwaitRelease(scheduler, release, resumed));
+			Assert::AreEqual(size_t(3), scheduler.GetRunningCount());
+
+			// Update doesn't wait for the jobs, the waiter's job can't finish before it returns.
+			scheduler.Update();
+			Assert::AreEqual(1, frames);
+			Assert::AreEqual(std::uint32_t(2), scheduler.GetStats().jobs);
+			Assert::IsFalse(resumed);
+
+			release = true;
+			while (scheduler.GetJobsInFlight() > 0)
+				std::this_thread::yield();
+
+			// Systems whose job finished resume on the next Update.
+			scheduler.Update();
+			Assert::AreEqual(2, frames);
+			Assert::IsTrue(log == std::vector<int>{ 1 });
+			Assert::AreEqual(2997, ecs.GetComponent<TestComponent>(entity).val);
+			Assert::IsTrue(resumed);
+			Assert::IsTrue(scheduler.IsDone(waiter));
+
+			scheduler.Update();
+			Assert::AreEqual(3, frames);
+			Assert::IsFalse(scheduler.IsDone(counter));
+
+			// The counter finishes on its fourth frame and the planner goes on in the same Update.
+			scheduler.Update();
+			Assert::IsTrue(scheduler.IsDone(counter));
+			Assert::IsTrue(log == std::vector<int>{ 1, 2 });
+
+			scheduler.Update();
+			Assert::IsFalse(scheduler.IsDone(planner));
+
+			ecs.GetComponent<TestComponent>(entity).val = 0;
+			scheduler.Update();
+			Assert::IsTrue(log == std::vector<int>{ 1, 2, 3 });
+			Assert::IsTrue(scheduler.IsDone(planner));
+			Assert::AreEqual(size_t(0), scheduler.GetRunningCount());
+		}
+#endif
+		TEST_METHOD(TestStateHasher)
+		{
+			std::vector<unsigned char> bytes(1000);
+			for (size_t i = 0; i < bytes.size(); i++)
+				bytes[i] = static_cast<unsigned char>(i * 7 + 3);
+
+			StateHasher whole;
+			whole.Update(bytes.data(), bytes.size());
+
+			// Split updates hash the same as one.
+			StateHasher split;
+			split.Update(bytes.data(), 5);
+			split.Update(bytes.data() + 5, 100);
+			split.Update(bytes.data() + 105, bytes.size() - 105);
+			Assert::AreEqual(whole.Finish(), split.Finish());
+
+			// Fixed value, so the SIMD and scalar paths can't drift apart.
+			Assert::AreEqual(std::uint64_t(1737596504094123942ull), whole.Finish());
+
+			bytes[500] ^= 1;
+			StateHasher changed;
+			changed.Update(bytes.data(), bytes.size());
+			Assert::AreNotEqual(whole.Finish(), changed.Finish());
+		}
+
+		// Spawns one entity per chunk from a world system, results only depend on the chunk.
+		static std::uint64_t RunLockstep(uint32_t workerCount, std::vector<Entity>& outSpawned)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+
+			JobSystem jobs(workerCount);
+			World world(ecs, &jobs);
+			world.SetDeterministic(true);
+
+			std::vector<Entity> seeds;
+			for (int i = 0; i < 1000; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestPosition{ float(i), 0.0f });
+				seeds.push_back(entity);
+			}
+
+			world.AddSystem(Phase::FixedUpdate, "Spawn", [&](ECS& ecs, const FrameTime&)
+			{
+				auto positions = ecs.GetComponentManager()->GetComponentArray<TestPosition>();
+				jobs.ParallelForChunks(static_cast<uint32_t>(seeds.size()), 64, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+				{
+					CommandRecorder recorder(0, chunk);
+					float sum = 0.0f;
+					for (uint32_t i = begin; i < end; i++)
+						sum += positions->ReadData(seeds[i]).x;
+
+					Entity spawned = recorder.CreateEntity();
+					recorder.AddComponent(spawned, TestPosition{ sum, float(chunk) });
+					world.GetCommands().Submit(std::move(recorder));
+				});
+			}, SystemAccess(Signature(), world.ComponentSignature<TestPosition>()));
+
+			world.SetFixedRate(60.0);
+			for (int frame = 0; frame < 3; frame++)
+				world.Tick(1.0 / 60.0);
+
+			ecs.GetEntityManager()->ForEachLivingEntity([&](Entity entity)
+			{
+				if (ecs.GetComponent<TestPosition>(entity).y > 0.0f)
+					outSpawned.push_back(entity);
+			});
+			return world.GetStats().stateHash;
+		}
+
+		TEST_METHOD(TestDeterministicWorld)
+		{
+			std::vector<Entity> single, pooled;
+			std::uint64_t singleHash = RunLockstep(0, single);
+			std::uint64_t pooledHash = RunLockstep(3, pooled);
+
+			Assert::AreNotEqual(std::uint64_t(0), singleHash);
+			Assert::AreEqual(singleHash, pooledHash);
+			Assert::IsTrue(single == pooled);
+			Assert::AreEqual(size_t(3 * 15), single.size());
+
+			// Playback follows (system, chunk), not the submission order.
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestName>();
+
+			CommandBuffer commands;
+			commands.SetDeterministic(true);
+			for (uint32_t chunk = 3; chunk-- > 0;)
+			{
+				CommandRecorder recorder(1, chunk);
+				Entity entity = recorder.CreateEntity();
+				recorder.AddComponent(entity, TestName{ std::to_string(chunk) });
+				commands.Submit(std::move(recorder));
+			}
+
+			CommandRecorder first(0, 7);
+			Entity entity = first.CreateEntity();
+			first.AddComponent(entity, TestName{ "first" });
+			first.SetComponent(entity, TestName{ "system 0" });
+			commands.Submit(std::move(first));
+
+			commands.Playback(ecs);
+			Assert::AreEqual(std::string("system 0"), ecs.ReadComponent<TestName>(0).name);
+			Assert::AreEqual(std::string("0"), ecs.ReadComponent<TestName>(1).name);
+			Assert::AreEqual(std::string("2"), ecs.ReadComponent<TestName>(3).name);
+			Assert::IsTrue(commands.IsEmpty());
+		}
+
+		TEST_METHOD(TestCommandRecorderPayloads)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestComponent>();
+			ecs.RegisterComponent<TestLarge>();
+
+			std::vector<Entity> set;
+			ecs.OnSet<TestComponent>([&](ECS&, const std::vector<Entity>& entities)
+			{
+				set.insert(set.end(), entities.begin(), entities.end());
+			});
+
+			Entity existing = ecs.CreateEntity();
+			ecs.AddComponent(existing, TestComponent(1));
+			ecs.FlushObservers();
+			set.clear();
+
+			// A small payload recorded after a large one must not land on top of it.
+			TestLarge large{};
+			large.values[0] = 3;
+			large.values[1099] = 4;
+
+			CommandRecorder recorder(0);
+			Entity entity = recorder.CreateEntity();
+			recorder.AddComponent(entity, large);
+			recorder.AddComponent(entity, TestComponent(5));
+			recorder.SetComponent(existing, TestComponent(6));
+			recorder.Playback(ecs);
+
+			entity = recorder.GetCreatedEntity(entity);
+			Assert::AreEqual(3, ecs.ReadComponent<TestLarge>(entity).values[0]);
+			Assert::AreEqual(4, ecs.ReadComponent<TestLarge>(entity).values[1099]);
+			Assert::AreEqual(5, ecs.ReadComponent<TestComponent>(entity).val);
+
+			// Set at playback reaches the observers like ECS::SetComponent.
+			Assert::AreEqual(6, ecs.ReadComponent<TestComponent>(existing).val);
+			ecs.FlushObservers();
+			Assert::IsTrue(std::count(set.begin(), set.end(), existing) == 1);
+		}
+
+		TEST_METHOD(TestWorldChecksum)
+		{
+			ECS ecs;
+			ecs.Init();
+			ecs.RegisterComponent<TestPosition>();
+
+			std::vector<Entity> entities;
+			for (int i = 0; i < 1000; i++)
+			{
+				Entity entity = ecs.CreateEntity();
+				ecs.AddComponent(entity, TestPosition{ float(i), 0.0f });
+				entities.push_back(entity);
+			}
+
+			// The incremental checksum has to match one built from scratch after every kind of change.
+			auto full = [&]()
+			{
+				WorldChecksum checksum(ecs);
+				return checksum.Update();
+			};
+
+			WorldChecksum checksum(ecs);
+			std::uint64_t root = checksum.Update();
+			Assert::AreEqual(full(), root);
+
+			Assert::AreEqual(root, checksum.Update());
+			Assert::AreEqual(0u, checksum.GetRehashedLeafCount());
+
+			ecs.GetComponent<TestPosition>(entities[500]).x = -1.0f;
+			Assert::AreNotEqual(root, checksum.Update());
+			Assert::AreEqual(1u, checksum.GetRehashedLeafCount());
+			Assert::AreEqual(full(), checksum.GetRoot());
+
+			// The last component moves into the removed slot without a new change tick.
+			root = checksum.GetRoot();
+			ecs.DestroyEntity(entities[10]);
+			Assert::AreNotEqual(root, checksum.Update());
+			Assert::AreEqual(full(), checksum.GetRoot());
+
+			ecs.Sort<TestPosition>([](const TestPosition& a, const TestPosition& b) { return a.x > b.x; });
+			checksum.Update();
+			Assert::AreEqual(full(), checksum.GetRoot());
+
+			Entity empty = ecs.CreateEntity();
+			root = checksum.GetRoot();
+			Assert::AreNotEqual(root, checksum.Update());
+			Assert::AreEqual(full(), checksum.GetRoot());
+
+			ecs.DestroyEntity(empty);
+			Assert::AreEqual(full(), checksum.Update());
+		}
+
+		TEST_METHOD(TestDivergenceLocator)
+		{
+			ECS local;
+			ECS remote;
+			for (ECS* ecs : { &local, &remote })
+			{
+				ecs->Init();
+				ecs->RegisterComponent<TestPosition>();
+				for (int i = 0; i < 1000; i++)
+				{
+					ecs->AddComponent(ecs->CreateEntity(), TestPosition{ float(i), 0.0f });
+				}
+			}
+
+			WorldChecksum localChecksum(local);
+			WorldChecksum remoteChecksum(remote);
+			localChecksum.Update();
+			remoteChecksum.Update();
+			Assert::AreEqual(localChecksum.GetRoot(), remoteChecksum.GetRoot());
+
+			DivergenceLocator locator(localChecksum);
+			Assert::IsFalse(locator.Start(remoteChecksum.GetSummary()));
+
+			// The peer answers one query per tree level.
+			auto locate = [&]() -> const ChecksumDivergence&
+			{
+				while (!locator.IsDone())
+				{
+					locator.Receive(remoteChecksum.Answer(locator.GetQuery()));
+				}
+				return locator.GetResult();
+			};
+
+			std::uint32_t levels = 0;
+			while ((std::uint32_t(1) << levels) < WorldChecksum::LEAF_COUNT)
+				levels++;
+
+			Entity changed = 700;
+			remote.GetComponent<TestPosition>(changed).y = 1.0f;
+			localChecksum.Update();
+			remoteChecksum.Update();
+			Assert::AreNotEqual(localChecksum.GetRoot(), remoteChecksum.GetRoot());
+
+			Assert::IsTrue(locator.Start(remoteChecksum.GetSummary()));
+			const ChecksumDivergence& component = locate();
+			Assert::AreEqual(std::uint32_t(local.GetComponentType<TestPosition>()), std::uint32_t(component.tree));
+			Assert::IsTrue(component.first <= 700 && 700 < component.first + component.count);
+			Assert::AreEqual(WorldChecksum::LEAF_SLOTS, component.count);
+			Assert::IsTrue(std::find(component.entities.begin(), component.entities.end(), changed) != component.entities.end());
+			Assert::AreEqual(levels + 1, component.exchanges);
+
+			// An entity without components only shows up in the entity layer.
+			remote.GetComponent<TestPosition>(changed).y = 0.0f;
+			Entity extra = remote.CreateEntity();
+			localChecksum.Update();
+			remoteChecksum.Update();
+
+			Assert::IsTrue(locator.Start(remoteChecksum.GetSummary()));
+			const ChecksumDivergence& entity = locate();
+			Assert::AreEqual(std::uint32_t(CHECKSUM_ENTITIES), std::uint32_t(entity.tree));
+			Assert::IsTrue(entity.first <= extra && extra < entity.first + entity.count);
+			Assert::AreEqual(levels + 1, entity.exchanges);
+		}
+		TEST_METHOD(TestBitPacking)
+		{
+			BitWriter writer;
+			for (std::uint32_t i = 0; i < 200; i++)
+			{
+				writer.WriteVarBits(i * 37);
+				writer.Write(i & 7, 3);
+			}
+			writer.Write(0xDEADBEEF, 32);
+
+			std::uint32_t words[5] = { 0, 1, 0x80000000u, 0, 12345 };
+			WriteReplicatedWords(writer, words, 5);
+
+			BitReader reader;
+			reader.Reset(writer.GetBytes(), writer.GetByteCount());
+			for (std::uint32_t i = 0; i < 200; i++)
+			{
+				Assert::AreEqual(i * 37, reader.ReadVarBits());
+				Assert::AreEqual(i & 7, reader.Read(3));
+			}
+			Assert::AreEqual(0xDEADBEEFu, reader.Read(32));
+
+			std::uint32_t read[5];
+			ReadReplicatedWords(reader, read, 5);
+			Assert::IsTrue(std::equal(words, words + 5, read));
+			Assert::IsTrue(reader.IsValid());
+
+			// Reading past the end is caught.
+			reader.Read(32);
+			Assert::IsFalse(reader.IsValid());
+		}
+
+		TEST_METHOD(TestReplication)
+		{
+			ECS server;
+			server.Init();
+			server.RegisterComponent<TestPosition>();
+			server.RegisterComponent<TestComponent>();
+			server.RegisterComponent<TestName>();
+
+			ECS client;
+			client.Init();
+			client.RegisterComponent<TestPosition>();
+			client.RegisterComponent<TestComponent>();
+
+			LoopbackTransport transport;
+			ReplicationServer replication(server, transport);
+			replication.Replicate<TestPosition>();
+			replication.Replicate<TestComponent>();
+
+			ReplicationClient receiver(client);
+			receiver.Replicate<TestPosition>();
+			receiver.Replicate<TestComponent>();
+
+			std::vector<Entity> entities;
+			for (int i = 0; i < 100; i++)
+			{
+				Entity entity = server.CreateEntity();
+				server.AddComponent(entity, TestPosition{ float(i), 0.0f });
+				if (i % 4 == 0)
+					server.AddComponent(entity, TestComponent(i));
+				server.AddComponent(entity, TestName{ "unit" });
+				entities.push_back(entity);
+			}
+
+			// Only the even entities are interesting to the client.
+			ClientId id = replication.AddClient();
+			for (int i = 0; i < 100; i += 2)
+			{
+				replication.SetInterest(id, entities[i], true);
+			}
+
+			replication.Update();
+			Assert::IsTrue(transport.Deliver(id, receiver));
+			Assert::AreEqual(50u, receiver.GetEntityCount());
+			Assert::AreEqual(50u, replication.GetClientStats(id).spawned);
+			Assert::AreEqual(INVALID_ENTITY, receiver.GetLocalEntity(entities[11]));
+
+			auto local = [&](int i) { return receiver.GetLocalEntity(entities[i]); };
+			auto has = [&](int i) { return client.GetEntityManager()->GetSignature(local(i)).test(client.GetComponentType<TestComponent>()); };
+			Assert::AreEqual(10.0f, client.ReadComponent<TestPosition>(local(10)).x);
+			Assert::AreEqual(8, client.ReadComponent<TestComponent>(local(8)).val);
+			Assert::IsFalse(has(10));
+
+			// Writes, added and removed components, a destroyed entity and interest changes.
+			server.GetComponent<TestPosition>(entities[10]).x = 10.5f;
+			server.GetComponent<TestPosition>(entities[12]).y = -3.0f;
+			server.GetComponent<TestName>(entities[14]).name = "changed";
+			server.RemoveComponent<TestComponent>(entities[20]);
+			server.AddComponent(entities[2], TestComponent(7));
+			server.AddComponent(entities[6], TestComponent(0));
+			server.DestroyEntity(entities[30]);
+			replication.SetInterest(id, entities[40], false);
+			replication.SetInterest(id, entities[11], true);
+
+			replication.Update();
+			Assert::IsTrue(transport.Deliver(id, receiver));
+			const ReplicationServer::ClientStats& stats = replication.GetClientStats(id);
+			Assert::AreEqual(5u, stats.updated);
+			Assert::AreEqual(2u, stats.despawned);
+			Assert::AreEqual(1u, stats.spawned);
+
+			Assert::AreEqual(49u, receiver.GetEntityCount());
+			Assert::AreEqual(10.5f, client.ReadComponent<TestPosition>(local(10)).x);
+			Assert::AreEqual(-3.0f, client.ReadComponent<TestPosition>(local(12)).y);
+			Assert::AreEqual(12.0f, client.ReadComponent<TestPosition>(local(12)).x);
+			Assert::IsFalse(has(20));
+			Assert::AreEqual(7, client.ReadComponent<TestComponent>(local(2)).val);
+
+			// An added component equal to zero has no delta but is sent anyway.
+			Assert::IsTrue(has(6));
+			Assert::AreEqual(0, client.ReadComponent<TestComponent>(local(6)).val);
+			Assert::AreEqual(INVALID_ENTITY, local(30));
+			Assert::AreEqual(INVALID_ENTITY, local(40));
+			Assert::AreEqual(11.0f, client.ReadComponent<TestPosition>(local(11)).x);
+			Assert::AreEqual(49u, client.GetEntityManager()->GetLivingEntityCount());
+
+			// Nothing changed, only the header is sent.
+			replication.Update();
+			Assert::IsTrue(transport.Deliver(id, receiver));
+			Assert::AreEqual(0u, stats.updated + stats.spawned + stats.despawned);
+			Assert::IsTrue(stats.bytes <= 12);
+			Assert::AreEqual(replication.GetUpdateCount(), receiver.GetLastUpdate());
+
+			// A client joining later is spawned the current values.
+			ECS lateClient;
+			lateClient.Init();
+			lateClient.RegisterComponent<TestPosition>();
+			lateClient.RegisterComponent<TestComponent>();
+			ReplicationClient lateReceiver(lateClient);
+			lateReceiver.Replicate<TestPosition>();
+			lateReceiver.Replicate<TestComponent>();
+
+			ClientId late = replication.AddClient();
+			replication.SetInterest(late, entities[10], true);
+			replication.SetInterest(late, entities[2], true);
+			replication.Update();
+			Assert::IsTrue(transport.Deliver(late, lateReceiver));
+			Assert::IsTrue(transport.Deliver(id, receiver));
+			Assert::AreEqual(2u, lateReceiver.GetEntityCount());
+			Assert::AreEqual(10.5f, lateClient.ReadComponent<TestPosition>(lateReceiver.GetLocalEntity(entities[10])).x);
+			Assert::AreEqual(7, lateClient.ReadComponent<TestComponent>(lateReceiver.GetLocalEntity(entities[2])).val);
+		}
 	};
 }